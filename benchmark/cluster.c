@@ -0,0 +1,875 @@
+/******************************************************************************
+ *
+ * Measure commit latency and throughput with replication in the loop.
+ *
+ * A cluster of 3 to 5 nodes is run in a single process. Every node has its
+ * own in-memory VFS and its own dqlite server, running its own loop thread.
+ * Node 0 is the leader and serves all clients.
+ *
+ * The nodes are connected through a stand-in replication layer, which ships
+ * the frames passed to the leader's xFrames hook to all other nodes, in chunks
+ * of bounded size so followers start applying large transactions early. Each
+ * follower has a thread applying the frames it receives to its own copy of
+ * the database, after the configured one-way network latency and the time
+ * needed to transmit them at the configured bandwidth. A commit completes
+ * once a majority of the nodes, including the leader, has applied it, and
+ * checkpoints issued by the leader are replayed on followers as well.
+ *
+ * Usage: dqlite-cluster-benchmark [-n nodes] [-c clients] [-r requests]
+ *                                 [-l latency us] [-b bandwidth MB/s]
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+
+#include "client.h"
+#include "log.h"
+#include "munit.h"
+#include "stats.h"
+
+/* Maximum and default number of nodes. */
+#define BENCHMARK_MAX_NODES 5
+#define BENCHMARK_NODES 3
+
+/* Default number of concurrent clients. */
+#define BENCHMARK_CLIENTS 4
+
+/* Default number of requests performed by each client. */
+#define BENCHMARK_REQUESTS 1000
+
+/* Default one-way network latency, in microseconds. */
+#define BENCHMARK_LATENCY 500
+
+/* Default network bandwidth, in megabytes per second. */
+#define BENCHMARK_BANDWIDTH 100
+
+/* Page size used by all nodes. */
+#define BENCHMARK_PAGE_SIZE 4096
+
+/* Maximum number of frames shipped in a single message. */
+#define BENCHMARK_CHUNK_FRAMES 256
+
+/* Kinds of messages shipped to followers. */
+#define BENCHMARK_FRAMES 0
+#define BENCHMARK_CHECKPOINT 1
+
+/* A message sent by the leader to a follower. */
+struct message {
+	int             type;     /* BENCHMARK_FRAMES or BENCHMARK_CHECKPOINT */
+	uint64_t        deliver;  /* When the message reaches the follower */
+	uint64_t        seq;      /* Sequence number of commits, or 0 */
+	char *          filename; /* Database the frames belong to */
+	int             begin;    /* First frames of a transaction */
+	int             n;        /* Number of frames */
+	unsigned *      pgnos;    /* Page numbers of the frames */
+	void *          pages;    /* Content of the frames */
+	unsigned        truncate; /* Database size after commit */
+	int             commit;   /* Last frames of a transaction */
+	struct message *next;     /* Next message in the queue */
+};
+
+struct cluster;
+
+/* A single node of the cluster. */
+struct node {
+	unsigned                id;          /* Index of the node */
+	struct cluster *        cluster;     /* Cluster we belong to */
+	char                    name[16];    /* VFS and replication name */
+	sqlite3_vfs *           vfs;         /* In-memory VFS of this node */
+	sqlite3_wal_replication replication; /* Stand-in replication hooks */
+	dqlite_server *         server;      /* Server of this node */
+	pthread_t               loop;        /* Thread running the server */
+
+	/* Follower state */
+	pthread_t       applier; /* Thread applying received frames */
+	pthread_mutex_t mutex;   /* Protect the queue */
+	pthread_cond_t  cond;    /* Signal new messages */
+	struct message *head;    /* First message to apply */
+	struct message *tail;    /* Last message to apply */
+	int             stop;    /* True when no more messages will come */
+	uint64_t        link;    /* When the link to us becomes idle */
+	sqlite3 *       db;      /* Follower connection */
+	uint64_t        acked;   /* Sequence number of the last commit */
+};
+
+struct cluster {
+	unsigned        n;         /* Number of nodes */
+	struct node     nodes[BENCHMARK_MAX_NODES];
+	uint64_t        latency;   /* One-way latency, in nanoseconds */
+	uint64_t        bandwidth; /* Bytes per second, or 0 for unlimited */
+	pthread_mutex_t mutex;     /* Protect acknowledgements */
+	pthread_cond_t  cond;      /* Signal acknowledgements */
+	uint64_t        seq;       /* Sequence number of the last commit */
+	int             begin;     /* A transaction has just started */
+	uint64_t        bytes;     /* Bytes shipped to each follower */
+	uint64_t        commits;   /* Number of replicated commits */
+};
+
+/* A client performing requests in its own thread. */
+struct worker {
+	struct test_client *client;    /* A connected client */
+	unsigned            requests;  /* Number of requests to perform */
+	uint64_t *          latencies; /* Latency of each request */
+	pthread_t           thread;    /* System thread we run in */
+};
+
+/******************************************************************************
+ *
+ * Stand-in replication layer
+ *
+ ******************************************************************************/
+
+/* Queue a message for a follower, computing when it will be delivered. */
+static void __ship(struct cluster *c, struct node *f, struct message *m)
+{
+	uint64_t now = benchmark_now();
+	uint64_t size;
+
+	size = m->type == BENCHMARK_FRAMES
+	           ? (uint64_t)m->n * (BENCHMARK_PAGE_SIZE + sizeof *m->pgnos)
+	           : 0;
+
+	pthread_mutex_lock(&f->mutex);
+
+	/* Messages are serialized on the link, so a message can't start
+	 * being transmitted before the previous one is done. */
+	if (f->link < now) {
+		f->link = now;
+	}
+	if (c->bandwidth > 0) {
+		f->link += size * 1000 * 1000 * 1000 / c->bandwidth;
+	}
+	m->deliver = f->link + c->latency;
+
+	m->next = NULL;
+	if (f->tail == NULL) {
+		f->head = m;
+	} else {
+		f->tail->next = m;
+	}
+	f->tail = m;
+
+	pthread_cond_signal(&f->cond);
+	pthread_mutex_unlock(&f->mutex);
+}
+
+/* Wait until the given commit has been applied by a majority. */
+static void __quorum(struct cluster *c, uint64_t seq)
+{
+	unsigned quorum = c->n / 2; /* The leader counts as well */
+	unsigned acked;
+	unsigned i;
+
+	pthread_mutex_lock(&c->mutex);
+
+	for (;;) {
+		acked = 0;
+		for (i = 1; i < c->n; i++) {
+			if (c->nodes[i].acked >= seq) {
+				acked++;
+			}
+		}
+		if (acked >= quorum) {
+			break;
+		}
+		pthread_cond_wait(&c->cond, &c->mutex);
+	}
+
+	pthread_mutex_unlock(&c->mutex);
+}
+
+static int __begin(sqlite3_wal_replication *r, void *arg)
+{
+	struct node *node = r->pAppData;
+
+	(void)arg;
+
+	node->cluster->begin = 1;
+
+	return 0;
+}
+
+static int __abort(sqlite3_wal_replication *r, void *arg)
+{
+	(void)r;
+	(void)arg;
+
+	return 0;
+}
+
+static int __frames(sqlite3_wal_replication *      r,
+                    void *                         arg,
+                    int                            page_size,
+                    int                            n,
+                    sqlite3_wal_replication_frame *frames,
+                    unsigned                       truncate,
+                    int                            commit)
+{
+	struct node *   node = r->pAppData;
+	struct cluster *c    = node->cluster;
+	const char *    filename;
+	uint64_t        seq = 0;
+	unsigned        i;
+	int             j;
+	int             k = 0;
+	int             len;
+
+	munit_assert_int(page_size, ==, BENCHMARK_PAGE_SIZE);
+
+	filename = sqlite3_db_filename(arg, "main");
+
+	if (commit) {
+		seq = ++c->seq;
+		c->commits++;
+	}
+	c->bytes += (uint64_t)n * (page_size + sizeof(unsigned));
+
+	/* Only the last chunk carries the commit marker. */
+	do {
+		len = n - k < BENCHMARK_CHUNK_FRAMES ? n - k
+		                                     : BENCHMARK_CHUNK_FRAMES;
+
+		/* Each follower gets its own copy, since it frees it when
+		 * done. */
+		for (i = 0; i < c->n; i++) {
+			struct message *m;
+
+			if (i == node->id) {
+				continue;
+			}
+
+			m           = munit_malloc(sizeof *m);
+			m->type     = BENCHMARK_FRAMES;
+			m->seq      = k + len == n ? seq : 0;
+			m->filename = strdup(filename);
+			m->begin    = c->begin;
+			m->n        = len;
+			m->pgnos    = munit_malloc(len * sizeof *m->pgnos);
+			m->pages    = munit_malloc((size_t)len * page_size);
+			m->truncate = truncate;
+			m->commit   = commit && k + len == n;
+
+			for (j = 0; j < len; j++) {
+				m->pgnos[j] = frames[k + j].pgno;
+				memcpy((char *)m->pages + (size_t)j * page_size,
+				       frames[k + j].pBuf,
+				       page_size);
+			}
+
+			__ship(c, &c->nodes[i], m);
+		}
+
+		c->begin = 0;
+		k += len;
+	} while (k < n);
+
+	if (commit) {
+		__quorum(c, seq);
+	}
+
+	return 0;
+}
+
+/* Rolling back after frames were shipped doesn't happen in this workload. */
+static int __undo(sqlite3_wal_replication *r, void *arg)
+{
+	(void)r;
+	(void)arg;
+
+	return 0;
+}
+
+static int __end(sqlite3_wal_replication *r, void *arg)
+{
+	(void)r;
+	(void)arg;
+
+	return 0;
+}
+
+/* Open the follower connection to the given database, if not done yet. */
+static void __follower_open(struct node *f, const char *filename)
+{
+	int rc;
+
+	if (f->db != NULL) {
+		munit_assert_string_equal(sqlite3_db_filename(f->db, "main"),
+		                          filename);
+		return;
+	}
+
+	rc = sqlite3_open_v2(filename,
+	                     &f->db,
+	                     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+	                     f->name);
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to open follower database: %d", rc);
+	}
+
+	rc = sqlite3_exec(f->db, "PRAGMA page_size=4096", NULL, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_exec(f->db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_exec(f->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_wal_replication_follower(f->db, "main");
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to set follower replication: %d", rc);
+	}
+}
+
+static void __follower_apply(struct node *f, struct message *m)
+{
+	int rc;
+
+	if (m->type == BENCHMARK_CHECKPOINT) {
+		if (f->db != NULL) {
+			sqlite3_wal_checkpoint_v2(
+			    f->db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+		}
+		return;
+	}
+
+	__follower_open(f, m->filename);
+
+	rc = sqlite3_wal_replication_frames(f->db,
+	                                    "main",
+	                                    m->begin,
+	                                    BENCHMARK_PAGE_SIZE,
+	                                    m->n,
+	                                    m->pgnos,
+	                                    m->pages,
+	                                    m->truncate,
+	                                    m->commit);
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to apply frames on node %u: %d", f->id, rc);
+	}
+}
+
+static void *__follower_run(void *arg)
+{
+	struct node *   f = arg;
+	struct cluster *c = f->cluster;
+	struct message *m;
+
+	for (;;) {
+		pthread_mutex_lock(&f->mutex);
+		while (f->head == NULL && !f->stop) {
+			pthread_cond_wait(&f->cond, &f->mutex);
+		}
+		m = f->head;
+		if (m != NULL) {
+			f->head = m->next;
+			if (f->head == NULL) {
+				f->tail = NULL;
+			}
+		}
+		pthread_mutex_unlock(&f->mutex);
+
+		if (m == NULL) {
+			break;
+		}
+
+		benchmark_sleep_until(m->deliver);
+
+		__follower_apply(f, m);
+
+		/* The acknowledgement travels back to the leader. */
+		if (m->commit) {
+			benchmark_sleep_until(benchmark_now() + c->latency);
+
+			pthread_mutex_lock(&c->mutex);
+			f->acked = m->seq;
+			pthread_cond_broadcast(&c->cond);
+			pthread_mutex_unlock(&c->mutex);
+		}
+
+		free(m->filename);
+		free(m->pgnos);
+		free(m->pages);
+		free(m);
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ *
+ * Cluster interface of the leader
+ *
+ ******************************************************************************/
+
+static const char *__leader(void *ctx)
+{
+	(void)ctx;
+
+	return strdup("node0");
+}
+
+static int __servers(void *ctx, dqlite_server_info **servers)
+{
+	struct cluster *c = ctx;
+	unsigned        i;
+
+	*servers = munit_malloc((c->n + 1) * sizeof **servers);
+
+	for (i = 0; i < c->n; i++) {
+		(*servers)[i].id      = i + 1;
+		(*servers)[i].address = strdup(c->nodes[i].name);
+	}
+	(*servers)[c->n].id      = 0;
+	(*servers)[c->n].address = NULL;
+
+	return 0;
+}
+
+static void __register(void *ctx, sqlite3 *db)
+{
+	(void)ctx;
+	(void)db;
+}
+
+static void __unregister(void *ctx, sqlite3 *db)
+{
+	(void)ctx;
+	(void)db;
+}
+
+static int __barrier(void *ctx)
+{
+	(void)ctx;
+
+	return 0;
+}
+
+/* Checkpoint the leader and have followers do the same. */
+static int __checkpoint(void *ctx, sqlite3 *db)
+{
+	struct cluster *c = ctx;
+	unsigned        i;
+	int             rc;
+
+	rc = sqlite3_wal_checkpoint_v2(
+	    db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+	if (rc != SQLITE_OK) {
+		return rc;
+	}
+
+	for (i = 1; i < c->n; i++) {
+		struct message *m = munit_malloc(sizeof *m);
+
+		memset(m, 0, sizeof *m);
+		m->type = BENCHMARK_CHECKPOINT;
+
+		__ship(c, &c->nodes[i], m);
+	}
+
+	return 0;
+}
+
+static dqlite_cluster __cluster = {
+    NULL,
+    __leader,
+    __servers,
+    __register,
+    __unregister,
+    __barrier,
+    NULL,
+    __checkpoint,
+};
+
+/******************************************************************************
+ *
+ * Nodes
+ *
+ ******************************************************************************/
+
+static void *__node_run(void *arg)
+{
+	struct node *node = arg;
+	int          rc;
+
+	rc = dqlite_server_run(node->server);
+	if (rc != 0) {
+		return (void *)1;
+	}
+
+	return NULL;
+}
+
+static void __node_start(struct cluster *c, unsigned id)
+{
+	struct node *  node      = &c->nodes[id];
+	dqlite_logger *logger    = test_logger();
+	uint16_t       page_size = BENCHMARK_PAGE_SIZE;
+	int            rc;
+
+	memset(node, 0, sizeof *node);
+
+	node->id      = id;
+	node->cluster = c;
+	sprintf(node->name, "node%u", id);
+
+	node->replication.iVersion = 1;
+	node->replication.zName    = node->name;
+	node->replication.pAppData = node;
+	node->replication.xBegin   = __begin;
+	node->replication.xAbort   = __abort;
+	node->replication.xFrames  = __frames;
+	node->replication.xUndo    = __undo;
+	node->replication.xEnd     = __end;
+
+	rc = sqlite3_wal_replication_register(&node->replication, 0);
+	if (rc != 0) {
+		munit_errorf("failed to register wal replication: %d", rc);
+	}
+
+	node->vfs = dqlite_vfs_create(node->name, logger);
+	if (node->vfs == NULL) {
+		munit_error("failed to create volatile VFS: out of memory");
+	}
+	sqlite3_vfs_register(node->vfs, 0);
+
+	rc = dqlite_server_create(&__cluster, &node->server);
+	if (rc != 0) {
+		munit_errorf("failed to create dqlite server: %d", rc);
+	}
+
+	rc = dqlite_server_config(node->server, DQLITE_CONFIG_LOGGER, logger);
+	if (rc != 0) {
+		munit_errorf("failed to set logger: %d", rc);
+	}
+
+	rc = dqlite_server_config(
+	    node->server, DQLITE_CONFIG_PAGE_SIZE, (void *)&page_size);
+	if (rc != 0) {
+		munit_errorf("failed to set page size: %d", rc);
+	}
+
+	rc = dqlite_server_config(
+	    node->server, DQLITE_CONFIG_VFS, (void *)node->name);
+	if (rc != 0) {
+		munit_errorf("failed to set VFS name: %d", rc);
+	}
+
+	rc = dqlite_server_config(
+	    node->server, DQLITE_CONFIG_WAL_REPLICATION, (void *)node->name);
+	if (rc != 0) {
+		munit_errorf("failed to set WAL replication name: %d", rc);
+	}
+
+	rc = pthread_create(&node->loop, NULL, __node_run, node);
+	if (rc != 0) {
+		munit_errorf("failed to spawn server thread: %s", strerror(rc));
+	}
+
+	if (!dqlite_server_ready(node->server)) {
+		munit_errorf("server did not start: %s",
+		             dqlite_server_errmsg(node->server));
+	}
+
+	if (id == 0) {
+		return;
+	}
+
+	pthread_mutex_init(&node->mutex, NULL);
+	pthread_cond_init(&node->cond, NULL);
+
+	rc = pthread_create(&node->applier, NULL, __follower_run, node);
+	if (rc != 0) {
+		munit_errorf("failed to spawn applier thread: %s", strerror(rc));
+	}
+}
+
+static void __node_stop(struct node *node)
+{
+	char *errmsg;
+	void *retval;
+	int   rc;
+
+	if (node->id > 0) {
+		pthread_mutex_lock(&node->mutex);
+		node->stop = 1;
+		pthread_cond_signal(&node->cond);
+		pthread_mutex_unlock(&node->mutex);
+
+		pthread_join(node->applier, NULL);
+
+		if (node->db != NULL) {
+			sqlite3_close(node->db);
+		}
+
+		pthread_cond_destroy(&node->cond);
+		pthread_mutex_destroy(&node->mutex);
+	}
+
+	rc = dqlite_server_stop(node->server, &errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to stop dqlite: %s", errmsg);
+	}
+
+	pthread_join(node->loop, &retval);
+	if (retval != NULL) {
+		munit_errorf("server thread error: %s",
+		             dqlite_server_errmsg(node->server));
+	}
+
+	dqlite_server_destroy(node->server);
+
+	sqlite3_wal_replication_unregister(&node->replication);
+	sqlite3_vfs_unregister(node->vfs);
+	dqlite_vfs_destroy(node->vfs);
+}
+
+/* Connect a new client to the given node. */
+static struct test_client *__connect(struct node *node)
+{
+	struct test_client *client;
+	char *              errmsg;
+	int                 fds[2];
+	int                 rc;
+
+	rc = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	if (rc != 0) {
+		munit_errorf("failed to create socket pair: %s",
+		             strerror(errno));
+	}
+
+	rc = fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	if (rc != 0) {
+		munit_errorf("failed to set non-blocking mode: %s",
+		             strerror(errno));
+	}
+
+	rc = dqlite_server_handle(node->server, fds[1], &errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to notify server about new client: %s",
+		             errmsg);
+	}
+
+	client = munit_malloc(sizeof *client);
+	test_client_init(client, fds[0]);
+
+	test_client_handshake(client);
+
+	return client;
+}
+
+/******************************************************************************
+ *
+ * Workload
+ *
+ ******************************************************************************/
+
+/* Create the table updated by the workers. */
+static void __setup(struct cluster *c)
+{
+	struct test_client *      client;
+	struct test_client_result result;
+	uint64_t                  heartbeat;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+
+	client = __connect(&c->nodes[0]);
+
+	test_client_client(client, &heartbeat);
+	test_client_open(client, "test.db", &db_id);
+
+	test_client_prepare(client, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_prepare(client, db_id, "INSERT INTO test VALUES(0)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_close(client);
+	free(client);
+}
+
+static void *__worker_run(void *arg)
+{
+	struct worker *           w = arg;
+	struct test_client_result result;
+	uint64_t                  heartbeat;
+	uint64_t                  start;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+	unsigned                  i;
+
+	test_client_client(w->client, &heartbeat);
+	test_client_open(w->client, "test.db", &db_id);
+
+	/* Each request is a small write transaction, so the time is dominated
+	 * by the replication round trip. */
+	test_client_prepare(
+	    w->client, db_id, "UPDATE test SET n = n + 1", &stmt_id);
+
+	for (i = 0; i < w->requests; i++) {
+		start = benchmark_now();
+		test_client_exec(w->client, db_id, stmt_id, &result);
+		w->latencies[i] = benchmark_now() - start;
+	}
+
+	test_client_finalize(w->client, db_id, stmt_id);
+
+	return NULL;
+}
+
+static void __usage(const char *name)
+{
+	fprintf(stderr,
+	        "usage: %s [-n nodes] [-c clients] [-r requests] "
+	        "[-l latency us] [-b bandwidth MB/s]\n",
+	        name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct cluster c;
+	struct worker *workers;
+	uint64_t *     latencies;
+	const char *   errmsg;
+	unsigned       nodes     = BENCHMARK_NODES;
+	unsigned       clients   = BENCHMARK_CLIENTS;
+	unsigned       requests  = BENCHMARK_REQUESTS;
+	unsigned       latency   = BENCHMARK_LATENCY;
+	unsigned       bandwidth = BENCHMARK_BANDWIDTH;
+	uint64_t       start;
+	uint64_t       elapsed;
+	uint64_t       total;
+	unsigned       i;
+	int            rc;
+	int            opt;
+
+	while ((opt = getopt(argc, argv, "n:c:r:l:b:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nodes = (unsigned)atoi(optarg);
+			break;
+		case 'c':
+			clients = (unsigned)atoi(optarg);
+			break;
+		case 'r':
+			requests = (unsigned)atoi(optarg);
+			break;
+		case 'l':
+			latency = (unsigned)atoi(optarg);
+			break;
+		case 'b':
+			bandwidth = (unsigned)atoi(optarg);
+			break;
+		default:
+			__usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || nodes < 3 || nodes > BENCHMARK_MAX_NODES ||
+	    clients == 0 || requests == 0) {
+		__usage(argv[0]);
+	}
+
+	rc = dqlite_init(&errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to init dqlite: %s", errmsg);
+	}
+
+	memset(&c, 0, sizeof c);
+	c.n         = nodes;
+	c.latency   = (uint64_t)latency * 1000;
+	c.bandwidth = (uint64_t)bandwidth * 1024 * 1024;
+	pthread_mutex_init(&c.mutex, NULL);
+	pthread_cond_init(&c.cond, NULL);
+
+	__cluster.ctx = &c;
+
+	for (i = 0; i < nodes; i++) {
+		__node_start(&c, i);
+	}
+
+	__setup(&c);
+
+	workers = munit_malloc(clients * sizeof *workers);
+
+	for (i = 0; i < clients; i++) {
+		workers[i].client    = __connect(&c.nodes[0]);
+		workers[i].requests  = requests;
+		workers[i].latencies = munit_malloc(requests * sizeof(uint64_t));
+	}
+
+	c.bytes   = 0;
+	c.commits = 0;
+
+	start = benchmark_now();
+
+	for (i = 0; i < clients; i++) {
+		rc = pthread_create(
+		    &workers[i].thread, NULL, __worker_run, &workers[i]);
+		if (rc != 0) {
+			munit_errorf("failed to spawn worker: %s", strerror(rc));
+		}
+	}
+
+	for (i = 0; i < clients; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	elapsed = benchmark_now() - start;
+
+	total     = (uint64_t)clients * requests;
+	latencies = munit_malloc(total * sizeof *latencies);
+	for (i = 0; i < clients; i++) {
+		memcpy(latencies + (uint64_t)i * requests,
+		       workers[i].latencies,
+		       requests * sizeof *latencies);
+	}
+
+	printf("%u nodes %u clients %u requests %.0f commits/s "
+	       "%.1f KiB/commit\n",
+	       nodes,
+	       clients,
+	       requests,
+	       total / ((double)elapsed / 1e9),
+	       c.commits > 0 ? c.bytes / 1024.0 / c.commits : 0);
+
+	benchmark_latency_report(latencies, total);
+
+	free(latencies);
+
+	for (i = 0; i < clients; i++) {
+		test_client_close(workers[i].client);
+		free(workers[i].client);
+		free(workers[i].latencies);
+	}
+	free(workers);
+
+	/* Stop the leader first, so no more frames get shipped. */
+	for (i = 0; i < nodes; i++) {
+		__node_stop(&c.nodes[i]);
+	}
+
+	pthread_cond_destroy(&c.cond);
+	pthread_mutex_destroy(&c.mutex);
+
+	rc = sqlite3_shutdown();
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to shutdown SQLite: %d", rc);
+	}
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/******************************************************************************
+ *
+ * Compare the throughput and latency of the available I/O backends.
+ *
+ * A number of clients are connected to an in-process server over Unix sockets,
+ * each one running in its own thread and performing a series of requests. The
+ * same workload is run against every backend built in.
+ *
+ * Usage: dqlite-benchmark [clients] [requests per client]
+ *
+ *****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+
+#include "client.h"
+#include "munit.h"
+#include "server.h"
+
+/* Default number of concurrent clients. */
+#define BENCHMARK_CLIENTS 8
+
+/* Default number of requests performed by each client. */
+#define BENCHMARK_REQUESTS 10000
+
+/* A client performing requests in its own thread. */
+struct worker {
+	struct test_client *client;   /* A connected client */
+	unsigned            requests; /* Number of requests to perform */
+	pthread_t           thread;   /* System thread we run in */
+};
+
+/* Return the current monotonic time in nanoseconds. */
+static uint64_t __now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+static void *__worker_run(void *arg)
+{
+	struct worker *           w = arg;
+	struct test_client_result result;
+	uint64_t                  heartbeat;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+	unsigned                  i;
+
+	test_client_handshake(w->client);
+	test_client_client(w->client, &heartbeat);
+	test_client_open(w->client, "test.db", &db_id);
+
+	/* Each request is a small write transaction, so the time is dominated
+	 * by the round trip. */
+	test_client_prepare(
+	    w->client, db_id, "UPDATE test SET n = n + 1", &stmt_id);
+
+	for (i = 0; i < w->requests; i++) {
+		test_client_exec(w->client, db_id, stmt_id, &result);
+	}
+
+	test_client_finalize(w->client, db_id, stmt_id);
+
+	return NULL;
+}
+
+/* Create the table updated by the workers. */
+static void __setup(struct test_server *server)
+{
+	struct test_client *      client;
+	struct test_client_result result;
+	uint64_t                  heartbeat;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+
+	test_server_connect(server, &client);
+
+	test_client_handshake(client);
+	test_client_client(client, &heartbeat);
+	test_client_open(client, "test.db", &db_id);
+
+	test_client_prepare(client, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_prepare(client, db_id, "INSERT INTO test VALUES(0)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_close(client);
+	free(client);
+}
+
+/* Run the workload against a server using the given backend. */
+static void __run(const char *name,
+                  uint8_t     io_backend,
+                  unsigned    clients,
+                  unsigned    requests)
+{
+	struct test_server *server;
+	struct worker *     workers;
+	const char *        errmsg;
+	uint64_t            start;
+	uint64_t            elapsed;
+	double              total;
+	unsigned            i;
+	int                 rc;
+
+	rc = dqlite_init(&errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to init dqlite: %s", errmsg);
+	}
+
+	server = test_server_start_io("unix", io_backend);
+
+	__setup(server);
+
+	workers = munit_malloc(clients * sizeof *workers);
+
+	for (i = 0; i < clients; i++) {
+		test_server_connect(server, &workers[i].client);
+		workers[i].requests = requests;
+	}
+
+	start = __now();
+
+	for (i = 0; i < clients; i++) {
+		rc = pthread_create(
+		    &workers[i].thread, NULL, __worker_run, &workers[i]);
+		if (rc != 0) {
+			munit_errorf("failed to spawn worker: %s", strerror(rc));
+		}
+	}
+
+	for (i = 0; i < clients; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	elapsed = __now() - start;
+
+	for (i = 0; i < clients; i++) {
+		test_client_close(workers[i].client);
+		free(workers[i].client);
+	}
+	free(workers);
+
+	test_server_stop(server);
+
+	rc = sqlite3_shutdown();
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to shutdown SQLite: %d", rc);
+	}
+
+	total = (double)clients * requests;
+
+	printf("%-6s %4u clients %8u requests %10.0f req/s %8.1f us/req\n",
+	       name,
+	       clients,
+	       requests,
+	       total / ((double)elapsed / 1e9),
+	       (double)elapsed / 1e3 / requests);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned clients  = BENCHMARK_CLIENTS;
+	unsigned requests = BENCHMARK_REQUESTS;
+
+	if (argc > 1) {
+		clients = (unsigned)atoi(argv[1]);
+	}
+
+	if (argc > 2) {
+		requests = (unsigned)atoi(argv[2]);
+	}
+
+	if (clients == 0 || requests == 0) {
+		fprintf(stderr, "usage: %s [clients] [requests]\n", argv[0]);
+		return 1;
+	}
+
+	__run("libuv", DQLITE_IO_LIBUV, clients, requests);
+
+#ifdef DQLITE_URING
+	__run("uring", DQLITE_IO_URING, clients, requests);
+#endif /* DQLITE_URING */
+
+	return 0;
+}
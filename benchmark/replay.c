@@ -0,0 +1,379 @@
+/******************************************************************************
+ *
+ * Replay requests recorded with DQLITE_CONFIG_CAPTURE.
+ *
+ * A fresh in-process server is started and one client is connected for every
+ * connection found in the capture, each one running in its own thread,
+ * performing the handshake with the protocol version originally negotiated and
+ * sending its requests exactly as they were recorded. Since database and
+ * statement IDs are assigned deterministically, the capture should have been
+ * taken against a server started from scratch as well.
+ *
+ * Requests are paced to match the original timing, optionally scaled by the
+ * given speed factor. A speed of 0 sends each request as soon as the response
+ * to the previous one has arrived.
+ *
+ * Usage: dqlite-replay [-s speed] <capture file>
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+#include "../src/binary.h"
+#include "../src/capture.h"
+
+#include "client.h"
+#include "munit.h"
+#include "server.h"
+#include "stats.h"
+
+/* A single recorded request. */
+struct record {
+	uint64_t timestamp; /* Nanoseconds since the capture started */
+	uint32_t conn;      /* Connection the request came from */
+	uint32_t len;       /* Length of the message */
+	uint8_t *data;      /* Message, including its header */
+};
+
+/* The requests of a single connection, replayed in their own thread. */
+struct session {
+	uint32_t            conn;      /* Connection ID in the capture */
+	uint64_t            protocol;  /* Protocol version to handshake with */
+	struct record **    records;   /* Requests to replay, in order */
+	unsigned            n;         /* Number of requests */
+	unsigned            cap;       /* Capacity of the records array */
+	uint64_t *          latencies; /* Latency of each request */
+	struct test_client *client;    /* A connected client */
+	uint64_t            start;     /* When the replay started */
+	double              speed;     /* Timing scale factor, or 0 */
+	pthread_t           thread;    /* System thread we run in */
+};
+
+static void __write(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			munit_errorf("failed to write request: %s",
+			             strerror(errno));
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void __read(int fd, uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n <= 0) {
+			munit_errorf("failed to read response: %s",
+			             n == 0 ? "connection closed" : strerror(errno));
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+/* Read a complete response, including all batches of a result set. */
+static void __response(int fd, uint8_t **body, size_t *cap)
+{
+	uint8_t  header[8];
+	uint64_t eof;
+	size_t   len;
+
+	do {
+		__read(fd, header, sizeof header);
+
+		len = dqlite__flip32(*(uint32_t *)header) * 8;
+		if (len > *cap) {
+			*body = realloc(*body, len);
+			if (*body == NULL) {
+				munit_error("out of memory");
+			}
+			*cap = len;
+		}
+		__read(fd, *body, len);
+
+		if (header[4] != DQLITE_RESPONSE_ROWS) {
+			break;
+		}
+
+		memcpy(&eof, *body + len - sizeof eof, sizeof eof);
+	} while (dqlite__flip64(eof) == DQLITE_RESPONSE_ROWS_PART);
+}
+
+static void *__session_run(void *arg)
+{
+	struct session *s    = arg;
+	uint8_t *       body = NULL;
+	size_t          cap  = 0;
+	uint64_t        protocol;
+	uint64_t        start;
+	unsigned        i;
+
+	protocol = dqlite__flip64(s->protocol);
+	__write(s->client->fd, (const uint8_t *)&protocol, sizeof protocol);
+
+	for (i = 0; i < s->n; i++) {
+		struct record *r = s->records[i];
+
+		if (s->speed > 0) {
+			benchmark_sleep_until(s->start +
+			              (uint64_t)(r->timestamp / s->speed));
+		}
+
+		start = benchmark_now();
+
+		__write(s->client->fd, r->data, r->len);
+		__response(s->client->fd, &body, &cap);
+
+		s->latencies[i] = benchmark_now() - start;
+	}
+
+	free(body);
+
+	return NULL;
+}
+
+/* Return the session of the given connection, creating it if needed. */
+static struct session *__session(struct session **sessions,
+                                 unsigned *       n,
+                                 uint32_t         conn)
+{
+	struct session *s;
+	unsigned        i;
+
+	for (i = 0; i < *n; i++) {
+		if ((*sessions)[i].conn == conn) {
+			return &(*sessions)[i];
+		}
+	}
+
+	*sessions = realloc(*sessions, (*n + 1) * sizeof **sessions);
+	if (*sessions == NULL) {
+		munit_error("out of memory");
+	}
+
+	s = &(*sessions)[*n];
+	memset(s, 0, sizeof *s);
+	s->conn     = conn;
+	s->protocol = DQLITE_PROTOCOL_VERSION;
+
+	(*n)++;
+
+	return s;
+}
+
+/* Load all records of a capture file, grouping them by connection. */
+static struct record *__load(const char *     path,
+                             unsigned *       n_records,
+                             struct session **sessions,
+                             unsigned *       n_sessions)
+{
+	struct dqlite__capture_record header;
+	struct record *               records = NULL;
+	struct session *              s;
+	char                          magic[DQLITE__CAPTURE_MAGIC_LEN];
+	unsigned                      cap = 0;
+	unsigned                      i;
+	size_t                        size;
+	FILE *                        file;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		munit_errorf("failed to open %s: %s", path, strerror(errno));
+	}
+
+	if (fread(magic, sizeof magic, 1, file) != 1 ||
+	    memcmp(magic, DQLITE__CAPTURE_MAGIC, sizeof magic) != 0) {
+		munit_errorf("%s is not a capture file", path);
+	}
+
+	*n_records = 0;
+
+	while (fread(&header, sizeof header, 1, file) == 1) {
+		struct record *r;
+
+		if (*n_records == cap) {
+			cap     = cap == 0 ? 1024 : cap * 2;
+			records = realloc(records, cap * sizeof *records);
+			if (records == NULL) {
+				munit_error("out of memory");
+			}
+		}
+
+		r            = &records[*n_records];
+		r->timestamp = dqlite__flip64(header.timestamp);
+		r->conn      = dqlite__flip32(header.conn);
+		r->len       = dqlite__flip32(header.len);
+
+		/* Handshake records hold the 8-byte protocol version. */
+		size    = r->len > 0 ? r->len : sizeof(uint64_t);
+		r->data = munit_malloc(size);
+
+		/* A truncated record means the capture was interrupted. */
+		if (fread(r->data, size, 1, file) != 1) {
+			free(r->data);
+			break;
+		}
+
+		(*n_records)++;
+	}
+
+	fclose(file);
+
+	*sessions   = NULL;
+	*n_sessions = 0;
+
+	/* Group records only once the array won't be moved anymore. */
+	for (i = 0; i < *n_records; i++) {
+		s = __session(sessions, n_sessions, records[i].conn);
+		if (records[i].len == 0) {
+			memcpy(&s->protocol, records[i].data, sizeof s->protocol);
+			s->protocol = dqlite__flip64(s->protocol);
+			continue;
+		}
+		if (s->n == s->cap) {
+			s->cap     = s->cap == 0 ? 64 : s->cap * 2;
+			s->records = realloc(s->records, s->cap * sizeof *s->records);
+			if (s->records == NULL) {
+				munit_error("out of memory");
+			}
+		}
+		s->records[s->n++] = &records[i];
+	}
+
+	return records;
+}
+
+/* Print throughput and the distribution of latencies. */
+static void __report(struct session *sessions,
+                     unsigned        n_sessions,
+                     unsigned        n_records,
+                     uint64_t        elapsed)
+{
+	uint64_t *latencies;
+	unsigned  n = 0;
+	unsigned  i;
+	unsigned  j;
+
+	latencies = munit_malloc((n_records + 1) * sizeof *latencies);
+
+	for (i = 0; i < n_sessions; i++) {
+		for (j = 0; j < sessions[i].n; j++) {
+			latencies[n++] = sessions[i].latencies[j];
+		}
+	}
+
+	printf("%u connections %u requests %.0f req/s\n",
+	       n_sessions,
+	       n,
+	       n / ((double)elapsed / 1e9));
+
+	benchmark_latency_report(latencies, n);
+
+	free(latencies);
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_server *server;
+	struct session *    sessions;
+	struct record *     records;
+	unsigned            n_sessions;
+	unsigned            n_records;
+	const char *        errmsg;
+	double              speed = 1;
+	uint64_t            start;
+	unsigned            i;
+	int                 rc;
+	int                 opt;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			speed = atof(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1 || speed < 0) {
+		goto usage;
+	}
+
+	records = __load(argv[optind], &n_records, &sessions, &n_sessions);
+
+	rc = dqlite_init(&errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to init dqlite: %s", errmsg);
+	}
+
+	server = test_server_start("unix");
+
+	/* Connect all clients before starting the clock. */
+	for (i = 0; i < n_sessions; i++) {
+		test_server_connect(server, &sessions[i].client);
+		sessions[i].latencies =
+		    munit_malloc(sessions[i].n * sizeof *sessions[i].latencies);
+		sessions[i].speed = speed;
+	}
+
+	start = benchmark_now();
+
+	for (i = 0; i < n_sessions; i++) {
+		sessions[i].start = start;
+
+		rc = pthread_create(
+		    &sessions[i].thread, NULL, __session_run, &sessions[i]);
+		if (rc != 0) {
+			munit_errorf("failed to spawn session: %s", strerror(rc));
+		}
+	}
+
+	for (i = 0; i < n_sessions; i++) {
+		pthread_join(sessions[i].thread, NULL);
+	}
+
+	__report(sessions, n_sessions, n_records, benchmark_now() - start);
+
+	for (i = 0; i < n_sessions; i++) {
+		test_client_close(sessions[i].client);
+		free(sessions[i].client);
+		free(sessions[i].latencies);
+		free(sessions[i].records);
+	}
+	free(sessions);
+
+	for (i = 0; i < n_records; i++) {
+		free(records[i].data);
+	}
+	free(records);
+
+	test_server_stop(server);
+
+	rc = sqlite3_shutdown();
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to shutdown SQLite: %d", rc);
+	}
+
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s speed] <capture file>\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,353 @@
+/******************************************************************************
+ *
+ * Find the scaling limits of a single server.
+ *
+ * The number of connected clients is ramped up in steps, doubling each time,
+ * and then the same is done with the number of open databases, each one
+ * served through its own connection. After every step all clients perform a
+ * request, and the following figures are printed:
+ *
+ * - resident memory of the process, which hosts both server and clients;
+ * - rate at which the new connections of the step were accepted and served
+ *   their first request;
+ * - current and maximum lag of the server's event loop;
+ * - distribution of the latency of the requests.
+ *
+ * The ramp stops early if a database can't be opened or written, for example
+ * when the VFS runs out of file slots.
+ *
+ * Usage: dqlite-scale-benchmark [-c max connections] [-d max databases]
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+
+#include "client.h"
+#include "munit.h"
+#include "server.h"
+#include "stats.h"
+
+/* Default maximum number of connections. */
+#define BENCHMARK_CONNECTIONS 20000
+
+/* Default maximum number of databases. */
+#define BENCHMARK_DATABASES 2000
+
+/* Size of the first step of each ramp. */
+#define BENCHMARK_FIRST_CONNECTIONS 1000
+#define BENCHMARK_FIRST_DATABASES 16
+
+/* File descriptors kept aside for the server and the process itself. */
+#define BENCHMARK_RESERVED_FDS 64
+
+/* A connected client, optionally using its own database. */
+struct client {
+	struct test_client *client; /* Connected client */
+	uint32_t            db_id;  /* Open database, if any */
+};
+
+/* Return the resident set size of the process, in bytes. */
+static uint64_t __rss()
+{
+	unsigned long size;
+	unsigned long resident;
+	FILE *        file;
+	int           n;
+
+	file = fopen("/proc/self/statm", "r");
+	if (file == NULL) {
+		return 0;
+	}
+
+	n = fscanf(file, "%lu %lu", &size, &resident);
+	fclose(file);
+
+	if (n != 2) {
+		return 0;
+	}
+
+	return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+/* Raise the limit of open files as much as possible, and return how many
+ * connections can be opened, given that each one takes two descriptors. */
+static unsigned __max_connections(unsigned wanted)
+{
+	struct rlimit limit;
+	rlim_t        needed;
+
+	needed = (rlim_t)wanted * 2 + BENCHMARK_RESERVED_FDS;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+		munit_errorf("failed to get file limit: %s", strerror(errno));
+	}
+
+	if (limit.rlim_cur < needed) {
+		limit.rlim_cur =
+		    limit.rlim_max < needed ? limit.rlim_max : needed;
+		if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+			munit_errorf("failed to raise file limit: %s",
+			             strerror(errno));
+		}
+	}
+
+	if (limit.rlim_cur < needed) {
+		wanted = (limit.rlim_cur - BENCHMARK_RESERVED_FDS) / 2;
+		printf("file limit allows only %u connections\n", wanted);
+	}
+
+	return wanted;
+}
+
+/* Connect a new client and register it, which is a full round trip. */
+static void __connect(struct test_server *server, struct client *c)
+{
+	uint64_t heartbeat;
+
+	test_server_connect(server, &c->client);
+	test_client_handshake(c->client);
+	test_client_client(c->client, &heartbeat);
+}
+
+static void __disconnect(struct client *c)
+{
+	test_client_close(c->client);
+	close(c->client->fd);
+	free(c->client);
+}
+
+/* Print the figures of a step. */
+static void __report(struct test_server *server,
+                     const char *        what,
+                     unsigned            n,
+                     unsigned            added,
+                     uint64_t            elapsed,
+                     uint64_t *          latencies,
+                     unsigned            sampled)
+{
+	dqlite_metrics metrics;
+	int            rc;
+
+	rc = dqlite_server_metrics(server->service, &metrics);
+	if (rc != 0) {
+		munit_errorf("failed to get metrics: %s",
+		             dqlite_server_errmsg(server->service));
+	}
+
+	printf("%6u %-9s accept %8.0f/s rss %8.1f MiB lag %8.1f us "
+	       "max %8.1f us\n",
+	       n,
+	       what,
+	       added / ((double)elapsed / 1e9),
+	       __rss() / 1024.0 / 1024.0,
+	       metrics.lag / 1e3,
+	       metrics.lag_max / 1e3);
+
+	benchmark_latency_report(latencies, sampled);
+}
+
+/* Return the size of the step following the given one. */
+static unsigned __next(unsigned n, unsigned max)
+{
+	if (n == max) {
+		return 0;
+	}
+
+	return n * 2 < max ? n * 2 : max;
+}
+
+static void __ramp_connections(struct test_server *server, unsigned max)
+{
+	struct client *clients;
+	uint64_t *     latencies;
+	uint64_t       start;
+	uint64_t       elapsed;
+	unsigned       n = 0;
+	unsigned       target;
+	unsigned       i;
+
+	clients   = munit_malloc(max * sizeof *clients);
+	latencies = munit_malloc(max * sizeof *latencies);
+
+	target = BENCHMARK_FIRST_CONNECTIONS < max ? BENCHMARK_FIRST_CONNECTIONS
+	                                           : max;
+
+	for (; target != 0; target = __next(target, max)) {
+		unsigned added = target - n;
+
+		start = benchmark_now();
+		for (; n < target; n++) {
+			__connect(server, &clients[n]);
+		}
+		elapsed = benchmark_now() - start;
+
+		for (i = 0; i < n; i++) {
+			start = benchmark_now();
+			test_client_leader(clients[i].client, NULL);
+			latencies[i] = benchmark_now() - start;
+		}
+
+		__report(server, "conns", n, added, elapsed, latencies, n);
+	}
+
+	for (i = 0; i < n; i++) {
+		__disconnect(&clients[i]);
+	}
+
+	free(latencies);
+	free(clients);
+}
+
+/* Open a new database and create the table used for sampling latency. */
+static int __open(struct client *c, unsigned i)
+{
+	char name[32];
+	int  rc;
+
+	sprintf(name, "scale-%u.db", i);
+
+	rc = test_client_open_try(c->client, name, &c->db_id);
+	if (rc != 0) {
+		printf("failed to open database %u: %d\n", i, rc);
+		return rc;
+	}
+
+	rc = test_client_exec_sql_try(
+	    c->client, c->db_id, "CREATE TABLE t (n INT)");
+	if (rc == 0) {
+		rc = test_client_exec_sql_try(
+		    c->client, c->db_id, "INSERT INTO t VALUES(0)");
+	}
+	if (rc != 0) {
+		printf("failed to write database %u: %d\n", i, rc);
+		return rc;
+	}
+
+	return 0;
+}
+
+static void __ramp_databases(struct test_server *server, unsigned max)
+{
+	struct client *clients;
+	uint64_t *     latencies;
+	uint64_t       start;
+	uint64_t       elapsed;
+	unsigned       n = 0;
+	unsigned       target;
+	unsigned       i;
+	int            rc = 0;
+	int            err;
+
+	clients   = munit_malloc(max * sizeof *clients);
+	latencies = munit_malloc(max * sizeof *latencies);
+
+	target = BENCHMARK_FIRST_DATABASES < max ? BENCHMARK_FIRST_DATABASES
+	                                         : max;
+
+	for (; target != 0 && rc == 0; target = __next(target, max)) {
+		unsigned added = target - n;
+
+		start = benchmark_now();
+		for (; n < target; n++) {
+			__connect(server, &clients[n]);
+			rc = __open(&clients[n], n);
+			if (rc != 0) {
+				__disconnect(&clients[n]);
+				added -= target - n;
+				break;
+			}
+		}
+		elapsed = benchmark_now() - start;
+
+		for (i = 0; i < n; i++) {
+			start = benchmark_now();
+			err   = test_client_exec_sql_try(clients[i].client,
+			                                 clients[i].db_id,
+			                                 "UPDATE t SET n = n + 1");
+			if (err != 0) {
+				printf("failed to update database %u: %d\n", i, err);
+				rc = err;
+				break;
+			}
+			latencies[i] = benchmark_now() - start;
+		}
+
+		if (n > 0) {
+			__report(
+			    server, "databases", n, added, elapsed, latencies, i);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		__disconnect(&clients[i]);
+	}
+
+	free(latencies);
+	free(clients);
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_server *server;
+	const char *        errmsg;
+	unsigned            connections = BENCHMARK_CONNECTIONS;
+	unsigned            databases   = BENCHMARK_DATABASES;
+	int                 rc;
+	int                 opt;
+
+	while ((opt = getopt(argc, argv, "c:d:")) != -1) {
+		switch (opt) {
+		case 'c':
+			connections = (unsigned)atoi(optarg);
+			break;
+		case 'd':
+			databases = (unsigned)atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc || connections == 0 || databases == 0) {
+		goto usage;
+	}
+
+	connections = __max_connections(connections);
+	if (databases > connections) {
+		databases = connections;
+	}
+
+	rc = dqlite_init(&errmsg);
+	if (rc != 0) {
+		munit_errorf("failed to init dqlite: %s", errmsg);
+	}
+
+	server = test_server_start("unix");
+
+	__ramp_connections(server, connections);
+	__ramp_databases(server, databases);
+
+	test_server_stop(server);
+
+	rc = sqlite3_shutdown();
+	if (rc != SQLITE_OK) {
+		munit_errorf("failed to shutdown SQLite: %d", rc);
+	}
+
+	return 0;
+
+usage:
+	fprintf(stderr,
+	        "usage: %s [-c max connections] [-d max databases]\n",
+	        argv[0]);
+	return 1;
+}
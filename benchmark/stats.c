@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+
+uint64_t benchmark_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+void benchmark_sleep_until(uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = deadline / (1000 * 1000 * 1000);
+	ts.tv_nsec = deadline % (1000 * 1000 * 1000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR) {
+	}
+}
+
+static int benchmark__compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void benchmark_latency_report(uint64_t *samples, unsigned n)
+{
+	double   total = 0;
+	unsigned i;
+
+	if (n == 0) {
+		printf("latency (us): no samples\n");
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		total += samples[i];
+	}
+
+	qsort(samples, n, sizeof *samples, benchmark__compare);
+
+	printf("latency (us): mean %.1f p50 %.1f p90 %.1f p99 %.1f "
+	       "p99.9 %.1f max %.1f\n",
+	       total / n / 1e3,
+	       samples[(uint64_t)n * 50 / 100] / 1e3,
+	       samples[(uint64_t)n * 90 / 100] / 1e3,
+	       samples[(uint64_t)n * 99 / 100] / 1e3,
+	       samples[(uint64_t)n * 999 / 1000] / 1e3,
+	       samples[n - 1] / 1e3);
+}
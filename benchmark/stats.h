@@ -0,0 +1,22 @@
+/******************************************************************************
+ *
+ * Helpers for collecting and reporting benchmark measurements.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_BENCHMARK_STATS_H
+#define DQLITE_BENCHMARK_STATS_H
+
+#include <stdint.h>
+
+/* Return the current monotonic time in nanoseconds. */
+uint64_t benchmark_now();
+
+/* Sleep until the given monotonic time. */
+void benchmark_sleep_until(uint64_t deadline);
+
+/* Sort the given latency samples, in nanoseconds, and print their mean and
+ * percentiles in microseconds. */
+void benchmark_latency_report(uint64_t *samples, unsigned n);
+
+#endif /* DQLITE_BENCHMARK_STATS_H */
@@ -24,6 +24,10 @@
 /* Current protocol version */
 #define DQLITE_PROTOCOL_VERSION 0x86104dd760433fe5
 
+/* Protocol version in which only the first ROWS response of a query carries
+ * the column count and names, while follow-up responses carry rows only. */
+#define DQLITE_PROTOCOL_VERSION_COMPACT_ROWS 0x86104dd760433fe6
+
 /* Request types */
 #define DQLITE_REQUEST_LEADER 0
 #define DQLITE_REQUEST_CLIENT 1
@@ -37,6 +41,11 @@
 #define DQLITE_REQUEST_QUERY_SQL 9
 #define DQLITE_REQUEST_INTERRUPT 10
 
+/* Register a client and open a database in one go, typically sent right after
+ * the protocol version without waiting, so a new connection is ready to run
+ * statements after a single round trip. */
+#define DQLITE_REQUEST_CONNECT 11
+
 /* Response types */
 #define DQLITE_RESPONSE_FAILURE 0
 #define DQLITE_RESPONSE_SERVER 1
@@ -47,6 +56,7 @@
 #define DQLITE_RESPONSE_RESULT 6
 #define DQLITE_RESPONSE_ROWS 7
 #define DQLITE_RESPONSE_EMPTY 8
+#define DQLITE_RESPONSE_WELCOME_DB 9 /* Response to a CONNECT request */
 
 /* Special datatypes */
 #define DQLITE_UNIXTIME 9
@@ -67,6 +77,34 @@
 #define DQLITE_CONFIG_PAGE_SIZE 4
 #define DQLITE_CONFIG_CHECKPOINT_THRESHOLD 5
 #define DQLITE_CONFIG_METRICS 6
+#define DQLITE_CONFIG_DB_POOL_SIZE 7
+#define DQLITE_CONFIG_INDEX_ADVISOR 8
+#define DQLITE_CONFIG_MAINTENANCE_INTERVAL 9
+#define DQLITE_CONFIG_IO_BACKEND 10
+#define DQLITE_CONFIG_BUSY_POLL 11
+#define DQLITE_CONFIG_CPU_AFFINITY 12
+#define DQLITE_CONFIG_CAPTURE 13
+#define DQLITE_CONFIG_SNAPSHOT_READS 14
+#define DQLITE_CONFIG_WAL_SOFT_LIMIT 15
+#define DQLITE_CONFIG_WAL_HARD_LIMIT 16
+#define DQLITE_CONFIG_COROUTINE_STACK 17
+#define DQLITE_CONFIG_ZERO_COPY_THRESHOLD 18
+
+/* Number of bytes that the server tries to stay under, shedding its caches as
+ * usage gets close. Usage is measured with sqlite3_memory_used(), which is
+ * process-wide and only covers memory allocated through SQLite: libuv handles,
+ * coroutine stacks, io_uring buffers and cluster allocations are not counted,
+ * while the usage of other servers and SQLite users in the process is. The
+ * budget is also set as SQLite's soft heap limit while the server runs. */
+#define DQLITE_CONFIG_MEMORY_BUDGET 19
+
+/* Asynchronous cluster methods, see dqlite_cluster_async. The given object is
+ * copied. */
+#define DQLITE_CONFIG_CLUSTER_ASYNC 20
+
+/* I/O backends for client connections */
+#define DQLITE_IO_LIBUV 0 /* Readiness based, using epoll on Linux */
+#define DQLITE_IO_URING 1 /* Completion based, using io_uring */
 
 /* Special value indicating that a batch of rows is over, but there are more. */
 #define DQLITE_RESPONSE_ROWS_PART 0xeeeeeeeeeeeeeeee
@@ -81,7 +119,11 @@
  */
 int dqlite_init(const char **ermsg);
 
-/* Interface implementing logging functionality */
+/* Interface implementing logging functionality
+ *
+ * While a server is running, the logger configured with DQLITE_CONFIG_LOGGER
+ * is invoked from a dedicated thread and receives already formatted
+ * messages, which are truncated to 255 bytes. */
 typedef struct dqlite_logger {
 	void *ctx;
 	void (*xLogf)(void *ctx, int level, const char *format, ...);
@@ -93,6 +135,10 @@ typedef struct dqlite_server_info {
 	const char *address;
 } dqlite_server_info;
 
+/* Completion callback of the asynchronous methods of the cluster interface,
+ * with status 0 on success. */
+typedef void (*dqlite_cluster_cb)(void *arg, int status);
+
 /* The memory returned by a method of the cluster interface must be valid until
  * the next invokation of the same method. */
 typedef struct dqlite_cluster {
@@ -106,6 +152,58 @@ typedef struct dqlite_cluster {
 	int (*xCheckpoint)(void *ctx, sqlite3 *db);
 } dqlite_cluster;
 
+/* Optional asynchronous counterparts of the blocking methods of the cluster
+ * interface, registered with DQLITE_CONFIG_CLUSTER_ASYNC and invoked with the
+ * ctx of the dqlite_cluster passed to dqlite_server_create. Any method left
+ * NULL falls back to its blocking counterpart.
+ *
+ * They are used by requests and background maintenance run on the loop
+ * thread, so waiting for raft doesn't hold up other clients. They must invoke
+ * cb exactly once, possibly before returning, unless they return non-zero, in
+ * which case cb must not be invoked at all. A connection passed to
+ * xCheckpointAsync must not be used anymore once it's passed to xUnregister,
+ * but cb must still be invoked. */
+typedef struct dqlite_cluster_async {
+	int (*xBarrierAsync)(void *ctx, void *arg, dqlite_cluster_cb cb);
+	int (*xCheckpointAsync)(void *            ctx,
+	                        sqlite3 *         db,
+	                        void *            arg,
+	                        dqlite_cluster_cb cb);
+} dqlite_cluster_async;
+
+/* Index recommendation for a statement doing expensive full table scans or
+ * building automatic indexes. */
+typedef struct dqlite_index_advice {
+	const char *db;             /* Database the statement was run against */
+	const char *sql;            /* Text of the statement */
+	const char *plan;           /* Offending query plan step, if known */
+	const char *index;          /* Suggested CREATE INDEX, if any */
+	uint64_t    count;          /* Number of expensive executions */
+	uint64_t    fullscan_steps; /* Total full scan steps */
+	uint64_t    autoindex;      /* Total rows inserted in automatic indexes */
+} dqlite_index_advice;
+
+/* Operational metrics of a server. All durations are in nanoseconds. */
+typedef struct dqlite_metrics {
+	uint64_t requests;      /* Number of requests served */
+	uint64_t duration;      /* Total time spent serving requests */
+	uint64_t iterations;    /* Number of event loop iterations */
+	uint64_t callbacks;     /* Client I/O callbacks run by the event loop */
+	uint64_t busy;          /* Time the event loop spent running callbacks */
+	uint64_t idle;          /* Time the event loop spent waiting for events */
+	uint64_t lag;           /* Most recent delay in firing a loop timer */
+	uint64_t lag_max;       /* Largest delay in firing a loop timer */
+	uint64_t throttled;     /* Writes delayed because of the WAL size */
+	uint64_t throttle_time; /* Total delay of throttled writes */
+	uint64_t rejected;      /* Writes rejected because of the WAL size */
+	uint64_t log_dropped;   /* Log messages dropped by a slow logger */
+	uint64_t log_throttled; /* Log messages over the rate limit (process) */
+	uint64_t memory_used;   /* Bytes allocated through SQLite (process) */
+	uint64_t memory_sheds;  /* Steps run to get back under the budget */
+	uint64_t spin_duration; /* Busy polling with no request served */
+	uint64_t work_duration; /* Busy polling while serving requests */
+} dqlite_metrics;
+
 /* Handle connections from dqlite clients */
 typedef struct dqlite__server dqlite_server;
 
@@ -174,6 +272,91 @@ dqlite_cluster *dqlite_server_cluster(dqlite_server *s);
  * configured. */
 dqlite_logger *dqlite_server_logger(dqlite_server *s);
 
+/* Return index recommendations for the statements whose full scan steps plus
+ * automatic index rows exceeded the DQLITE_CONFIG_INDEX_ADVISOR threshold.
+ *
+ * The plan and index fields are NULL until the statement's query plan gets
+ * analyzed, which the maintenance timer does in the background, one statement
+ * at a time, against a connection to that database not serving a request.
+ * Full scans get an index on the columns their WHERE and ON terms compare.
+ *
+ * This is a thread-safe API. The returned array and the strings it references
+ * are allocated as a single block, which the caller must release with
+ * sqlite3_free. */
+int dqlite_server_index_advice(dqlite_server *       s,
+                               dqlite_index_advice **advice,
+                               unsigned *            n);
+
+/* Return the operational metrics of a server, which must have been enabled
+ * with DQLITE_CONFIG_METRICS.
+ *
+ * The ratio of busy time to busy plus idle time is the utilization of the
+ * event loop, and a lag growing beyond a few milliseconds means that the loop
+ * is saturated and requests are queuing up.
+ *
+ * This is a thread-safe API, but it must be invoked after dqlite_server_ready.
+ * The values are sampled without synchronizing with the loop, so they might be
+ * slightly out of date. */
+int dqlite_server_metrics(dqlite_server *s, dqlite_metrics *metrics);
+
+/* In-process client of a dqlite server.
+ *
+ * Requests are handed straight to the server's event loop, skipping sockets
+ * and the wire protocol, but are otherwise served exactly like those of
+ * regular clients, including barriers and WAL replication. */
+typedef struct dqlite__direct dqlite_direct;
+
+/* Create an in-process client and open the database with the given name.
+**
+** This is a thread-safe API, which must be invoked after dqlite_server_ready
+** and blocks until the database is open. A client must be used by one thread
+** at a time, but different clients can be used concurrently.
+**
+** In case of error, the caller must invoke sqlite3_free
+** against the returned errmsg.
+*/
+int dqlite_direct_open(dqlite_server * s,
+                       const char *    name,
+                       dqlite_direct **out,
+                       char **         errmsg);
+
+/* Execute the given SQL text, which may contain several statements.
+**
+** Returns DQLITE_ENGINE if SQLite failed, or DQLITE_STOPPED if the server is
+** not running anymore. In case of error, the caller must invoke sqlite3_free
+** against the returned errmsg.
+*/
+int dqlite_direct_exec(dqlite_direct *d,
+                       const char *   sql,
+                       uint64_t *     last_insert_id,
+                       uint64_t *     rows_affected,
+                       char **        errmsg);
+
+/* Run the given query, invoking xRow for each row it yields.
+**
+** The callback runs in the event loop thread, with the statement positioned
+** on the current row: it must read the columns it needs with the
+** sqlite3_column_* APIs and return quickly, since other clients are blocked
+** in the meantime. Rows are handed over in batches, and other clients are
+** served between them. The callback must not use the statement's connection
+** otherwise, since the connection might be handed to other clients later. A
+** non-zero return value aborts the query.
+**
+** Error handling is the same as dqlite_direct_exec.
+*/
+int dqlite_direct_query(dqlite_direct *d,
+                        const char *   sql,
+                        int (*xRow)(void *arg, sqlite3_stmt *stmt),
+                        void * arg,
+                        char **errmsg);
+
+/* Close an in-process client and its database.
+**
+** This is a thread-safe API, which must be invoked before
+** dqlite_server_destroy, even if the server has been stopped.
+*/
+void dqlite_direct_close(dqlite_direct *d);
+
 /* Allocate and initialize an in-memory dqlite VFS object, configured with the
  * given registration name.
  *
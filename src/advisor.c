@@ -0,0 +1,873 @@
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+
+#include "advisor.h"
+#include "lifecycle.h"
+
+/* Maximum nesting of parentheses followed when looking for the terms of WHERE
+ * and ON clauses. */
+#define DQLITE__ADVISOR_MAX_DEPTH 32
+
+/* Maximum number of columns in a suggested index. */
+#define DQLITE__ADVISOR_MAX_COLUMNS 8
+
+/* Types of the tokens of the minimal SQL tokenizer used to find WHERE terms. */
+#define DQLITE__ADVISOR_WORD 0   /* Keyword, bare identifier or number */
+#define DQLITE__ADVISOR_QUOTED 1 /* Quoted identifier */
+#define DQLITE__ADVISOR_OTHER 2  /* String literal, operator or punctuation */
+
+struct dqlite__advisor_token {
+	const char *text; /* Start of the token in the SQL text */
+	int         len;  /* Length of the token */
+	int         type; /* One of the token types above */
+};
+
+/* Columns of a table that a statement compares to something. */
+struct dqlite__advisor_terms {
+	sqlite3_stmt *lookup; /* Check whether a column belongs to the table */
+	const char *  table;  /* Name of the table */
+	int           table_len;
+	const char *  alias; /* Alias of the table in the statement, or NULL */
+	int           alias_len;
+	char *        eq[DQLITE__ADVISOR_MAX_COLUMNS];
+	unsigned      n_eq;  /* Number of columns compared for equality */
+	char *        range; /* First column compared by range */
+};
+
+/* Make a copy of the given string, or return NULL if out of memory. */
+static char *dqlite__advisor_strdup(const char *s)
+{
+	char *copy;
+
+	assert(s != NULL);
+
+	copy = sqlite3_malloc(strlen(s) + 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	strcpy(copy, s);
+
+	return copy;
+}
+
+/* Return 1 if the given query plan step is a full table scan. */
+static int dqlite__advisor_is_full_scan(const char *detail)
+{
+	return strncmp(detail, "SCAN ", 5) == 0 &&
+	       strstr(detail, " USING ") == NULL &&
+	       strstr(detail, " VIRTUAL TABLE") == NULL &&
+	       strncmp(detail, "SCAN CONSTANT ROW", 17) != 0 &&
+	       strncmp(detail, "SCAN SUBQUERY", 13) != 0;
+}
+
+void dqlite__advisor_init(struct dqlite__advisor *a)
+{
+	int err;
+
+	assert(a != NULL);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_ADVISOR);
+
+	a->len     = 0;
+	a->pending = 0;
+
+	err = pthread_mutex_init(&a->mutex, NULL);
+	assert(err == 0); /* Docs say that pthread_mutex_init can't fail */
+	(void)err;
+}
+
+void dqlite__advisor_close(struct dqlite__advisor *a)
+{
+	struct dqlite__advisor_entry *e;
+	unsigned                      i;
+
+	assert(a != NULL);
+
+	for (i = 0; i < a->len; i++) {
+		e = &a->entries[i];
+
+		sqlite3_free(e->db);
+		sqlite3_free(e->sql);
+
+		if (e->plan != NULL) {
+			sqlite3_free(e->plan);
+		}
+
+		if (e->index != NULL) {
+			sqlite3_free(e->index);
+		}
+	}
+
+	pthread_mutex_destroy(&a->mutex);
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_ADVISOR);
+}
+
+/* Find the entry for the given database and statement text, creating it if
+ * there's still room. Must be called with the mutex held. */
+static struct dqlite__advisor_entry *dqlite__advisor_entry_get(
+    struct dqlite__advisor *a,
+    const char *            name,
+    const char *            sql)
+{
+	struct dqlite__advisor_entry *e;
+	unsigned                      i;
+
+	for (i = 0; i < a->len; i++) {
+		e = &a->entries[i];
+		if (strcmp(e->sql, sql) == 0 && strcmp(e->db, name) == 0) {
+			return e;
+		}
+	}
+
+	if (a->len == DQLITE__ADVISOR_MAX_ENTRIES) {
+		return NULL;
+	}
+
+	e = &a->entries[a->len];
+
+	e->db = dqlite__advisor_strdup(name);
+	if (e->db == NULL) {
+		return NULL;
+	}
+
+	e->sql = dqlite__advisor_strdup(sql);
+	if (e->sql == NULL) {
+		sqlite3_free(e->db);
+		return NULL;
+	}
+
+	e->plan           = NULL;
+	e->index          = NULL;
+	e->count          = 0;
+	e->fullscan_steps = 0;
+	e->autoindex      = 0;
+	e->analyzed       = 0;
+
+	a->len++;
+	a->pending++;
+
+	return e;
+}
+
+void dqlite__advisor_sample(struct dqlite__advisor *a,
+                            const char *            name,
+                            sqlite3_stmt *          stmt,
+                            uint32_t                threshold)
+{
+	struct dqlite__advisor_entry *e;
+	const char *                  sql;
+	int                           fullscan_steps;
+	int                           autoindex;
+
+	assert(a != NULL);
+	assert(name != NULL);
+	assert(stmt != NULL);
+	assert(threshold > 0);
+
+	fullscan_steps =
+	    sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+	autoindex = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+
+	if ((uint32_t)(fullscan_steps + autoindex) < threshold) {
+		return;
+	}
+
+	sql = sqlite3_sql(stmt);
+	if (sql == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&a->mutex);
+
+	e = dqlite__advisor_entry_get(a, name, sql);
+	if (e != NULL) {
+		e->count++;
+		e->fullscan_steps += fullscan_steps;
+		e->autoindex += autoindex;
+	}
+
+	pthread_mutex_unlock(&a->mutex);
+}
+
+int dqlite__advisor_analyze(struct dqlite__advisor *a,
+                            sqlite3 *               db,
+                            const char *            name)
+{
+	struct dqlite__advisor_entry *e = NULL;
+	sqlite3_stmt *                stmt;
+	const char *                  detail;
+	char *                        sql;
+	char *                        plan  = NULL;
+	char *                        index = NULL;
+	char *                        scan  = NULL;
+	unsigned                      i;
+	int                           rc;
+
+	assert(a != NULL);
+	assert(db != NULL);
+	assert(name != NULL);
+
+	/* Entries are only ever added by the loop thread, which is also the
+	 * thread calling us, so the pending counter and the statement text can
+	 * be read without holding the mutex. */
+	if (a->pending == 0) {
+		return 0;
+	}
+
+	for (i = 0; i < a->len; i++) {
+		if (!a->entries[i].analyzed &&
+		    strcmp(a->entries[i].db, name) == 0) {
+			e = &a->entries[i];
+			break;
+		}
+	}
+
+	if (e == NULL) {
+		return 0;
+	}
+
+	sql = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", e->sql);
+	if (sql == NULL) {
+		return 0;
+	}
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	sqlite3_free(sql);
+
+	if (rc == SQLITE_OK) {
+		while (sqlite3_step(stmt) == SQLITE_ROW) {
+			/* The last column holds the human readable
+			 * description of the step. */
+			detail = (const char *)sqlite3_column_text(
+			    stmt, sqlite3_column_count(stmt) - 1);
+			if (detail == NULL) {
+				continue;
+			}
+
+			/* An automatic index tells exactly which index would
+			 * help, so prefer it over a plain full scan. */
+			index = dqlite__advisor_parse(detail);
+			if (index != NULL) {
+				if (plan != NULL) {
+					sqlite3_free(plan);
+				}
+				plan = dqlite__advisor_strdup(detail);
+				break;
+			}
+
+			if (!dqlite__advisor_is_full_scan(detail) ||
+			    scan != NULL) {
+				continue;
+			}
+
+			/* Otherwise report the first full scan of a table
+			 * that an index on its compared columns would
+			 * avoid, or just the first full scan. */
+			scan = dqlite__advisor_suggest(db, e->sql, detail);
+			if (plan == NULL || scan != NULL) {
+				if (plan != NULL) {
+					sqlite3_free(plan);
+				}
+				plan = dqlite__advisor_strdup(detail);
+			}
+		}
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (index == NULL) {
+		index = scan;
+	} else if (scan != NULL) {
+		sqlite3_free(scan);
+	}
+
+	pthread_mutex_lock(&a->mutex);
+
+	e->plan     = plan;
+	e->index    = index;
+	e->analyzed = 1;
+	a->pending--;
+
+	pthread_mutex_unlock(&a->mutex);
+
+	return 1;
+}
+
+/* Return the size of the given string including the terminator, or 0 if it's
+ * NULL. */
+static size_t dqlite__advisor_strsize(const char *s)
+{
+	return s != NULL ? strlen(s) + 1 : 0;
+}
+
+/* Copy the given string at the given cursor and advance it. */
+static const char *dqlite__advisor_strput(char **cursor, const char *s)
+{
+	char *copy = *cursor;
+
+	if (s == NULL) {
+		return NULL;
+	}
+
+	strcpy(copy, s);
+	*cursor += strlen(s) + 1;
+
+	return copy;
+}
+
+int dqlite__advisor_report(struct dqlite__advisor *a,
+                           dqlite_index_advice **  advice,
+                           unsigned *              n)
+{
+	struct dqlite__advisor_entry *e;
+	dqlite_index_advice *         out;
+	char *                        cursor;
+	size_t                        size;
+	unsigned                      i;
+
+	assert(a != NULL);
+	assert(advice != NULL);
+	assert(n != NULL);
+
+	pthread_mutex_lock(&a->mutex);
+
+	*advice = NULL;
+	*n      = a->len;
+
+	if (a->len == 0) {
+		pthread_mutex_unlock(&a->mutex);
+		return 0;
+	}
+
+	/* The array is followed by the strings it references. */
+	size = a->len * sizeof *out;
+	for (i = 0; i < a->len; i++) {
+		e = &a->entries[i];
+		size += dqlite__advisor_strsize(e->db);
+		size += dqlite__advisor_strsize(e->sql);
+		size += dqlite__advisor_strsize(e->plan);
+		size += dqlite__advisor_strsize(e->index);
+	}
+
+	out = sqlite3_malloc(size);
+	if (out == NULL) {
+		pthread_mutex_unlock(&a->mutex);
+		*n = 0;
+		return DQLITE_NOMEM;
+	}
+
+	cursor = (char *)(out + a->len);
+
+	for (i = 0; i < a->len; i++) {
+		e = &a->entries[i];
+
+		out[i].db             = dqlite__advisor_strput(&cursor, e->db);
+		out[i].sql            = dqlite__advisor_strput(&cursor, e->sql);
+		out[i].plan           = dqlite__advisor_strput(&cursor, e->plan);
+		out[i].index          = dqlite__advisor_strput(&cursor, e->index);
+		out[i].count          = e->count;
+		out[i].fullscan_steps = e->fullscan_steps;
+		out[i].autoindex      = e->autoindex;
+	}
+
+	pthread_mutex_unlock(&a->mutex);
+
+	*advice = out;
+
+	return 0;
+}
+
+char *dqlite__advisor_parse(const char *detail)
+{
+	const char *table;
+	int         table_len;
+	const char *cursor;
+	const char *end;
+	const char *next;
+	char *      columns;
+	char *      suffix;
+	int         len;
+
+	assert(detail != NULL);
+
+	/* The step looks like one of:
+	 *
+	 *   SEARCH TABLE t USING AUTOMATIC COVERING INDEX (a=? AND b>?)
+	 *   SEARCH t AS x USING AUTOMATIC PARTIAL COVERING INDEX (a=?)
+	 */
+	if (strncmp(detail, "SEARCH ", 7) != 0 ||
+	    strstr(detail, " USING AUTOMATIC ") == NULL) {
+		return NULL;
+	}
+
+	table = detail + 7;
+	if (strncmp(table, "TABLE ", 6) == 0) {
+		table += 6;
+	}
+	table_len = strcspn(table, " ");
+
+	cursor = strchr(table, '(');
+	if (cursor == NULL) {
+		return NULL;
+	}
+	cursor++;
+
+	end = strchr(cursor, ')');
+	if (end == NULL) {
+		return NULL;
+	}
+
+	columns = sqlite3_mprintf("");
+	suffix  = sqlite3_mprintf("");
+
+	while (cursor < end && columns != NULL && suffix != NULL) {
+		len = strcspn(cursor, "=<> )");
+
+		columns = sqlite3_mprintf(
+		    "%z%s%.*s", columns, *columns ? ", " : "", len, cursor);
+		suffix = sqlite3_mprintf("%z_%.*s", suffix, len, cursor);
+
+		next = strstr(cursor, " AND ");
+		if (next == NULL || next > end) {
+			break;
+		}
+		cursor = next + 5;
+	}
+
+	if (columns == NULL || suffix == NULL || *columns == 0) {
+		sqlite3_free(columns);
+		sqlite3_free(suffix);
+		return NULL;
+	}
+
+	return sqlite3_mprintf("CREATE INDEX %.*s%z_idx ON %.*s(%z)",
+	                       table_len,
+	                       table,
+	                       suffix,
+	                       table_len,
+	                       table,
+	                       columns);
+}
+
+/* Split the given SQL text into tokens, skipping whitespace and comments.
+ * Return the number of tokens, or -1 if out of memory. */
+static int dqlite__advisor_tokenize(const char *                   sql,
+                                    struct dqlite__advisor_token **tokens)
+{
+	struct dqlite__advisor_token *t;
+	struct dqlite__advisor_token *grown;
+	const char *                  p = sql;
+	const char *                  end;
+	char                          close;
+	int                           n   = 0;
+	int                           cap = 0;
+
+	*tokens = NULL;
+
+	while (*p != 0) {
+		if (isspace((unsigned char)*p)) {
+			p++;
+			continue;
+		}
+
+		if (p[0] == '-' && p[1] == '-') {
+			p += strcspn(p, "\n");
+			continue;
+		}
+
+		if (p[0] == '/' && p[1] == '*') {
+			end = strstr(p + 2, "*/");
+			p   = end != NULL ? end + 2 : p + strlen(p);
+			continue;
+		}
+
+		if (n == cap) {
+			cap   = cap == 0 ? 64 : cap * 2;
+			grown = sqlite3_realloc(*tokens, cap * sizeof **tokens);
+			if (grown == NULL) {
+				sqlite3_free(*tokens);
+				*tokens = NULL;
+				return -1;
+			}
+			*tokens = grown;
+		}
+
+		t       = &(*tokens)[n++];
+		t->text = p;
+		t->type = DQLITE__ADVISOR_OTHER;
+
+		if (*p == '\'' || *p == '"' || *p == '`' || *p == '[') {
+			/* Quotes are escaped by doubling them. */
+			close = *p == '[' ? ']' : *p;
+			end   = p + 1;
+			while ((end = strchr(end, close)) != NULL &&
+			       close != ']' && end[1] == close) {
+				end += 2;
+			}
+			p = end != NULL ? end + 1 : p + strlen(p);
+			if (*t->text != '\'') {
+				t->type = DQLITE__ADVISOR_QUOTED;
+			}
+		} else if (isalnum((unsigned char)*p) || *p == '_' ||
+		           *p == '$') {
+			while (isalnum((unsigned char)*p) || *p == '_' ||
+			       *p == '$') {
+				p++;
+			}
+			t->type = DQLITE__ADVISOR_WORD;
+		} else if (strncmp(p, "==", 2) == 0 ||
+		           strncmp(p, "<=", 2) == 0 ||
+		           strncmp(p, ">=", 2) == 0 ||
+		           strncmp(p, "<>", 2) == 0 ||
+		           strncmp(p, "!=", 2) == 0) {
+			p += 2;
+		} else {
+			p++;
+		}
+
+		t->len = (int)(p - t->text);
+	}
+
+	return n;
+}
+
+/* Return 1 if the given token is the given keyword or operator. */
+static int dqlite__advisor_is(const struct dqlite__advisor_token *t,
+                              const char *                        s)
+{
+	return t->type != DQLITE__ADVISOR_QUOTED && t->len == (int)strlen(s) &&
+	       sqlite3_strnicmp(t->text, s, t->len) == 0;
+}
+
+/* Return 1 if the given token is one of the given keywords. */
+static int dqlite__advisor_is_any(const struct dqlite__advisor_token *t,
+                                  const char **                       s)
+{
+	for (; *s != NULL; s++) {
+		if (dqlite__advisor_is(t, *s)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Return 1 if the given token can be the name of a table or column. */
+static int dqlite__advisor_is_name(const struct dqlite__advisor_token *t)
+{
+	return t->type == DQLITE__ADVISOR_QUOTED ||
+	       (t->type == DQLITE__ADVISOR_WORD &&
+	        !isdigit((unsigned char)*t->text));
+}
+
+/* Return the name held by the given token, without quotes, as a new string. */
+static char *dqlite__advisor_name(const struct dqlite__advisor_token *t)
+{
+	if (t->type == DQLITE__ADVISOR_QUOTED && t->len >= 2) {
+		return sqlite3_mprintf("%.*s", t->len - 2, t->text + 1);
+	}
+
+	return sqlite3_mprintf("%.*s", t->len, t->text);
+}
+
+/* Record the column referenced by the tokens in the given range, if it's a
+ * column of the table. The range holds either a bare name or a qualified one,
+ * whose qualifier must then match the table. */
+static void dqlite__advisor_term(struct dqlite__advisor_terms *      terms,
+                                 const struct dqlite__advisor_token *ref,
+                                 int                                 len,
+                                 int                                 eq)
+{
+	const struct dqlite__advisor_token *qualifier = NULL;
+	char *                              column;
+	unsigned                            i;
+
+	if (len == 3) {
+		qualifier = &ref[0];
+		ref       = &ref[2];
+		if (qualifier->len == terms->table_len &&
+		    sqlite3_strnicmp(qualifier->text,
+		                     terms->table,
+		                     terms->table_len) == 0) {
+			/* Qualified with the table name */
+		} else if (terms->alias == NULL ||
+		           qualifier->len != terms->alias_len ||
+		           sqlite3_strnicmp(qualifier->text,
+		                            terms->alias,
+		                            terms->alias_len) != 0) {
+			return;
+		}
+	}
+
+	column = dqlite__advisor_name(ref);
+	if (column == NULL) {
+		return;
+	}
+
+	sqlite3_bind_text(terms->lookup, 2, column, -1, SQLITE_STATIC);
+	if (sqlite3_step(terms->lookup) != SQLITE_ROW) {
+		goto out;
+	}
+
+	for (i = 0; i < terms->n_eq; i++) {
+		if (sqlite3_stricmp(terms->eq[i], column) == 0) {
+			goto out;
+		}
+	}
+
+	if (eq && terms->n_eq < DQLITE__ADVISOR_MAX_COLUMNS) {
+		terms->eq[terms->n_eq++] = column;
+		column                   = NULL;
+	} else if (!eq && terms->range == NULL) {
+		terms->range = column;
+		column       = NULL;
+	}
+
+out:
+	sqlite3_reset(terms->lookup);
+	sqlite3_free(column);
+}
+
+/* Return the number of tokens of the column reference starting at the given
+ * index, or 0 if there's none. */
+static int dqlite__advisor_ref(const struct dqlite__advisor_token *tokens,
+                               int                                 n,
+                               int                                 i)
+{
+	int len = 0;
+
+	if (i >= 0 && i < n && dqlite__advisor_is_name(&tokens[i])) {
+		len = 1;
+		if (i + 2 < n && dqlite__advisor_is(&tokens[i + 1], ".") &&
+		    dqlite__advisor_is_name(&tokens[i + 2])) {
+			len = 3;
+		}
+	}
+
+	/* A name followed by a parenthesis is a function call. */
+	if (len > 0 && i + len < n &&
+	    dqlite__advisor_is(&tokens[i + len], "(")) {
+		return 0;
+	}
+
+	return len;
+}
+
+/* Collect the columns of the table compared by the terms of the WHERE and ON
+ * clauses in the given tokens. */
+static void dqlite__advisor_terms(struct dqlite__advisor_terms *      terms,
+                                  const struct dqlite__advisor_token *tokens,
+                                  int                                 n)
+{
+	/* Keywords starting and ending clauses with conditions. */
+	static const char *start[] = {"WHERE", "ON", NULL};
+	static const char *stop[]  = {"SET",
+	                              "SELECT",
+	                              "FROM",
+	                              "GROUP",
+	                              "ORDER",
+	                              "LIMIT",
+	                              "HAVING",
+	                              "WINDOW",
+	                              "RETURNING",
+	                              "UNION",
+	                              "EXCEPT",
+	                              "INTERSECT",
+	                              "JOIN",
+	                              "VALUES",
+	                              NULL};
+	static const char *eq[]    = {"=", "==", "IN", "IS", NULL};
+	static const char *range[] = {"<", "<=", ">", ">=", "BETWEEN", NULL};
+
+	/* Tokens that can precede and follow a term. */
+	static const char *before[] = {
+	    "WHERE", "ON", "AND", "OR", "NOT", "(", NULL};
+	static const char *after[] = {"AND", "OR", ")", ";", NULL};
+
+	/* Whether a condition is being parsed, at each nesting level. */
+	int cond[DQLITE__ADVISOR_MAX_DEPTH];
+	int depth = 0;
+	int is_eq;
+	int both;
+	int left;
+	int len;
+	int i;
+
+	cond[0] = 0;
+
+	for (i = 0; i < n; i++) {
+		if (dqlite__advisor_is(&tokens[i], "(")) {
+			if (depth == DQLITE__ADVISOR_MAX_DEPTH - 1) {
+				return;
+			}
+			depth++;
+			cond[depth] = cond[depth - 1];
+			continue;
+		}
+
+		if (dqlite__advisor_is(&tokens[i], ")")) {
+			if (depth > 0) {
+				depth--;
+			}
+			continue;
+		}
+
+		if (dqlite__advisor_is_any(&tokens[i], start)) {
+			cond[depth] = 1;
+			continue;
+		}
+
+		if (dqlite__advisor_is_any(&tokens[i], stop)) {
+			cond[depth] = 0;
+			continue;
+		}
+
+		if (!cond[depth]) {
+			continue;
+		}
+
+		is_eq = dqlite__advisor_is_any(&tokens[i], eq);
+		if (!is_eq && !dqlite__advisor_is_any(&tokens[i], range)) {
+			continue;
+		}
+
+		/* "a IS NOT b" can't use an index. */
+		if (dqlite__advisor_is(&tokens[i], "IS") && i + 1 < n &&
+		    dqlite__advisor_is(&tokens[i + 1], "NOT")) {
+			continue;
+		}
+
+		/* Keyword operators only take a column on their left. */
+		both = tokens[i].type == DQLITE__ADVISOR_OTHER;
+
+		/* Only bare column references can use an index, not
+		 * expressions involving them. */
+		left = i - 3 >= 0 && dqlite__advisor_ref(tokens, n, i - 3) == 3
+		           ? i - 3
+		           : i - 1;
+		len = dqlite__advisor_ref(tokens, n, left);
+		if (len > 0 && left + len == i &&
+		    (left == 0 ||
+		     dqlite__advisor_is_any(&tokens[left - 1], before))) {
+			dqlite__advisor_term(terms, &tokens[left], len, is_eq);
+		}
+
+		len = dqlite__advisor_ref(tokens, n, i + 1);
+		if (both && len > 0 &&
+		    (i + 1 + len == n ||
+		     dqlite__advisor_is_any(&tokens[i + 1 + len], after) ||
+		     dqlite__advisor_is_any(&tokens[i + 1 + len], stop))) {
+			dqlite__advisor_term(terms, &tokens[i + 1], len, is_eq);
+		}
+	}
+}
+
+char *dqlite__advisor_suggest(sqlite3 *db, const char *sql, const char *detail)
+{
+	struct dqlite__advisor_terms  terms;
+	struct dqlite__advisor_token *tokens;
+	const char *                  cursor;
+	char *                        columns = NULL;
+	char *                        suffix  = NULL;
+	char *                        index   = NULL;
+	unsigned                      i;
+	int                           n;
+	int                           rc;
+
+	assert(db != NULL);
+	assert(sql != NULL);
+	assert(detail != NULL);
+
+	/* The step looks like one of:
+	 *
+	 *   SCAN TABLE t
+	 *   SCAN t AS x
+	 */
+	if (!dqlite__advisor_is_full_scan(detail)) {
+		return NULL;
+	}
+
+	terms.table = detail + 5;
+	if (strncmp(terms.table, "TABLE ", 6) == 0) {
+		terms.table += 6;
+	}
+	terms.table_len = (int)strcspn(terms.table, " ");
+
+	terms.alias     = NULL;
+	terms.alias_len = 0;
+	cursor          = terms.table + terms.table_len;
+	if (strncmp(cursor, " AS ", 4) == 0) {
+		terms.alias     = cursor + 4;
+		terms.alias_len = (int)strcspn(terms.alias, " ");
+	}
+
+	terms.n_eq  = 0;
+	terms.range = NULL;
+
+	rc = sqlite3_prepare_v2(db,
+	                        "SELECT 1 FROM pragma_table_info(?1) "
+	                        "WHERE name = ?2 COLLATE NOCASE",
+	                        -1,
+	                        &terms.lookup,
+	                        NULL);
+	if (rc != SQLITE_OK) {
+		return NULL;
+	}
+
+	sqlite3_bind_text(
+	    terms.lookup, 1, terms.table, terms.table_len, SQLITE_STATIC);
+
+	n = dqlite__advisor_tokenize(sql, &tokens);
+	if (n > 0) {
+		dqlite__advisor_terms(&terms, tokens, n);
+	}
+
+	sqlite3_free(tokens);
+	sqlite3_finalize(terms.lookup);
+
+	if (terms.range != NULL && terms.n_eq < DQLITE__ADVISOR_MAX_COLUMNS) {
+		terms.eq[terms.n_eq++] = terms.range;
+	} else {
+		sqlite3_free(terms.range);
+	}
+
+	if (terms.n_eq == 0) {
+		return NULL;
+	}
+
+	columns = sqlite3_mprintf("");
+	suffix  = sqlite3_mprintf("");
+
+	for (i = 0; i < terms.n_eq; i++) {
+		if (columns != NULL && suffix != NULL) {
+			columns = sqlite3_mprintf("%z%s%s",
+			                          columns,
+			                          i > 0 ? ", " : "",
+			                          terms.eq[i]);
+			suffix = sqlite3_mprintf("%z_%s", suffix, terms.eq[i]);
+		}
+		sqlite3_free(terms.eq[i]);
+	}
+
+	if (columns != NULL && suffix != NULL) {
+		index = sqlite3_mprintf("CREATE INDEX %.*s%s_idx ON %.*s(%s)",
+		                        terms.table_len,
+		                        terms.table,
+		                        suffix,
+		                        terms.table_len,
+		                        terms.table,
+		                        columns);
+	}
+
+	sqlite3_free(columns);
+	sqlite3_free(suffix);
+
+	return index;
+}
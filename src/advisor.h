@@ -0,0 +1,83 @@
+/******************************************************************************
+ *
+ * Suggest missing indexes by sampling full scan statistics of statements.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_ADVISOR_H
+#define DQLITE_ADVISOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+
+/* Maximum number of distinct statements the advisor keeps track of. */
+#define DQLITE__ADVISOR_MAX_ENTRIES 64
+
+/* Statistics and recommendation for a single expensive statement. */
+struct dqlite__advisor_entry {
+	char *   db;             /* Name of the database */
+	char *   sql;            /* Text of the statement */
+	char *   plan;           /* Offending query plan step, if found */
+	char *   index;          /* Suggested CREATE INDEX, if any */
+	uint64_t count;          /* Number of expensive executions */
+	uint64_t fullscan_steps; /* Total full scan steps */
+	uint64_t autoindex;      /* Total rows inserted in automatic indexes */
+	int      analyzed;       /* Whether the query plan was analyzed */
+};
+
+/* Track statements doing expensive full scans. */
+struct dqlite__advisor {
+	struct dqlite__advisor_entry entries[DQLITE__ADVISOR_MAX_ENTRIES];
+	unsigned                     len;     /* Number of tracked statements */
+	unsigned                     pending; /* Entries not yet analyzed */
+	pthread_mutex_t              mutex;   /* Serialize access to entries */
+};
+
+void dqlite__advisor_init(struct dqlite__advisor *a);
+
+void dqlite__advisor_close(struct dqlite__advisor *a);
+
+/* Sample the full scan and automatic index counters of a statement that has
+ * just completed, resetting them.
+ *
+ * If their sum is at least the given threshold, the statement is recorded for
+ * later analysis. This is cheap enough to be called after every execution. */
+void dqlite__advisor_sample(struct dqlite__advisor *a,
+                            const char *            name,
+                            sqlite3_stmt *          stmt,
+                            uint32_t                threshold);
+
+/* Analyze the query plan of at most one pending statement recorded against the
+ * database with the given name, using the given connection.
+ *
+ * This runs an EXPLAIN QUERY PLAN, and it's meant to be called when the
+ * connection is idle. Return 1 if a statement was analyzed. */
+int dqlite__advisor_analyze(struct dqlite__advisor *a,
+                            sqlite3 *               db,
+                            const char *            name);
+
+/* Return a copy of all recommendations, allocated as a single memory block. */
+int dqlite__advisor_report(struct dqlite__advisor *a,
+                           dqlite_index_advice **  advice,
+                           unsigned *              n);
+
+/* Return a CREATE INDEX statement for the table and columns of the automatic
+ * index mentioned in the given query plan step, or NULL if the step does not
+ * use an automatic index. The returned string must be freed with
+ * sqlite3_free(). */
+char *dqlite__advisor_parse(const char *detail);
+
+/* Return a CREATE INDEX statement for the columns of the table fully scanned by
+ * the given query plan step that the WHERE and ON clauses of the given
+ * statement compare to something, or NULL if there are none. Columns compared
+ * for equality come first, followed by at most one column compared by range,
+ * as an index can't serve more. The connection is used to check which columns
+ * belong to the table. The returned string must be freed with
+ * sqlite3_free(). */
+char *dqlite__advisor_suggest(sqlite3 *db, const char *sql, const char *detail);
+
+#endif /* DQLITE_ADVISOR_H */
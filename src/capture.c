@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <uv.h>
+
+#include "../include/dqlite.h"
+
+#include "binary.h"
+#include "capture.h"
+#include "lifecycle.h"
+
+int dqlite__capture_init(struct dqlite__capture *c, const char *path)
+{
+	assert(c != NULL);
+	assert(path != NULL);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_CAPTURE);
+
+	dqlite__error_init(&c->error);
+
+	c->start = uv_hrtime();
+	c->conns = 0;
+
+	c->file = fopen(path, "wb");
+	if (c->file == NULL) {
+		dqlite__error_sys(&c->error, "failed to open capture file");
+		return DQLITE_ERROR;
+	}
+
+	if (fwrite(DQLITE__CAPTURE_MAGIC,
+	           DQLITE__CAPTURE_MAGIC_LEN,
+	           1,
+	           c->file) != 1) {
+		dqlite__error_sys(&c->error, "failed to write capture file");
+		fclose(c->file);
+		c->file = NULL;
+		return DQLITE_ERROR;
+	}
+
+	return 0;
+}
+
+void dqlite__capture_close(struct dqlite__capture *c)
+{
+	assert(c != NULL);
+
+	if (c->file != NULL) {
+		fclose(c->file);
+	}
+
+	dqlite__error_close(&c->error);
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_CAPTURE);
+}
+
+uint32_t dqlite__capture_conn(struct dqlite__capture *c)
+{
+	assert(c != NULL);
+
+	return c->conns++;
+}
+
+/* Stop the capture after a failed write. */
+static int dqlite__capture_fail(struct dqlite__capture *c)
+{
+	dqlite__error_sys(&c->error, "failed to write capture file");
+	fclose(c->file);
+	c->file = NULL;
+
+	return DQLITE_ERROR;
+}
+
+int dqlite__capture_handshake(struct dqlite__capture *c,
+                              uint32_t                conn,
+                              uint64_t                protocol)
+{
+	struct dqlite__capture_record record;
+
+	assert(c != NULL);
+
+	if (c->file == NULL) {
+		return 0;
+	}
+
+	record.timestamp = dqlite__flip64(uv_hrtime() - c->start);
+	record.conn      = dqlite__flip32(conn);
+	record.len       = 0;
+
+	protocol = dqlite__flip64(protocol);
+
+	if (fwrite(&record, sizeof record, 1, c->file) != 1 ||
+	    fwrite(&protocol, sizeof protocol, 1, c->file) != 1) {
+		return dqlite__capture_fail(c);
+	}
+
+	return 0;
+}
+
+int dqlite__capture_record(struct dqlite__capture *c,
+                           uint32_t                conn,
+                           struct dqlite__message *m)
+{
+	struct dqlite__capture_record record;
+	uint8_t                       header[DQLITE__MESSAGE_HEADER_LEN];
+	uv_buf_t                      body;
+	uint32_t                      words;
+
+	assert(c != NULL);
+	assert(m != NULL);
+
+	if (c->file == NULL) {
+		return 0;
+	}
+
+	dqlite__message_body_buf(m, &body);
+
+	record.timestamp = dqlite__flip64(uv_hrtime() - c->start);
+	record.conn      = dqlite__flip32(conn);
+	record.len = dqlite__flip32(DQLITE__MESSAGE_HEADER_LEN + body.len);
+
+	/* The word count has already been converted to host byte order, while
+	 * the extra field is kept as received. */
+	words = dqlite__flip32(m->words);
+	memcpy(header, &words, sizeof words);
+	header[4] = m->type;
+	header[5] = m->flags;
+	memcpy(header + 6, &m->extra, sizeof m->extra);
+
+	if (fwrite(&record, sizeof record, 1, c->file) != 1 ||
+	    fwrite(header, sizeof header, 1, c->file) != 1 ||
+	    fwrite(body.base, body.len, 1, c->file) != 1) {
+		return dqlite__capture_fail(c);
+	}
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Record the requests received from clients, for replaying them later.
+ *
+ * A capture file starts with DQLITE__CAPTURE_MAGIC, followed by one record for
+ * each handshake and each request. A record is made of a struct
+ * dqlite__capture_record header, followed by either:
+ *
+ * - for a handshake, whose length field is 0, the 8-byte protocol version
+ *   negotiated with the client;
+ * - for a request, the message exactly as sent by the client, including its
+ *   8-byte header.
+ *
+ * All integers are little endian.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_CAPTURE_H
+#define DQLITE_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "error.h"
+#include "message.h"
+
+/* Identifies capture files and their format version. */
+#define DQLITE__CAPTURE_MAGIC "DQLTCAP2"
+
+/* Length of the magic string, without the terminating null byte. */
+#define DQLITE__CAPTURE_MAGIC_LEN 8
+
+/* Header of a single captured request. */
+struct dqlite__capture_record {
+	uint64_t timestamp; /* Nanoseconds since the capture started */
+	uint32_t conn;      /* ID of the connection the request came from */
+	uint32_t len;       /* Length of the message that follows */
+};
+
+struct dqlite__capture {
+	/* read-only */
+	dqlite__error error; /* Last error occurred, if any */
+
+	/* private */
+	FILE *   file;  /* Buffered capture file */
+	uint64_t start; /* When the capture started */
+	uint32_t conns; /* Number of connections seen so far */
+};
+
+/* Create the capture file at the given path, truncating it if it exists. */
+int dqlite__capture_init(struct dqlite__capture *c, const char *path);
+
+/* Flush and close the capture file. */
+void dqlite__capture_close(struct dqlite__capture *c);
+
+/* Return the ID to use for a new connection. */
+uint32_t dqlite__capture_conn(struct dqlite__capture *c);
+
+/* Record the protocol version negotiated by a connection.
+ *
+ * Errors are handled like for dqlite__capture_record. */
+int dqlite__capture_handshake(struct dqlite__capture *c,
+                              uint32_t                conn,
+                              uint64_t                protocol);
+
+/* Record a request whose body has been completely received.
+ *
+ * If writing fails, the capture gets stopped and DQLITE_ERROR is returned,
+ * along with an error message. Requests recorded afterwards are ignored. */
+int dqlite__capture_record(struct dqlite__capture *c,
+                           uint32_t                conn,
+                           struct dqlite__message *m);
+
+#endif /* DQLITE_CAPTURE_H */
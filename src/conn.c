@@ -1,12 +1,15 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+
 #include <sqlite3.h>
 #include <uv.h>
 
@@ -21,17 +24,146 @@
 #include "log.h"
 #include "request.h"
 #include "response.h"
+#include "uring.h"
 
 /* Context attached to an uv_write_t write request */
 struct dqlite__conn_write_ctx {
 	struct dqlite__conn *    conn;
 	struct dqlite__response *response;
+#ifdef DQLITE_URING
+	struct dqlite__uring_req req; /* Send request */
+	struct msghdr            msg; /* Message being sent */
+
+	/* Data left to send */
+	struct iovec iov[DQLITE__MESSAGE_MAX_BUFS];
+#endif /* DQLITE_URING */
 };
 
 /* Forward declarations */
 static void dqlite__conn_alloc_cb(uv_handle_t *, size_t, uv_buf_t *);
 static void dqlite__conn_read_cb(uv_stream_t *, ssize_t, const uv_buf_t *);
 static void dqlite__conn_write_cb(uv_write_t *, int);
+static void dqlite__conn_write_done(struct dqlite__conn *,
+                                    struct dqlite__response *,
+                                    int);
+#ifdef DQLITE_URING
+static void dqlite__conn_send_cb(struct dqlite__uring_req *,
+                                 int,
+                                 const char *,
+                                 int);
+static void dqlite__conn_feed(struct dqlite__conn *, const char *, size_t);
+static int  dqlite__conn_recv_start(struct dqlite__conn *);
+static void dqlite__conn_release(struct dqlite__conn *);
+
+/* Queue a response for sending with the io_uring backend. */
+static int dqlite__conn_send(struct dqlite__conn *    c,
+                             struct dqlite__response *response)
+{
+	int                            err;
+	struct dqlite__conn_write_ctx *ctx;
+	uv_buf_t                       bufs[DQLITE__MESSAGE_MAX_BUFS];
+	unsigned                       n;
+	unsigned                       i;
+
+	/* The socket is about to be closed. */
+	if (c->aborting) {
+		dqlite__error_static(&c->error, "connection is being aborted");
+		return DQLITE_ERROR;
+	}
+
+	ctx = dqlite__message_arena_alloc(&response->message, sizeof *ctx);
+	if (ctx == NULL) {
+		dqlite__error_oom(&c->error, "failed to start sending response");
+		return DQLITE_NOMEM;
+	}
+
+	ctx->conn     = c;
+	ctx->response = response;
+	ctx->req.data = (void *)ctx;
+	ctx->req.cb   = dqlite__conn_send_cb;
+
+	n = dqlite__message_send_start(&response->message, bufs);
+
+	for (i = 0; i < n; i++) {
+		ctx->iov[i].iov_base = bufs[i].base;
+		ctx->iov[i].iov_len  = bufs[i].len;
+	}
+
+	memset(&ctx->msg, 0, sizeof ctx->msg);
+	ctx->msg.msg_iov    = ctx->iov;
+	ctx->msg.msg_iovlen = n;
+
+	err = dqlite__uring_send(c->uring, &ctx->req, c->fd, &ctx->msg);
+	if (err != 0) {
+		dqlite__message_send_reset(&response->message);
+		dqlite__error_uv(&c->error, err, "failed to send response");
+		return DQLITE_ERROR;
+	}
+
+	c->inflight++;
+
+	return 0;
+}
+
+/* Invoked when the kernel has sent all or part of a response. */
+static void dqlite__conn_send_cb(struct dqlite__uring_req *req,
+                                 int                       res,
+                                 const char *              buf,
+                                 int                       more)
+{
+	struct dqlite__conn_write_ctx *ctx;
+	struct dqlite__conn *          c;
+	struct msghdr *                msg;
+	size_t                         n;
+	int                            status;
+
+	assert(req != NULL);
+	assert(req->data != NULL);
+	assert(!more);
+
+	(void)buf;
+
+	ctx = (struct dqlite__conn_write_ctx *)req->data;
+	c   = ctx->conn;
+	msg = &ctx->msg;
+
+	assert(c->inflight > 0);
+	c->inflight--;
+
+	if (res > 0) {
+		/* Skip over what was sent, and send the rest in case of a short
+		 * send. */
+		n = (size_t)res;
+		while (msg->msg_iovlen > 0 && n >= msg->msg_iov->iov_len) {
+			n -= msg->msg_iov->iov_len;
+			msg->msg_iov++;
+			msg->msg_iovlen--;
+		}
+		if (msg->msg_iovlen > 0 && !c->aborting) {
+			msg->msg_iov->iov_base = (char *)msg->msg_iov->iov_base + n;
+			msg->msg_iov->iov_len -= n;
+
+			res = dqlite__uring_send(c->uring, req, c->fd, msg);
+			if (res == 0) {
+				c->inflight++;
+				return;
+			}
+		}
+	}
+
+	if (res < 0) {
+		status = res;
+	} else {
+		status = msg->msg_iovlen > 0 ? UV_ECANCELED : 0;
+	}
+
+	/* The context was allocated from the arena of the response, which
+	 * might get reset and reused by the time this returns. */
+	dqlite__conn_write_done(c, ctx->response, status);
+
+	dqlite__conn_release(c);
+}
+#endif /* DQLITE_URING */
 
 /* Write out a response for the client */
 static int dqlite__conn_write(struct dqlite__conn *    c,
@@ -40,10 +172,19 @@ static int dqlite__conn_write(struct dqlite__conn *    c,
 	int                            err;
 	struct dqlite__conn_write_ctx *ctx;
 	uv_write_t *                   req;
-	uv_buf_t                       bufs[3];
+	uv_buf_t                       bufs[DQLITE__MESSAGE_MAX_BUFS];
+	unsigned                       n;
+
+#ifdef DQLITE_URING
+	if (c->uring != NULL) {
+		return dqlite__conn_send(c, response);
+	}
+#endif /* DQLITE_URING */
 
-	/* Create a write request UV handle */
-	req = (uv_write_t *)sqlite3_malloc(sizeof(*req) + sizeof(*ctx));
+	/* Create a write request UV handle, which lives until the response has
+	 * been flushed. */
+	req = dqlite__message_arena_alloc(&response->message,
+	                                  sizeof(*req) + sizeof(*ctx));
 	if (req == NULL) {
 		err = DQLITE_NOMEM;
 		dqlite__error_oom(&c->error,
@@ -58,7 +199,7 @@ static int dqlite__conn_write(struct dqlite__conn *    c,
 
 	req->data = (void *)ctx;
 
-	dqlite__message_send_start(&response->message, bufs);
+	n = dqlite__message_send_start(&response->message, bufs);
 
 	assert(bufs[0].base != NULL);
 	assert(bufs[0].len > 0);
@@ -66,10 +207,9 @@ static int dqlite__conn_write(struct dqlite__conn *    c,
 	assert(bufs[1].base != NULL);
 	assert(bufs[1].len > 0);
 
-	err = uv_write(req, &c->stream, bufs, 3, dqlite__conn_write_cb);
+	err = uv_write(req, &c->stream, bufs, n, dqlite__conn_write_cb);
 	if (err != 0) {
 		dqlite__message_send_reset(&response->message);
-		sqlite3_free(req);
 		dqlite__error_uv(&c->error, err, "failed to write response");
 		return err;
 	}
@@ -86,7 +226,11 @@ static int dqlite__conn_write_failure(struct dqlite__conn *c, int code)
 	assert(code != 0);
 
 	dqlite__debugf(
-	    c, "failure (fd=%d code=%d msg=%s)", c->fd, code, c->error);
+	    c,
+	    "failure (fd=%d code=%d msg=%s)",
+	    c->fd,
+	    code,
+	    dqlite__error_msg(&c->error));
 
 	/* TODO: allocate the response object dynamically, to allow for
 	 *       concurrent failures (e.g. the client issues a second failing
@@ -94,7 +238,7 @@ static int dqlite__conn_write_failure(struct dqlite__conn *c, int code)
 	 *       been completely written out. */
 	c->response.type            = DQLITE_RESPONSE_FAILURE;
 	c->response.failure.code    = code;
-	c->response.failure.message = c->error;
+	c->response.failure.message = dqlite__error_msg(&c->error);
 
 	err = dqlite__response_encode(&c->response);
 	if (err != 0) {
@@ -114,23 +258,124 @@ static int dqlite__conn_write_failure(struct dqlite__conn *c, int code)
 	return 0;
 }
 
+/* Resume reading requests after a pause. */
+static void dqlite__conn_read_resume(struct dqlite__conn *c)
+{
+	int err;
+
+#ifdef DQLITE_URING
+	char * backlog;
+	size_t len;
+
+	/* Process the data received in the meantime. */
+	if (c->uring != NULL) {
+		backlog = c->backlog;
+		len     = c->backlog_len;
+
+		c->paused      = 0;
+		c->backlog     = NULL;
+		c->backlog_len = 0;
+
+		if (backlog != NULL) {
+			dqlite__conn_feed(c, backlog, len);
+			sqlite3_free(backlog);
+		}
+
+		/* Re-arm the receive cancelled by dqlite__conn_read_stop, unless
+		 * the backlog paused reading again or its cancellation is still
+		 * in flight, in which case the final completion re-arms it. */
+		if (!c->paused && !c->aborting && !c->receiving) {
+			err = dqlite__conn_recv_start(c);
+			if (err != 0) {
+				dqlite__error_uv(
+				    &c->error, err, "failed to resume receiving");
+				dqlite__conn_abort(c);
+			}
+		}
+
+		return;
+	}
+#endif /* DQLITE_URING */
+
+	err = uv_read_start(
+	    &c->stream, dqlite__conn_alloc_cb, dqlite__conn_read_cb);
+	/* TODO: is it possible for uv_read_start to fail now?
+	 */
+	assert(err == 0);
+	(void)err;
+}
+
+/* Pause reading requests until the gateway can handle the next one. */
+static int dqlite__conn_read_stop(struct dqlite__conn *c)
+{
+	int err;
+
+#ifdef DQLITE_URING
+	/* Cancel the multishot receive, so unread data stays in the socket and
+	 * the client gets flow-controlled. Only the data already received
+	 * before the cancellation takes effect gets saved in the backlog. */
+	if (c->uring != NULL) {
+		if (c->receiving && !c->paused) {
+			err = dqlite__uring_cancel_req(c->uring, &c->recv);
+			if (err != 0) {
+				dqlite__error_uv(
+				    &c->error, err, "failed to pause reading");
+				return err;
+			}
+		}
+		c->paused = 1;
+		return 0;
+	}
+#endif /* DQLITE_URING */
+
+	err = uv_read_stop(&c->stream);
+	if (err != 0) {
+		dqlite__error_uv(&c->error, err, "failed to pause reading");
+		return err;
+	}
+	c->paused = 1;
+
+	return 0;
+}
+
 static void dqlite__conn_write_cb(uv_write_t *req, int status)
 {
 	struct dqlite__conn_write_ctx *ctx;
-	struct dqlite__conn *          c;
-	struct dqlite__response *      response;
 
 	assert(req != NULL);
 	assert(req->data != NULL);
 
 	ctx = (struct dqlite__conn_write_ctx *)req->data;
 
-	c        = ctx->conn;
-	response = ctx->response;
+	/* The request was allocated from the arena of the response, which
+	 * might get reset and reused by the time this returns. */
+	dqlite__conn_write_done(ctx->conn, ctx->response, status);
+}
+
+/* Return true if the request whose header was received can't be handled
+ * yet. */
+static int dqlite__conn_held(struct dqlite__conn *c)
+{
+	if (c->request.message.type != DQLITE_REQUEST_INTERRUPT) {
+		return 0;
+	}
 
+	return dqlite__gateway_ctx_for(&c->gateway, DQLITE_REQUEST_INTERRUPT) ==
+	       -1;
+}
+
+/* Complete a response write, either with libuv or with io_uring. */
+static void dqlite__conn_write_done(struct dqlite__conn *    c,
+                                    struct dqlite__response *response,
+                                    int                      status)
+{
 	assert(c != NULL);
 	assert(response != NULL);
 
+	if (c->metrics != NULL) {
+		DQLITE__METRICS_ADD(c->metrics, callbacks, 1);
+	}
+
 	dqlite__message_send_reset(&response->message);
 
 	/* From libuv docs about the uv_write_cb type: "status will be 0 in case
@@ -146,22 +391,23 @@ static void dqlite__conn_write_cb(uv_write_t *req, int status)
 		 * gateway that we're done */
 		if (response != &c->response) {
 			dqlite__gateway_flushed(&c->gateway, response);
+		} else {
+			dqlite__message_arena_reset(&response->message);
+		}
+
+		/* The request is done with its message, if it was parked. */
+		if (c->parked && !dqlite__gateway_parked(&c->gateway)) {
+			dqlite__message_recv_reset(&c->request.message);
+			c->parked = 0;
 		}
 
 		/* If we had paused reading requests and we're not shutting
-		 * down, let's resume. */
-		if (c->paused && !c->aborting) {
-			int err;
-			err = uv_read_start(&c->stream,
-			                    dqlite__conn_alloc_cb,
-			                    dqlite__conn_read_cb);
-			/* TODO: is it possible for uv_read_start to fail now?
-			 */
-			assert(err == 0);
+		 * down, let's resume, unless the next batch of rows holds back
+		 * an interrupt again. */
+		if (c->paused && !c->aborting && !dqlite__conn_held(c)) {
+			dqlite__conn_read_resume(c);
 		}
 	}
-
-	sqlite3_free(req);
 }
 
 /* Invoked by the gateway when a response for a request is ready to be flushed
@@ -192,8 +438,9 @@ static void dqlite__conn_flush_cb(void *arg, struct dqlite__response *response)
 
 	if (c->metrics != NULL) {
 		/* Update the metrics. */
-		c->metrics->requests++;
-		c->metrics->duration += uv_hrtime() - c->timestamp;
+		DQLITE__METRICS_ADD(c->metrics, requests, 1);
+		DQLITE__METRICS_ADD(
+		    c->metrics, duration, uv_hrtime() - c->timestamp);
 	}
 
 	return;
@@ -287,13 +534,27 @@ static int dqlite__conn_handshake_read_cb(void *arg)
 
 	c->protocol = dqlite__flip64(c->protocol);
 
-	if (c->protocol != DQLITE_PROTOCOL_VERSION) {
+	if (c->protocol != DQLITE_PROTOCOL_VERSION &&
+	    c->protocol != DQLITE_PROTOCOL_VERSION_COMPACT_ROWS) {
 		err = DQLITE_PROTO;
 		dqlite__error_printf(
 		    &c->error, "unknown protocol version: %lx", c->protocol);
 		return err;
 	}
 
+	c->gateway.protocol = c->protocol;
+
+	/* Replaying the requests needs the same protocol version. */
+	if (c->capture != NULL) {
+		err = dqlite__capture_handshake(
+		    c->capture, c->capture_id, c->protocol);
+		if (err != 0) {
+			dqlite__errorf(c,
+			               "capture stopped (msg=%s)",
+			               dqlite__error_msg(&c->capture->error));
+		}
+	}
+
 	return 0;
 }
 
@@ -358,13 +619,10 @@ static int dqlite__conn_header_read_cb(void *arg)
 	 * throttle the client. */
 	ctx = dqlite__gateway_ctx_for(&c->gateway, c->request.message.type);
 	if (ctx == -1) {
-		err = uv_read_stop(&c->stream);
+		err = dqlite__conn_read_stop(c);
 		if (err != 0) {
-			dqlite__error_uv(
-			    &c->error, err, "failed to pause reading");
 			return err;
 		}
-		c->paused = 1;
 	}
 
 	return 0;
@@ -398,15 +656,81 @@ static int dqlite__conn_body_alloc_cb(void *arg)
 	return 0;
 }
 
+/* Hand the decoded request to the gateway. */
+static int dqlite__conn_handle(struct dqlite__conn *c)
+{
+	int err;
+
+	err = dqlite__gateway_handle(&c->gateway, &c->request);
+	if (err != 0) {
+		dqlite__error_wrapf(
+		    &c->error, &c->gateway.error, "failed to handle request");
+
+		err = dqlite__conn_write_failure(c, err);
+		if (err != 0) {
+			return err;
+		}
+
+		return 0;
+	}
+
+	/* A request waiting for a raft barrier will be run again, so its
+	 * message can't be reset nor overwritten by the next one until its
+	 * response gets written. */
+	if (dqlite__gateway_parked(&c->gateway)) {
+		c->parked = 1;
+		return dqlite__conn_read_stop(c);
+	}
+
+	dqlite__message_recv_reset(&c->request.message);
+
+	return 0;
+}
+
+/* Handle a throttled request once its delay has expired. Reading resumes when
+ * its response has been written. */
+static void dqlite__conn_throttle_cb(uv_timer_t *throttle)
+{
+	struct dqlite__conn *c;
+	int                  err;
+
+	assert(throttle != NULL);
+
+	c = (struct dqlite__conn *)throttle->data;
+
+	assert(c != NULL);
+
+	if (c->metrics != NULL) {
+		DQLITE__METRICS_ADD(c->metrics, callbacks, 1);
+	}
+
+	err = dqlite__conn_handle(c);
+	if (err != 0) {
+		dqlite__conn_abort(c);
+	}
+}
+
 static int dqlite__conn_body_read_cb(void *arg)
 {
 	int                  err;
 	struct dqlite__conn *c;
+	uint64_t             delay;
 
 	assert(arg != NULL);
 
 	c = (struct dqlite__conn *)arg;
 
+	/* A failing capture doesn't affect the client, it just stops. */
+	if (c->capture != NULL) {
+		err = dqlite__capture_record(
+		    c->capture, c->capture_id, &c->request.message);
+		if (err != 0) {
+			dqlite__errorf(c,
+			               "capture stopped (msg=%s)",
+			               dqlite__error_msg(&c->capture->error));
+		}
+	}
+
 	err = dqlite__request_decode(&c->request);
 	if (err != 0) {
 		dqlite__error_wrapf(
@@ -416,16 +740,27 @@ static int dqlite__conn_body_read_cb(void *arg)
 
 	c->request.timestamp = uv_now(c->loop);
 
-	err = dqlite__gateway_handle(&c->gateway, &c->request);
-	if (err != 0) {
-		dqlite__error_wrapf(
-		    &c->error, &c->gateway.error, "failed to handle request");
-		goto request_failure;
-	}
+	/* If the WAL is growing faster than it can be checkpointed, hold the
+	 * write back for a while, without reading further requests. */
+	delay = dqlite__gateway_throttle(&c->gateway, &c->request);
+	if (delay > 0) {
+		err = dqlite__conn_read_stop(c);
+		if (err != 0) {
+			return err;
+		}
 
-	dqlite__message_recv_reset(&c->request.message);
+		err = uv_timer_start(
+		    &c->throttle, dqlite__conn_throttle_cb, delay, 0);
+		if (err != 0) {
+			dqlite__error_uv(
+			    &c->error, err, "failed to start throttle timer");
+			return err;
+		}
 
-	return 0;
+		return 0;
+	}
+
+	return dqlite__conn_handle(c);
 
 request_failure:
 	assert(err != 0);
@@ -520,6 +855,10 @@ static void dqlite__conn_read_cb(uv_stream_t *   stream,
 
 	assert(c != NULL);
 
+	if (c->metrics != NULL) {
+		DQLITE__METRICS_ADD(c->metrics, callbacks, 1);
+	}
+
 	if (nread > 0) {
 		size_t n = (size_t)nread;
 
@@ -570,13 +909,146 @@ out:
 	return;
 }
 
-void dqlite__conn_init(struct dqlite__conn *   c,
-                       int                     fd,
-                       dqlite_logger *         logger,
-                       dqlite_cluster *        cluster,
-                       uv_loop_t *             loop,
-                       struct dqlite__options *options,
-                       struct dqlite__metrics *metrics)
+#ifdef DQLITE_URING
+/* Feed data received by the io_uring backend to the read state machine, just
+ * like libuv does with data read from the stream. If reading gets paused, the
+ * rest of the data is saved in the backlog. */
+static void dqlite__conn_feed(struct dqlite__conn *c,
+                              const char *         data,
+                              size_t               len)
+{
+	uv_buf_t buf;
+	char *   backlog;
+	size_t   n;
+
+	while (len > 0 && !c->aborting) {
+		if (c->paused) {
+			backlog =
+			    sqlite3_realloc(c->backlog, c->backlog_len + len);
+			if (backlog == NULL) {
+				dqlite__error_oom(&c->error,
+				                  "failed to save received data");
+				dqlite__conn_abort(c);
+				return;
+			}
+
+			memcpy(backlog + c->backlog_len, data, len);
+
+			c->backlog = backlog;
+			c->backlog_len += len;
+
+			return;
+		}
+
+		dqlite__conn_alloc_cb((uv_handle_t *)&c->stream, len, &buf);
+		if (c->aborting) {
+			return;
+		}
+
+		n = buf.len < len ? buf.len : len;
+		memcpy(buf.base, data, n);
+
+		dqlite__conn_read_cb(&c->stream, (ssize_t)n, &buf);
+
+		data += n;
+		len -= n;
+	}
+}
+
+/* Invoked when data is received from the client, or when receiving stops. */
+static void dqlite__conn_recv_cb(struct dqlite__uring_req *req,
+                                 int                       res,
+                                 const char *              buf,
+                                 int                       more)
+{
+	struct dqlite__conn *c;
+	int                  err;
+
+	assert(req != NULL);
+	assert(req->data != NULL);
+
+	c = (struct dqlite__conn *)req->data;
+
+	if (!more) {
+		assert(c->inflight > 0);
+		c->inflight--;
+		c->receiving = 0;
+	}
+
+	if (c->aborting) {
+		goto out;
+	}
+
+	if (res > 0) {
+		assert(buf != NULL);
+		dqlite__conn_feed(c, buf, (size_t)res);
+	} else if (res == 0) {
+		dqlite__error_uv(&c->error, UV_EOF, "read error");
+		goto abort;
+	} else if (res != -ENOBUFS && res != -ECANCELED) {
+		dqlite__error_uv(&c->error, res, "read error");
+		goto abort;
+	}
+
+	/* The kernel stops a multishot receive for instance when it runs out
+	 * of provided buffers, so start a new one, unless reading is paused,
+	 * in which case dqlite__conn_read_resume will. */
+	if (!more && !c->aborting && !c->paused) {
+		err = dqlite__conn_recv_start(c);
+		if (err != 0) {
+			dqlite__error_uv(&c->error, err, "failed to receive");
+			goto abort;
+		}
+	}
+
+	goto out;
+
+abort:
+	dqlite__conn_abort(c);
+out:
+	dqlite__conn_release(c);
+}
+
+/* Arm the multishot receive request. */
+static int dqlite__conn_recv_start(struct dqlite__conn *c)
+{
+	int err;
+
+	err = dqlite__uring_recv(c->uring, &c->recv, c->fd);
+	if (err != 0) {
+		return err;
+	}
+
+	c->inflight++;
+	c->receiving = 1;
+
+	return 0;
+}
+
+/* Release the connection if its stream is closed and no request owned by the
+ * ring references it anymore. */
+static void dqlite__conn_release(struct dqlite__conn *c)
+{
+	if (c->closed && c->inflight == 0) {
+		dqlite__conn_close(c);
+		sqlite3_free(c);
+	}
+}
+#endif /* DQLITE_URING */
+
+void dqlite__conn_init(struct dqlite__conn *          c,
+                       int                            fd,
+                       dqlite_logger *                logger,
+                       dqlite_cluster *               cluster,
+                       uv_loop_t *                    loop,
+                       struct dqlite__options *       options,
+                       struct dqlite__metrics *       metrics,
+                       struct dqlite__db_pool *       pool,
+                       struct dqlite__advisor *       advisor,
+                       struct dqlite__uring *         uring,
+                       struct dqlite__message_pool *  bufs,
+                       struct dqlite__coroutine_pool *coroutines,
+                       struct dqlite__capture *       capture)
 {
 	struct dqlite__gateway_cbs callbacks;
 
@@ -587,6 +1059,7 @@ void dqlite__conn_init(struct dqlite__conn *   c,
 
 	callbacks.ctx    = c;
 	callbacks.xFlush = dqlite__conn_flush_cb;
+	callbacks.xRow   = NULL;
 
 	/* The tcp and pipe handle structures are pointing to the same memory
 	 * location as the abstract stream handle. */
@@ -608,9 +1081,21 @@ void dqlite__conn_init(struct dqlite__conn *   c,
 	                 dqlite__conn_events,
 	                 dqlite__transitions);
 	dqlite__request_init(&c->request);
-
-	dqlite__gateway_init(&c->gateway, &callbacks, cluster, logger, options);
+	c->request.message.pool = bufs;
+
+	dqlite__gateway_init(&c->gateway,
+	                     &callbacks,
+	                     cluster,
+	                     logger,
+	                     options,
+	                     metrics,
+	                     pool,
+	                     advisor,
+	                     bufs);
 	dqlite__response_init(&c->response);
+	c->response.message.pool = bufs;
+
+	c->coroutines = coroutines;
 
 	c->fd   = fd;
 	c->loop = loop;
@@ -620,12 +1105,30 @@ void dqlite__conn_init(struct dqlite__conn *   c,
 
 	c->aborting = 0;
 	c->paused   = 0;
+	c->parked   = 0;
+
+	c->uring       = uring;
+	c->backlog     = NULL;
+	c->backlog_len = 0;
+	c->inflight    = 0;
+	c->receiving   = 0;
+	c->closed      = 0;
+
+	c->capture    = capture;
+	c->capture_id = 0;
+	if (capture != NULL) {
+		c->capture_id = dqlite__capture_conn(capture);
+	}
 }
 
 void dqlite__conn_close(struct dqlite__conn *c)
 {
 	assert(c != NULL);
 
+	if (c->backlog != NULL) {
+		sqlite3_free(c->backlog);
+	}
+
 	dqlite__response_close(&c->response);
 	dqlite__gateway_close(&c->gateway);
 	dqlite__fsm_close(&c->fsm);
@@ -644,10 +1147,10 @@ int dqlite__conn_start(struct dqlite__conn *c)
 
 #ifdef DQLITE_EXPERIMENTAL
 	/* Start the gateway */
-	err = dqlite__gateway_start(&c->gateway, uv_now(c->loop));
+	err = dqlite__gateway_start(
+	    &c->gateway, uv_now(c->loop), c->coroutines);
 	if (err != 0) {
-		dqlite__error_uv(
-		    &c->error, err, "failed to start gateway coroutine");
+		dqlite__error_uv(&c->error, err, "failed to start gateway");
 		goto err;
 	}
 #else
@@ -659,11 +1162,20 @@ int dqlite__conn_start(struct dqlite__conn *c)
 	heartbeat_timeout = c->options->heartbeat_timeout;
 	assert(heartbeat_timeout > 0);
 
+	err = uv_timer_init(c->loop, &c->throttle);
+	if (err != 0) {
+		dqlite__error_uv(
+		    &c->error, err, "failed to init throttle timer");
+		err = DQLITE_ERROR;
+		goto err;
+	}
+	c->throttle.data = (void *)c;
+
 	err = uv_timer_init(c->loop, &c->alive);
 	if (err != 0) {
 		dqlite__error_uv(&c->error, err, "failed to init alive timer");
 		err = DQLITE_ERROR;
-		goto err;
+		goto err_after_throttle_init;
 	}
 	c->alive.data = (void *)c;
 
@@ -674,7 +1186,7 @@ int dqlite__conn_start(struct dqlite__conn *c)
 	if (err != 0) {
 		dqlite__error_uv(&c->error, err, "failed to init alive timer");
 		err = DQLITE_ERROR;
-		goto err;
+		goto err_after_timer_start;
 	}
 
 	/* Start reading from the stream. */
@@ -696,6 +1208,24 @@ int dqlite__conn_start(struct dqlite__conn *c)
 			goto err_after_timer_start;
 		}
 
+		/* Have the kernel poll the device queue when the socket has no
+		 * data, instead of waiting for an interrupt. Going beyond the
+		 * net.core.busy_read sysctl requires CAP_NET_ADMIN, so this is
+		 * best effort. */
+		if (c->options->busy_poll > 0) {
+			int usecs = (int)c->options->busy_poll;
+			if (setsockopt(c->fd,
+			               SOL_SOCKET,
+			               SO_BUSY_POLL,
+			               &usecs,
+			               sizeof usecs) != 0) {
+				dqlite__debugf(c,
+				               "no busy poll (fd=%d errno=%d)",
+				               c->fd,
+				               errno);
+			}
+		}
+
 		break;
 
 	case UV_NAMED_PIPE:
@@ -718,13 +1248,32 @@ int dqlite__conn_start(struct dqlite__conn *c)
 		break;
 
 	default:
-		dqlite__error_printf(&c->error, "unsupported stream type");
+		dqlite__error_static(&c->error, "unsupported stream type");
 		err = DQLITE_ERROR;
 		goto err_after_timer_start;
 	}
 
 	c->stream.data = (void *)c;
 
+#ifdef DQLITE_URING
+	/* The stream handle still owns the socket, but the ring takes care of
+	 * all I/O on it. */
+	if (c->uring != NULL) {
+		c->recv.data = (void *)c;
+		c->recv.cb   = dqlite__conn_recv_cb;
+
+		err = dqlite__conn_recv_start(c);
+		if (err != 0) {
+			dqlite__error_uv(
+			    &c->error, err, "failed to start receiving");
+			err = DQLITE_ERROR;
+			goto err_after_stream_open;
+		}
+
+		return 0;
+	}
+#endif /* DQLITE_URING */
+
 	err = uv_read_start(
 	    &c->stream, dqlite__conn_alloc_cb, dqlite__conn_read_cb);
 	if (err != 0) {
@@ -742,6 +1291,9 @@ err_after_stream_open:
 err_after_timer_start:
 	uv_close((uv_handle_t *)(&c->alive), NULL);
 
+err_after_throttle_init:
+	uv_close((uv_handle_t *)(&c->throttle), NULL);
+
 err:
 	assert(err != 0);
 	return err;
@@ -755,6 +1307,15 @@ static void dqlite__conn_stream_close_cb(uv_handle_t *handle)
 
 	c = handle->data;
 
+#ifdef DQLITE_URING
+	/* Requests still owned by the ring reference the connection, the last
+	 * one to complete releases it. */
+	c->closed = 1;
+	if (c->inflight > 0) {
+		return;
+	}
+#endif /* DQLITE_URING */
+
 	dqlite__conn_close(c);
 	sqlite3_free(c);
 }
@@ -796,8 +1357,11 @@ void dqlite__conn_abort(struct dqlite__conn *c)
 
 #ifdef DQLITE_DEBUG
 	/* In debug mode always log disconnections. */
-	dqlite__debugf(
-	    c, "aborting (fd=%d state=%s msg=%s)", c->fd, state, c->error);
+	dqlite__debugf(c,
+	               "aborting (fd=%d state=%s msg=%s)",
+	               c->fd,
+	               state,
+	               dqlite__error_msg(&c->error));
 #else
 	/* If the error is not due to a client disconnection, log an error
 	 * message */
@@ -806,9 +1370,27 @@ void dqlite__conn_abort(struct dqlite__conn *c)
 		               "aborting (fd=%d state=%s msg=%s)",
 		               c->fd,
 		               state,
-		               c->error);
+		               dqlite__error_msg(&c->error));
 	}
 #endif
 
+#ifdef DQLITE_URING
+	/* Cancel outstanding requests right away, since the socket gets closed
+	 * along with the stream. */
+	if (c->uring != NULL && c->inflight > 0) {
+		int err;
+		err = dqlite__uring_cancel(c->uring, c->fd);
+		if (err != 0) {
+			dqlite__errorf(c,
+			               "failed to cancel requests (fd=%d err=%d)",
+			               c->fd,
+			               err);
+		}
+	}
+#endif /* DQLITE_URING */
+
+	/* The connection is released only once the stream is closed, which
+	 * happens in a later loop iteration than the closing of the timers. */
+	uv_close((uv_handle_t *)(&c->throttle), NULL);
 	uv_close((uv_handle_t *)(&c->alive), dqlite__conn_timer_close_cb);
 }
@@ -7,12 +7,15 @@
 
 #include "../include/dqlite.h"
 
+#include "capture.h"
+#include "coroutine.h"
 #include "error.h"
 #include "fsm.h"
 #include "gateway.h"
 #include "metrics.h"
 #include "options.h"
 #include "request.h"
+#include "uring.h"
 
 /* The size of pre-allocated read buffer for holding the payload of incoming
  * requests. This should generally fit in a single IP packet, given typical MTU
@@ -47,22 +50,46 @@ struct dqlite__conn {
 		uv_pipe_t   pipe;
 		uv_stream_t stream;
 	};                /* UV stream handle */
-	uv_timer_t alive; /* Check that the client is still alive */
-	uv_buf_t   buf;   /* Read buffer */
+	uv_timer_t alive;    /* Check that the client is still alive */
+	uv_timer_t throttle; /* Delay a write while the WAL is too large */
+	uv_buf_t   buf;      /* Read buffer */
 
 	uint64_t timestamp; /* Time at which the current request started. */
 	int      aborting;  /* True if we started to abort the connetion */
 	int      paused;    /* True if we have paused reading from the stream */
+	int      parked;    /* True if the gateway still needs the request */
+
+	/* Coroutines to run database requests in (experimental) */
+	struct dqlite__coroutine_pool *coroutines;
+
+	/* io_uring backend */
+	struct dqlite__uring *   uring;       /* Ring to use, or NULL for libuv */
+	struct dqlite__uring_req recv;        /* Multishot receive request */
+	char *                   backlog;     /* Data received while paused */
+	size_t                   backlog_len; /* Length of the backlog */
+	unsigned                 inflight;    /* Requests owned by the ring */
+	int                      receiving;   /* True if recv is armed */
+	int                      closed;      /* True if the stream is closed */
+
+	/* Request capture */
+	struct dqlite__capture *capture;    /* Capture to record to, or NULL */
+	uint32_t                capture_id; /* ID of this connection in it */
 };
 
 /* Initialize a connection object */
-void dqlite__conn_init(struct dqlite__conn *   c,
-                       int                     fd,
-                       dqlite_logger *         logger,
-                       dqlite_cluster *        cluster,
-                       uv_loop_t *             loop,
-                       struct dqlite__options *options,
-                       struct dqlite__metrics *metrics);
+void dqlite__conn_init(struct dqlite__conn *          c,
+                       int                            fd,
+                       dqlite_logger *                logger,
+                       dqlite_cluster *               cluster,
+                       uv_loop_t *                    loop,
+                       struct dqlite__options *       options,
+                       struct dqlite__metrics *       metrics,
+                       struct dqlite__db_pool *       pool,
+                       struct dqlite__advisor *       advisor,
+                       struct dqlite__uring *         uring,
+                       struct dqlite__message_pool *  bufs,
+                       struct dqlite__coroutine_pool *coroutines,
+                       struct dqlite__capture *       capture);
 
 /* Close a connection object, releasing all associated resources. */
 void dqlite__conn_close(struct dqlite__conn *c);
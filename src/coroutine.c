@@ -0,0 +1,206 @@
+#ifdef DQLITE_EXPERIMENTAL
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef DQLITE_CO_DERIVE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* DQLITE_CO_DERIVE */
+
+#include <libco.h>
+#include <sqlite3.h>
+
+#include "coroutine.h"
+#include "lifecycle.h"
+
+/* Coroutine being switched to by dqlite__coroutine_run, used to pass it to the
+ * entry point of coroutines that haven't run yet. Loops of different servers
+ * may run in different threads, hence the thread-local storage. */
+static __thread struct dqlite__coroutine *dqlite__coroutine_arg;
+
+/* Entry point of all coroutines. A coroutine never returns from here, and
+ * rather switches back to its caller after each run, ready for the next
+ * one. */
+static void dqlite__coroutine_main()
+{
+	struct dqlite__coroutine *c = dqlite__coroutine_arg;
+
+	while (1) {
+		assert(c->fn != NULL);
+
+		c->fn(c->arg);
+		c->fn = NULL;
+
+		co_switch(c->caller);
+	}
+}
+
+static struct dqlite__coroutine *dqlite__coroutine_create(size_t stack_size)
+{
+	struct dqlite__coroutine *c;
+#ifdef DQLITE_CO_DERIVE
+	size_t page;
+#endif /* DQLITE_CO_DERIVE */
+
+	c = sqlite3_malloc(sizeof *c);
+	if (c == NULL) {
+		return NULL;
+	}
+
+	c->caller = NULL;
+	c->fn     = NULL;
+	c->arg    = NULL;
+	c->next   = NULL;
+
+#ifdef DQLITE_CO_DERIVE
+	/* Map the stack with an inaccessible page right below it, since stacks
+	 * grow downwards. */
+	page    = (size_t)sysconf(_SC_PAGESIZE);
+	c->size = (stack_size + page - 1) / page * page + page;
+
+	c->memory = mmap(NULL,
+	                 c->size,
+	                 PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS,
+	                 -1,
+	                 0);
+	if (c->memory == MAP_FAILED) {
+		goto err_after_malloc;
+	}
+
+	if (mprotect(c->memory, page, PROT_NONE) != 0) {
+		goto err_after_stack;
+	}
+
+	c->thread = co_derive((char *)c->memory + page,
+	                      (unsigned)(c->size - page),
+	                      dqlite__coroutine_main);
+#else
+	c->memory = NULL;
+	c->size   = 0;
+	c->thread = co_create((unsigned)stack_size, dqlite__coroutine_main);
+#endif /* DQLITE_CO_DERIVE */
+
+	if (c->thread == NULL) {
+		goto err_after_stack;
+	}
+
+	return c;
+
+err_after_stack:
+#ifdef DQLITE_CO_DERIVE
+	munmap(c->memory, c->size);
+
+err_after_malloc:
+#endif /* DQLITE_CO_DERIVE */
+	sqlite3_free(c);
+
+	return NULL;
+}
+
+static void dqlite__coroutine_destroy(struct dqlite__coroutine *c)
+{
+#ifdef DQLITE_CO_DERIVE
+	munmap(c->memory, c->size);
+#else
+	co_delete(c->thread);
+#endif /* DQLITE_CO_DERIVE */
+
+	sqlite3_free(c);
+}
+
+void dqlite__coroutine_pool_init(struct dqlite__coroutine_pool *p,
+                                 size_t                         stack_size,
+                                 unsigned                       cap)
+{
+	assert(p != NULL);
+	assert(stack_size >= DQLITE__COROUTINE_MIN_STACK_SIZE);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_COROUTINE_POOL);
+
+	p->stack_size = stack_size;
+	p->idle       = NULL;
+	p->len        = 0;
+	p->cap        = cap;
+}
+
+void dqlite__coroutine_pool_close(struct dqlite__coroutine_pool *p)
+{
+	struct dqlite__coroutine *c;
+
+	assert(p != NULL);
+
+	while (p->idle != NULL) {
+		c       = p->idle;
+		p->idle = c->next;
+		dqlite__coroutine_destroy(c);
+	}
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_COROUTINE_POOL);
+}
+
+struct dqlite__coroutine *dqlite__coroutine_get(
+    struct dqlite__coroutine_pool *p)
+{
+	struct dqlite__coroutine *c;
+
+	if (p == NULL) {
+		return dqlite__coroutine_create(DQLITE__COROUTINE_STACK_SIZE);
+	}
+
+	if (p->idle == NULL) {
+		return dqlite__coroutine_create(p->stack_size);
+	}
+
+	c       = p->idle;
+	p->idle = c->next;
+	p->len--;
+
+	c->next = NULL;
+
+	return c;
+}
+
+void dqlite__coroutine_put(struct dqlite__coroutine_pool *p,
+                           struct dqlite__coroutine *     c)
+{
+	assert(c != NULL);
+
+	if (p == NULL || p->len == p->cap || dqlite__coroutine_running(c)) {
+		dqlite__coroutine_destroy(c);
+		return;
+	}
+
+	c->caller = NULL;
+	c->arg    = NULL;
+	c->next   = p->idle;
+	p->idle   = c;
+	p->len++;
+}
+
+void dqlite__coroutine_run(struct dqlite__coroutine *c,
+                           dqlite__coroutine_fn      fn,
+                           void *                    arg)
+{
+	assert(c != NULL);
+	assert(fn != NULL);
+	assert(!dqlite__coroutine_running(c));
+
+	c->caller = co_active();
+	c->fn     = fn;
+	c->arg    = arg;
+
+	dqlite__coroutine_arg = c;
+
+	co_switch(c->thread);
+}
+
+int dqlite__coroutine_running(struct dqlite__coroutine *c)
+{
+	assert(c != NULL);
+
+	return c->fn != NULL;
+}
+
+#endif /* DQLITE_EXPERIMENTAL */
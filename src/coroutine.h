@@ -0,0 +1,92 @@
+/******************************************************************************
+ *
+ * Pool of coroutines running gateway requests.
+ *
+ * A coroutine is bound to a gateway only while one of its database requests
+ * is in flight, and handed back to the pool as soon as the request completes,
+ * so idle connections don't hold any stack. Stacks are sized by the
+ * DQLITE_CONFIG_COROUTINE_STACK option and, when libco supports running on
+ * caller-provided memory, mapped with a guard page below them, so an overflow
+ * faults instead of silently corrupting the heap.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_COROUTINE_H
+#define DQLITE_COROUTINE_H
+
+/* Pools are passed around by pointer even by non-experimental builds, which
+ * just ignore them. */
+struct dqlite__coroutine_pool;
+
+/* Smallest accepted stack size. */
+#define DQLITE__COROUTINE_MIN_STACK_SIZE (16 * 1024)
+
+#ifdef DQLITE_EXPERIMENTAL
+
+#include <stddef.h>
+
+#include <libco.h>
+
+/* Maximum number of idle coroutines kept by a pool. */
+#define DQLITE__COROUTINE_POOL_CAP 64
+
+/* Stack size used when no pool is given. */
+#define DQLITE__COROUTINE_STACK_SIZE (256 * 1024)
+
+/* Function run by a coroutine. */
+typedef void (*dqlite__coroutine_fn)(void *arg);
+
+/* A coroutine along with its stack. */
+struct dqlite__coroutine {
+	/* read-only */
+	cothread_t caller; /* Coroutine that started the current run */
+
+	/* private */
+	cothread_t                thread; /* libco handle */
+	void *                    memory; /* Stack mapping, or NULL */
+	size_t                    size;   /* Size of the stack mapping */
+	dqlite__coroutine_fn      fn;     /* Function being run, or NULL */
+	void *                    arg;    /* Argument of fn */
+	struct dqlite__coroutine *next;   /* Next idle coroutine in the pool */
+};
+
+/* Idle coroutines shared by all gateways served by the same loop. */
+struct dqlite__coroutine_pool {
+	size_t                    stack_size; /* Stack size of new coroutines */
+	struct dqlite__coroutine *idle;       /* Idle coroutines */
+	unsigned                  len;        /* Number of idle coroutines */
+	unsigned                  cap;        /* Maximum number of idle ones */
+};
+
+void dqlite__coroutine_pool_init(struct dqlite__coroutine_pool *p,
+                                 size_t                         stack_size,
+                                 unsigned                       cap);
+
+void dqlite__coroutine_pool_close(struct dqlite__coroutine_pool *p);
+
+/* Take an idle coroutine from the pool, or create a new one if the pool is
+ * empty or NULL. Return NULL if out of memory. */
+struct dqlite__coroutine *dqlite__coroutine_get(
+    struct dqlite__coroutine_pool *p);
+
+/* Hand a coroutine back to the pool, or destroy it if the pool is full or
+ * NULL. A coroutine which is still in the middle of a run can't be reused and
+ * always gets destroyed. */
+void dqlite__coroutine_put(struct dqlite__coroutine_pool *p,
+                           struct dqlite__coroutine *     c);
+
+/* Switch to the given coroutine and have it call fn(arg).
+ *
+ * This returns as soon as fn either returns or yields by switching back to
+ * c->caller. In the latter case the run can be resumed later with
+ * co_switch(c->thread). */
+void dqlite__coroutine_run(struct dqlite__coroutine *c,
+                           dqlite__coroutine_fn      fn,
+                           void *                    arg);
+
+/* Return true if the coroutine is in the middle of a run. */
+int dqlite__coroutine_running(struct dqlite__coroutine *c);
+
+#endif /* DQLITE_EXPERIMENTAL */
+
+#endif /* DQLITE_COROUTINE_H */
@@ -1,5 +1,7 @@
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <sqlite3.h>
 
@@ -9,6 +11,7 @@
 #include "lifecycle.h"
 #include "registry.h"
 #include "stmt.h"
+#include "vfs.h"
 
 /* Default name of the registered sqlite3_vfs implementation to use when opening
  * new connections. */
@@ -18,6 +21,107 @@
  * to switch new connections to leader replication mode. */
 #define DQLITE__DB_DEFAULT_WAL_REPLICATION "dqlite"
 
+/* Memory-mapped I/O limit to use for new connections. The volatile VFS serves
+ * mapped pages straight from its own memory, so SQLite doesn't need to keep a
+ * second copy of each page it reads in the page cache. SQLite will clamp this
+ * value to its compile-time SQLITE_MAX_MMAP_SIZE. */
+#define DQLITE__DB_MMAP_SIZE 2147418112
+
+/* Maximum number of free pages released by a single maintenance step. */
+#define DQLITE__DB_VACUUM_SLICE 64
+
+/* Pragmas that take an argument without changing the state of the connection,
+ * so they don't prevent it from being pooled. */
+static const char *dqlite__db_pragmas[] = {
+    "foreign_key_check",
+    "foreign_key_list",
+    "incremental_vacuum",
+    "index_info",
+    "index_list",
+    "index_xinfo",
+    "integrity_check",
+    "quick_check",
+    "table_info",
+    "table_xinfo",
+    NULL,
+};
+
+/* Authorizer callback flagging the connection as tainted when a statement
+ * touching per-connection state gets prepared. Nothing is ever denied. */
+static int dqlite__db_authorize(void *      arg,
+                                int         action,
+                                const char *arg1,
+                                const char *arg2,
+                                const char *schema,
+                                const char *trigger)
+{
+	struct dqlite__db *db = arg;
+	int                i;
+
+	(void)schema;
+	(void)trigger;
+
+	switch (action) {
+	case SQLITE_PRAGMA:
+		/* Pragmas without an argument only read settings. */
+		if (arg2 == NULL) {
+			break;
+		}
+		for (i = 0; dqlite__db_pragmas[i] != NULL; i++) {
+			if (sqlite3_stricmp(arg1, dqlite__db_pragmas[i]) == 0) {
+				break;
+			}
+		}
+		if (dqlite__db_pragmas[i] == NULL) {
+			db->tainted = 1;
+		}
+		break;
+	case SQLITE_ATTACH:
+	case SQLITE_DETACH:
+	case SQLITE_CREATE_TEMP_INDEX:
+	case SQLITE_CREATE_TEMP_TABLE:
+	case SQLITE_CREATE_TEMP_TRIGGER:
+	case SQLITE_CREATE_TEMP_VIEW:
+		db->tainted = 1;
+		break;
+	}
+
+	return SQLITE_OK;
+}
+
+/* Finalize all statements kept in the cache. */
+static void dqlite__db_cache_clear(struct dqlite__db *db)
+{
+	unsigned i;
+
+	for (i = 0; i < db->cached; i++) {
+		sqlite3_finalize(db->cache[i]);
+	}
+
+	db->cached = 0;
+}
+
+/* Take the cached statement prepared from the given SQL text out of the cache,
+ * if any. */
+static sqlite3_stmt *dqlite__db_cache_take(struct dqlite__db *db,
+                                           const char *       sql)
+{
+	sqlite3_stmt *stmt;
+	unsigned      i;
+
+	for (i = 0; i < db->cached; i++) {
+		stmt = db->cache[i];
+		if (strcmp(sqlite3_sql(stmt), sql) != 0) {
+			continue;
+		}
+		db->cached--;
+		db->cache[i] = db->cache[db->cached];
+		return stmt;
+	}
+
+	return NULL;
+}
+
 /* Wrapper around sqlite3_exec that frees the memory allocated for the error
  * message in case of failure and sets the dqlite__db's error field
  * appropriately */
@@ -33,7 +137,7 @@ static int dqlite__db_exec(struct dqlite__db *db, const char *sql)
 
 		assert(msg != NULL);
 		sqlite3_free(msg);
-		dqlite__error_printf(&db->error, sqlite3_errmsg(db->db));
+		dqlite__error_sqlite(&db->error, db->db);
 
 		return rc;
 	}
@@ -46,6 +150,18 @@ void dqlite__db_init(struct dqlite__db *db)
 	assert(db != NULL);
 
 	db->cluster = NULL;
+	db->async   = NULL;
+	db->db      = NULL;
+	db->name    = NULL;
+	db->flags   = 0;
+
+	db->maintenance = DQLITE__DB_MAINTAIN_DONE;
+	db->clock       = 0;
+	db->maintained  = 0;
+	db->tainted     = 0;
+	db->cached      = 0;
+	db->wait        = NULL;
+	db->barrier     = DQLITE__DB_BARRIER_NONE;
 
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_DB);
 	dqlite__error_init(&db->error);
@@ -58,7 +174,14 @@ void dqlite__db_close(struct dqlite__db *db)
 
 	assert(db != NULL);
 
+	/* A maintenance call still in progress will find nobody to notify. */
+	if (db->wait != NULL) {
+		db->wait->db = NULL;
+		db->wait     = NULL;
+	}
+
 	dqlite__stmt_registry_close(&db->stmts);
+	dqlite__db_cache_clear(db);
 	dqlite__error_close(&db->error);
 
 	if (db->db != NULL) {
@@ -77,6 +200,10 @@ void dqlite__db_close(struct dqlite__db *db)
 		db->db = NULL;
 	}
 
+	if (db->name != NULL) {
+		sqlite3_free(db->name);
+	}
+
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_DB);
 }
 
@@ -92,7 +219,8 @@ int dqlite__db_open(struct dqlite__db *db,
                     int                flags,
                     const char *       vfs,
                     uint16_t           page_size,
-                    const char *       wal_replication)
+                    const char *       wal_replication,
+                    int                vacuum)
 {
 	char pragma[255];
 	int  rc;
@@ -109,18 +237,28 @@ int dqlite__db_open(struct dqlite__db *db,
 		wal_replication = DQLITE__DB_DEFAULT_WAL_REPLICATION;
 	}
 
+	/* Save the name and flags, so the database can be pooled and matched
+	 * against subsequent open requests. */
+	db->name = sqlite3_malloc(strlen(name) + 1);
+	if (db->name == NULL) {
+		dqlite__error_oom(&db->error, "unable to copy database name");
+		return SQLITE_NOMEM;
+	}
+	strcpy(db->name, name);
+	db->flags = flags;
+
 	/* TODO: do some validation of the name (e.g. can't begin with a slash)
 	 */
 	rc = sqlite3_open_v2(name, &db->db, flags, vfs);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&db->error, sqlite3_errmsg(db->db));
+		dqlite__error_sqlite(&db->error, db->db);
 		return rc;
 	}
 
 	/* Enable extended result codes */
 	rc = sqlite3_extended_result_codes(db->db, 1);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&db->error, sqlite3_errmsg(db->db));
+		dqlite__error_sqlite(&db->error, db->db);
 		return rc;
 	}
 
@@ -133,6 +271,18 @@ int dqlite__db_open(struct dqlite__db *db,
 		return rc;
 	}
 
+	/* Make it possible for background maintenance to release free pages in
+	 * small steps. This only has effect on new databases. */
+	if (vacuum) {
+		rc = dqlite__db_exec(db, "PRAGMA auto_vacuum=INCREMENTAL");
+		if (rc != SQLITE_OK) {
+			dqlite__error_wrapf(&db->error,
+			                    &db->error,
+			                    "unable to set auto vacuum");
+			return rc;
+		}
+	}
+
 	/* Disable syncs. */
 	rc = dqlite__db_exec(db, "PRAGMA synchronous=OFF");
 	if (rc != SQLITE_OK) {
@@ -141,6 +291,15 @@ int dqlite__db_open(struct dqlite__db *db,
 		return rc;
 	}
 
+	/* Read database pages in place, without copying them. */
+	sprintf(pragma, "PRAGMA mmap_size=%d", DQLITE__DB_MMAP_SIZE);
+	rc = dqlite__db_exec(db, pragma);
+	if (rc != SQLITE_OK) {
+		dqlite__error_wrapf(
+		    &db->error, &db->error, "unable to set mmap size");
+		return rc;
+	}
+
 	/* Set WAL journaling. */
 	rc = dqlite__db_exec(db, "PRAGMA journal_mode=WAL");
 	if (rc != SQLITE_OK) {
@@ -154,7 +313,7 @@ int dqlite__db_open(struct dqlite__db *db,
 	    db->db, "main", wal_replication, (void *)db->db);
 
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&db->error,
+		dqlite__error_static(&db->error,
 		                     "unable to set WAL replication");
 		return rc;
 	}
@@ -168,7 +327,133 @@ int dqlite__db_open(struct dqlite__db *db,
 		return rc;
 	}
 
+	/* From now on, watch for clients changing the connection state. */
+	rc = sqlite3_set_authorizer(db->db, dqlite__db_authorize, db);
+	if (rc != SQLITE_OK) {
+		dqlite__error_sqlite(&db->error, db->db);
+		return rc;
+	}
+
+	return SQLITE_OK;
+}
+
+int dqlite__db_snapshot(struct dqlite__db *db, struct dqlite__db *snapshot)
+{
+	sqlite3_vfs *vfs;
+	const char * filename;
+	char *       path;
+	char         pragma[255];
+	int          rc;
+
+	assert(db != NULL);
+	assert(db->db != NULL);
+	assert(snapshot != NULL);
+	assert(snapshot->db == NULL);
+
+	rc = sqlite3_file_control(db->db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+	assert(rc == SQLITE_OK); /* Should never fail */
+
+	filename = sqlite3_db_filename(db->db, "main");
+	assert(filename != NULL);
+
+	/* Keep the name of the original database, so statements running
+	 * against the snapshot are accounted to it. */
+	snapshot->name = sqlite3_malloc(strlen(db->name) + 1);
+	if (snapshot->name == NULL) {
+		dqlite__error_oom(&snapshot->error,
+		                  "unable to copy database name");
+		return SQLITE_NOMEM;
+	}
+	strcpy(snapshot->name, db->name);
+	snapshot->flags = SQLITE_OPEN_READWRITE;
+
+	/* The address of the snapshot object makes the file name unique. */
+	path = sqlite3_mprintf("%s-snapshot-%p", filename, (void *)snapshot);
+	if (path == NULL) {
+		dqlite__error_oom(&snapshot->error,
+		                  "unable to format snapshot name");
+		return SQLITE_NOMEM;
+	}
+
+	rc = dqlite__vfs_snapshot(vfs, filename, path);
+	if (rc != SQLITE_OK) {
+		dqlite__error_printf(&snapshot->error,
+		                     "unable to create snapshot (%d)",
+		                     rc);
+		goto err;
+	}
+
+	rc = sqlite3_open_v2(path, &snapshot->db, snapshot->flags, vfs->zName);
+	if (rc != SQLITE_OK) {
+		dqlite__error_sqlite(&snapshot->error, snapshot->db);
+		goto err_after_vfs_snapshot;
+	}
+
+	rc = sqlite3_extended_result_codes(snapshot->db, 1);
+	if (rc != SQLITE_OK) {
+		dqlite__error_sqlite(&snapshot->error, snapshot->db);
+		goto err_after_vfs_snapshot;
+	}
+
+	/* Read pages in place, as they are shared with the original
+	 * database. */
+	sprintf(pragma, "PRAGMA mmap_size=%d", DQLITE__DB_MMAP_SIZE);
+	rc = dqlite__db_exec(snapshot, pragma);
+	if (rc != SQLITE_OK) {
+		dqlite__error_wrapf(
+		    &snapshot->error, &snapshot->error, "unable to set mmap size");
+		goto err_after_vfs_snapshot;
+	}
+
+	/* Changes to the snapshot would never be replicated. */
+	rc = dqlite__db_exec(snapshot, "PRAGMA query_only=1");
+	if (rc != SQLITE_OK) {
+		dqlite__error_wrapf(&snapshot->error,
+		                    &snapshot->error,
+		                    "unable to set query only");
+		goto err_after_vfs_snapshot;
+	}
+
+	sqlite3_free(path);
+
 	return SQLITE_OK;
+
+err_after_vfs_snapshot:
+	sqlite3_close(snapshot->db);
+	snapshot->db = NULL;
+	vfs->xDelete(vfs, path, 0);
+
+err:
+	sqlite3_free(path);
+
+	return rc;
+}
+
+void dqlite__db_snapshot_close(struct dqlite__db *snapshot)
+{
+	sqlite3_vfs *vfs;
+	char *       path = NULL;
+	int          rc;
+
+	assert(snapshot != NULL);
+	assert(snapshot->cluster == NULL);
+
+	if (snapshot->db != NULL) {
+		rc = sqlite3_file_control(
+		    snapshot->db, "main", SQLITE_FCNTL_VFS_POINTER, &vfs);
+		assert(rc == SQLITE_OK); /* Should never fail */
+
+		/* Ignore failures here, the file will only be leaked. */
+		path = sqlite3_mprintf("%s",
+		                       sqlite3_db_filename(snapshot->db, "main"));
+	}
+
+	dqlite__db_close(snapshot);
+
+	if (path != NULL) {
+		vfs->xDelete(vfs, path, 0);
+		sqlite3_free(path);
+	}
 }
 
 int dqlite__db_prepare(struct dqlite__db *   db,
@@ -194,14 +479,24 @@ int dqlite__db_prepare(struct dqlite__db *   db,
 
 	(*stmt)->db = db->db;
 
+	/* A cached statement matches only if it spans the whole text. */
+	(*stmt)->stmt = dqlite__db_cache_take(db, sql);
+	if ((*stmt)->stmt != NULL) {
+		(*stmt)->tail = sql + strlen(sql);
+		(*stmt)->used = ++db->clock;
+		return SQLITE_OK;
+	}
+
 	rc =
 	    sqlite3_prepare_v2(db->db, sql, -1, &(*stmt)->stmt, &(*stmt)->tail);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&db->error, sqlite3_errmsg(db->db));
+		dqlite__error_sqlite(&db->error, db->db);
 		dqlite__stmt_registry_del(&db->stmts, *stmt);
 		return rc;
 	}
 
+	(*stmt)->used = ++db->clock;
+
 	return SQLITE_OK;
 }
 
@@ -211,6 +506,16 @@ struct dqlite__stmt *dqlite__db_stmt(struct dqlite__db *db, uint32_t stmt_id)
 	return dqlite__stmt_registry_get(&db->stmts, stmt_id);
 }
 
+int dqlite__db_use(struct dqlite__db *db, struct dqlite__stmt *stmt)
+{
+	assert(db != NULL);
+	assert(stmt != NULL);
+
+	stmt->used = ++db->clock;
+
+	return dqlite__stmt_revive(stmt);
+}
+
 int dqlite__db_finalize(struct dqlite__db *db, struct dqlite__stmt *stmt)
 {
 	int rc;
@@ -222,8 +527,7 @@ int dqlite__db_finalize(struct dqlite__db *db, struct dqlite__stmt *stmt)
 	if (stmt->stmt != NULL) {
 		rc = sqlite3_finalize(stmt->stmt);
 		if (rc != SQLITE_OK) {
-			dqlite__error_printf(&db->error,
-			                     sqlite3_errmsg(db->db));
+			dqlite__error_sqlite(&db->error, db->db);
 		}
 
 		/* Unset the stmt member, to prevent dqlite__stmt_registry_del
@@ -290,3 +594,458 @@ int dqlite__db_rollback(struct dqlite__db *db)
 
 	return SQLITE_OK;
 }
+
+/* Reset a database that is about to be pooled, so the next client will find it
+ * in a pristine state. */
+static int dqlite__db_reset(struct dqlite__db *db)
+{
+	struct dqlite__stmt *stmt;
+	size_t               i;
+	int                  rc;
+
+	assert(db != NULL);
+	assert(db->db != NULL);
+
+	/* Settings, attached databases and the TEMP schema can't be reliably
+	 * restored, so such a connection is not reused at all. */
+	if (db->tainted) {
+		return SQLITE_MISUSE;
+	}
+
+	/* The cluster might still be checkpointing the connection, which must
+	 * then be unregistered rather than handed to another client. */
+	if (db->wait != NULL) {
+		return SQLITE_BUSY;
+	}
+
+	/* Statement IDs are scoped to a single client, so release all of them,
+	 * keeping a few of the prepared statements around in case the next
+	 * client prepares the same ones. */
+	for (i = 0; i < db->stmts.len && db->cached < DQLITE__DB_CACHE_SIZE;
+	     i++) {
+		stmt = db->stmts.buf[i];
+		if (stmt == NULL || stmt->stmt == NULL) {
+			continue;
+		}
+		sqlite3_reset(stmt->stmt);
+		sqlite3_clear_bindings(stmt->stmt);
+		db->cache[db->cached] = stmt->stmt;
+		db->cached++;
+		stmt->stmt = NULL;
+	}
+
+	dqlite__stmt_registry_close(&db->stmts);
+	dqlite__stmt_registry_init(&db->stmts);
+
+	if (!sqlite3_get_autocommit(db->db)) {
+		rc = dqlite__db_rollback(db);
+		if (rc != SQLITE_OK) {
+			return rc;
+		}
+	}
+
+	/* The WAL hook context is the gateway of the old client. */
+	sqlite3_wal_hook(db->db, NULL, NULL);
+
+	/* Don't let the next client see what the old one inserted. */
+	sqlite3_set_last_insert_rowid(db->db, 0);
+
+	/* The old client might have freed pages or changed the data
+	 * distribution. */
+	db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+	db->barrier     = DQLITE__DB_BARRIER_NONE;
+
+	return SQLITE_OK;
+}
+
+/* Return the value of an integer pragma, or 0 on error. */
+static int dqlite__db_pragma_int(struct dqlite__db *db, const char *pragma)
+{
+	sqlite3_stmt *stmt;
+	int           n = 0;
+	int           rc;
+
+	rc = sqlite3_prepare_v2(db->db, pragma, -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		return 0;
+	}
+
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		n = sqlite3_column_int(stmt, 0);
+	}
+
+	sqlite3_finalize(stmt);
+
+	return n;
+}
+
+static struct dqlite__db_wait *dqlite__db_wait_new(struct dqlite__db *db)
+{
+	struct dqlite__db_wait *w;
+
+	w = sqlite3_malloc(sizeof *w);
+	if (w == NULL) {
+		return NULL;
+	}
+
+	w->db = db;
+
+	return w;
+}
+
+static void dqlite__db_barrier_cb(void *arg, int status)
+{
+	struct dqlite__db_wait *w  = arg;
+	struct dqlite__db *     db = w->db;
+
+	sqlite3_free(w);
+
+	if (db == NULL) {
+		return;
+	}
+
+	db->wait    = NULL;
+	db->barrier = status == 0 ? DQLITE__DB_BARRIER_PASSED
+	                          : DQLITE__DB_BARRIER_FAILED;
+}
+
+/* Make sure there are no pending logs and that we're still the leader, before
+ * running a maintenance step which might write to the database. Return 0 if
+ * it's safe to write, 1 if an asynchronous barrier was started and the step
+ * must be run again once it completes, or -1 if the barrier failed. */
+static int dqlite__db_barrier(struct dqlite__db *db)
+{
+	struct dqlite__db_wait *w;
+	int                     rc;
+
+	switch (db->barrier) {
+	case DQLITE__DB_BARRIER_PASSED:
+		db->barrier = DQLITE__DB_BARRIER_NONE;
+		return 0;
+	case DQLITE__DB_BARRIER_FAILED:
+		db->barrier = DQLITE__DB_BARRIER_NONE;
+		return -1;
+	}
+
+	if (db->cluster == NULL) {
+		return 0;
+	}
+
+	if (db->async == NULL || db->async->xBarrierAsync == NULL) {
+		return db->cluster->xBarrier(db->cluster->ctx) == 0 ? 0 : -1;
+	}
+
+	w = dqlite__db_wait_new(db);
+	if (w == NULL) {
+		return -1;
+	}
+
+	db->wait = w;
+
+	rc = db->async->xBarrierAsync(
+	    db->cluster->ctx, w, dqlite__db_barrier_cb);
+	if (rc != 0) {
+		/* The callback won't be invoked. */
+		db->wait = NULL;
+		sqlite3_free(w);
+		return -1;
+	}
+
+	/* Check if the barrier completed before xBarrierAsync returned. */
+	if (db->wait == NULL) {
+		return dqlite__db_barrier(db);
+	}
+
+	return 1;
+}
+
+static void dqlite__db_checkpoint_cb(void *arg, int status)
+{
+	struct dqlite__db_wait *w  = arg;
+	struct dqlite__db *     db = w->db;
+
+	(void)status;
+
+	sqlite3_free(w);
+
+	if (db != NULL) {
+		db->wait = NULL;
+	}
+}
+
+/* Checkpoint the database across the cluster, without waiting for the
+ * checkpoint to complete if the cluster supports it. */
+static void dqlite__db_checkpoint(struct dqlite__db *db)
+{
+	struct dqlite__db_wait *w;
+	int                     rc;
+
+	if (db->async == NULL || db->async->xCheckpointAsync == NULL) {
+		db->cluster->xCheckpoint(db->cluster->ctx, db->db);
+		return;
+	}
+
+	w = dqlite__db_wait_new(db);
+	if (w == NULL) {
+		return;
+	}
+
+	db->wait = w;
+
+	rc = db->async->xCheckpointAsync(
+	    db->cluster->ctx, db->db, w, dqlite__db_checkpoint_cb);
+	if (rc != 0) {
+		db->wait = NULL;
+		sqlite3_free(w);
+	}
+}
+
+int dqlite__db_maintain(struct dqlite__db *db)
+{
+	char pragma[64];
+	int  rc;
+
+	assert(db != NULL);
+	assert(db->db != NULL);
+
+	/* The current step is resumed once the cluster is done. */
+	if (db->wait != NULL) {
+		return 0;
+	}
+
+	/* Start a new round if statements were run since the last one. */
+	if (db->maintenance == DQLITE__DB_MAINTAIN_DONE &&
+	    db->clock != db->maintained) {
+		db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+	}
+
+	/* Errors are not fatal: the database is just left as it is, and the
+	 * next maintenance round will try again.
+	 *
+	 * Maintenance might be spread over several ticks, and leadership might
+	 * be lost in between, so every step which writes goes through the
+	 * barrier and skips straight to releasing memory if it fails. */
+	switch (db->maintenance) {
+
+	case DQLITE__DB_MAINTAIN_OPTIMIZE:
+		rc = dqlite__db_barrier(db);
+		if (rc > 0) {
+			break;
+		}
+		if (rc < 0) {
+			db->maintenance = DQLITE__DB_MAINTAIN_RELEASE;
+			break;
+		}
+
+		dqlite__db_exec(db, "PRAGMA optimize");
+		db->maintenance = DQLITE__DB_MAINTAIN_VACUUM;
+		break;
+
+	case DQLITE__DB_MAINTAIN_VACUUM:
+		/* Free pages can only be released in slices from databases
+		 * created with incremental auto vacuum (mode 2). */
+		if (dqlite__db_pragma_int(db, "PRAGMA auto_vacuum") != 2 ||
+		    dqlite__db_pragma_int(db, "PRAGMA freelist_count") == 0) {
+			db->maintenance = DQLITE__DB_MAINTAIN_CHECKPOINT;
+			break;
+		}
+
+		rc = dqlite__db_barrier(db);
+		if (rc > 0) {
+			break;
+		}
+		if (rc < 0) {
+			db->maintenance = DQLITE__DB_MAINTAIN_RELEASE;
+			break;
+		}
+
+		sprintf(pragma,
+		        "PRAGMA incremental_vacuum(%d)",
+		        DQLITE__DB_VACUUM_SLICE);
+		rc = dqlite__db_exec(db, pragma);
+		if (rc != SQLITE_OK) {
+			db->maintenance = DQLITE__DB_MAINTAIN_CHECKPOINT;
+		}
+		break;
+
+	case DQLITE__DB_MAINTAIN_CHECKPOINT:
+		/* Pages released by the vacuum are dropped from the volatile
+		 * file only once the WAL gets checkpointed and the database
+		 * file truncated. */
+		if (db->cluster != NULL) {
+			rc = dqlite__db_barrier(db);
+			if (rc > 0) {
+				break;
+			}
+			if (rc == 0) {
+				dqlite__db_checkpoint(db);
+			}
+		}
+		db->maintenance = DQLITE__DB_MAINTAIN_RELEASE;
+		break;
+
+	case DQLITE__DB_MAINTAIN_RELEASE:
+		sqlite3_db_release_memory(db->db);
+		db->maintenance = DQLITE__DB_MAINTAIN_DONE;
+		db->maintained  = db->clock;
+		break;
+	}
+
+	return db->wait == NULL && db->maintenance != DQLITE__DB_MAINTAIN_DONE;
+}
+
+/* Return true if the given registry slot holds a statement that can be
+ * evicted. */
+static int dqlite__db_evictable(struct dqlite__stmt *stmt)
+{
+	return stmt != NULL && stmt->stmt != NULL &&
+	       !sqlite3_stmt_busy(stmt->stmt);
+}
+
+unsigned dqlite__db_evict(struct dqlite__db *db)
+{
+	struct dqlite__stmt *stmt;
+	uint64_t             oldest = UINT64_MAX;
+	uint64_t             newest = 0;
+	uint64_t             threshold;
+	unsigned             n = 0;
+	size_t               i;
+
+	assert(db != NULL);
+
+	for (i = 0; i < db->stmts.len; i++) {
+		stmt = db->stmts.buf[i];
+		if (!dqlite__db_evictable(stmt)) {
+			continue;
+		}
+		if (stmt->used < oldest) {
+			oldest = stmt->used;
+		}
+		if (stmt->used > newest) {
+			newest = stmt->used;
+		}
+	}
+
+	/* Statements kept for the next client are not used by anyone. */
+	n = db->cached;
+	dqlite__db_cache_clear(db);
+
+	if (oldest > newest) {
+		/* No statement can be evicted. */
+		return n;
+	}
+
+	threshold = oldest + (newest - oldest) / 2;
+
+	for (i = 0; i < db->stmts.len; i++) {
+		stmt = db->stmts.buf[i];
+		if (!dqlite__db_evictable(stmt) || stmt->used > threshold) {
+			continue;
+		}
+		if (dqlite__stmt_evict(stmt)) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+void dqlite__db_pool_init(struct dqlite__db_pool *p, unsigned cap)
+{
+	assert(p != NULL);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_DB_POOL);
+
+	p->dbs = NULL;
+	p->len = 0;
+	p->cap = cap;
+}
+
+void dqlite__db_pool_close(struct dqlite__db_pool *p)
+{
+	assert(p != NULL);
+
+	dqlite__db_pool_trim(p);
+
+	if (p->dbs != NULL) {
+		sqlite3_free(p->dbs);
+	}
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_DB_POOL);
+}
+
+void dqlite__db_pool_trim(struct dqlite__db_pool *p)
+{
+	unsigned i;
+
+	assert(p != NULL);
+
+	for (i = 0; i < p->len; i++) {
+		dqlite__db_close(p->dbs[i]);
+		sqlite3_free(p->dbs[i]);
+	}
+
+	p->len = 0;
+}
+
+struct dqlite__db *dqlite__db_pool_get(struct dqlite__db_pool *p,
+                                       const char *            name,
+                                       int                     flags)
+{
+	struct dqlite__db *db;
+	unsigned           i;
+
+	assert(p != NULL);
+	assert(name != NULL);
+
+	for (i = p->len; i > 0; i--) {
+		db = p->dbs[i - 1];
+
+		if (db->flags != flags || strcmp(db->name, name) != 0) {
+			continue;
+		}
+
+		memmove(&p->dbs[i - 1],
+		        &p->dbs[i],
+		        (p->len - i) * sizeof *p->dbs);
+		p->len--;
+
+		return db;
+	}
+
+	return NULL;
+}
+
+int dqlite__db_pool_put(struct dqlite__db_pool *p, struct dqlite__db *db)
+{
+	int rc;
+
+	assert(p != NULL);
+	assert(db != NULL);
+
+	if (db->db == NULL || db->name == NULL) {
+		/* The database was never successfully opened. */
+		return DQLITE_ERROR;
+	}
+
+	if (p->len == p->cap) {
+		return DQLITE_OVERFLOW;
+	}
+
+	if (p->dbs == NULL) {
+		p->dbs = sqlite3_malloc(p->cap * sizeof *p->dbs);
+		if (p->dbs == NULL) {
+			return DQLITE_NOMEM;
+		}
+	}
+
+	rc = dqlite__db_reset(db);
+	if (rc != SQLITE_OK) {
+		return DQLITE_ENGINE;
+	}
+
+	p->dbs[p->len] = db;
+	p->len++;
+
+	return 0;
+}
@@ -8,10 +8,34 @@
 #include "error.h"
 #include "stmt.h"
 
+/* Background maintenance steps run on idle databases, in this order. */
+#define DQLITE__DB_MAINTAIN_OPTIMIZE 0   /* Refresh query planner stats */
+#define DQLITE__DB_MAINTAIN_VACUUM 1     /* Release free pages */
+#define DQLITE__DB_MAINTAIN_CHECKPOINT 2 /* Let the VFS drop released pages */
+#define DQLITE__DB_MAINTAIN_RELEASE 3    /* Shrink the page cache */
+#define DQLITE__DB_MAINTAIN_DONE 4
+
+/* Outcome of an asynchronous barrier awaited by a maintenance step. */
+#define DQLITE__DB_BARRIER_NONE 0   /* No barrier completed */
+#define DQLITE__DB_BARRIER_PASSED 1 /* Safe to run the step */
+#define DQLITE__DB_BARRIER_FAILED 2 /* The step must be skipped */
+
+/* Maximum number of prepared statements that a pooled database keeps for its
+ * next client. */
+#define DQLITE__DB_CACHE_SIZE 16
+
+/* Pending asynchronous call to the cluster interface made by background
+ * maintenance. It's allocated separately since it may complete after the
+ * database has been closed, in which case it just gets detached from it. */
+struct dqlite__db_wait {
+	struct dqlite__db *db; /* Database to notify, or NULL if detached */
+};
+
 /* Hold state for a single open SQLite database */
 struct dqlite__db {
 	/* public */
-	dqlite_cluster *cluster; /* Cluster API implementation  */
+	dqlite_cluster *            cluster; /* Cluster API implementation  */
+	const dqlite_cluster_async *async;   /* Optional async cluster API */
 
 	/* read-only */
 	size_t        id;    /* Database ID */
@@ -20,7 +44,34 @@ struct dqlite__db {
 	/* private */
 	sqlite3 *db; /* Underlying SQLite database */
 	struct dqlite__stmt_registry
-	    stmts; /* Registry of prepared statements */
+	    stmts;  /* Registry of prepared statements */
+	char *name;      /* Name the database was opened with */
+	int flags;       /* Flags the database was opened with */
+	int maintenance; /* Next background maintenance step */
+	uint64_t clock;  /* Ticks every time a statement is used */
+	uint64_t maintained; /* Clock as of the last maintenance round */
+	int tainted;     /* Connection state was changed by a client */
+	sqlite3_stmt *cache[DQLITE__DB_CACHE_SIZE]; /* Statements kept warm */
+	unsigned      cached; /* Number of statements in the cache */
+	struct dqlite__db_wait *wait; /* Pending maintenance cluster call */
+	int barrier; /* Outcome of the last maintenance barrier */
+};
+
+/* Pool of idle databases that can be handed over to new clients without paying
+ * again the cost of opening and configuring them.
+ *
+ * Pooled databases are still registered with the cluster implementation and
+ * have no pending transaction. Their statements are finalized, except for a
+ * few which are kept in a cache keyed by SQL text, so a new client preparing
+ * the same statements gets them back without parsing them again.
+ *
+ * Databases whose connection-level state was changed by a client (settings
+ * changed with a PRAGMA, attached databases, TEMP tables, indexes, triggers or
+ * views) are never pooled, since that state would leak to the next client. */
+struct dqlite__db_pool {
+	struct dqlite__db **dbs; /* Idle databases, oldest first */
+	unsigned            len; /* Number of idle databases */
+	unsigned            cap; /* Maximum number of idle databases */
 };
 
 /* Initialize a database state object */
@@ -32,15 +83,28 @@ void dqlite__db_close(struct dqlite__db *db);
 /* No-op hash function (hashing is not supported for dqlite__db). */
 const char *dqlite__db_hash(struct dqlite__db *db);
 
-/* Open the underlying db. */
+/* Open the underlying db. If vacuum is non-zero, new databases are created
+ * with incremental auto vacuum, so background maintenance can release their
+ * free pages. */
 int dqlite__db_open(struct dqlite__db *db,
                     const char *       name,
                     int                flags,
                     const char *       vfs,
                     uint16_t           page_size,
-                    const char *       wal_replication);
+                    const char *       wal_replication,
+                    int                vacuum);
 
-/* Prepare a statement using the underlying db. */
+/* Open a read-only copy of the given database as of its last committed
+ * transaction, sharing pages with the original database until either side
+ * modifies them. The snapshot object must have been initialized and must be
+ * released with dqlite__db_snapshot_close(). */
+int dqlite__db_snapshot(struct dqlite__db *db, struct dqlite__db *snapshot);
+
+/* Close a database snapshot and delete its file. */
+void dqlite__db_snapshot_close(struct dqlite__db *snapshot);
+
+/* Prepare a statement using the underlying db, possibly reusing a cached one
+ * with the same SQL text. */
 int dqlite__db_prepare(struct dqlite__db *   db,
                        const char *          sql,
                        struct dqlite__stmt **stmt);
@@ -48,6 +112,10 @@ int dqlite__db_prepare(struct dqlite__db *   db,
 /* Lookup the statement with the given ID. */
 struct dqlite__stmt *dqlite__db_stmt(struct dqlite__db *db, uint32_t stmt_id);
 
+/* Mark a statement as the most recently used one, before running it, and
+ * prepare it again if it was evicted. */
+int dqlite__db_use(struct dqlite__db *db, struct dqlite__stmt *stmt);
+
 /* Finalize a statement. */
 int dqlite__db_finalize(struct dqlite__db *db, struct dqlite__stmt *stmt);
 
@@ -60,4 +128,54 @@ int dqlite__db_commit(struct dqlite__db *db);
 /* Rollback a transaction. */
 int dqlite__db_rollback(struct dqlite__db *db);
 
+/* Run the next slice of background maintenance on an idle database, with no
+ * pending transaction. A new round starts whenever statements were run on the
+ * database since the previous one.
+ *
+ * Each call performs a single short step, so callers can interleave other work
+ * and stop as soon as their time budget is exhausted. Steps which write to the
+ * database first go through the cluster barrier, and are skipped if it fails.
+ * If the cluster implements the asynchronous methods, the barrier and the
+ * checkpoint don't block: the call returns right away and the step is resumed
+ * by the first call made after they complete.
+ *
+ * Return 1 if there are more steps to run right away, or 0 if the database is
+ * either fully maintained or waiting for the cluster. */
+int dqlite__db_maintain(struct dqlite__db *db);
+
+/* Evict the least recently used prepared statements of the database which are
+ * not being run, see dqlite__stmt_evict. Statements are evicted if their last
+ * use falls in the older half of the span between the least and the most
+ * recently used statement, so each call evicts at least one statement if any
+ * can be evicted. Cached statements are all finalized. Return the number of
+ * evicted statements. */
+unsigned dqlite__db_evict(struct dqlite__db *db);
+
+/* Initialize a database pool holding at most the given number of idle
+ * databases. A capacity of 0 disables pooling. */
+void dqlite__db_pool_init(struct dqlite__db_pool *p, unsigned cap);
+
+/* Close and release all idle databases in the pool. */
+void dqlite__db_pool_close(struct dqlite__db_pool *p);
+
+/* Close and release all idle databases in the pool, which keeps accepting new
+ * ones. */
+void dqlite__db_pool_trim(struct dqlite__db_pool *p);
+
+/* Check out an idle database with the given name and open flags, if any. The
+ * most recently checked in database is preferred, since its caches are more
+ * likely to be warm. Return NULL if there is no match. */
+struct dqlite__db *dqlite__db_pool_get(struct dqlite__db_pool *p,
+                                       const char *            name,
+                                       int                     flags);
+
+/* Check in a database that is no longer used by its client, caching or
+ * finalizing all its statements and rolling back any pending transaction.
+ *
+ * Return 0 if the pool took ownership of the database, or an error if the pool
+ * is full, if the client changed the state of the connection, if maintenance
+ * is still waiting for the cluster or if the database could not be reset, in
+ * which case the caller is still responsible for closing it. */
+int dqlite__db_pool_put(struct dqlite__db_pool *p, struct dqlite__db *db);
+
 #endif /* DQLITE_DB_H */
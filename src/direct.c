@@ -0,0 +1,661 @@
+#include <assert.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+#include "../include/dqlite.h"
+
+#include "direct.h"
+#include "error.h"
+#include "gateway.h"
+#include "lifecycle.h"
+#include "request.h"
+#include "response.h"
+
+/* Value of the head of a queue which does not accept items. */
+#define DQLITE__DIRECT_CLOSED ((struct dqlite__direct_item *)1)
+
+static void dqlite__direct_item_init(struct dqlite__direct_item *i, int type)
+{
+	int err;
+
+	assert(i != NULL);
+
+	dqlite__error_init(&i->error);
+
+	i->rc             = 0;
+	i->last_insert_id = 0;
+	i->rows_affected  = 0;
+	i->type           = type;
+	i->direct         = NULL;
+	i->text           = NULL;
+	i->xRow           = NULL;
+	i->arg            = NULL;
+	i->next           = NULL;
+
+	/* Docs say that sem_init only fails for an invalid initial value or
+	 * for process-shared semaphores. */
+	err = sem_init(&i->done, 0, 0);
+	assert(err == 0);
+}
+
+static void dqlite__direct_item_close(struct dqlite__direct_item *i)
+{
+	int err;
+
+	assert(i != NULL);
+
+	/* The sem_destroy call should only fail if the given semaphore is
+	 * invalid, which must not be our case. */
+	err = sem_destroy(&i->done);
+	assert(err == 0);
+
+	dqlite__error_close(&i->error);
+}
+
+/* Unblock the client thread waiting for the given item. */
+static void dqlite__direct_item_done(struct dqlite__direct_item *i)
+{
+	int err;
+
+	err = sem_post(&i->done);
+	assert(err == 0); /* No reason for which posting should fail */
+}
+
+/* Reverse a list of items, which the queue keeps newest first. */
+static struct dqlite__direct_item *dqlite__direct_reverse(
+    struct dqlite__direct_item *head)
+{
+	struct dqlite__direct_item *prev = NULL;
+	struct dqlite__direct_item *next;
+
+	while (head != NULL) {
+		next       = head->next;
+		head->next = prev;
+		prev       = head;
+		head       = next;
+	}
+
+	return prev;
+}
+
+/* Push an item onto the queue, waking up the loop thread if needed.
+ *
+ * This is the only code path run by client threads, and it never takes a
+ * lock: the senders counter just lets the loop thread know when it's safe to
+ * close the async handle. */
+static int dqlite__direct_queue_push(struct dqlite__direct_queue *q,
+                                     struct dqlite__direct_item * item)
+{
+	struct dqlite__direct_item *head;
+	int                         err = 0;
+
+	__atomic_add_fetch(&q->senders, 1, __ATOMIC_SEQ_CST);
+
+	head = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+	do {
+		if (head == DQLITE__DIRECT_CLOSED) {
+			err = DQLITE_STOPPED;
+			goto out;
+		}
+		item->next = head;
+	} while (!__atomic_compare_exchange_n(&q->head,
+	                                      &head,
+	                                      item,
+	                                      1,
+	                                      __ATOMIC_SEQ_CST,
+	                                      __ATOMIC_SEQ_CST));
+
+	/* If the queue was not empty, whoever pushed the first item has
+	 * already woken up the loop, which hasn't taken the items yet. */
+	if (head == NULL) {
+		err = uv_async_send(&q->async);
+		assert(err == 0); /* Can't fail on Linux */
+	}
+
+out:
+	__atomic_sub_fetch(&q->senders, 1, __ATOMIC_SEQ_CST);
+
+	return err;
+}
+
+/* Push an item and wait for the loop thread to serve it. */
+static int dqlite__direct_submit(struct dqlite__direct_queue *q,
+                                 struct dqlite__direct_item * item,
+                                 char **                      errmsg)
+{
+	int err;
+
+	err = dqlite__direct_queue_push(q, item);
+	if (err != 0) {
+		dqlite__error_static(&item->error, "server is not running");
+	} else {
+		sem_wait(&item->done);
+		err = item->rc;
+	}
+
+	if (err != 0 && errmsg != NULL) {
+		if (dqlite__error_copy(&item->error, errmsg) != 0) {
+			*errmsg = "error message unavailable (out of memory)";
+		}
+	}
+
+	return err;
+}
+
+/* Hand the item being served back to its client. */
+static void dqlite__direct_complete(struct dqlite__direct *d)
+{
+	struct dqlite__direct_item *item = d->item;
+
+	assert(item != NULL);
+
+	d->item = NULL;
+
+	if (item->type == DQLITE__DIRECT_OPEN) {
+		if (item->rc == 0) {
+			item->direct = d;
+		} else {
+			/* The gateway can't be closed from within its own
+			 * callbacks, so the client gets released by the loop
+			 * thread the next time it serves the queue. */
+			d->failed = 1;
+		}
+	}
+
+	/* The item is owned by its client again from now on. */
+	dqlite__direct_item_done(item);
+}
+
+/* Fill the item being served with the result of its request and complete it,
+ * unless more batches of rows are coming.
+ *
+ * This is invoked after dqlite__gateway_handle has returned if the request
+ * got suspended, for example while waiting for the cluster, and for all the
+ * batches of rows after the first one. */
+static void dqlite__direct_flush_cb(void *ctx, struct dqlite__response *response)
+{
+	struct dqlite__direct *     d = ctx;
+	struct dqlite__direct_item *item = d->item;
+
+	assert(item != NULL);
+
+	switch (response->type) {
+	case DQLITE_RESPONSE_FAILURE:
+		dqlite__error_printf(&item->error,
+		                     "%s (code %d)",
+		                     response->failure.message,
+		                     (int)response->failure.code);
+		item->rc = DQLITE_ENGINE;
+		break;
+	case DQLITE_RESPONSE_DB:
+		d->db_id = response->db.id;
+		break;
+	case DQLITE_RESPONSE_RESULT:
+		item->last_insert_id = response->result.last_insert_id;
+		item->rows_affected  = response->result.rows_affected;
+		break;
+	case DQLITE_RESPONSE_ROWS:
+		/* Rows were handed to the xRow callback. Like network clients,
+		 * the query gets the next batch only after the loop had a
+		 * chance to run other work. */
+		if (response->rows.eof == DQLITE_RESPONSE_ROWS_PART) {
+			assert(d->batch == NULL);
+			d->batch = response;
+			uv_async_send(&d->queue->async);
+			return;
+		}
+		break;
+	}
+
+	dqlite__gateway_flushed(&d->gateway, response);
+
+	dqlite__direct_complete(d);
+}
+
+static int dqlite__direct_row_cb(void *ctx, sqlite3_stmt *stmt)
+{
+	struct dqlite__direct *d = ctx;
+
+	assert(d->item != NULL);
+	assert(d->item->xRow != NULL);
+
+	return d->item->xRow(d->item->arg, stmt);
+}
+
+/* Hand the request of the given client to its gateway. The item gets
+ * completed by dqlite__direct_flush_cb, unless the gateway rejects the
+ * request right away. */
+static void dqlite__direct_handle(struct dqlite__direct *     d,
+                                  struct dqlite__direct_item *item)
+{
+	int err;
+
+	/* Items of the same client are only served concurrently if the client
+	 * is shared between threads. */
+	if (d->item != NULL) {
+		dqlite__error_static(&item->error,
+		                     "concurrent request limit exceeded");
+		item->rc = DQLITE_PROTO;
+		dqlite__direct_item_done(item);
+		return;
+	}
+
+	d->item = item;
+
+	err = dqlite__gateway_handle(&d->gateway, &d->request);
+	if (err != 0) {
+		dqlite__error_wrapf(&item->error,
+		                    &d->gateway.error,
+		                    "failed to handle request");
+		item->rc = err;
+		dqlite__direct_complete(d);
+	}
+}
+
+/* Close the gateway of a client, which stays allocated until the user closes
+ * it as well. */
+static void dqlite__direct_release(struct dqlite__direct *d)
+{
+	struct dqlite__direct_queue *q = d->queue;
+
+	if (d->prev != NULL) {
+		d->prev->next = d->next;
+	} else {
+		q->directs = d->next;
+	}
+	if (d->next != NULL) {
+		d->next->prev = d->prev;
+	}
+
+	/* Closing the gateway drops any request it was still serving. */
+	if (d->item != NULL) {
+		dqlite__error_static(&d->item->error, "client was closed");
+		d->item->rc = DQLITE_STOPPED;
+		dqlite__direct_complete(d);
+	}
+
+	/* A query waiting to produce its next batch of rows is dropped too. */
+	if (d->batch != NULL) {
+		dqlite__gateway_aborted(&d->gateway, d->batch);
+		d->batch = NULL;
+	}
+
+	dqlite__request_close(&d->request);
+	dqlite__gateway_close(&d->gateway);
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_DIRECT);
+
+	/* From now on the client might get freed by dqlite_direct_close. */
+	__atomic_store_n(&d->closed, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Create a new client and open its database. */
+static void dqlite__direct_serve_open(struct dqlite__direct_queue *q,
+                                      struct dqlite__direct_item * item)
+{
+	struct dqlite__gateway_cbs callbacks;
+	struct dqlite__direct *    d;
+#ifdef DQLITE_EXPERIMENTAL
+	int err;
+#endif /* DQLITE_EXPERIMENTAL */
+
+	d = sqlite3_malloc(sizeof *d);
+	if (d == NULL) {
+		dqlite__error_oom(&item->error, "failed to allocate client");
+		item->rc = DQLITE_NOMEM;
+		dqlite__direct_item_done(item);
+		return;
+	}
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_DIRECT);
+
+	callbacks.ctx    = d;
+	callbacks.xFlush = dqlite__direct_flush_cb;
+	callbacks.xRow   = dqlite__direct_row_cb;
+
+	d->queue  = q;
+	d->item   = NULL;
+	d->batch  = NULL;
+	d->db_id  = 0;
+	d->failed = 0;
+	d->closed = 0;
+	d->prev     = NULL;
+	d->next     = q->directs;
+
+	if (q->directs != NULL) {
+		q->directs->prev = d;
+	}
+	q->directs = d;
+
+	dqlite__request_init(&d->request);
+	dqlite__gateway_init(&d->gateway,
+	                     &callbacks,
+	                     q->cluster,
+	                     q->logger,
+	                     q->options,
+	                     q->metrics,
+	                     q->pool,
+	                     q->advisor,
+	                     q->bufs);
+
+#ifdef DQLITE_EXPERIMENTAL
+	err = dqlite__gateway_start(
+	    &d->gateway, uv_now(q->loop), q->coroutines);
+	if (err != 0) {
+		dqlite__error_static(&item->error, "failed to start gateway");
+		item->rc = err;
+		dqlite__direct_release(d);
+		sqlite3_free(d);
+		dqlite__direct_item_done(item);
+		return;
+	}
+#else
+	d->gateway.heartbeat = uv_now(q->loop);
+#endif /* DQLITE_EXPERIMENTAL */
+
+	d->request.type       = DQLITE_REQUEST_OPEN;
+	d->request.open.name  = item->text;
+	d->request.open.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	d->request.open.vfs   = NULL;
+
+	dqlite__direct_handle(d, item);
+
+	/* The item can't be accessed anymore, since it might have been
+	 * completed already. */
+	if (d->failed) {
+		dqlite__direct_release(d);
+		sqlite3_free(d);
+	}
+}
+
+/* Release the clients whose open item failed after their gateway had
+ * returned, and produce the next batch of rows of the queries which handed
+ * one to their client. */
+static void dqlite__direct_queue_sweep(struct dqlite__direct_queue *q)
+{
+	struct dqlite__direct *  d;
+	struct dqlite__direct *  next;
+	struct dqlite__response *batch;
+
+	for (d = q->directs; d != NULL; d = next) {
+		next = d->next;
+		if (d->failed) {
+			dqlite__direct_release(d);
+			sqlite3_free(d);
+		} else if (d->batch != NULL) {
+			batch    = d->batch;
+			d->batch = NULL;
+			dqlite__gateway_flushed(&d->gateway, batch);
+		}
+	}
+}
+
+/* Serve the given item, which gets completed either right away or once its
+ * gateway flushes the response. */
+static void dqlite__direct_serve(struct dqlite__direct_queue *q,
+                                 struct dqlite__direct_item * item)
+{
+	struct dqlite__direct *d = item->direct;
+
+	switch (item->type) {
+	case DQLITE__DIRECT_OPEN:
+		dqlite__direct_serve_open(q, item);
+		break;
+	case DQLITE__DIRECT_EXEC:
+		d->request.type            = DQLITE_REQUEST_EXEC_SQL;
+		d->request.exec_sql.db_id  = d->db_id;
+		d->request.exec_sql.sql    = item->text;
+		dqlite__direct_handle(d, item);
+		break;
+	case DQLITE__DIRECT_QUERY:
+		d->request.type            = DQLITE_REQUEST_QUERY_SQL;
+		d->request.query_sql.db_id = d->db_id;
+		d->request.query_sql.sql   = item->text;
+		dqlite__direct_handle(d, item);
+		break;
+	case DQLITE__DIRECT_CLOSE:
+		dqlite__direct_release(d);
+		sqlite3_free(d);
+		dqlite__direct_item_done(item);
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+/* Invoked on the loop thread when some client has pushed new items. */
+static void dqlite__direct_queue_cb(uv_async_t *async)
+{
+	struct dqlite__direct_queue *q;
+	struct dqlite__direct_item * item;
+	struct dqlite__direct_item * next;
+
+	assert(async != NULL);
+	assert(async->data != NULL);
+
+	q = async->data;
+
+	dqlite__direct_queue_sweep(q);
+
+	item = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+	do {
+		if (item == NULL || item == DQLITE__DIRECT_CLOSED) {
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&q->head,
+	                                      &item,
+	                                      NULL,
+	                                      1,
+	                                      __ATOMIC_SEQ_CST,
+	                                      __ATOMIC_SEQ_CST));
+
+	for (item = dqlite__direct_reverse(item); item != NULL; item = next) {
+		/* The item is owned by its client again as soon as it's
+		 * done. */
+		next = item->next;
+		dqlite__direct_serve(q, item);
+	}
+}
+
+void dqlite__direct_queue_init(struct dqlite__direct_queue *q)
+{
+	assert(q != NULL);
+
+	q->head    = DQLITE__DIRECT_CLOSED;
+	q->senders = 0;
+	q->directs = NULL;
+}
+
+int dqlite__direct_queue_start(struct dqlite__direct_queue *  q,
+                               uv_loop_t *                    loop,
+                               dqlite_cluster *               cluster,
+                               struct dqlite_logger *         logger,
+                               struct dqlite__options *       options,
+                               struct dqlite__metrics *       metrics,
+                               struct dqlite__db_pool *       pool,
+                               struct dqlite__advisor *       advisor,
+                               struct dqlite__message_pool *  bufs,
+                               struct dqlite__coroutine_pool *coroutines)
+{
+	int err;
+
+	assert(q != NULL);
+	assert(q->head == DQLITE__DIRECT_CLOSED);
+	assert(q->directs == NULL);
+
+	err = uv_async_init(loop, &q->async, dqlite__direct_queue_cb);
+	if (err != 0) {
+		return err;
+	}
+	q->async.data = (void *)q;
+
+	q->loop    = loop;
+	q->cluster = cluster;
+	q->logger  = logger;
+	q->options = options;
+	q->metrics = metrics;
+	q->pool    = pool;
+	q->advisor = advisor;
+	q->bufs    = bufs;
+
+	q->coroutines = coroutines;
+
+	__atomic_store_n(&q->head, NULL, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+void dqlite__direct_queue_stop(struct dqlite__direct_queue *q)
+{
+	struct dqlite__direct_item *item;
+	struct dqlite__direct_item *next;
+
+	assert(q != NULL);
+
+	item = __atomic_exchange_n(&q->head, DQLITE__DIRECT_CLOSED, __ATOMIC_SEQ_CST);
+	if (item == DQLITE__DIRECT_CLOSED) {
+		return;
+	}
+
+	/* Wait for pushes that saw the queue open to finish with the async
+	 * handle, which is about to be closed. */
+	while (__atomic_load_n(&q->senders, __ATOMIC_SEQ_CST) > 0) {
+		sched_yield();
+	}
+
+	for (item = dqlite__direct_reverse(item); item != NULL; item = next) {
+		next = item->next;
+		if (item->type == DQLITE__DIRECT_CLOSE) {
+			dqlite__direct_serve(q, item);
+		} else {
+			dqlite__error_static(&item->error,
+			                     "server is not running");
+			item->rc = DQLITE_STOPPED;
+			dqlite__direct_item_done(item);
+		}
+	}
+
+	/* Items still being served by a gateway are failed as well. */
+	while (q->directs != NULL) {
+		dqlite__direct_release(q->directs);
+	}
+}
+
+int dqlite__direct_open(struct dqlite__direct_queue *q,
+                        const char *                 name,
+                        struct dqlite__direct **     out,
+                        char **                      errmsg)
+{
+	struct dqlite__direct_item item;
+	int                        err;
+
+	assert(q != NULL);
+	assert(name != NULL);
+	assert(out != NULL);
+	assert(errmsg != NULL);
+
+	*out = NULL;
+
+	dqlite__direct_item_init(&item, DQLITE__DIRECT_OPEN);
+
+	item.text = name;
+
+	err = dqlite__direct_submit(q, &item, errmsg);
+	if (err == 0) {
+		*out = item.direct;
+	}
+
+	dqlite__direct_item_close(&item);
+
+	return err;
+}
+
+int dqlite_direct_exec(dqlite_direct *d,
+                       const char *   sql,
+                       uint64_t *     last_insert_id,
+                       uint64_t *     rows_affected,
+                       char **        errmsg)
+{
+	struct dqlite__direct_item item;
+	int                        err;
+
+	assert(d != NULL);
+	assert(sql != NULL);
+	assert(errmsg != NULL);
+
+	dqlite__direct_item_init(&item, DQLITE__DIRECT_EXEC);
+
+	item.direct = d;
+	item.text   = sql;
+
+	err = dqlite__direct_submit(d->queue, &item, errmsg);
+	if (err == 0) {
+		if (last_insert_id != NULL) {
+			*last_insert_id = item.last_insert_id;
+		}
+		if (rows_affected != NULL) {
+			*rows_affected = item.rows_affected;
+		}
+	}
+
+	dqlite__direct_item_close(&item);
+
+	return err;
+}
+
+int dqlite_direct_query(dqlite_direct *d,
+                        const char *   sql,
+                        int (*xRow)(void *arg, sqlite3_stmt *stmt),
+                        void * arg,
+                        char **errmsg)
+{
+	struct dqlite__direct_item item;
+	int                        err;
+
+	assert(d != NULL);
+	assert(sql != NULL);
+	assert(xRow != NULL);
+	assert(errmsg != NULL);
+
+	dqlite__direct_item_init(&item, DQLITE__DIRECT_QUERY);
+
+	item.direct = d;
+	item.text   = sql;
+	item.xRow   = xRow;
+	item.arg    = arg;
+
+	err = dqlite__direct_submit(d->queue, &item, errmsg);
+
+	dqlite__direct_item_close(&item);
+
+	return err;
+}
+
+void dqlite_direct_close(dqlite_direct *d)
+{
+	struct dqlite__direct_item item;
+	int                        err;
+
+	assert(d != NULL);
+
+	dqlite__direct_item_init(&item, DQLITE__DIRECT_CLOSE);
+
+	item.direct = d;
+
+	err = dqlite__direct_submit(d->queue, &item, NULL);
+	if (err == DQLITE_STOPPED) {
+		/* The loop is stopping, and it's going to close the gateway
+		 * if it hasn't done it yet. */
+		while (!__atomic_load_n(&d->closed, __ATOMIC_SEQ_CST)) {
+			sched_yield();
+		}
+		sqlite3_free(d);
+	}
+
+	dqlite__direct_item_close(&item);
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ * In-process clients, whose requests are submitted straight to a gateway
+ * running on the loop thread, without going through a socket.
+ *
+ * Client threads push work items onto a lock-free stack and block until the
+ * loop thread has served them. The loop thread takes all pending items at
+ * once and serves them in submission order. Queries hand their rows to the
+ * client in batches, and the loop thread serves other work between them.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_DIRECT_H
+#define DQLITE_DIRECT_H
+
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+#include "../include/dqlite.h"
+
+#include "advisor.h"
+#include "coroutine.h"
+#include "db.h"
+#include "error.h"
+#include "gateway.h"
+#include "message.h"
+#include "metrics.h"
+#include "options.h"
+#include "request.h"
+
+/* Types of work items */
+#define DQLITE__DIRECT_OPEN 0
+#define DQLITE__DIRECT_EXEC 1
+#define DQLITE__DIRECT_QUERY 2
+#define DQLITE__DIRECT_CLOSE 3
+
+/* A unit of work submitted by a client thread. */
+struct dqlite__direct_item {
+	/* read-only */
+	dqlite__error error;          /* Set if the item failed */
+	int           rc;             /* Result code, 0 on success */
+	uint64_t      last_insert_id; /* For exec items */
+	uint64_t      rows_affected;  /* For exec items */
+
+	/* private */
+	int                     type;   /* One of DQLITE__DIRECT_* */
+	struct dqlite__direct * direct; /* Target client, set by open items */
+	const char *            text;   /* Database name or SQL text */
+	int (*xRow)(void *arg, sqlite3_stmt *stmt); /* For query items */
+	void *                      arg;  /* Argument of xRow */
+	struct dqlite__direct_item *next; /* Next submitted item */
+	sem_t                       done; /* Block until the item is served */
+};
+
+/* Submission queue shared by all in-process clients of a server. */
+struct dqlite__direct_queue {
+	/* private */
+	struct dqlite__direct_item *head;    /* Submitted items, newest first */
+	unsigned                    senders; /* Threads in the middle of a push */
+	uv_async_t                  async;   /* Wake up the loop thread */
+	struct dqlite__direct *     directs; /* Open clients */
+
+	/* Used to create new clients on the loop thread */
+	uv_loop_t *                    loop;
+	dqlite_cluster *               cluster;
+	struct dqlite_logger *         logger;
+	struct dqlite__options *       options;
+	struct dqlite__metrics *       metrics;
+	struct dqlite__db_pool *       pool;
+	struct dqlite__advisor *       advisor;
+	struct dqlite__message_pool *  bufs;
+	struct dqlite__coroutine_pool *coroutines;
+};
+
+/* An in-process client, owned by the loop thread. */
+struct dqlite__direct {
+	/* private */
+	struct dqlite__direct_queue *queue;    /* Queue to submit items to */
+	struct dqlite__gateway       gateway;  /* Serves the requests */
+	struct dqlite__request       request;  /* Request being served */
+	struct dqlite__direct_item * item;     /* Item being served */
+	struct dqlite__response *    batch;    /* Rows batch to resume from */
+	uint32_t                     db_id;    /* ID of the open database */
+	int                          failed;   /* The open item failed */
+	int                          closed;   /* The server has stopped */
+	struct dqlite__direct *      prev;     /* Previous open client */
+	struct dqlite__direct *      next;     /* Next open client */
+};
+
+/* Initialize a queue that does not accept items yet. */
+void dqlite__direct_queue_init(struct dqlite__direct_queue *q);
+
+/* Start accepting items, to be served by the given loop. Must be called from
+ * the loop thread. */
+int dqlite__direct_queue_start(struct dqlite__direct_queue *  q,
+                               uv_loop_t *                    loop,
+                               dqlite_cluster *               cluster,
+                               struct dqlite_logger *         logger,
+                               struct dqlite__options *       options,
+                               struct dqlite__metrics *       metrics,
+                               struct dqlite__db_pool *       pool,
+                               struct dqlite__advisor *       advisor,
+                               struct dqlite__message_pool *  bufs,
+                               struct dqlite__coroutine_pool *coroutines);
+
+/* Stop accepting items, fail the pending ones with DQLITE_STOPPED and close
+ * the gateways of all open clients. It's a no-op if the queue was not
+ * started. Must be called from the loop thread, which remains in charge of
+ * closing the async handle. */
+void dqlite__direct_queue_stop(struct dqlite__direct_queue *q);
+
+/* Submit an open item and wait for it. */
+int dqlite__direct_open(struct dqlite__direct_queue *q,
+                        const char *                 name,
+                        struct dqlite__direct **     out,
+                        char **                      errmsg);
+
+#endif /* DQLITE_DIRECT_H */
@@ -14,46 +14,111 @@
 #include "error.h"
 #include "lifecycle.h"
 
-/* Fallback message returned when failing to allocate the error message
- * itself. */
-static char *dqlite__error_oom_msg =
-    "error message unavailable (out of memory)";
-
 void dqlite__error_init(dqlite__error *e) {
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_ERROR);
 
-	*e = NULL;
+	e->msg    = NULL;
+	e->heap   = NULL;
+	e->buf[0] = 0;
 }
 
 void dqlite__error_close(dqlite__error *e) {
-	if (*e != NULL && *e != dqlite__error_oom_msg) {
-		sqlite3_free(*e);
-	}
+	sqlite3_free(e->heap);
 
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_ERROR);
 }
 
+/* Make the given heap allocated message, or the inline buffer if NULL, the
+ * message of the error, releasing the previous one. */
+static void dqlite__error_adopt(dqlite__error *e, char *heap) {
+	sqlite3_free(e->heap);
+
+	e->heap = heap;
+	e->msg  = heap;
+}
+
+const char *dqlite__error_msg(const dqlite__error *e) {
+	if (e->msg != NULL) {
+		return e->msg;
+	}
+
+	return e->buf;
+}
+
+void dqlite__error_static(dqlite__error *e, const char *msg) {
+	assert(msg != NULL);
+
+	dqlite__error_adopt(e, NULL);
+	e->msg = msg;
+}
+
+void dqlite__error_set(dqlite__error *e, const char *msg) {
+	char * heap = NULL;
+	size_t len;
+
+	assert(msg != NULL);
+
+	len = strlen(msg);
+	if (len >= DQLITE__ERROR_LEN) {
+		heap = sqlite3_malloc64(len + 1);
+		if (heap != NULL) {
+			memcpy(heap, msg, len + 1);
+		}
+		len = DQLITE__ERROR_LEN - 1;
+	}
+
+	/* The message might be a part of the error itself, so the previous
+	 * one is released only after copying it. */
+	memmove(e->buf, msg, len);
+	e->buf[len] = 0;
+
+	dqlite__error_adopt(e, heap);
+}
+
+void dqlite__error_forward(dqlite__error *e, const dqlite__error *cause) {
+	if (cause->msg != NULL && cause->msg != cause->heap) {
+		dqlite__error_static(e, cause->msg);
+		return;
+	}
+
+	dqlite__error_set(e, dqlite__error_msg(cause));
+}
+
+void dqlite__error_sqlite(dqlite__error *e, sqlite3 *db) {
+	const char *msg = sqlite3_errmsg(db);
+
+	if (msg == sqlite3_errstr(sqlite3_extended_errcode(db))) {
+		dqlite__error_static(e, msg);
+		return;
+	}
+
+	dqlite__error_set(e, msg);
+}
+
 /* Set an error message by rendering the given format against the given
- * parameters.
+ * parameters, truncating it if needed.
  *
  * Any previously set error message will be cleared. */
 static void dqlite__error_vprintf(dqlite__error *e,
                                   const char *   fmt,
                                   va_list        args) {
+	char *  heap = NULL;
+	va_list copy;
+
 	assert(fmt != NULL);
 
-	/* If a previous error was set (other than the hard-coded OOM fallback
-	 * fallback), let's free it. */
-	if (*e != NULL && *e != dqlite__error_oom_msg) {
-		sqlite3_free(*e);
-	}
+	va_copy(copy, args);
+
+	sqlite3_vsnprintf(DQLITE__ERROR_LEN, e->buf, fmt, args);
 
-	/* Render the message. In case of error we fallback to the hard-coded
-	 * OOM fallback message. */
-	*e = sqlite3_vmprintf(fmt, args);
-	if (*e == NULL) {
-		*e = dqlite__error_oom_msg;
+	/* The message might have been truncated. */
+	if (strlen(e->buf) == DQLITE__ERROR_LEN - 1) {
+		heap = sqlite3_vmprintf(fmt, copy);
 	}
+
+	va_end(copy);
+
+	dqlite__error_adopt(e, heap);
 }
 
 void dqlite__error_printf(dqlite__error *e, const char *fmt, ...) {
@@ -68,27 +133,39 @@ static void dqlite__error_vwrapf(dqlite__error *e,
                                  const char *   cause,
                                  const char *   fmt,
                                  va_list        args) {
-	dqlite__error tmp;
-	char *        msg;
-
-	/* First, print the format and arguments, using a temporary error. */
-	dqlite__error_init(&tmp);
-
-	dqlite__error_vprintf(&tmp, fmt, args);
-
-	if (cause == NULL) {
-		/* Special case the cause error being empty. */
-		dqlite__error_printf(e, "%s: (null)", tmp);
-	} else if (cause == *e) {
-		/* When the error is wrapping itself, we need to make a copy */
-		dqlite__error_copy(e, &msg);
-		dqlite__error_printf(e, "%s: %s", tmp, msg);
-		sqlite3_free(msg);
-	} else {
-		dqlite__error_printf(e, "%s: %s", tmp, cause);
+	char    tmp[DQLITE__ERROR_LEN];
+	char *  heap = NULL;
+	size_t  len;
+	va_list copy;
+
+	va_copy(copy, args);
+
+	/* First, print the format and arguments into a temporary buffer, since
+	 * the cause might be the error itself. */
+	sqlite3_vsnprintf(DQLITE__ERROR_LEN, tmp, fmt, args);
+
+	/* Special case the cause error being empty. */
+	if (cause[0] == 0) {
+		cause = "(null)";
 	}
 
-	dqlite__error_close(&tmp);
+	len = strlen(tmp);
+	sqlite3_snprintf(
+	    (int)(DQLITE__ERROR_LEN - len), tmp + len, ": %s", cause);
+
+	/* The message might have been truncated. */
+	if (strlen(tmp) == DQLITE__ERROR_LEN - 1) {
+		heap = sqlite3_vmprintf(fmt, copy);
+		if (heap != NULL) {
+			heap = sqlite3_mprintf("%z: %s", heap, cause);
+		}
+	}
+
+	va_end(copy);
+
+	memcpy(e->buf, tmp, DQLITE__ERROR_LEN);
+
+	dqlite__error_adopt(e, heap);
 }
 
 void dqlite__error_wrapf(dqlite__error *      e,
@@ -98,7 +175,7 @@ void dqlite__error_wrapf(dqlite__error *      e,
 	va_list args;
 
 	va_start(args, fmt);
-	dqlite__error_vwrapf(e, (const char *)(*cause), fmt, args);
+	dqlite__error_vwrapf(e, dqlite__error_msg(cause), fmt, args);
 	va_end(args);
 }
 
@@ -127,12 +204,12 @@ int dqlite__error_copy(dqlite__error *e, char **msg) {
 	assert(msg != NULL);
 
 	/* Trying to copy an empty error message is an error. */
-	if (*e == NULL) {
+	if (dqlite__error_is_null(e)) {
 		*msg = NULL;
 		return DQLITE_ERROR;
 	}
 
-	len = strlen(*e) + 1;
+	len = strlen(dqlite__error_msg(e)) + 1;
 
 	copy = sqlite3_malloc(len * sizeof *copy);
 	if (copy == NULL) {
@@ -140,23 +217,27 @@ int dqlite__error_copy(dqlite__error *e, char **msg) {
 		return DQLITE_NOMEM;
 	}
 
-	memcpy(copy, *e, len);
+	memcpy(copy, dqlite__error_msg(e), len);
 
 	*msg = copy;
 
 	return 0;
 }
 
-int dqlite__error_is_null(dqlite__error *e) { return *e == NULL; }
+int dqlite__error_is_null(dqlite__error *e) {
+	return dqlite__error_msg(e)[0] == 0;
+}
 
 int dqlite__error_is_disconnect(dqlite__error *e) {
-	if (*e == NULL)
+	const char *msg = dqlite__error_msg(e);
+
+	if (msg[0] == 0)
 		return 0;
 
-	if (strstr(*e, uv_err_name(UV_EOF)) != NULL)
+	if (strstr(msg, uv_err_name(UV_EOF)) != NULL)
 		return 1;
 
-	if (strstr(*e, uv_err_name(UV_ECONNRESET)) != NULL)
+	if (strstr(msg, uv_err_name(UV_ECONNRESET)) != NULL)
 		return 1;
 
 	return 0;
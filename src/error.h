@@ -5,15 +5,47 @@
 
 #include <sqlite3.h>
 
-/* A message describing the last error occurred on an object */
-typedef char *dqlite__error;
+/* Capacity of the inline buffer of an error, including the terminating null
+ * byte. Longer messages are allocated on the heap. */
+#define DQLITE__ERROR_LEN 96
+
+/* A message describing the last error occurred on an object.
+ *
+ * Fixed messages, such as the ones of common failures, are referenced without
+ * being copied, and other messages are rendered into a small inline buffer.
+ * Only messages that don't fit in the buffer are allocated, so most failing
+ * requests cost no more than successful ones. If that allocation fails, the
+ * message gets truncated. */
+typedef struct {
+	const char *msg;                    /* Message, or NULL to use buf */
+	char *      heap;                   /* Message too long for buf */
+	char        buf[DQLITE__ERROR_LEN]; /* Rendered message */
+} dqlite__error;
 
 /* Initialize the error with an empty message */
 void dqlite__error_init(dqlite__error *e);
 
-/* Release the memory of the error message, if any is set */
+/* Close the error */
 void dqlite__error_close(dqlite__error *e);
 
+/* Return the error message, or an empty string if the error is not set */
+const char *dqlite__error_msg(const dqlite__error *e);
+
+/* Set the error message to a string which lives as long as the program, such
+ * as a string literal, without copying it */
+void dqlite__error_static(dqlite__error *e, const char *msg);
+
+/* Set the error message, without any formatting */
+void dqlite__error_set(dqlite__error *e, const char *msg);
+
+/* Set the error message to the one of another error */
+void dqlite__error_forward(dqlite__error *e, const dqlite__error *cause);
+
+/* Set the error message of the last failed call against the given SQLite
+ * connection. Messages of codes which SQLite doesn't customize, such as
+ * "database is locked", are static and don't get copied. */
+void dqlite__error_sqlite(dqlite__error *e, sqlite3 *db);
+
 /* Set the error message */
 void dqlite__error_printf(dqlite__error *e, const char *fmt, ...);
 
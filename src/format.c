@@ -46,6 +46,29 @@ void dqlite__format_get_mx_frame(const uint8_t *buf, uint32_t *mx_frame) {
 	*mx_frame = ((uint32_t *)buf)[4];
 }
 
+void dqlite__format_get_n_backfill(const uint8_t *buf, uint32_t *n_backfill) {
+	assert(buf != NULL);
+	assert(n_backfill != NULL);
+
+	/* The nBackfill field is the first one of the checkpoint information,
+	 * which starts at the 96th byte of the WAL index header. See also
+	 * https://sqlite.org/walformat.html. */
+	*n_backfill = ((uint32_t *)buf)[24];
+}
+
+void dqlite__format_get_frame_info(const uint8_t *hdr,
+                                   uint32_t *     pgno,
+                                   uint32_t *     commit) {
+	assert(hdr != NULL);
+	assert(pgno != NULL);
+	assert(commit != NULL);
+
+	/* Both fields are stored as big-endian 32-bit integers at the start of
+	 * the frame header. See also https://sqlite.org/fileformat.html. */
+	*pgno   = ((uint32_t)hdr[0] << 24) + (hdr[1] << 16) + (hdr[2] << 8) + hdr[3];
+	*commit = ((uint32_t)hdr[4] << 24) + (hdr[5] << 16) + (hdr[6] << 8) + hdr[7];
+}
+
 void dqlite__format_get_read_marks(const uint8_t *buf,
                                    uint32_t read_marks[DQLITE__FORMAT_WAL_NREADER]) {
 	uint32_t *idx;
@@ -70,6 +70,16 @@ int dqlite__format_get_page_size(int            type,
  * buffer */
 void dqlite__format_get_mx_frame(const uint8_t *buf, uint32_t *mx_frame);
 
+/* Extract the nBackfill field, the number of WAL frames already copied back
+ * into the database, from the WAL index header stored in the given buffer. */
+void dqlite__format_get_n_backfill(const uint8_t *buf, uint32_t *n_backfill);
+
+/* Extract the page number and the commit field (the size of the database in
+ * pages for commit frames, or zero) from the given WAL frame header. */
+void dqlite__format_get_frame_info(const uint8_t *hdr,
+                                   uint32_t *     pgno,
+                                   uint32_t *     commit);
+
 /* Extract the read marks array from the WAL index header stored in the given
  * buffer. */
 void dqlite__format_get_read_marks(const uint8_t *buf,
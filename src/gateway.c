@@ -2,12 +2,6 @@
 #include <float.h>
 #include <stdio.h>
 
-#ifdef DQLITE_EXPERIMENTAL
-
-#include <libco.h>
-
-#endif /* DQLITE_EXPERIMENTAL */
-
 #include "../include/dqlite.h"
 
 #include "error.h"
@@ -19,36 +13,207 @@
 #include "request.h"
 #include "response.h"
 
-/* Perform a distributed checkpoint if the size of the WAL has reached the
- * configured threshold and there are no reading transactions in progress (there
- * can't be writing transaction because this helper gets called after a
- * successful commit). */
-static int dqlite__gateway_maybe_checkpoint(void *      ctx,
-                                            sqlite3 *   db,
-                                            const char *schema,
-                                            int         pages)
+/* Longest delay applied to writes when the WAL approaches its hard limit, in
+ * milliseconds. */
+#define DQLITE__GATEWAY_THROTTLE_MAX_DELAY 100
+
+/* Maximum number of rows handed to the xRow callback in a single batch, before
+ * yielding to other clients. */
+#define DQLITE__GATEWAY_ROWS_BATCH 256
+
+/* Maximum number of VM steps that the first batch of a query may have taken for
+ * the query to be run again against a snapshot. Beyond that, running it twice
+ * would cost more than holding the WAL. */
+#define DQLITE__GATEWAY_SNAPSHOT_MAX_STEPS 100000
+
+/* Return the number of frames in the WAL of the given database that have not
+ * been checkpointed yet, including the ones committed by other connections.
+ *
+ * Frames already copied back into the database don't count, since the next
+ * write transaction restarts the WAL from the beginning. */
+static uint32_t dqlite__gateway_wal_frames(sqlite3 *db)
 {
-	struct dqlite__gateway *g;
-	struct sqlite3_file *   file;
-	volatile void *         region;
-	uint32_t                mx_frame;
-	uint32_t                read_marks[DQLITE__FORMAT_WAL_NREADER];
-	int                     rc;
-	int                     i;
+	struct sqlite3_file *file;
+	volatile void *      region;
+	uint32_t             mx_frame;
+	uint32_t             n_backfill;
+	int                  rc;
 
-	(void)schema;
+	rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &file);
+	assert(rc == SQLITE_OK); /* Should never fail */
 
-	assert(ctx != NULL);
-	assert(db != NULL);
+	/* The WAL index doesn't exist until the first write. */
+	rc = file->pMethods->xShmMap(file, 0, 0, 0, &region);
+	if (rc != SQLITE_OK || region == NULL) {
+		return 0;
+	}
 
-	g = ctx;
+	dqlite__format_get_mx_frame((const uint8_t *)region, &mx_frame);
+	dqlite__format_get_n_backfill((const uint8_t *)region, &n_backfill);
 
-	/* Check if the size of the WAL is beyond the threshold. */
-	if ((unsigned)pages < g->options->checkpoint_threshold) {
-		/* Nothing to do yet. */
-		return SQLITE_OK;
+	if (n_backfill >= mx_frame) {
+		return 0;
+	}
+
+	return mx_frame - n_backfill;
+}
+
+static void dqlite__gateway_checkpoint_try(struct dqlite__gateway *g,
+                                           sqlite3 *               db);
+
+/* Return the delay in milliseconds that the given request should be subject to
+ * because of the size of the WAL, or -1 if it should be rejected.
+ *
+ * Only requests that start a new write transaction are throttled: statements
+ * of an explicit transaction are let through, so the transaction can complete
+ * and release its locks. */
+static int64_t dqlite__gateway_wal_pressure(struct dqlite__gateway *g,
+                                            struct dqlite__request *request)
+{
+	struct dqlite__stmt *stmt;
+	uint32_t             soft = g->options->wal_soft_limit;
+	uint32_t             hard = g->options->wal_hard_limit;
+	uint32_t             upper;
+	uint32_t             frames;
+
+	if ((soft == 0 && hard == 0) || g->db == NULL ||
+	    !sqlite3_get_autocommit(g->db->db)) {
+		return 0;
+	}
+
+	switch (request->type) {
+	case DQLITE_REQUEST_EXEC:
+		if (g->db->id != request->exec.db_id) {
+			return 0;
+		}
+		/* Statements evicted to free memory are still throttled. */
+		stmt = dqlite__db_stmt(g->db, request->exec.stmt_id);
+		if (stmt == NULL || dqlite__stmt_readonly(stmt)) {
+			return 0;
+		}
+		break;
+	case DQLITE_REQUEST_EXEC_SQL:
+		if (g->db->id != request->exec_sql.db_id) {
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	frames = dqlite__gateway_wal_frames(g->db->db);
+
+	if ((hard == 0 || frames < hard) && (soft == 0 || frames < soft)) {
+		return 0;
+	}
+
+	/* Only a checkpoint can relieve the pressure, and the WAL hook might
+	 * not start one anymore if writes keep being delayed or rejected. */
+	dqlite__gateway_checkpoint_try(g, g->db->db);
+
+	if (hard > 0 && frames >= hard) {
+		return -1;
+	}
+
+	if (soft == 0 || frames < soft) {
+		return 0;
 	}
 
+	/* Grow the delay linearly up to the hard limit, or up to twice the
+	 * soft limit if there's no hard limit. */
+	upper = hard > soft ? hard : soft * 2;
+	if (frames >= upper) {
+		return DQLITE__GATEWAY_THROTTLE_MAX_DELAY;
+	}
+
+	return 1 + (int64_t)(DQLITE__GATEWAY_THROTTLE_MAX_DELAY - 1) *
+	               (frames - soft) / (upper - soft);
+}
+
+static struct dqlite__gateway_wait *dqlite__gateway_wait_new(
+    struct dqlite__gateway *g)
+{
+	struct dqlite__gateway_wait *w;
+
+	w = sqlite3_malloc(sizeof *w);
+	if (w == NULL) {
+		return NULL;
+	}
+
+	w->g = g;
+
+	return w;
+}
+
+/* Detach a pending asynchronous call from the gateway, so its completion just
+ * releases it. */
+static void dqlite__gateway_wait_detach(struct dqlite__gateway_wait **w)
+{
+	if (*w != NULL) {
+		(*w)->g = NULL;
+		*w      = NULL;
+	}
+}
+
+static void dqlite__gateway_checkpoint_cb(void *arg, int status)
+{
+	struct dqlite__gateway_wait *w = arg;
+	struct dqlite__gateway *     g = w->g;
+
+	sqlite3_free(w);
+
+	if (g == NULL) {
+		return;
+	}
+
+	g->checkpoint_wait = NULL;
+
+	if (status != 0) {
+		dqlite__debugf(g, "checkpoint failed (status=%d)", status);
+	}
+}
+
+/* Start an asynchronous distributed checkpoint, unless one is already in
+ * progress. Failures are ignored, a new attempt is made after the next
+ * commit or delayed write. */
+static void dqlite__gateway_checkpoint(struct dqlite__gateway *g, sqlite3 *db)
+{
+	struct dqlite__gateway_wait *w;
+	int                          rc;
+
+	if (g->checkpoint_wait != NULL) {
+		return;
+	}
+
+	w = dqlite__gateway_wait_new(g);
+	if (w == NULL) {
+		return;
+	}
+
+	g->checkpoint_wait = w;
+
+	rc = g->options->cluster_async.xCheckpointAsync(
+	    g->cluster->ctx, db, w, dqlite__gateway_checkpoint_cb);
+	if (rc != 0) {
+		g->checkpoint_wait = NULL;
+		sqlite3_free(w);
+	}
+}
+
+/* Perform a distributed checkpoint if there are no reading transactions in
+ * progress (there can't be a writing transaction, because this helper gets
+ * called either after a successful commit or before starting a new write
+ * transaction). */
+static void dqlite__gateway_checkpoint_try(struct dqlite__gateway *g,
+                                           sqlite3 *               db)
+{
+	struct sqlite3_file *file;
+	volatile void *      region;
+	uint32_t             mx_frame;
+	uint32_t             read_marks[DQLITE__FORMAT_WAL_NREADER];
+	int                  rc;
+	int                  i;
+
 	/* Get the database file associated with this connection */
 	rc = sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &file);
 	assert(rc == SQLITE_OK); /* Should never fail */
@@ -72,7 +237,7 @@ static int dqlite__gateway_maybe_checkpoint(void *      ctx,
 		if (rc == SQLITE_BUSY) {
 			/* It's locked. Let's postpone the checkpoint
 			 * for now. */
-			return SQLITE_OK;
+			return;
 		}
 
 		/* Not locked. Let's release the lock we just
@@ -85,7 +250,36 @@ static int dqlite__gateway_maybe_checkpoint(void *      ctx,
 	 *
 	 * TODO: reason about if it's indeed fine to ignore all kind of
 	 * errors. */
-	g->cluster->xCheckpoint(g->cluster->ctx, db);
+	if (g->options->cluster_async.xCheckpointAsync != NULL) {
+		dqlite__gateway_checkpoint(g, db);
+	} else {
+		g->cluster->xCheckpoint(g->cluster->ctx, db);
+	}
+}
+
+/* WAL hook checkpointing the database once the size of the WAL has reached the
+ * configured threshold. */
+static int dqlite__gateway_maybe_checkpoint(void *      ctx,
+                                            sqlite3 *   db,
+                                            const char *schema,
+                                            int         pages)
+{
+	struct dqlite__gateway *g;
+
+	(void)schema;
+
+	assert(ctx != NULL);
+	assert(db != NULL);
+
+	g = ctx;
+
+	/* Check if the size of the WAL is beyond the threshold. */
+	if ((unsigned)pages < g->options->checkpoint_threshold) {
+		/* Nothing to do yet. */
+		return SQLITE_OK;
+	}
+
+	dqlite__gateway_checkpoint_try(g, db);
 
 	return SQLITE_OK;
 }
@@ -130,7 +324,7 @@ static void dqlite__gateway_failure(struct dqlite__gateway *    g,
 {
 	ctx->response.type            = DQLITE_RESPONSE_FAILURE;
 	ctx->response.failure.code    = code;
-	ctx->response.failure.message = g->error;
+	ctx->response.failure.message = dqlite__error_msg(&g->error);
 }
 
 static void dqlite__gateway_leader(struct dqlite__gateway *    g,
@@ -167,7 +361,7 @@ static void dqlite__gateway_heartbeat(struct dqlite__gateway *    g,
 	/* Get the current list of servers in the cluster */
 	rc = g->cluster->xServers(g->cluster->ctx, &servers);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error,
+		dqlite__error_static(&g->error,
 		                     "failed to get cluster servers");
 		dqlite__gateway_failure(g, ctx, rc);
 		return;
@@ -182,26 +376,39 @@ static void dqlite__gateway_heartbeat(struct dqlite__gateway *    g,
 	g->heartbeat = ctx->request->timestamp;
 }
 
-static void dqlite__gateway_open(struct dqlite__gateway *    g,
-                                 struct dqlite__gateway_ctx *ctx)
+/* Open the database of the connection, shared by OPEN and CONNECT requests.
+ * Return non-zero if the request failed. */
+static int dqlite__gateway_open_db(struct dqlite__gateway *    g,
+                                   struct dqlite__gateway_ctx *ctx,
+                                   const char *                name,
+                                   int                         flags)
 {
 	int rc;
 
 	assert(g != NULL);
 
 	if (g->db != NULL) {
-		dqlite__error_printf(
+		dqlite__error_static(
 		    &g->error,
 		    "a database for this connection is already open");
 		dqlite__gateway_failure(g, ctx, SQLITE_BUSY);
-		return;
+		return SQLITE_BUSY;
+	}
+
+	/* Try to reuse an idle database first: it's already configured and
+	 * registered with the cluster implementation. */
+	if (g->pool != NULL) {
+		g->db = dqlite__db_pool_get(g->pool, name, flags);
+		if (g->db != NULL) {
+			goto out;
+		}
 	}
 
 	g->db = sqlite3_malloc(sizeof *g->db);
 	if (g->db == NULL) {
 		dqlite__error_oom(&g->error, "unable to create database");
 		dqlite__gateway_failure(g, ctx, SQLITE_NOMEM);
-		return;
+		return SQLITE_NOMEM;
 	}
 
 	dqlite__db_init(g->db);
@@ -209,37 +416,156 @@ static void dqlite__gateway_open(struct dqlite__gateway *    g,
 	g->db->id = 0;
 
 	rc = dqlite__db_open(g->db,
-	                     ctx->request->open.name,
-	                     ctx->request->open.flags,
+	                     name,
+	                     flags,
 	                     g->options->vfs,
 	                     g->options->page_size,
-	                     g->options->wal_replication);
+	                     g->options->wal_replication,
+	                     g->options->maintenance_interval > 0);
 
 	if (rc != 0) {
-		dqlite__error_printf(&g->error, g->db->error);
+		dqlite__error_forward(&g->error, &g->db->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		dqlite__db_close(g->db);
 		sqlite3_free(g->db);
 		g->db = NULL;
-		return;
+		return rc;
 	}
 
+	/* Notify the cluster implementation about the new connection. */
+	g->cluster->xRegister(g->cluster->ctx, g->db->db);
+	g->db->cluster = g->cluster;
+	g->db->async   = &g->options->cluster_async;
+
+out:
 	sqlite3_wal_hook(g->db->db, dqlite__gateway_maybe_checkpoint, g);
 
+	return 0;
+}
+
+static void dqlite__gateway_open(struct dqlite__gateway *    g,
+                                 struct dqlite__gateway_ctx *ctx)
+{
+	int rc;
+
+	rc = dqlite__gateway_open_db(g,
+	                             ctx,
+	                             ctx->request->open.name,
+	                             (int)ctx->request->open.flags);
+	if (rc != 0) {
+		return;
+	}
+
 	ctx->response.type  = DQLITE_RESPONSE_DB;
 	ctx->response.db.id = (uint32_t)g->db->id;
+}
 
-	/* Notify the cluster implementation about the new connection. */
-	g->cluster->xRegister(g->cluster->ctx, g->db->db);
-	g->db->cluster = g->cluster;
+/* Register the client and open its database, replying with both the welcome
+ * and the database ID. */
+static void dqlite__gateway_connect(struct dqlite__gateway *    g,
+                                    struct dqlite__gateway_ctx *ctx)
+{
+	int rc;
+
+	/* TODO: handle client registrations */
+
+	rc = dqlite__gateway_open_db(g,
+	                             ctx,
+	                             ctx->request->connect.name,
+	                             (int)ctx->request->connect.flags);
+	if (rc != 0) {
+		return;
+	}
+
+	ctx->response.type = DQLITE_RESPONSE_WELCOME_DB;
+	ctx->response.welcome_db.heartbeat_timeout =
+	    g->options->heartbeat_timeout;
+	ctx->response.welcome_db.id = (uint32_t)g->db->id;
+}
+
+static void dqlite__gateway_barrier_cb(void *arg, int status);
+
+/* Ensure that there are no raft logs pending.
+ *
+ * If the barrier can't be passed right away, the request gets parked and the
+ * handler is run again from scratch once the barrier completes. Return
+ * non-zero if the handler must return, either because the request failed or
+ * because it got parked. */
+static int dqlite__gateway_barrier(struct dqlite__gateway *    g,
+                                   struct dqlite__gateway_ctx *ctx)
+{
+	struct dqlite__gateway_wait *w;
+	int                          rc;
+
+	switch (ctx->barrier) {
+	case DQLITE__GATEWAY_BARRIER_PASSED:
+		return 0;
+	case DQLITE__GATEWAY_BARRIER_FAILED:
+		rc = ctx->barrier_rc;
+		goto err;
+	}
+
+	assert(ctx->barrier == DQLITE__GATEWAY_BARRIER_NONE);
+
+	if (g->options->cluster_async.xBarrierAsync == NULL) {
+		rc = g->cluster->xBarrier(g->cluster->ctx);
+		if (rc != 0) {
+			goto err;
+		}
+		ctx->barrier = DQLITE__GATEWAY_BARRIER_PASSED;
+		return 0;
+	}
+
+	w = dqlite__gateway_wait_new(g);
+	if (w == NULL) {
+		rc = SQLITE_NOMEM;
+		goto err;
+	}
+
+	ctx->barrier    = DQLITE__GATEWAY_BARRIER_STARTED;
+	g->barrier_wait = w;
+
+	rc = g->options->cluster_async.xBarrierAsync(
+	    g->cluster->ctx, w, dqlite__gateway_barrier_cb);
+	if (rc != 0) {
+		/* The callback won't be invoked. */
+		ctx->barrier    = DQLITE__GATEWAY_BARRIER_NONE;
+		g->barrier_wait = NULL;
+		sqlite3_free(w);
+		goto err;
+	}
+
+	/* Check if the barrier completed before xBarrierAsync returned. */
+	if (ctx->barrier == DQLITE__GATEWAY_BARRIER_STARTED) {
+		ctx->barrier = DQLITE__GATEWAY_BARRIER_PARKED;
+		return 1;
+	}
+
+	return dqlite__gateway_barrier(g, ctx);
+
+err:
+	assert(rc != 0);
+
+	dqlite__error_static(&g->error, "raft barrier failed");
+	dqlite__gateway_failure(g, ctx, rc);
+
+	return rc;
 }
 
-/* Ensure that there are no raft logs pending. */
 #define DQLITE__GATEWAY_BARRIER                                                \
-	rc = g->cluster->xBarrier(g->cluster->ctx);                            \
-	if (rc != 0) {                                                         \
-		dqlite__error_printf(&g->error, "raft barrier failed");        \
-		dqlite__gateway_failure(g, ctx, rc);                           \
+	if (dqlite__gateway_barrier(g, ctx) != 0) {                            \
+		return;                                                        \
+	}
+
+/* Reject writes while the WAL is beyond its hard limit. The error is retryable,
+ * since the WAL shrinks as soon as a checkpoint succeeds. */
+#define DQLITE__GATEWAY_WAL_LIMIT                                              \
+	if (dqlite__gateway_wal_pressure(g, ctx->request) < 0) {               \
+		if (g->metrics != NULL) {                                      \
+			DQLITE__METRICS_ADD(g->metrics, rejected, 1);          \
+		}                                                              \
+		dqlite__error_static(&g->error, "WAL size limit reached");     \
+		dqlite__gateway_failure(g, ctx, SQLITE_BUSY);                  \
 		return;                                                        \
 	}
 
@@ -261,6 +587,30 @@ static void dqlite__gateway_open(struct dqlite__gateway *    g,
 		return;                                                        \
 	}
 
+/* Mark the statement as used, and prepare it again if it was evicted to free
+ * memory. */
+#define DQLITE__GATEWAY_USE_STMT                                               \
+	rc = dqlite__db_use(db, stmt);                                         \
+	if (rc != SQLITE_OK) {                                                 \
+		dqlite__error_forward(&g->error, &stmt->error);                \
+		dqlite__gateway_failure(g, ctx, rc);                           \
+		return;                                                        \
+	}
+
+/* Feed the index advisor with the full scan statistics of a statement that has
+ * just completed. */
+static void dqlite__gateway_sample(struct dqlite__gateway *g,
+                                   struct dqlite__db *     db,
+                                   struct dqlite__stmt *   stmt)
+{
+	if (g->advisor == NULL || g->options->advisor_threshold == 0) {
+		return;
+	}
+
+	dqlite__advisor_sample(
+	    g->advisor, db->name, stmt->stmt, g->options->advisor_threshold);
+}
+
 static void dqlite__gateway_prepare(struct dqlite__gateway *    g,
                                     struct dqlite__gateway_ctx *ctx)
 {
@@ -273,7 +623,7 @@ static void dqlite__gateway_prepare(struct dqlite__gateway *    g,
 
 	rc = dqlite__db_prepare(db, ctx->request->prepare.sql, &stmt);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error, db->error);
+		dqlite__error_forward(&g->error, &db->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		return;
 	}
@@ -296,56 +646,124 @@ static void dqlite__gateway_exec(struct dqlite__gateway *    g,
 	DQLITE__GATEWAY_BARRIER;
 	DQLITE__GATEWAY_LOOKUP_DB(ctx->request->exec.db_id);
 	DQLITE__GATEWAY_LOOKUP_STMT(ctx->request->exec.stmt_id);
+	DQLITE__GATEWAY_USE_STMT;
+	DQLITE__GATEWAY_WAL_LIMIT;
 
 	assert(stmt != NULL);
 
 	rc = dqlite__stmt_bind(stmt, &ctx->request->message);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error, stmt->error);
+		dqlite__error_forward(&g->error, &stmt->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		return;
 	}
 
 	rc = dqlite__stmt_exec(stmt, &last_insert_id, &rows_affected);
 	if (rc == SQLITE_OK) {
+		dqlite__gateway_sample(g, db, stmt);
+
 		ctx->response.type                  = DQLITE_RESPONSE_RESULT;
 		ctx->response.result.last_insert_id = last_insert_id;
 		ctx->response.result.rows_affected  = rows_affected;
 	} else {
-		dqlite__error_printf(&g->error, stmt->error);
+		dqlite__error_forward(&g->error, &stmt->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		sqlite3_reset(stmt->stmt);
 	}
 }
 
+/* Release the statement of the original database that a snapshot query was
+ * moved away from, if still held. */
+static void dqlite__gateway_origin_release(struct dqlite__gateway *    g,
+                                           struct dqlite__gateway_ctx *ctx)
+{
+	if (ctx->origin == NULL) {
+		return;
+	}
+
+	if (ctx->cleanup == DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET) {
+		sqlite3_reset(ctx->origin->stmt);
+	} else {
+		dqlite__db_finalize(g->db, ctx->origin);
+	}
+
+	ctx->origin = NULL;
+}
+
+/* Release the resources associated with a database request according to the
+ * cleanup code of its context, and reset the context. */
+static void dqlite__gateway_cleanup(struct dqlite__gateway *    g,
+                                    struct dqlite__gateway_ctx *ctx,
+                                    struct dqlite__db *         db,
+                                    struct dqlite__stmt *       stmt)
+{
+	switch (ctx->cleanup) {
+	case DQLITE__GATEWAY_CLEANUP_NONE:
+		/* Nothing to do */
+		break;
+	case DQLITE__GATEWAY_CLEANUP_FINALIZE:
+		/* Finalize the statement */
+		dqlite__db_finalize(db, stmt);
+		break;
+	case DQLITE__GATEWAY_CLEANUP_SNAPSHOT:
+	case DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET:
+		/* Finalize the statement and drop the snapshot, along with
+		 * the original statement if its batch was never sent. */
+		dqlite__db_finalize(db, stmt);
+		dqlite__db_snapshot_close(db);
+		sqlite3_free(db);
+		dqlite__gateway_origin_release(g, ctx);
+		break;
+	}
+
+	ctx->db      = NULL;
+	ctx->stmt    = NULL;
+	ctx->origin  = NULL;
+	ctx->cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
+}
+
 /* Step through the tiven statement and populate the response of the given
  * context with a single batch of rows.
  *
  * A single batch of rows is typically about the size of the static response
- * message body. */
+ * message body. If rows are consumed by the xRow callback, the batch holds up
+ * to DQLITE__GATEWAY_ROWS_BATCH rows instead. */
 static void dqlite__gateway_query_batch(struct dqlite__gateway *    g,
                                         struct dqlite__db *         db,
                                         struct dqlite__stmt *       stmt,
                                         struct dqlite__gateway_ctx *ctx)
 {
+	int header;
 	int rc;
 
-	rc = dqlite__stmt_query(stmt, &ctx->response.message);
+	/* Follow-up batches repeat the column count and names only for clients
+	 * of the original protocol version. */
+	header = ctx->stmt == NULL ||
+	         g->protocol != DQLITE_PROTOCOL_VERSION_COMPACT_ROWS;
+
+	if (g->callbacks.xRow != NULL) {
+		rc = dqlite__stmt_each(stmt,
+		                       g->callbacks.xRow,
+		                       g->callbacks.ctx,
+		                       DQLITE__GATEWAY_ROWS_BATCH);
+	} else {
+		rc = dqlite__stmt_query(stmt,
+		                        &ctx->response.message,
+		                        header,
+		                        g->options->zero_copy_threshold);
+	}
 	if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
-		sqlite3_reset(stmt->stmt);
+		/* Discard the rows encoded so far, which might reference
+		 * memory of the statement. */
+		dqlite__message_send_reset(&ctx->response.message);
 
-		/* Finalize the statement if needed. */
-		if (ctx->cleanup == DQLITE__GATEWAY_CLEANUP_FINALIZE) {
-			dqlite__db_finalize(db, stmt);
-		}
+		sqlite3_reset(stmt->stmt);
 
-		/* TODO: reset what was written in the message */
-		dqlite__error_printf(&g->error, stmt->error);
+		dqlite__error_forward(&g->error, &stmt->error);
 		dqlite__gateway_failure(g, ctx, rc);
 
-		ctx->db      = NULL;
-		ctx->stmt    = NULL;
-		ctx->cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
+		/* Finalize the statement if needed. */
+		dqlite__gateway_cleanup(g, ctx, db, stmt);
 	} else {
 		ctx->response.type = DQLITE_RESPONSE_ROWS;
 		assert(rc == SQLITE_ROW || rc == SQLITE_DONE);
@@ -354,37 +772,158 @@ static void dqlite__gateway_query_batch(struct dqlite__gateway *    g,
 			ctx->db                = db;
 			ctx->stmt              = stmt;
 		} else {
-			/* Finalize the statement if needed. */
-			if (ctx->cleanup == DQLITE__GATEWAY_CLEANUP_FINALIZE) {
-				dqlite__db_finalize(db, stmt);
-			}
+			dqlite__gateway_sample(g, db, stmt);
 
-			/* Reset the multi-response info and the cleanup code */
-			ctx->db      = NULL;
-			ctx->stmt    = NULL;
-			ctx->cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
+			/* Finalize the statement if needed, and reset the
+			 * multi-response info and the cleanup code. */
+			dqlite__gateway_cleanup(g, ctx, db, stmt);
 
 			ctx->response.rows.eof = DQLITE_RESPONSE_ROWS_DONE;
 		}
 	}
 }
 
+/* Return true if a query might be moved to a snapshot after its first batch,
+ * see dqlite__gateway_snapshot. Queries inside an explicit transaction must
+ * see its changes. */
+static int dqlite__gateway_snapshot_eligible(struct dqlite__gateway *g,
+                                             struct dqlite__db *     db,
+                                             struct dqlite__stmt *   stmt)
+{
+	return g->options->snapshot_reads &&
+	       sqlite3_stmt_readonly(stmt->stmt) &&
+	       sqlite3_get_autocommit(db->db);
+}
+
+/* Move a read-only query whose rows don't fit in a single batch to a snapshot
+ * of its database, so that streaming the remaining rows doesn't hold a read
+ * lock on the WAL and checkpoints can proceed in the meantime.
+ *
+ * The snapshot is taken right after the first batch, when it has the same
+ * content the query has been reading, so the query is run again against it
+ * skipping the rows already yielded. That's done only if the first batch took
+ * at most DQLITE__GATEWAY_SNAPSHOT_MAX_STEPS, and only if the skipped rows
+ * match the checksum of the yielded ones, which rules out queries whose rows
+ * come in a different order or with different values when run again. The
+ * original statement might still be referenced by the batch, and is released
+ * once the batch has been sent.
+ *
+ * If the query is not eligible or the snapshot could not be created, the
+ * query keeps running against the database. */
+static void dqlite__gateway_snapshot(struct dqlite__gateway *    g,
+                                     struct dqlite__gateway_ctx *ctx,
+                                     const char *                sql,
+                                     size_t                      bindings,
+                                     int                         steps)
+{
+	struct dqlite__db *  db   = ctx->db;
+	struct dqlite__stmt *stmt = ctx->stmt;
+	struct dqlite__db *  snapshot;
+	struct dqlite__stmt *snapshot_stmt;
+	uint64_t             checksum = DQLITE__STMT_CHECKSUM_SEED;
+	uint64_t             i;
+	int                  rc;
+
+	steps = sqlite3_stmt_status(stmt->stmt, SQLITE_STMTSTATUS_VM_STEP, 0) -
+	        steps;
+	if (steps > DQLITE__GATEWAY_SNAPSHOT_MAX_STEPS) {
+		dqlite__debugf(g,
+		               "query not served from snapshot: %d steps",
+		               steps);
+		return;
+	}
+
+	snapshot = sqlite3_malloc(sizeof *snapshot);
+	if (snapshot == NULL) {
+		return;
+	}
+
+	dqlite__db_init(snapshot);
+
+	rc = dqlite__db_snapshot(db, snapshot);
+	if (rc != SQLITE_OK) {
+		goto err;
+	}
+
+	rc = dqlite__db_prepare(snapshot, sql, &snapshot_stmt);
+	if (rc != SQLITE_OK) {
+		goto err;
+	}
+
+	dqlite__message_body_seek(&ctx->request->message, bindings);
+
+	rc = dqlite__stmt_bind(snapshot_stmt, &ctx->request->message);
+	if (rc != SQLITE_OK) {
+		dqlite__error_forward(&snapshot->error, &snapshot_stmt->error);
+		goto err_after_prepare;
+	}
+
+	for (i = 0; i < stmt->rows; i++) {
+		rc = sqlite3_step(snapshot_stmt->stmt);
+		if (rc != SQLITE_ROW) {
+			dqlite__error_printf(&snapshot->error,
+			                     "unable to skip %lu rows (%d)",
+			                     (unsigned long)stmt->rows,
+			                     rc);
+			goto err_after_prepare;
+		}
+		dqlite__stmt_checksum(snapshot_stmt->stmt, &checksum);
+	}
+
+	if (checksum != stmt->checksum) {
+		dqlite__error_static(&snapshot->error,
+		                     "rows differ from the original query");
+		goto err_after_prepare;
+	}
+
+	ctx->db     = snapshot;
+	ctx->stmt   = snapshot_stmt;
+	ctx->origin = stmt;
+
+	if (ctx->cleanup == DQLITE__GATEWAY_CLEANUP_FINALIZE) {
+		ctx->cleanup = DQLITE__GATEWAY_CLEANUP_SNAPSHOT;
+	} else {
+		ctx->cleanup = DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET;
+	}
+
+	return;
+
+err_after_prepare:
+	dqlite__db_finalize(snapshot, snapshot_stmt);
+
+err:
+	dqlite__debugf(g,
+	               "query not served from snapshot: %s",
+	               dqlite__error_msg(&snapshot->error));
+
+	dqlite__db_snapshot_close(snapshot);
+	sqlite3_free(snapshot);
+}
+
 static void dqlite__gateway_query(struct dqlite__gateway *    g,
                                   struct dqlite__gateway_ctx *ctx)
 {
 	int                  rc;
 	struct dqlite__db *  db;
 	struct dqlite__stmt *stmt;
+	size_t               bindings;
+	int                  eligible;
+	int                  steps;
 
 	DQLITE__GATEWAY_BARRIER;
 	DQLITE__GATEWAY_LOOKUP_DB(ctx->request->query.db_id);
 	DQLITE__GATEWAY_LOOKUP_STMT(ctx->request->query.stmt_id);
+	DQLITE__GATEWAY_USE_STMT;
 
 	assert(stmt != NULL);
 
+	/* Remember where the bindings start, in case they need to be applied
+	 * to a snapshot query as well. */
+	bindings = dqlite__message_body_tell(&ctx->request->message);
+
 	rc = dqlite__stmt_bind(stmt, &ctx->request->message);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error, stmt->error);
+		dqlite__error_forward(&g->error, &stmt->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		return;
 	}
@@ -393,7 +932,18 @@ static void dqlite__gateway_query(struct dqlite__gateway *    g,
 	 * once the request is done. */
 	ctx->cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
 
+	eligible     = dqlite__gateway_snapshot_eligible(g, db, stmt);
+	stmt->digest = eligible;
+	steps = sqlite3_stmt_status(stmt->stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+
 	dqlite__gateway_query_batch(g, db, stmt, ctx);
+
+	stmt->digest = 0;
+
+	if (ctx->stmt != NULL && eligible) {
+		dqlite__gateway_snapshot(
+		    g, ctx, sqlite3_sql(stmt->stmt), bindings, steps);
+	}
 }
 
 static void dqlite__gateway_finalize(struct dqlite__gateway *    g,
@@ -411,7 +961,7 @@ static void dqlite__gateway_finalize(struct dqlite__gateway *    g,
 	if (rc == SQLITE_OK) {
 		ctx->response.type = DQLITE_RESPONSE_EMPTY;
 	} else {
-		dqlite__error_printf(&g->error, db->error);
+		dqlite__error_forward(&g->error, &db->error);
 		dqlite__gateway_failure(g, ctx, rc);
 	}
 }
@@ -428,6 +978,7 @@ static void dqlite__gateway_exec_sql(struct dqlite__gateway *    g,
 
 	DQLITE__GATEWAY_BARRIER;
 	DQLITE__GATEWAY_LOOKUP_DB(ctx->request->exec_sql.db_id);
+	DQLITE__GATEWAY_WAL_LIMIT;
 
 	assert(db != NULL);
 
@@ -436,7 +987,7 @@ static void dqlite__gateway_exec_sql(struct dqlite__gateway *    g,
 	while (sql != NULL && strcmp(sql, "") != 0) {
 		rc = dqlite__db_prepare(db, sql, &stmt);
 		if (rc != SQLITE_OK) {
-			dqlite__error_printf(&g->error, db->error);
+			dqlite__error_forward(&g->error, &db->error);
 			dqlite__gateway_failure(g, ctx, rc);
 			return;
 		}
@@ -448,7 +999,7 @@ static void dqlite__gateway_exec_sql(struct dqlite__gateway *    g,
 		/* TODO: what about bindings for multi-statement SQL text? */
 		rc = dqlite__stmt_bind(stmt, &ctx->request->message);
 		if (rc != SQLITE_OK) {
-			dqlite__error_printf(&g->error, stmt->error);
+			dqlite__error_forward(&g->error, &stmt->error);
 			dqlite__gateway_failure(g, ctx, rc);
 			goto err;
 			return;
@@ -456,11 +1007,13 @@ static void dqlite__gateway_exec_sql(struct dqlite__gateway *    g,
 
 		rc = dqlite__stmt_exec(stmt, &last_insert_id, &rows_affected);
 		if (rc == SQLITE_OK) {
+			dqlite__gateway_sample(g, db, stmt);
+
 			ctx->response.type = DQLITE_RESPONSE_RESULT;
 			ctx->response.result.last_insert_id = last_insert_id;
 			ctx->response.result.rows_affected  = rows_affected;
 		} else {
-			dqlite__error_printf(&g->error, stmt->error);
+			dqlite__error_forward(&g->error, &stmt->error);
 			dqlite__gateway_failure(g, ctx, rc);
 			goto err;
 		}
@@ -484,6 +1037,9 @@ static void dqlite__gateway_query_sql(struct dqlite__gateway *    g,
 	int                  rc;
 	struct dqlite__db *  db;
 	struct dqlite__stmt *stmt;
+	size_t               bindings;
+	int                  eligible;
+	int                  steps;
 
 	DQLITE__GATEWAY_BARRIER;
 	DQLITE__GATEWAY_LOOKUP_DB(ctx->request->query_sql.db_id);
@@ -492,23 +1048,45 @@ static void dqlite__gateway_query_sql(struct dqlite__gateway *    g,
 
 	rc = dqlite__db_prepare(db, ctx->request->query_sql.sql, &stmt);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error, db->error);
+		dqlite__error_forward(&g->error, &db->error);
 		dqlite__gateway_failure(g, ctx, rc);
 		return;
 	}
 
+	/* When the request is completed, the statement needs to be
+	 * finalized. */
+	ctx->cleanup = DQLITE__GATEWAY_CLEANUP_FINALIZE;
+
+	/* Remember where the bindings start, in case they need to be applied
+	 * to a snapshot query as well. */
+	bindings = dqlite__message_body_tell(&ctx->request->message);
+
 	rc = dqlite__stmt_bind(stmt, &ctx->request->message);
 	if (rc != SQLITE_OK) {
-		dqlite__error_printf(&g->error, stmt->error);
+		dqlite__error_forward(&g->error, &stmt->error);
 		dqlite__gateway_failure(g, ctx, rc);
+		dqlite__gateway_cleanup(g, ctx, db, stmt);
 		return;
 	}
 
-	/* When the request is completed, the statement needs to be
-	 * finalized. */
-	ctx->cleanup = DQLITE__GATEWAY_CLEANUP_FINALIZE;
+	eligible     = dqlite__gateway_snapshot_eligible(g, db, stmt);
+	stmt->digest = eligible;
+	steps = sqlite3_stmt_status(stmt->stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
 
 	dqlite__gateway_query_batch(g, db, stmt, ctx);
+
+	/* Only queries streaming more batches hold the WAL long enough to be
+	 * worth a snapshot. Otherwise the statement is gone already. */
+	if (ctx->stmt != NULL) {
+		stmt->digest = 0;
+		if (eligible) {
+			dqlite__gateway_snapshot(g,
+			                         ctx,
+			                         ctx->request->query_sql.sql,
+			                         bindings,
+			                         steps);
+		}
+	}
 }
 
 static void dqlite__gateway_interrupt(struct dqlite__gateway *    g,
@@ -524,24 +1102,24 @@ static void dqlite__gateway_interrupt(struct dqlite__gateway *    g,
 	}
 
 	assert(g->ctxs[0].cleanup == DQLITE__GATEWAY_CLEANUP_NONE ||
-	       g->ctxs[0].cleanup == DQLITE__GATEWAY_CLEANUP_FINALIZE);
+	       g->ctxs[0].cleanup == DQLITE__GATEWAY_CLEANUP_FINALIZE ||
+	       g->ctxs[0].cleanup == DQLITE__GATEWAY_CLEANUP_SNAPSHOT ||
+	       g->ctxs[0].cleanup == DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET);
 
 	/* Take appropriate action depending on the cleanup code. */
-	switch (g->ctxs[0].cleanup) {
-	case DQLITE__GATEWAY_CLEANUP_NONE:
-		/* Nothing to do */
-		break;
-	case DQLITE__GATEWAY_CLEANUP_FINALIZE:
-		/* Finalize the statempt */
-		dqlite__db_finalize(g->ctxs[0].db, g->ctxs[0].stmt);
-		break;
-	}
+	dqlite__gateway_cleanup(
+	    g, &g->ctxs[0], g->ctxs[0].db, g->ctxs[0].stmt);
 
 out:
+	/* A parked request is dropped along with its barrier. */
+	dqlite__gateway_wait_detach(&g->barrier_wait);
+
 	g->ctxs[0].request = NULL;
 	g->ctxs[0].db      = NULL;
 	g->ctxs[0].stmt    = NULL;
+	g->ctxs[0].origin  = NULL;
 	g->ctxs[0].cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
+	g->ctxs[0].barrier = DQLITE__GATEWAY_BARRIER_NONE;
 
 	ctx->response.type = DQLITE_RESPONSE_EMPTY;
 }
@@ -566,41 +1144,110 @@ static void dqlite__gateway_dispatch(struct dqlite__gateway *    g,
 		break;
 	}
 
+	/* A parked request gets dispatched again once its barrier
+	 * completes. */
+	if (ctx->barrier == DQLITE__GATEWAY_BARRIER_PARKED) {
+		return;
+	}
+
 	g->callbacks.xFlush(g->callbacks.ctx, &ctx->response);
 }
 
 #ifdef DQLITE_EXPERIMENTAL
 
-/* Use a global variable to pass a gateway object as argument of the main loop
- * coroutine entry point. */
-static struct dqlite__gateway *dqlite__gateway_loop_arg;
-
-static void dqlite__gateway_loop()
+/* Serve the pending database request, in the gateway's coroutine. */
+static void dqlite__gateway_loop(void *arg)
 {
-	struct dqlite__gateway *g = dqlite__gateway_loop_arg;
+	struct dqlite__gateway *    g   = arg;
+	struct dqlite__gateway_ctx *ctx = &g->ctxs[0];
 
-	/* Pass control back to the main coroutine, as all we need to do
-	 * initially is to set the gateway local variable above */
-	co_switch(g->main_coroutine);
+	assert(ctx->request != NULL);
 
-	while (1) {
-		struct dqlite__gateway_ctx *ctx = &g->ctxs[0];
+	dqlite__gateway_dispatch(g, ctx);
+}
 
-		assert(ctx->request != NULL);
+#endif /* DQLITE_EXPERIMENTAL */
 
-		dqlite__gateway_dispatch(g, ctx);
+/* Run the pending database request. */
+static int dqlite__gateway_run(struct dqlite__gateway *g)
+{
+#ifdef DQLITE_EXPERIMENTAL
+	/* Database requests are handled asynchronously by the gateway
+	 * coroutine, held only until the request completes, which goes back to
+	 * the pool unless the request got suspended. */
+	assert(g->coroutine == NULL);
+	g->coroutine = dqlite__coroutine_get(g->coroutines);
+	if (g->coroutine == NULL) {
+		dqlite__error_oom(&g->error,
+		                  "failed to create request coroutine");
+		return DQLITE_NOMEM;
+	}
 
-		co_switch(g->main_coroutine);
+	dqlite__coroutine_run(g->coroutine, dqlite__gateway_loop, g);
+	if (!dqlite__coroutine_running(g->coroutine)) {
+		dqlite__coroutine_put(g->coroutines, g->coroutine);
+		g->coroutine = NULL;
 	}
+#else
+	dqlite__gateway_dispatch(g, &g->ctxs[0]);
+#endif /* DQLITE_EXPERIMENTAL */
+
+	return 0;
 }
 
-#endif /* DQLITE_EXPERIMENTAL */
+/* Invoked when an asynchronous barrier completes. */
+static void dqlite__gateway_barrier_cb(void *arg, int status)
+{
+	struct dqlite__gateway_wait *w = arg;
+	struct dqlite__gateway *     g = w->g;
+	struct dqlite__gateway_ctx * ctx;
+	int                          parked;
+	int                          err;
+
+	sqlite3_free(w);
 
-void dqlite__gateway_init(struct dqlite__gateway *    g,
-                          struct dqlite__gateway_cbs *callbacks,
-                          struct dqlite_cluster *     cluster,
-                          struct dqlite_logger *      logger,
-                          struct dqlite__options *    options)
+	/* The request was interrupted or the gateway closed. */
+	if (g == NULL) {
+		return;
+	}
+
+	g->barrier_wait = NULL;
+
+	ctx = &g->ctxs[0];
+
+	assert(ctx->barrier == DQLITE__GATEWAY_BARRIER_STARTED ||
+	       ctx->barrier == DQLITE__GATEWAY_BARRIER_PARKED);
+
+	parked = ctx->barrier == DQLITE__GATEWAY_BARRIER_PARKED;
+
+	if (status == 0) {
+		ctx->barrier = DQLITE__GATEWAY_BARRIER_PASSED;
+	} else {
+		ctx->barrier    = DQLITE__GATEWAY_BARRIER_FAILED;
+		ctx->barrier_rc = status;
+	}
+
+	/* If the callback was invoked inline, the handler is still running. */
+	if (!parked) {
+		return;
+	}
+
+	err = dqlite__gateway_run(g);
+	if (err != 0) {
+		dqlite__gateway_failure(g, ctx, SQLITE_NOMEM);
+		g->callbacks.xFlush(g->callbacks.ctx, &ctx->response);
+	}
+}
+
+void dqlite__gateway_init(struct dqlite__gateway *     g,
+                          struct dqlite__gateway_cbs * callbacks,
+                          struct dqlite_cluster *      cluster,
+                          struct dqlite_logger *       logger,
+                          struct dqlite__options *     options,
+                          struct dqlite__metrics *     metrics,
+                          struct dqlite__db_pool *     pool,
+                          struct dqlite__advisor *     advisor,
+                          struct dqlite__message_pool *bufs)
 {
 	int i;
 
@@ -613,6 +1260,7 @@ void dqlite__gateway_init(struct dqlite__gateway *    g,
 
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_GATEWAY);
 
+	g->protocol  = DQLITE_PROTOCOL_VERSION;
 	g->client_id = 0;
 
 	dqlite__error_init(&g->error);
@@ -623,43 +1271,40 @@ void dqlite__gateway_init(struct dqlite__gateway *    g,
 	g->cluster = cluster;
 	g->logger  = logger;
 	g->options = options;
+	g->metrics = metrics;
+	g->pool    = pool;
+	g->advisor = advisor;
 
 	/* Reset all request contexts in the buffer */
 	for (i = 0; i < DQLITE__GATEWAY_MAX_REQUESTS; i++) {
 		g->ctxs[i].request = NULL;
 		g->ctxs[i].db      = NULL;
 		g->ctxs[i].stmt    = NULL;
+		g->ctxs[i].origin  = NULL;
 		g->ctxs[i].cleanup = DQLITE__GATEWAY_CLEANUP_NONE;
+		g->ctxs[i].barrier = DQLITE__GATEWAY_BARRIER_NONE;
 		dqlite__response_init(&g->ctxs[i].response);
+		g->ctxs[i].response.message.pool = bufs;
 	}
 
-	g->db = NULL;
+	g->db              = NULL;
+	g->barrier_wait    = NULL;
+	g->checkpoint_wait = NULL;
 
 #ifdef DQLITE_EXPERIMENTAL
-	g->main_coroutine = NULL;
-	g->loop_coroutine = NULL;
+	g->coroutines = NULL;
+	g->coroutine  = NULL;
 #endif /* DQLITE_EXPERIMENTAL */
 }
 
 #ifdef DQLITE_EXPERIMENTAL
 
-int dqlite__gateway_start(struct dqlite__gateway *g, uint64_t now)
+int dqlite__gateway_start(struct dqlite__gateway *       g,
+                          uint64_t                       now,
+                          struct dqlite__coroutine_pool *coroutines)
 {
-	g->heartbeat      = now;
-	g->main_coroutine = co_active();
-	g->loop_coroutine =
-	    co_create(1024 * 1024 * sizeof(void *), dqlite__gateway_loop);
-
-	if (g->loop_coroutine == NULL) {
-		return DQLITE_NOMEM;
-	}
-
-	dqlite__gateway_loop_arg = g;
-
-	/* Kick off the gateway loop coroutine, which will initialize itself by
-	 * saving a reference to this gateway object and then immediately switch
-	 * back here. */
-	co_switch(g->loop_coroutine);
+	g->heartbeat  = now;
+	g->coroutines = coroutines;
 
 	return 0;
 }
@@ -668,19 +1313,47 @@ int dqlite__gateway_start(struct dqlite__gateway *g, uint64_t now)
 
 void dqlite__gateway_close(struct dqlite__gateway *g)
 {
+	int reusable;
 	int i;
 
 	assert(g != NULL);
 
+	/* A database still being checkpointed is not reused, so the cluster
+	 * learns through xUnregister that it must not use it anymore, instead
+	 * of having it reused by another gateway in the meantime. Neither is a
+	 * database with a request suspended in the middle of a statement. */
+	reusable = g->checkpoint_wait == NULL;
+#ifdef DQLITE_EXPERIMENTAL
+	reusable = reusable && g->coroutine == NULL;
+#endif /* DQLITE_EXPERIMENTAL */
+
+	/* Asynchronous cluster calls still in progress will find nobody to
+	 * notify. */
+	dqlite__gateway_wait_detach(&g->barrier_wait);
+	dqlite__gateway_wait_detach(&g->checkpoint_wait);
+
+	/* Release the statement and snapshot of a query whose result set was
+	 * not fully consumed. */
+	if (g->ctxs[0].stmt != NULL) {
+		dqlite__gateway_cleanup(
+		    g, &g->ctxs[0], g->ctxs[0].db, g->ctxs[0].stmt);
+	}
+
+	/* Hand the database over to the pool if possible, otherwise close
+	 * it. */
 	if (g->db != NULL) {
-		dqlite__db_close(g->db);
-		sqlite3_free(g->db);
+		if (!reusable || g->pool == NULL ||
+		    dqlite__db_pool_put(g->pool, g->db) != 0) {
+			dqlite__db_close(g->db);
+			sqlite3_free(g->db);
+		}
 	}
 
 #ifdef DQLITE_EXPERIMENTAL
 
-	if (g->loop_coroutine != NULL) {
-		co_delete(g->loop_coroutine);
+	/* A request still suspended at this point will never be resumed. */
+	if (g->coroutine != NULL) {
+		dqlite__coroutine_put(g->coroutines, g->coroutine);
 	}
 
 #endif /* DQLITE_EXPERIMENTAL */
@@ -694,6 +1367,55 @@ void dqlite__gateway_close(struct dqlite__gateway *g)
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_GATEWAY);
 }
 
+int dqlite__gateway_parked(struct dqlite__gateway *g)
+{
+	assert(g != NULL);
+
+	return g->ctxs[0].barrier == DQLITE__GATEWAY_BARRIER_PARKED;
+}
+
+int dqlite__gateway_idle(struct dqlite__gateway *g)
+{
+	assert(g != NULL);
+
+	if (g->db == NULL || g->ctxs[0].request != NULL ||
+	    g->ctxs[0].stmt != NULL || g->checkpoint_wait != NULL) {
+		return 0;
+	}
+
+#ifdef DQLITE_EXPERIMENTAL
+	if (g->coroutine != NULL) {
+		return 0;
+	}
+#endif /* DQLITE_EXPERIMENTAL */
+
+	return 1;
+}
+
+uint64_t dqlite__gateway_throttle(struct dqlite__gateway *g,
+                                  struct dqlite__request *request)
+{
+	int64_t delay;
+
+	assert(g != NULL);
+	assert(request != NULL);
+
+	delay = dqlite__gateway_wal_pressure(g, request);
+	if (delay <= 0) {
+		return 0;
+	}
+
+	/* Like all durations in the metrics, the delay is accounted in
+	 * nanoseconds. */
+	if (g->metrics != NULL) {
+		DQLITE__METRICS_ADD(g->metrics, throttled, 1);
+		DQLITE__METRICS_ADD(
+		    g->metrics, throttle_time, (uint64_t)delay * 1000000);
+	}
+
+	return (uint64_t)delay;
+}
+
 int dqlite__gateway_ctx_for(struct dqlite__gateway *g, int type)
 {
 	int idx;
@@ -703,8 +1425,16 @@ int dqlite__gateway_ctx_for(struct dqlite__gateway *g, int type)
 	 * control ones. A control request can be served concurrently with a
 	 * database request, but not the other way round. */
 	switch (type) {
-	case DQLITE_REQUEST_HEARTBEAT:
 	case DQLITE_REQUEST_INTERRUPT:
+		/* Interrupting a query finalizes its statement, which must wait
+		 * until a response referencing the statement's memory has been
+		 * sent. */
+		if (dqlite__message_has_external(&g->ctxs[0].response.message)) {
+			return -1;
+		}
+		idx = 1;
+		break;
+	case DQLITE_REQUEST_HEARTBEAT:
 		idx = 1;
 		break;
 	default:
@@ -735,7 +1465,7 @@ int dqlite__gateway_handle(struct dqlite__gateway *g,
 	/* Abort if we can't accept the request at this time */
 	i = dqlite__gateway_ctx_for(g, request->type);
 	if (i == -1) {
-		dqlite__error_printf(&g->error,
+		dqlite__error_static(&g->error,
 		                     "concurrent request limit exceeded");
 		err = DQLITE_PROTO;
 		goto err;
@@ -750,14 +1480,13 @@ int dqlite__gateway_handle(struct dqlite__gateway *g,
 		 */
 		dqlite__gateway_dispatch(g, ctx);
 	} else {
+		ctx->barrier = DQLITE__GATEWAY_BARRIER_NONE;
 
-#ifdef DQLITE_EXPERIMENTAL
-		/* Database requests are handled asynchronously by the gateway
-		 * coroutine. */
-		co_switch(g->loop_coroutine);
-#else
-		dqlite__gateway_dispatch(g, ctx);
-#endif /* DQLITE_EXPERIMENTAL */
+		err = dqlite__gateway_run(g);
+		if (err != 0) {
+			ctx->request = NULL;
+			goto err;
+		}
 	}
 
 	return 0;
@@ -775,6 +1504,10 @@ static void dqlite__gateway_query_resume(struct dqlite__gateway *    g,
 	assert(ctx->db != NULL);
 	assert(ctx->stmt != NULL);
 
+	/* The batch which was still referencing the statement that the query
+	 * was moved away from has been sent. */
+	dqlite__gateway_origin_release(g, ctx);
+
 	dqlite__gateway_query_batch(g, ctx->db, ctx->stmt, ctx);
 
 	/* Notify user code that a response is available. */
@@ -793,6 +1526,8 @@ void dqlite__gateway_flushed(struct dqlite__gateway * g,
 	for (i = 0; i < DQLITE__GATEWAY_MAX_REQUESTS; i++) {
 		struct dqlite__gateway_ctx *ctx = &g->ctxs[i];
 		if (&ctx->response == response) {
+			/* Transient memory used to serve this batch. */
+			dqlite__message_arena_reset(&response->message);
 			dqlite__gateway_response_reset(response);
 			if (ctx->stmt != NULL) {
 				dqlite__gateway_query_resume(g, ctx);
@@ -812,4 +1547,6 @@ void dqlite__gateway_aborted(struct dqlite__gateway * g,
 {
 	assert(g != NULL);
 	assert(response != NULL);
+
+	dqlite__message_arena_reset(&response->message);
 }
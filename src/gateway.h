@@ -11,19 +11,16 @@
 #include <stdio.h>
 #include <time.h>
 
-#ifdef DQLITE_EXPERIMENTAL
-
-#include <libco.h>
-
-#endif /* DQLITE_EXPERIMENTAL */
-
 #include "../include/dqlite.h"
 
 #include "../include/dqlite.h"
 
+#include "advisor.h"
+#include "coroutine.h"
 #include "db.h"
 #include "error.h"
 #include "fsm.h"
+#include "metrics.h"
 #include "options.h"
 #include "request.h"
 #include "response.h"
@@ -38,13 +35,40 @@
  * statement needs to be finalized. */
 #define DQLITE__GATEWAY_CLEANUP_FINALIZE 1
 
+/* Cleanup code indicating that in order to complete the request the associated
+ * statement needs to be finalized and the database snapshot it runs against
+ * needs to be closed. The statement of the original database that the query
+ * was moved away from is finalized as soon as its last batch is sent. */
+#define DQLITE__GATEWAY_CLEANUP_SNAPSHOT 2
+
+/* Same as DQLITE__GATEWAY_CLEANUP_SNAPSHOT, except that the statement of the
+ * original database belongs to the client, so it's just reset. */
+#define DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET 3
+
+/* States of the raft barrier of a database request. */
+#define DQLITE__GATEWAY_BARRIER_NONE 0    /* Not performed yet */
+#define DQLITE__GATEWAY_BARRIER_STARTED 1 /* Asynchronous call in progress */
+#define DQLITE__GATEWAY_BARRIER_PARKED 2  /* Request waiting for completion */
+#define DQLITE__GATEWAY_BARRIER_PASSED 3  /* No raft logs pending */
+#define DQLITE__GATEWAY_BARRIER_FAILED 4  /* Barrier failed with barrier_rc */
+
 /* Context for the gateway request handlers */
 struct dqlite__gateway_ctx {
 	struct dqlite__request *request;
 	struct dqlite__response response;
-	struct dqlite__db *     db;      /* For multi-response queries */
-	struct dqlite__stmt *   stmt;    /* For multi-response queries */
-	int                     cleanup; /* Code indicating how to cleanup */
+	struct dqlite__db *     db;         /* For multi-response queries */
+	struct dqlite__stmt *   stmt;       /* For multi-response queries */
+	struct dqlite__stmt *   origin;     /* Replaced by a snapshot query */
+	int                     cleanup;    /* Code indicating how to cleanup */
+	int                     barrier;    /* State of the raft barrier */
+	int                     barrier_rc; /* Error of a failed barrier */
+};
+
+/* Pending asynchronous call to the cluster interface. It's allocated
+ * separately since it may complete after the gateway has been closed, in which
+ * case it just gets detached from it. */
+struct dqlite__gateway_wait {
+	struct dqlite__gateway *g; /* Gateway to notify, or NULL if detached */
 };
 
 /* Callbacks that the gateway will invoke during the various phases of request
@@ -57,6 +81,14 @@ struct dqlite__gateway_cbs {
 	 * the response data to the client and that the response buffer can be
 	 * used for another request. */
 	void (*xFlush)(void *ctx, struct dqlite__response *response);
+
+	/* Optional. If set, the rows yielded by queries are handed to this
+	 * callback one at a time instead of being encoded in the response,
+	 * which then just signals whether the result set is over. Rows still
+	 * come in batches, the next one being produced once the response of
+	 * the previous one is flushed. A non-zero return value aborts the
+	 * query. */
+	int (*xRow)(void *ctx, sqlite3_stmt *stmt);
 };
 
 /*
@@ -64,6 +96,9 @@ struct dqlite__gateway_cbs {
  * SQLite.
  */
 struct dqlite__gateway {
+	/* public */
+	uint64_t protocol; /* Protocol version spoken by the client */
+
 	/* read-only */
 	uint64_t      client_id;
 	uint64_t      heartbeat; /* Last successful heartbeat from the client */
@@ -73,7 +108,10 @@ struct dqlite__gateway {
 	struct dqlite__gateway_cbs callbacks; /* User callbacks */
 	dqlite_cluster *           cluster;   /* Cluster API implementation  */
 	struct dqlite__options *   options;   /* Configuration options */
+	struct dqlite__metrics *   metrics;   /* Operational metrics, or NULL */
 	struct dqlite_logger *     logger;    /* Logger to use */
+	struct dqlite__db_pool *   pool;      /* Idle databases, or NULL */
+	struct dqlite__advisor *   advisor;   /* Index advisor, or NULL */
 
 	/* Buffer holding responses for in-progress requests. Clients are
 	 * expected to issue one SQL request at a time and wait for the
@@ -85,35 +123,46 @@ struct dqlite__gateway {
 
 	struct dqlite__db *db; /* Open database */
 
+	struct dqlite__gateway_wait *barrier_wait;    /* Pending barrier */
+	struct dqlite__gateway_wait *checkpoint_wait; /* Pending checkpoint */
+
 #ifdef DQLITE_EXPERIMENTAL
 
-	cothread_t main_coroutine; /* Main coroutine ID */
-	cothread_t loop_coroutine; /* Coroutine ID of the gateway main loop. */
+	struct dqlite__coroutine_pool *coroutines; /* Pool to run requests in */
+	struct dqlite__coroutine *     coroutine;  /* Running request, if any */
 
 #endif /* DQLITE_EXPERIMENTAL */
 };
 
-void dqlite__gateway_init(struct dqlite__gateway *    g,
-                          struct dqlite__gateway_cbs *callbacks,
-                          struct dqlite_cluster *     cluster,
-			  struct dqlite_logger *      logger,
-                          struct dqlite__options *    options);
+void dqlite__gateway_init(struct dqlite__gateway *     g,
+                          struct dqlite__gateway_cbs * callbacks,
+                          struct dqlite_cluster *      cluster,
+                          struct dqlite_logger *       logger,
+                          struct dqlite__options *     options,
+                          struct dqlite__metrics *     metrics,
+                          struct dqlite__db_pool *     pool,
+                          struct dqlite__advisor *     advisor,
+                          struct dqlite__message_pool *bufs);
 
 void dqlite__gateway_close(struct dqlite__gateway *g);
 
 /* Start the gateway.
  *
- * This function will kick off the gateway loop which runs in its own coroutine
- * and has its own stack. Whenever blocking I/O is required (for example when
- * applying a new raft entry) control will be passed back to the main thread
- * loop, and the gateway loop will resume when the relevant I/O is completed.
+ * Database requests will be run in coroutines taken from the given pool (or
+ * created on the fly if it's NULL), each with its own stack. Whenever blocking
+ * I/O is required (for example when applying a new raft entry) control will be
+ * passed back to the main thread loop, and the request will resume when the
+ * relevant I/O is completed. The coroutine is handed back to the pool as soon
+ * as the request completes.
  *
  * The 'now' parameter holds the current time, and it's used to set the initial
  * heartbeat timestamp.
  *
  * It's a separate function from dqlite__gateway_init() since it must be called
  * from the main loop thread. */
-int dqlite__gateway_start(struct dqlite__gateway *g, uint64_t now);
+int dqlite__gateway_start(struct dqlite__gateway *       g,
+                          uint64_t                       now,
+                          struct dqlite__coroutine_pool *coroutines);
 
 /* Start handling a new client request.
  *
@@ -122,7 +171,8 @@ int dqlite__gateway_start(struct dqlite__gateway *g, uint64_t now);
  * function returns.
  *
  * Responses for requests that need to perform network or disk I/O will be
- * generated asynchronously and xFlush() will be invoked when done.
+ * generated asynchronously and xFlush() will be invoked when done. This is
+ * the case for database requests when the cluster has xBarrierAsync.
  *
  * Some requests might generate more than one response (for example when a
  * SELECT query yields a large number of rows). In that case xFlush() will be
@@ -140,6 +190,24 @@ int dqlite__gateway_start(struct dqlite__gateway *g, uint64_t now);
 int dqlite__gateway_handle(struct dqlite__gateway *g,
                            struct dqlite__request *request);
 
+/* Return true if the pending database request is parked waiting for an
+ * asynchronous raft barrier, in which case the request object passed to
+ * dqlite__gateway_handle must be left untouched until its response gets
+ * flushed. */
+int dqlite__gateway_parked(struct dqlite__gateway *g);
+
+/* Return true if the gateway has an open database which no request is
+ * currently using, so background work can run against it. */
+int dqlite__gateway_idle(struct dqlite__gateway *g);
+
+/* Return how many milliseconds a request should be delayed before being handed
+ * to dqlite__gateway_handle, because the WAL of the database it writes to has
+ * grown past the configured soft limit. Writes that would push the WAL past
+ * the hard limit are not delayed, since the gateway rejects them right away
+ * with SQLITE_BUSY. */
+uint64_t dqlite__gateway_throttle(struct dqlite__gateway *g,
+                                  struct dqlite__request *request);
+
 /* Return the request ctx index that the gateway will use to handle a request of
  * the given type at this moment, or -1 if the gateway can't handle a request of
  * that type right now. */
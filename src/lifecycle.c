@@ -24,6 +24,14 @@ static char *dqlite__lifecycle_type_names[] = {
     "dqlite__db",          /* DQLITE__LIFECYCLE_DB */
     "dqlite__stmt",        /* DQLITE__LIFECYCLE_STMT */
     "dqlite__replication", /* DQLITE__LIFECYCLE_REPLICATION */
+    "dqlite__db_pool",     /* DQLITE__LIFECYCLE_DB_POOL */
+    "dqlite__advisor",     /* DQLITE__LIFECYCLE_ADVISOR */
+    "dqlite__uring",        /* DQLITE__LIFECYCLE_URING */
+    "dqlite__message_pool", /* DQLITE__LIFECYCLE_MESSAGE_POOL */
+    "dqlite__capture",      /* DQLITE__LIFECYCLE_CAPTURE */
+    "dqlite__direct",       /* DQLITE__LIFECYCLE_DIRECT */
+    "dqlite__coroutine_pool", /* DQLITE__LIFECYCLE_COROUTINE_POOL */
+    "dqlite__log",            /* DQLITE__LIFECYCLE_LOG */
 };
 
 static int dqlite__lifecycle_refcount[] = {
@@ -41,6 +49,14 @@ static int dqlite__lifecycle_refcount[] = {
     0, /* DQLITE__LIFECYCLE_DB */
     0, /* DQLITE__LIFECYCLE_STMT */
     0, /* DQLITE__LIFECYCLE_REPLICATION */
+    0, /* DQLITE__LIFECYCLE_DB_POOL */
+    0, /* DQLITE__LIFECYCLE_ADVISOR */
+    0, /* DQLITE__LIFECYCLE_URING */
+    0, /* DQLITE__LIFECYCLE_MESSAGE_POOL */
+    0, /* DQLITE__LIFECYCLE_CAPTURE */
+    0, /* DQLITE__LIFECYCLE_DIRECT */
+    0, /* DQLITE__LIFECYCLE_COROUTINE_POOL */
+    0, /* DQLITE__LIFECYCLE_LOG */
     DQLITE__LIFECYCLE_REFCOUNT_NULL};
 
 static char dqlite__lifecycle_errmsg[4096];
@@ -20,6 +20,14 @@
 #define DQLITE__LIFECYCLE_DB 11
 #define DQLITE__LIFECYCLE_STMT 12
 #define DQLITE__LIFECYCLE_REPLICATION 13
+#define DQLITE__LIFECYCLE_DB_POOL 14
+#define DQLITE__LIFECYCLE_ADVISOR 15
+#define DQLITE__LIFECYCLE_URING 16
+#define DQLITE__LIFECYCLE_MESSAGE_POOL 17
+#define DQLITE__LIFECYCLE_CAPTURE 18
+#define DQLITE__LIFECYCLE_DIRECT 19
+#define DQLITE__LIFECYCLE_COROUTINE_POOL 20
+#define DQLITE__LIFECYCLE_LOG 21
 
 #ifdef DQLITE_DEBUG
 void dqlite__lifecycle_init(int type);
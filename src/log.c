@@ -0,0 +1,234 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/dqlite.h"
+
+#include "lifecycle.h"
+#include "log.h"
+
+/* Messages throttled by all call sites of the process. */
+static uint64_t dqlite__log_throttled_count = 0;
+
+int dqlite__log_site_enter(struct dqlite__log_site *site)
+{
+	struct timespec now;
+	uint64_t        window;
+
+	assert(site != NULL);
+
+	/* The coarse clock is cheap enough to be read for every message. */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+	window = __atomic_load_n(&site->window, __ATOMIC_SEQ_CST);
+
+	/* Sites might be entered by several threads at once, so only the one
+	 * moving the window forward resets the count. A message racing with it
+	 * might be counted against the wrong second, which is harmless. */
+	if (window != (uint64_t)now.tv_sec &&
+	    __atomic_compare_exchange_n(&site->window,
+	                                &window,
+	                                (uint64_t)now.tv_sec,
+	                                0,
+	                                __ATOMIC_SEQ_CST,
+	                                __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&site->count, 0, __ATOMIC_SEQ_CST);
+	}
+
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_SEQ_CST) <=
+	    DQLITE__LOG_SITE_BURST) {
+		return 1;
+	}
+
+	__atomic_add_fetch(&dqlite__log_throttled_count, 1, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+uint64_t dqlite__log_throttled(void)
+{
+	return __atomic_load_n(&dqlite__log_throttled_count, __ATOMIC_SEQ_CST);
+}
+
+/* Hand the messages published so far to the sink, in order. Only one thread
+ * at a time may drain the ring. */
+static void dqlite__log_drain(struct dqlite__log *l)
+{
+	struct dqlite__log_entry *e;
+
+	while (1) {
+		e = &l->entries[l->tail % DQLITE__LOG_RING_LEN];
+
+		/* Stop at the first slot which is empty or still being
+		 * written. */
+		if (__atomic_load_n(&e->seq, __ATOMIC_SEQ_CST) != l->tail + 1) {
+			break;
+		}
+
+		l->sink->xLogf(l->sink->ctx, e->level, "%s", e->text);
+
+		/* Make the slot available again for the next lap. */
+		__atomic_store_n(
+		    &e->seq, l->tail + DQLITE__LOG_RING_LEN, __ATOMIC_SEQ_CST);
+		l->tail++;
+	}
+}
+
+static void *dqlite__log_run(void *arg)
+{
+	struct dqlite__log *l = arg;
+
+	while (1) {
+		sem_wait(&l->wakeup);
+
+		dqlite__log_drain(l);
+
+		if (!__atomic_load_n(&l->running, __ATOMIC_SEQ_CST)) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* Implementation of xLogf, which never blocks.
+ *
+ * Writers claim slots with the bounded queue algorithm by Dmitry Vyukov: a
+ * slot can be claimed for a position when its sequence number matches it, and
+ * it's published by setting the sequence number to the next position. */
+static void dqlite__log_logf(void *ctx, int level, const char *format, ...)
+{
+	struct dqlite__log *      l = ctx;
+	struct dqlite__log_entry *e;
+	char                      text[DQLITE__LOG_ENTRY_LEN];
+	va_list                   args;
+	unsigned                  pos;
+	unsigned                  seq;
+
+	if (!__atomic_load_n(&l->running, __ATOMIC_SEQ_CST)) {
+		va_start(args, format);
+		vsnprintf(text, sizeof text, format, args);
+		va_end(args);
+
+		l->sink->xLogf(l->sink->ctx, level, "%s", text);
+
+		return;
+	}
+
+	pos = __atomic_load_n(&l->head, __ATOMIC_SEQ_CST);
+
+	while (1) {
+		e   = &l->entries[pos % DQLITE__LOG_RING_LEN];
+		seq = __atomic_load_n(&e->seq, __ATOMIC_SEQ_CST);
+
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&l->head,
+			                                &pos,
+			                                pos + 1,
+			                                0,
+			                                __ATOMIC_SEQ_CST,
+			                                __ATOMIC_SEQ_CST)) {
+				break;
+			}
+		} else if ((int)(seq - pos) < 0) {
+			/* The slot still holds the message of the previous
+			 * lap, so the ring is full. */
+			__atomic_add_fetch(&l->dropped, 1, __ATOMIC_SEQ_CST);
+			return;
+		} else {
+			pos = __atomic_load_n(&l->head, __ATOMIC_SEQ_CST);
+		}
+	}
+
+	va_start(args, format);
+	vsnprintf(e->text, sizeof e->text, format, args);
+	va_end(args);
+
+	e->level = level;
+
+	__atomic_store_n(&e->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	sem_post(&l->wakeup);
+}
+
+int dqlite__log_init(struct dqlite__log *l, dqlite_logger *sink)
+{
+	unsigned i;
+	int      err;
+
+	assert(l != NULL);
+	assert(sink != NULL);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_LOG);
+
+	l->logger.ctx   = l;
+	l->logger.xLogf = dqlite__log_logf;
+	l->dropped      = 0;
+	l->sink         = sink;
+	l->running      = 0;
+	l->head         = 0;
+	l->tail         = 0;
+
+	for (i = 0; i < DQLITE__LOG_RING_LEN; i++) {
+		l->entries[i].seq = i;
+	}
+
+	err = sem_init(&l->wakeup, 0, 0);
+	if (err != 0) {
+		dqlite__lifecycle_close(DQLITE__LIFECYCLE_LOG);
+		return DQLITE_ERROR;
+	}
+
+	return 0;
+}
+
+void dqlite__log_close(struct dqlite__log *l)
+{
+	int err;
+
+	assert(l != NULL);
+	assert(!l->running);
+
+	/* Messages published by writers which raced with the drain thread
+	 * shutting down. */
+	dqlite__log_drain(l);
+
+	err = sem_destroy(&l->wakeup);
+	assert(err == 0);
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_LOG);
+}
+
+int dqlite__log_start(struct dqlite__log *l)
+{
+	int err;
+
+	assert(l != NULL);
+	assert(!l->running);
+
+	__atomic_store_n(&l->running, 1, __ATOMIC_SEQ_CST);
+
+	err = pthread_create(&l->thread, NULL, dqlite__log_run, l);
+	if (err != 0) {
+		__atomic_store_n(&l->running, 0, __ATOMIC_SEQ_CST);
+		return DQLITE_ERROR;
+	}
+
+	return 0;
+}
+
+void dqlite__log_stop(struct dqlite__log *l)
+{
+	int err;
+
+	assert(l != NULL);
+	assert(l->running);
+
+	__atomic_store_n(&l->running, 0, __ATOMIC_SEQ_CST);
+
+	sem_post(&l->wakeup);
+
+	err = pthread_join(l->thread, NULL);
+	assert(err == 0);
+}
@@ -1,25 +1,111 @@
+/******************************************************************************
+ *
+ * Logging helpers.
+ *
+ * Each call site of the dqlite__*f macros is rate limited on its own, so a
+ * burst of failures can't flood the logger.
+ *
+ * A server hands its user-provided logger to a dqlite__log object, which
+ * formats messages into a fixed ring of slots and returns right away. A
+ * background thread drains the ring and invokes the user's logger, so a slow
+ * sink never stalls the event loop. Messages that find the ring full are
+ * dropped and counted.
+ *
+ *****************************************************************************/
+
 #ifndef DQLITE_DEBUG_H
 #define DQLITE_DEBUG_H
 
 #include <libgen.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "../include/dqlite.h"
 
+/* Maximum number of messages per second logged by a single call site. */
+#define DQLITE__LOG_SITE_BURST 10
+
+/* Number of slots in the ring of a dqlite__log. */
+#define DQLITE__LOG_RING_LEN 256
+
+/* Size of a slot, longer messages get truncated. */
+#define DQLITE__LOG_ENTRY_LEN 256
+
+/* Rate limiting state of a single call site. */
+struct dqlite__log_site {
+	uint64_t window; /* Second the count refers to */
+	unsigned count;  /* Messages attempted in the current second */
+};
+
+/* Return true if a message from the given site can be logged. Messages past
+ * the burst of the current second are counted as throttled. */
+int dqlite__log_site_enter(struct dqlite__log_site *site);
+
+/* Return the number of messages throttled so far across all call sites of
+ * the process. */
+uint64_t dqlite__log_throttled(void);
+
+#define dqlite__logf(P, LEVEL, FORMAT, ARGS...)                                     \
+	do {                                                                        \
+		static struct dqlite__log_site dqlite__log_site_;                   \
+		if (P->logger != NULL &&                                            \
+		    dqlite__log_site_enter(&dqlite__log_site_)) {                   \
+			P->logger->xLogf(                                           \
+			    P->logger->ctx, LEVEL, FORMAT, ##ARGS);                 \
+		}                                                                   \
+	} while (0)
+
 #ifdef DQLITE_DEBUG
 #define dqlite__debugf(P, FORMAT, ARGS...)                                          \
-	if (P->logger != NULL)                                                      \
-	P->logger->xLogf(P->logger->ctx, DQLITE_LOG_DEBUG, FORMAT, ##ARGS)
+	dqlite__logf(P, DQLITE_LOG_DEBUG, FORMAT, ##ARGS)
 #else
 #define dqlite__debugf(P, FORMAT, ARGS...)
 #endif /* DQLITE_DEBUG */
 
 #define dqlite__infof(P, FORMAT, ARGS...)                                           \
-	if (P->logger != NULL)                                                      \
-	P->logger->xLogf(P->logger->ctx, DQLITE_LOG_INFO, FORMAT, ##ARGS)
+	dqlite__logf(P, DQLITE_LOG_INFO, FORMAT, ##ARGS)
 
 #define dqlite__errorf(P, FORMAT, ARGS...)                                          \
-	if (P->logger != NULL)                                                      \
-	P->logger->xLogf(P->logger->ctx, DQLITE_LOG_ERROR, FORMAT, ##ARGS)
+	dqlite__logf(P, DQLITE_LOG_ERROR, FORMAT, ##ARGS)
+
+/* A formatted message waiting to be handed to the sink. */
+struct dqlite__log_entry {
+	unsigned seq;                         /* Ring position it's valid for */
+	int      level;                       /* One of DQLITE_LOG_* */
+	char     text[DQLITE__LOG_ENTRY_LEN]; /* Formatted message */
+};
+
+/* Logger forwarding messages to a sink from a background thread. */
+struct dqlite__log {
+	/* read-only */
+	dqlite_logger logger;  /* Interface to hand to code logging */
+	uint64_t      dropped; /* Messages dropped because the ring was full */
+
+	/* private */
+	dqlite_logger *          sink;    /* User-provided logger */
+	int                      running; /* Whether the drain thread runs */
+	unsigned                 head;    /* Next position claimed by writers */
+	unsigned                 tail;    /* Next position to drain */
+	sem_t                    wakeup;  /* Signal new messages */
+	pthread_t                thread;  /* Drain thread */
+	struct dqlite__log_entry entries[DQLITE__LOG_RING_LEN];
+};
+
+/* Initialize a log forwarding messages to the given sink.
+ *
+ * Until dqlite__log_start is called, messages are passed to the sink right
+ * away by the thread logging them. */
+int dqlite__log_init(struct dqlite__log *l, dqlite_logger *sink);
+
+/* Flush any message left and release all resources. */
+void dqlite__log_close(struct dqlite__log *l);
+
+/* Start the drain thread. */
+int dqlite__log_start(struct dqlite__log *l);
+
+/* Hand all pending messages to the sink and stop the drain thread. */
+void dqlite__log_stop(struct dqlite__log *l);
 
 #endif /* DQLITE_DEBUG_H */
@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include <sqlite3.h>
+
+#include "memory.h"
+#include "metrics.h"
+
+void dqlite__memory_init(struct dqlite__memory *m, uint64_t budget)
+{
+	assert(m != NULL);
+
+	m->budget  = budget;
+	m->used    = 0;
+	m->sheds   = 0;
+	m->step    = 0;
+	m->settled = 0;
+}
+
+int dqlite__memory_next(struct dqlite__memory *m)
+{
+	uint64_t used;
+
+	assert(m != NULL);
+
+	used = (uint64_t)sqlite3_memory_used();
+	DQLITE__METRICS_SET(m, used, used);
+
+	if (m->budget == 0 ||
+	    used < m->budget / 100 * DQLITE__MEMORY_HIGH_WATER) {
+		m->step    = 0;
+		m->settled = 0;
+		return -1;
+	}
+
+	if (m->step == DQLITE__MEMORY_STEPS) {
+		/* Give the memory released by the steps of this round a chance
+		 * to be reused, and remember what's left. */
+		if (m->settled == 0) {
+			m->settled = used;
+			return -1;
+		}
+
+		if (used <= m->settled) {
+			return -1;
+		}
+
+		m->step    = 0;
+		m->settled = 0;
+	}
+
+	DQLITE__METRICS_SET(m, sheds, m->sheds + 1);
+
+	return m->step++;
+}
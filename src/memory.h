@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ * Keep the memory used by a server under a budget.
+ *
+ * Usage is measured with sqlite3_memory_used(), which covers what goes through
+ * the SQLite allocator: database pages held by the VFS, page caches, prepared
+ * statements, message buffers and per-connection state. It does not cover
+ * memory allocated with malloc, like libuv handles, coroutine stacks, io_uring
+ * buffers or what the cluster implementation allocates. The figure is
+ * process-wide, so it includes the usage of any other server or SQLite user in
+ * the same process.
+ *
+ * When usage gets close to the budget, caches are shed one step at a time,
+ * cheapest to rebuild first, until usage is back under the high water mark:
+ *
+ *  1. Free the idle message buffers kept for reuse.
+ *  2. Have every open database release the unused pages of its page cache.
+ *  3. Close the idle databases kept for reuse, dropping their page caches.
+ *  4. Finalize the least recently used prepared statements which are not
+ *     being run, keeping their SQL text so they get prepared again the next
+ *     time they're used.
+ *
+ * Once all steps have been run, no new round is started until usage grows
+ * past what the last round left, since shedding the same caches again would
+ * not free anything.
+ *
+ * Database pages held by the VFS are never shed, since they are the data
+ * itself.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_MEMORY_H
+#define DQLITE_MEMORY_H
+
+#include <stdint.h>
+
+/* Shedding steps, in the order they are run. */
+#define DQLITE__MEMORY_TRIM 0    /* Free pooled message buffers */
+#define DQLITE__MEMORY_RELEASE 1 /* Release unused page cache memory */
+#define DQLITE__MEMORY_SHRINK 2  /* Close pooled idle databases */
+#define DQLITE__MEMORY_EVICT 3   /* Finalize idle prepared statements */
+#define DQLITE__MEMORY_STEPS 4
+
+/* Percentage of the budget past which steps start being run. */
+#define DQLITE__MEMORY_HIGH_WATER 90
+
+/* The used and sheds fields can be read by any thread, through the
+ * DQLITE__METRICS_GET macro. */
+struct dqlite__memory {
+	/* read-only */
+	uint64_t budget; /* Bytes to stay under, or 0 for no budget */
+	uint64_t used;   /* Bytes in use when last sampled */
+	uint64_t sheds;  /* Shedding steps run so far */
+
+	/* private */
+	int      step;    /* Next step to run */
+	uint64_t settled; /* Usage left by the last round, or 0 */
+};
+
+void dqlite__memory_init(struct dqlite__memory *m, uint64_t budget);
+
+/* Sample the current memory usage and return the next shedding step to run,
+ * or -1 if usage is under the high water mark, or if all steps have been run
+ * and usage hasn't grown since. */
+int dqlite__memory_next(struct dqlite__memory *m);
+
+#endif /* DQLITE_MEMORY_H */
@@ -19,6 +19,89 @@
 #error "Requires IEEE 754 floating point!"
 #endif
 
+void dqlite__message_pool_init(struct dqlite__message_pool *p, unsigned cap)
+{
+	assert(p != NULL);
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_MESSAGE_POOL);
+
+	p->bufs = NULL;
+	p->len  = 0;
+	p->cap  = cap;
+}
+
+void dqlite__message_pool_close(struct dqlite__message_pool *p)
+{
+	assert(p != NULL);
+
+	dqlite__message_pool_trim(p);
+
+	if (p->bufs != NULL) {
+		sqlite3_free(p->bufs);
+	}
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_MESSAGE_POOL);
+}
+
+void dqlite__message_pool_trim(struct dqlite__message_pool *p)
+{
+	unsigned i;
+
+	assert(p != NULL);
+
+	for (i = 0; i < p->len; i++) {
+		sqlite3_free(p->bufs[i]);
+	}
+
+	p->len = 0;
+}
+
+/* Take a free buffer from the pool, or allocate a new one if the pool is empty
+ * or NULL. */
+static char *dqlite__message_pool_get(struct dqlite__message_pool *p)
+{
+	if (p != NULL && p->len > 0) {
+		p->len--;
+		return p->bufs[p->len];
+	}
+
+	/* Allocations returned by SQLite are 8-byte aligned, as required for
+	 * reading words in place. */
+	return sqlite3_malloc(DQLITE__MESSAGE_BUF_LEN);
+}
+
+/* Hand a buffer back to the pool, or free it if the pool is full or NULL. */
+static void dqlite__message_pool_put(struct dqlite__message_pool *p, char *buf)
+{
+	if (p == NULL || p->len == p->cap) {
+		goto err;
+	}
+
+	if (p->bufs == NULL) {
+		p->bufs = sqlite3_malloc(p->cap * sizeof *p->bufs);
+		if (p->bufs == NULL) {
+			goto err;
+		}
+	}
+
+	p->bufs[p->len] = buf;
+	p->len++;
+
+	return;
+
+err:
+	sqlite3_free(buf);
+}
+
+/* Hand the static body buffer back, if borrowed. */
+static void dqlite__message_body_release(struct dqlite__message *m)
+{
+	if (m->body1 != NULL) {
+		dqlite__message_pool_put(m->pool, m->body1);
+		m->body1 = NULL;
+	}
+}
+
 static void dqlite__message_reset(struct dqlite__message *m)
 {
 	assert(m != NULL);
@@ -31,19 +114,21 @@ static void dqlite__message_reset(struct dqlite__message *m)
 	m->body2.len  = 0;
 	m->offset1    = 0;
 	m->offset2    = 0;
+	m->n_external = 0;
 }
 
 void dqlite__message_init(struct dqlite__message *m)
 {
 	assert(m != NULL);
 
-	/* The statically allocated buffer is aligned to word boundary */
-	/* TODO: re-enable this assertion once we figure a way to do make it
-	 * work on 32-bit. */
-	/* assert((uintptr_t)m->body1 % DQLITE__MESSAGE_WORD_SIZE == 0); */
-
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_MESSAGE);
 
+	m->pool  = NULL;
+	m->body1 = NULL;
+
+	m->arena_offset = 0;
+	m->arena_extra  = NULL;
+
 	dqlite__message_reset(m);
 
 	dqlite__error_init(&m->error);
@@ -55,6 +140,9 @@ void dqlite__message_close(struct dqlite__message *m)
 
 	dqlite__error_close(&m->error);
 
+	dqlite__message_body_release(m);
+	dqlite__message_arena_reset(m);
+
 	if (m->body2.base != NULL) {
 		sqlite3_free(m->body2.base);
 	}
@@ -62,6 +150,69 @@ void dqlite__message_close(struct dqlite__message *m)
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_MESSAGE);
 }
 
+void *dqlite__message_arena_alloc(struct dqlite__message *m, size_t size)
+{
+	void **extra;
+	char * p;
+
+	assert(m != NULL);
+
+	/* Keep allocations aligned to words. */
+	size = (size + DQLITE__MESSAGE_WORD_SIZE - 1) &
+	       ~(size_t)(DQLITE__MESSAGE_WORD_SIZE - 1);
+
+	if (size <= sizeof m->arena - m->arena_offset) {
+		p = (char *)m->arena + m->arena_offset;
+		m->arena_offset += size;
+
+		return p;
+	}
+
+	/* Heap allocations are chained through a leading word. */
+	extra = sqlite3_malloc(DQLITE__MESSAGE_WORD_SIZE + size);
+	if (extra == NULL) {
+		return NULL;
+	}
+
+	*extra         = m->arena_extra;
+	m->arena_extra = extra;
+
+	return (char *)extra + DQLITE__MESSAGE_WORD_SIZE;
+}
+
+void dqlite__message_arena_reset(struct dqlite__message *m)
+{
+	void **extra;
+
+	assert(m != NULL);
+
+	m->arena_offset = 0;
+
+	while (m->arena_extra != NULL) {
+		extra          = m->arena_extra;
+		m->arena_extra = *extra;
+		sqlite3_free(extra);
+	}
+}
+
+int dqlite__message_body_borrow(struct dqlite__message *m)
+{
+	assert(m != NULL);
+
+	if (m->body1 != NULL) {
+		return 0;
+	}
+
+	m->body1 = dqlite__message_pool_get(m->pool);
+	if (m->body1 == NULL) {
+		dqlite__error_oom(&m->error,
+		                  "failed to allocate message body buffer");
+		return DQLITE_NOMEM;
+	}
+
+	return 0;
+}
+
 void dqlite__message_header_recv_start(struct dqlite__message *m, uv_buf_t *buf)
 {
 	assert(m != NULL);
@@ -84,13 +235,13 @@ int dqlite__message_header_recv_done(struct dqlite__message *m)
 	m->words = dqlite__flip32(m->words);
 	/* The message body can't be empty. */
 	if (m->words == 0) {
-		dqlite__error_printf(&m->error, "empty message body");
+		dqlite__error_static(&m->error, "empty message body");
 		return DQLITE_PROTO;
 	}
 
 	/* The message body can't exeed DQLITE__MESSAGE_MAX_WORDS. */
 	if (m->words > DQLITE__MESSAGE_MAX_WORDS) {
-		dqlite__error_printf(&m->error, "message body too large");
+		dqlite__error_static(&m->error, "message body too large");
 		return DQLITE_PROTO;
 	}
 
@@ -152,6 +303,11 @@ int dqlite__message_body_recv_start(struct dqlite__message *m, uv_buf_t *buf)
 		buf->base = m->body2.base;
 		buf->len  = m->body2.len;
 	} else {
+		err = dqlite__message_body_borrow(m);
+		if (err != 0) {
+			assert(err == DQLITE_NOMEM);
+			return err;
+		}
 		buf->base = m->body1;
 		buf->len  = dqlite__message_body_len(m);
 	}
@@ -197,7 +353,7 @@ dqlite__message_get(struct dqlite__message *m, const char **dst, size_t len)
 
 	/* Check aligment. */
 	if (!dqlite__message_body_is_offset_aligned(m, len)) {
-		dqlite__error_printf(&m->error, "misaligned read");
+		dqlite__error_static(&m->error, "misaligned read");
 		return DQLITE_PARSE;
 	}
 
@@ -214,7 +370,7 @@ dqlite__message_get(struct dqlite__message *m, const char **dst, size_t len)
 
 	/* Check that we're not overflowing the buffer. */
 	if (offset + len > cap) {
-		dqlite__error_printf(&m->error, "read overflow");
+		dqlite__error_static(&m->error, "read overflow");
 		return DQLITE_OVERFLOW;
 	}
 
@@ -266,7 +422,7 @@ int dqlite__message_body_get_text(struct dqlite__message *m, text_t *text)
 	len = strnlen((const char *)src, cap);
 
 	if (len == cap) {
-		dqlite__error_printf(&m->error, "no string found");
+		dqlite__error_static(&m->error, "no string found");
 		return DQLITE_PARSE;
 	}
 
@@ -297,7 +453,7 @@ int dqlite__message_body_get_servers(struct dqlite__message *m,
 	do {
 		err = dqlite__message_body_get_uint64(m, &id);
 		if (err != 0) {
-			dqlite__error_printf(&m->error,
+			dqlite__error_static(&m->error,
 			                     "missing server address");
 			err = DQLITE_PROTO;
 			break;
@@ -408,6 +564,20 @@ int dqlite__message_body_get_double(struct dqlite__message *m, double_t *value)
 	return err;
 }
 
+void dqlite__message_body_buf(struct dqlite__message *m, uv_buf_t *buf)
+{
+	assert(m != NULL);
+	assert(buf != NULL);
+
+	if (m->body2.base != NULL) {
+		buf->base = m->body2.base;
+	} else {
+		buf->base = m->body1;
+	}
+
+	buf->len = dqlite__message_body_len(m);
+}
+
 void dqlite__message_header_put(struct dqlite__message *m,
                                 uint8_t                 type,
                                 uint8_t                 flags)
@@ -418,35 +588,25 @@ void dqlite__message_header_put(struct dqlite__message *m,
 	m->flags = flags;
 }
 
-static int dqlite__message_body_put(struct dqlite__message *m,
-                                    const char *            src,
-                                    size_t                  len,
-                                    size_t                  pad)
+/* Return in dst a pointer to the current write offset of the body, making
+ * sure that there's room for len more bytes. The offset is not advanced. */
+static int dqlite__message_body_span(struct dqlite__message *m,
+                                     size_t                  len,
+                                     char **                 dst)
 {
-	size_t offset; /* Write offset */
-	char * dst;    /* Write buffer to use */
-
-	assert(m != NULL);
-	assert(src != NULL);
-	assert(len > 0);
-
-	/* Check aligment. */
-	if (!dqlite__message_body_is_offset_aligned(m, len + pad)) {
-		dqlite__error_printf(&m->error, "misaligned write");
-		return DQLITE_PROTO;
-	}
+	int err;
 
 	/* Check if we need to use the dynamic buffer. This happens if either:
 	 *
 	 * a) The dynamic buffer was previously allocated
 	 * b) The size of the data to put would exceed the static buffer size
 	 */
-	if (m->body2.base != NULL ||                         /* a) */
-	    m->offset1 + len + pad > DQLITE__MESSAGE_BUF_LEN /* b) */
+	if (m->body2.base != NULL ||                   /* a) */
+	    m->offset1 + len > DQLITE__MESSAGE_BUF_LEN /* b) */
 	) {
 
 		/* Check if we need to grow the dynamic buffer */
-		if (m->offset2 + len + pad >= m->body2.len) {
+		if (m->offset2 + len >= m->body2.len) {
 			size_t cap;
 			char * base;
 			/* Overallocate a bit to avoid allocating again at the
@@ -454,7 +614,7 @@ static int dqlite__message_body_put(struct dqlite__message *m,
 			 *
 			 * TODO: this fails if we need more than 1024 additional
 			 * bytes. */
-			cap  = m->offset2 + len + pad + 1024;
+			cap  = m->offset2 + len + 1024;
 			base = sqlite3_realloc(m->body2.base, cap);
 			if (base == NULL) {
 				dqlite__error_oom(
@@ -466,29 +626,122 @@ static int dqlite__message_body_put(struct dqlite__message *m,
 			m->body2.len  = cap;
 		}
 
-		dst    = m->body2.base;
-		offset = m->offset2;
+		*dst = m->body2.base + m->offset2;
 	} else {
-		dst    = m->body1;
-		offset = m->offset1;
+		err = dqlite__message_body_borrow(m);
+		if (err != 0) {
+			return err;
+		}
+		*dst = m->body1 + m->offset1;
+	}
+
+	return 0;
+}
+
+static int dqlite__message_body_put(struct dqlite__message *m,
+                                    const char *            src,
+                                    size_t                  len,
+                                    size_t                  pad)
+{
+	char *dst; /* Write position */
+	int   err;
+
+	assert(m != NULL);
+	assert(src != NULL);
+	assert(len > 0);
+
+	/* Check aligment. */
+	if (!dqlite__message_body_is_offset_aligned(m, len + pad)) {
+		dqlite__error_static(&m->error, "misaligned write");
+		return DQLITE_PROTO;
+	}
+
+	err = dqlite__message_body_span(m, len + pad, &dst);
+	if (err != 0) {
+		return err;
 	}
 
 	/* Write the data */
-	memcpy(dst + offset, src, len);
+	memcpy(dst, src, len);
 
 	/* Add padding if needed */
 	if (pad > 0) {
-		memset(dst + offset + len, 0, pad);
+		memset(dst + len, 0, pad);
 	}
 
-	if (m->body2.base == NULL)
-		m->offset1 += len + pad;
-	else
-		m->offset2 += len + pad;
+	dqlite__message_body_commit(m, len + pad);
 
 	return 0;
 }
 
+int dqlite__message_body_put_text_ref(struct dqlite__message *m,
+                                      text_t                  text,
+                                      size_t                  len)
+{
+	struct dqlite__message_external *e;
+
+	assert(m != NULL);
+	assert(text != NULL);
+
+	if (m->n_external == DQLITE__MESSAGE_MAX_EXTERNAL) {
+		return DQLITE_OVERFLOW;
+	}
+
+	/* Check aligment. */
+	if (!dqlite__message_body_is_offset_aligned(
+	        m, DQLITE__MESSAGE_WORD_SIZE)) {
+		dqlite__error_static(&m->error, "misaligned write");
+		return DQLITE_PROTO;
+	}
+
+	e         = &m->external[m->n_external];
+	e->base   = text;
+	e->len    = len;
+	e->offset = m->offset1 + m->offset2;
+
+	m->n_external++;
+
+	return 0;
+}
+
+int dqlite__message_has_external(struct dqlite__message *m)
+{
+	assert(m != NULL);
+
+	return m->n_external > 0;
+}
+
+int dqlite__message_body_reserve(struct dqlite__message *m,
+                                 size_t                  len,
+                                 char **                 span)
+{
+	assert(m != NULL);
+	assert(span != NULL);
+	assert(len > 0);
+	assert(len % DQLITE__MESSAGE_WORD_SIZE == 0);
+
+	/* Check aligment. */
+	if (!dqlite__message_body_is_offset_aligned(m, len)) {
+		dqlite__error_static(&m->error, "misaligned write");
+		return DQLITE_PROTO;
+	}
+
+	return dqlite__message_body_span(m, len, span);
+}
+
+void dqlite__message_body_commit(struct dqlite__message *m, size_t len)
+{
+	assert(m != NULL);
+
+	if (m->body2.base == NULL) {
+		assert(m->offset1 + len <= DQLITE__MESSAGE_BUF_LEN);
+		m->offset1 += len;
+	} else {
+		assert(m->offset2 + len <= m->body2.len);
+		m->offset2 += len;
+	}
+}
+
 int dqlite__message_body_put_text(struct dqlite__message *m, text_t text)
 {
 	size_t pad;
@@ -584,8 +837,75 @@ int dqlite__message_body_put_double(struct dqlite__message *m, double_t value)
 	    m, (const char *)(&buf), sizeof(buf), 0);
 }
 
-void dqlite__message_send_start(struct dqlite__message *m, uv_buf_t bufs[3])
+/* Length of the padding following an external text value, which includes the
+ * terminating null. */
+static size_t dqlite__message_external_pad(struct dqlite__message_external *e)
+{
+	return DQLITE__MESSAGE_WORD_SIZE - (e->len % DQLITE__MESSAGE_WORD_SIZE);
+}
+
+/* Append to bufs the buffers holding the body bytes between the given
+ * offsets, which might span both body buffers. */
+static void dqlite__message_send_body(struct dqlite__message *m,
+                                      size_t                  start,
+                                      size_t                  end,
+                                      uv_buf_t *              bufs,
+                                      unsigned *              n)
+{
+	if (start < m->offset1) {
+		bufs[*n].base = m->body1 + start;
+		bufs[*n].len  = (end < m->offset1 ? end : m->offset1) - start;
+		(*n)++;
+		start = m->offset1;
+	}
+
+	if (start < end) {
+		bufs[*n].base = m->body2.base + (start - m->offset1);
+		bufs[*n].len  = end - start;
+		(*n)++;
+	}
+}
+
+/* Fill bufs for a body that references external text values. */
+static unsigned dqlite__message_send_external(struct dqlite__message *m,
+                                              uv_buf_t *              bufs)
+{
+	/* The padding of an external text value is sent from here. */
+	static char zeros[DQLITE__MESSAGE_WORD_SIZE];
+
+	struct dqlite__message_external *e;
+	size_t                           start = 0;
+	unsigned                         n     = 1;
+	unsigned                         i;
+
+	for (i = 0; i < m->n_external; i++) {
+		e = &m->external[i];
+
+		dqlite__message_send_body(m, start, e->offset, bufs, &n);
+		start = e->offset;
+
+		bufs[n].base = (char *)e->base;
+		bufs[n].len  = e->len;
+		n++;
+
+		bufs[n].base = zeros;
+		bufs[n].len  = dqlite__message_external_pad(e);
+		n++;
+	}
+
+	dqlite__message_send_body(m, start, m->offset1 + m->offset2, bufs, &n);
+
+	assert(n <= DQLITE__MESSAGE_MAX_BUFS);
+
+	return n;
+}
+
+unsigned dqlite__message_send_start(struct dqlite__message *m,
+                                    uv_buf_t bufs[DQLITE__MESSAGE_MAX_BUFS])
 {
+	size_t   len;
+	unsigned i;
+
 	assert(m != NULL);
 	assert(bufs != NULL);
 
@@ -599,8 +919,13 @@ void dqlite__message_send_start(struct dqlite__message *m, uv_buf_t bufs[3])
 	assert((m->offset1 % DQLITE__MESSAGE_WORD_SIZE) == 0);
 	assert((m->offset2 % DQLITE__MESSAGE_WORD_SIZE) == 0);
 
-	m->words = dqlite__flip32((m->offset1 + m->offset2) /
-	                          DQLITE__MESSAGE_WORD_SIZE);
+	len = m->offset1 + m->offset2;
+	for (i = 0; i < m->n_external; i++) {
+		len += m->external[i].len +
+		       dqlite__message_external_pad(&m->external[i]);
+	}
+
+	m->words = dqlite__flip32(len / DQLITE__MESSAGE_WORD_SIZE);
 
 	/* The message header is stored in the first part of the dqlite_message
 	 * structure. */
@@ -609,13 +934,17 @@ void dqlite__message_send_start(struct dqlite__message *m, uv_buf_t bufs[3])
 	/* The length of the message header is fixed */
 	bufs[0].len = DQLITE__MESSAGE_HEADER_LEN;
 
+	if (m->n_external > 0) {
+		return dqlite__message_send_external(m, bufs);
+	}
+
 	bufs[1].base = m->body1;
 	bufs[1].len  = m->offset1;
 
 	bufs[2].base = m->body2.base;
 	bufs[2].len  = m->offset2;
 
-	return;
+	return 3;
 }
 
 void dqlite__message_send_reset(struct dqlite__message *m)
@@ -623,6 +952,7 @@ void dqlite__message_send_reset(struct dqlite__message *m)
 	assert(m != NULL);
 
 	/* Reset the state so we can start writing another message */
+	dqlite__message_body_release(m);
 	if (m->body2.base != NULL) {
 		sqlite3_free(m->body2.base);
 	}
@@ -637,12 +967,36 @@ void dqlite__message_recv_reset(struct dqlite__message *m)
 	assert(m->words > 0);
 
 	/* Reset the state so we can start reading another message */
+	dqlite__message_body_release(m);
 	if (m->body2.base != NULL) {
 		sqlite3_free(m->body2.base);
 	}
 	dqlite__message_reset(m);
 }
 
+size_t dqlite__message_body_tell(struct dqlite__message *m)
+{
+	assert(m != NULL);
+
+	if (m->body2.base != NULL) {
+		return m->offset2;
+	}
+
+	return m->offset1;
+}
+
+void dqlite__message_body_seek(struct dqlite__message *m, size_t offset)
+{
+	assert(m != NULL);
+	assert(offset <= m->words * DQLITE__MESSAGE_WORD_SIZE);
+
+	if (m->body2.base != NULL) {
+		m->offset2 = offset;
+	} else {
+		m->offset1 = offset;
+	}
+}
+
 int dqlite__message_has_been_fully_consumed(struct dqlite__message *m)
 {
 	size_t offset;
@@ -36,9 +36,8 @@
  */
 #define DQLITE__MESSAGE_MAX_WORDS (1 << 25) /* ~250M */
 
-/* Length of the statically allocated message body buffer of dqlite__message. If
- * a message body exeeds this size, a dynamically allocated buffer will be
- * used. */
+/* Length of the static message body buffer of dqlite__message. If a message
+ * body exeeds this size, a dynamically allocated buffer will be used. */
 #define DQLITE__MESSAGE_BUF_LEN 4096
 
 /* Number of words that the statically allocated message body buffer can
@@ -46,6 +45,22 @@
 #define DQLITE__MESSAGE_BUF_WORDS                                              \
 	(DQLITE__MESSAGE_BUF_LEN / DQLITE__MESSAGE_WORD_SIZE)
 
+/* Maximum number of external text values a message body can reference. */
+#define DQLITE__MESSAGE_MAX_EXTERNAL 4
+
+/* Maximum number of buffers returned by dqlite__message_send_start: the
+ * header, the two body buffers (each possibly split around external values),
+ * and each external value along with its padding. */
+#define DQLITE__MESSAGE_MAX_BUFS (3 + 3 * DQLITE__MESSAGE_MAX_EXTERNAL)
+
+/* Length of the inline arena of dqlite__message, enough for the write request
+ * of a response along with the column types of a batch of rows with a few
+ * dozen columns. */
+#define DQLITE__MESSAGE_ARENA_LEN 512
+
+/* Maximum number of free static body buffers kept by a message pool. */
+#define DQLITE__MESSAGE_POOL_CAP 256
+
 /* The maximum number of statement bindings or column rows is 255, which can fit
  * in one byte. */
 #define DQLITE__MESSAGE_MAX_BINDINGS ((1 << 8) - 1)
@@ -63,7 +78,26 @@ static_assert(sizeof(double) == sizeof(uint64_t),
               "Size of 'double' is not 64 bits");
 #endif
 
-/* A message serializes dqlite requests and responses. */
+/* Pool of free static body buffers, shared by the messages of all connections
+ * served by the same loop. */
+struct dqlite__message_pool {
+	char **  bufs; /* Free buffers, each DQLITE__MESSAGE_BUF_LEN bytes */
+	unsigned len;  /* Number of free buffers */
+	unsigned cap;  /* Maximum number of free buffers */
+};
+
+/* A text value sent straight from memory owned by someone else. */
+struct dqlite__message_external {
+	const char *base;   /* Text bytes, without the terminating null */
+	size_t      len;    /* Length of the text */
+	size_t      offset; /* Body bytes written before the value */
+};
+
+/* A message serializes dqlite requests and responses.
+ *
+ * The static body buffer is borrowed only while a message is being received or
+ * rendered, and handed back once it's reset, so idle connections don't hold
+ * any body memory. */
 struct dqlite__message {
 	/* public */
 	uint32_t words; /* Number of 64-bit words in the body (little endian) */
@@ -71,26 +105,66 @@ struct dqlite__message {
 	uint8_t  flags; /* Type-specific flags */
 	uint16_t extra; /* Extra space for type-specific data */
 
+	/* Where body1 gets borrowed from. If NULL, body1 is allocated and freed
+	 * every time. */
+	struct dqlite__message_pool *pool;
+
 	/* read-only */
 	dqlite__error error;
 
 	/* private */
-	union {
-		/* Pre-allocated body buffer, enough for most cases */
-		char     body1[DQLITE__MESSAGE_BUF_LEN];
-		uint64_t __body1__[DQLITE__MESSAGE_BUF_WORDS]; /* Alignment */
-	};
+	char *   body1;   /* Static body buffer, enough for most cases */
 	uv_buf_t body2;   /* Dynamic buffer for bodies exceeding body1 */
 	size_t   offset1; /* Bytes that have been read or written to body1 */
 	size_t   offset2; /* Bytes that have been read or written to bdoy2 */
+
+	/* Text values referenced instead of being copied into the body */
+	struct dqlite__message_external external[DQLITE__MESSAGE_MAX_EXTERNAL];
+	unsigned                        n_external;
+
+	/* Arena for transient memory, see dqlite__message_arena_alloc */
+	uint64_t arena[DQLITE__MESSAGE_ARENA_LEN / DQLITE__MESSAGE_WORD_SIZE];
+	size_t   arena_offset; /* Bytes of the arena handed out */
+	void *   arena_extra;  /* Allocations which didn't fit in the arena */
 };
 
+/* Initialize a message pool keeping at most the given number of free
+ * buffers. */
+void dqlite__message_pool_init(struct dqlite__message_pool *p, unsigned cap);
+
+/* Close a message pool, releasing all its free buffers.
+ *
+ * All messages using the pool must have been closed or reset. */
+void dqlite__message_pool_close(struct dqlite__message_pool *p);
+
+/* Release all free buffers of a message pool, which keeps accepting new
+ * ones. */
+void dqlite__message_pool_trim(struct dqlite__message_pool *p);
+
 /* Initialize the message. */
 void dqlite__message_init(struct dqlite__message *m);
 
 /* Close the message, releasing any associated resources. */
 void dqlite__message_close(struct dqlite__message *m);
 
+/* Allocate memory which stays valid until dqlite__message_arena_reset is
+ * called, typically once the message has been flushed.
+ *
+ * Allocations are carved out of a small buffer embedded in the message, so
+ * handling a request doesn't need to go through the general-purpose allocator,
+ * and only the ones not fitting in it fall back to the heap. Return NULL if out
+ * of memory. */
+void *dqlite__message_arena_alloc(struct dqlite__message *m, size_t size);
+
+/* Release all memory allocated with dqlite__message_arena_alloc. */
+void dqlite__message_arena_reset(struct dqlite__message *m);
+
+/* Borrow the static body buffer, if not borrowed already.
+ *
+ * This is done automatically when receiving or rendering a body, and it's
+ * needed only to fill body1 directly. */
+int dqlite__message_body_borrow(struct dqlite__message *m);
+
 /* Called when starting to receive a message header.
  *
  * It returns a buffer large enough to hold the message header bytes. The buffer
@@ -127,6 +201,15 @@ int dqlite__message_body_get_double(struct dqlite__message *m, double_t *value);
 int dqlite__message_body_get_servers(struct dqlite__message *m,
                                      servers_t *             servers);
 
+/* Return the current read position in the body, which can be passed to
+ * dqlite__message_body_seek to decode the following data again. */
+size_t dqlite__message_body_tell(struct dqlite__message *m);
+void   dqlite__message_body_seek(struct dqlite__message *m, size_t offset);
+
+/* Return the buffer holding the body of a message that has been completely
+ * received. */
+void dqlite__message_body_buf(struct dqlite__message *m, uv_buf_t *buf);
+
 /* Called after the message body has been completely decoded and it has been
  * processed. It resets the internal state so the object can be re-used for
  * receiving another message */
@@ -149,12 +232,46 @@ int dqlite__message_body_put_double(struct dqlite__message *m, double_t value);
 int dqlite__message_body_put_servers(struct dqlite__message *m,
                                      servers_t               servers);
 
+/* Like dqlite__message_body_put_text, but reference the len bytes of text
+ * instead of copying them, so they get sent straight from their memory. The
+ * memory must stay valid until the message is reset.
+ *
+ * Return DQLITE_OVERFLOW without setting an error if the message already
+ * references DQLITE__MESSAGE_MAX_EXTERNAL values, in which case the text
+ * should be copied instead. */
+int dqlite__message_body_put_text_ref(struct dqlite__message *m,
+                                      text_t                  text,
+                                      size_t                  len);
+
+/* Return true if the body references external text values. */
+int dqlite__message_has_external(struct dqlite__message *m);
+
+/* Reserve a writable span of len bytes at the current write offset, which
+ * must be word-aligned, as must len.
+ *
+ * This lets callers encode several values at once with plain stores, instead
+ * of going through one put call per value. The span is valid until the next
+ * write, and the bytes actually filled must be committed with
+ * dqlite__message_body_commit before that. */
+int dqlite__message_body_reserve(struct dqlite__message *m,
+                                 size_t                  len,
+                                 char **                 span);
+
+/* Advance the write offset past len bytes of the span returned by
+ * dqlite__message_body_reserve. */
+void dqlite__message_body_commit(struct dqlite__message *m, size_t len);
+
 /* Called when starting to send a message.
  *
- * It returns three buffers: the message header buffer, the statically allocated
+ * It fills the given array with the buffers to send and returns their number.
+ * These are three buffers: the message header buffer, the statically allocated
  * message body buffer, and optionally a dynamically allocated body buffer (if
- * the body size exeeds the size of the statically allocated body buffer). */
-void dqlite__message_send_start(struct dqlite__message *m, uv_buf_t bufs[3]);
+ * the body size exeeds the size of the statically allocated body buffer).
+ *
+ * If the body references external text values, the body buffers are split
+ * around them, and each value is followed by a buffer holding its padding. */
+unsigned dqlite__message_send_start(struct dqlite__message *m,
+                                    uv_buf_t bufs[DQLITE__MESSAGE_MAX_BUFS]);
 
 /* Called after the body has been completely sent to the client.
  *
@@ -6,6 +6,17 @@
 void dqlite__metrics_init(struct dqlite__metrics *m) {
 	assert(m != NULL);
 
-	m->requests = 0;
-	m->duration = 0;
+	m->requests      = 0;
+	m->duration      = 0;
+	m->spin_duration = 0;
+	m->work_duration = 0;
+	m->iterations    = 0;
+	m->callbacks     = 0;
+	m->busy          = 0;
+	m->idle          = 0;
+	m->lag           = 0;
+	m->lag_max       = 0;
+	m->throttled     = 0;
+	m->throttle_time = 0;
+	m->rejected      = 0;
 }
@@ -9,9 +9,33 @@
 
 #include <stdint.h>
 
+/* Metrics are only updated by the loop thread, but they can be read by any
+ * thread through dqlite_server_metrics(), so they're accessed atomically to
+ * avoid torn values. With a single writer, updates don't need atomic
+ * read-modify-write instructions. */
+#define DQLITE__METRICS_GET(M, FIELD)                                          \
+	__atomic_load_n(&(M)->FIELD, __ATOMIC_RELAXED)
+
+#define DQLITE__METRICS_SET(M, FIELD, VALUE)                                   \
+	__atomic_store_n(&(M)->FIELD, (VALUE), __ATOMIC_RELAXED)
+
+#define DQLITE__METRICS_ADD(M, FIELD, N)                                       \
+	DQLITE__METRICS_SET(M, FIELD, (M)->FIELD + (N))
+
 struct dqlite__metrics {
-	uint64_t requests; /* Total number of requests served. */
-	uint64_t duration; /* Total time spent to server requests. */
+	uint64_t requests;      /* Total number of requests served. */
+	uint64_t duration;      /* Total time spent to server requests. */
+	uint64_t spin_duration; /* Busy polling time with no request served. */
+	uint64_t work_duration; /* Busy polling time serving requests. */
+	uint64_t iterations;    /* Number of event loop iterations. */
+	uint64_t callbacks;     /* Client I/O callbacks run by the loop. */
+	uint64_t busy;          /* Time the loop spent running callbacks. */
+	uint64_t idle;          /* Time the loop spent waiting for events. */
+	uint64_t lag;           /* Most recent delay of the lag timer. */
+	uint64_t lag_max;       /* Largest delay of the lag timer. */
+	uint64_t throttled;     /* Writes delayed by the WAL soft limit. */
+	uint64_t throttle_time; /* Total delay of throttled writes. */
+	uint64_t rejected;      /* Writes rejected by the WAL hard limit. */
 };
 
 void dqlite__metrics_init(struct dqlite__metrics *m);
@@ -21,6 +21,57 @@
  * soon as possible. */
 #define DQLITE__OPTIONS_DEFAULT_CHECKPOINT_THRESHOLD 1000
 
+/* Maximum number of idle databases kept open for reuse by new client
+ * connections. Pooling is disabled by default. */
+#define DQLITE__OPTIONS_DEFAULT_DB_POOL_SIZE 0
+
+/* Number of full scan steps plus automatic index rows in a single execution of
+ * a statement after which the index advisor starts tracking it. The advisor is
+ * disabled by default. */
+#define DQLITE__OPTIONS_DEFAULT_ADVISOR_THRESHOLD 0
+
+/* Default interval in milliseconds between background maintenance slices on
+ * idle databases, either pooled or open by a client with no request or
+ * transaction in progress. With an interval of 0, maintenance is disabled and
+ * new databases are created without incremental auto vacuum. */
+#define DQLITE__OPTIONS_DEFAULT_MAINTENANCE_INTERVAL 1000
+
+/* Default I/O backend for client connections. */
+#define DQLITE__OPTIONS_DEFAULT_IO_BACKEND DQLITE_IO_LIBUV
+
+/* Time in microseconds the loop keeps polling without blocking after the last
+ * served request. Busy polling is disabled by default. */
+#define DQLITE__OPTIONS_DEFAULT_BUSY_POLL 0
+
+/* CPU the loop thread gets pinned to, or -1 to let the scheduler decide. */
+#define DQLITE__OPTIONS_DEFAULT_CPU_AFFINITY -1
+
+/* Whether read-only queries are served from a snapshot of their database, so
+ * they don't prevent checkpoints while their rows are being sent. */
+#define DQLITE__OPTIONS_DEFAULT_SNAPSHOT_READS 0
+
+/* Number of WAL frames past which writes get delayed, to give checkpoints a
+ * chance to catch up. Delays are disabled by default. */
+#define DQLITE__OPTIONS_DEFAULT_WAL_SOFT_LIMIT 0
+
+/* Number of WAL frames past which writes get rejected, to keep the WAL from
+ * exhausting memory. Rejections are disabled by default. */
+#define DQLITE__OPTIONS_DEFAULT_WAL_HARD_LIMIT 0
+
+/* Stack size in bytes of the coroutines running database requests in
+ * experimental builds. SQLite needs much less than the 8 MiB given to threads,
+ * and idle stacks are pooled, so a small default is enough. */
+#define DQLITE__OPTIONS_DEFAULT_COROUTINE_STACK (256 * 1024)
+
+/* Size in bytes from which text values in query results are sent straight
+ * from SQLite's memory instead of being copied into the response. Below that,
+ * copying is cheaper than ending the batch of rows early. */
+#define DQLITE__OPTIONS_DEFAULT_ZERO_COPY_THRESHOLD (64 * 1024)
+
+/* Memory usage in bytes that the server tries to stay under, by shedding its
+ * caches. There's no budget by default. */
+#define DQLITE__OPTIONS_DEFAULT_MEMORY_BUDGET 0
+
 void dqlite__options_defaults(struct dqlite__options *o) {
 	assert(o != NULL);
 
@@ -29,6 +80,21 @@ void dqlite__options_defaults(struct dqlite__options *o) {
 	o->heartbeat_timeout    = DQLITE__OPTIONS_DEFAULT_HEARTBEAT_TIMEOUT;
 	o->page_size            = DQLITE__OPTIONS_DEFAULT_PAGE_SIZE;
 	o->checkpoint_threshold = DQLITE__OPTIONS_DEFAULT_CHECKPOINT_THRESHOLD;
+	o->db_pool_size         = DQLITE__OPTIONS_DEFAULT_DB_POOL_SIZE;
+	o->advisor_threshold    = DQLITE__OPTIONS_DEFAULT_ADVISOR_THRESHOLD;
+	o->maintenance_interval = DQLITE__OPTIONS_DEFAULT_MAINTENANCE_INTERVAL;
+	o->io_backend           = DQLITE__OPTIONS_DEFAULT_IO_BACKEND;
+	o->busy_poll            = DQLITE__OPTIONS_DEFAULT_BUSY_POLL;
+	o->cpu_affinity         = DQLITE__OPTIONS_DEFAULT_CPU_AFFINITY;
+	o->capture              = NULL;
+	o->snapshot_reads       = DQLITE__OPTIONS_DEFAULT_SNAPSHOT_READS;
+	o->wal_soft_limit       = DQLITE__OPTIONS_DEFAULT_WAL_SOFT_LIMIT;
+	o->wal_hard_limit       = DQLITE__OPTIONS_DEFAULT_WAL_HARD_LIMIT;
+	o->coroutine_stack      = DQLITE__OPTIONS_DEFAULT_COROUTINE_STACK;
+	o->zero_copy_threshold  = DQLITE__OPTIONS_DEFAULT_ZERO_COPY_THRESHOLD;
+	o->memory_budget        = DQLITE__OPTIONS_DEFAULT_MEMORY_BUDGET;
+
+	memset(&o->cluster_async, 0, sizeof o->cluster_async);
 }
 
 void dqlite__options_close(struct dqlite__options *o) {
@@ -41,6 +107,10 @@ void dqlite__options_close(struct dqlite__options *o) {
 	if (o->wal_replication != NULL) {
 		sqlite3_free((char *)o->wal_replication);
 	}
+
+	if (o->capture != NULL) {
+		sqlite3_free((char *)o->capture);
+	}
 }
 
 int dqlite__options_set_vfs(struct dqlite__options *o, const char *vfs) {
@@ -71,3 +141,17 @@ int dqlite__options_set_wal_replication(struct dqlite__options *o,
 
 	return 0;
 }
+
+int dqlite__options_set_capture(struct dqlite__options *o, const char *capture) {
+	assert(o != NULL);
+	assert(capture != NULL);
+
+	o->capture = sqlite3_malloc(strlen(capture) + 1);
+	if (o->capture == NULL) {
+		return DQLITE_NOMEM;
+	}
+
+	strcpy((char *)o->capture, capture);
+
+	return 0;
+}
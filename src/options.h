@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "../include/dqlite.h"
+
 /* Value object holding configuration options. */
 struct dqlite__options {
 	const char *vfs;                  /* Registered VFS to use. */
@@ -10,6 +12,22 @@ struct dqlite__options {
 	uint16_t    heartbeat_timeout;    /* In milliseconds */
 	uint16_t    page_size;            /* Database page size */
 	uint32_t    checkpoint_threshold; /* In outstanding WAL frames */
+	uint32_t    db_pool_size;         /* Max idle databases to keep open */
+	uint32_t    advisor_threshold;    /* Full scan steps to track a stmt */
+	uint32_t    maintenance_interval; /* In milliseconds */
+	uint8_t     io_backend;           /* DQLITE_IO_LIBUV or DQLITE_IO_URING */
+	uint32_t    busy_poll;            /* Spin window in microseconds */
+	int         cpu_affinity;         /* CPU to pin the loop thread to */
+	const char *capture;              /* File to record requests to */
+	uint8_t     snapshot_reads;       /* Serve queries from snapshots */
+	uint32_t    wal_soft_limit;       /* WAL frames to start delaying writes */
+	uint32_t    wal_hard_limit;       /* WAL frames to start rejecting writes */
+	uint32_t    coroutine_stack;      /* Stack size of request coroutines */
+	uint32_t    zero_copy_threshold;  /* Text bytes to send without copying */
+	uint64_t    memory_budget;        /* Bytes to shed caches past */
+
+	/* Optional asynchronous cluster methods. */
+	dqlite_cluster_async cluster_async;
 };
 
 /* Apply default values to the given options object. */
@@ -25,4 +43,7 @@ int dqlite__options_set_vfs(struct dqlite__options *o, const char *vfs);
 int dqlite__options_set_wal_replication(struct dqlite__options *o,
                                         const char *            wal_replication);
 
+/* Set the capture field, making a copy of the given string. */
+int dqlite__options_set_capture(struct dqlite__options *o, const char *capture);
+
 #endif /* DQLITE_OPTIONS_H */
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <libco.h>
 #include <sqlite3.h>
@@ -14,6 +15,14 @@ void dqlite__replication_ctx_init(struct dqlite__replication_ctx *c)
 	assert(c != NULL);
 
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_REPLICATION);
+
+	c->main_coroutine = NULL;
+	c->chunk_frames   = DQLITE__REPLICATION_CHUNK_FRAMES;
+	c->rc             = SQLITE_OK;
+	c->begin          = 1;
+	c->shipped        = 0;
+
+	memset(&c->chunk, 0, sizeof c->chunk);
 };
 
 void dqlite__replication_ctx_close(struct dqlite__replication_ctx *c)
@@ -23,19 +32,45 @@ void dqlite__replication_ctx_close(struct dqlite__replication_ctx *c)
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_REPLICATION);
 }
 
+/* Reset the state of the current transaction. */
+static void dqlite__replication_reset(struct dqlite__replication_ctx *c)
+{
+	c->begin   = 1;
+	c->shipped = 0;
+}
+
+/* Pass the current chunk to the main coroutine and return the result of
+ * shipping it. */
+static int dqlite__replication_ship(struct dqlite__replication_ctx *c)
+{
+	c->rc = SQLITE_OK;
+
+	co_switch(c->main_coroutine);
+
+	return c->rc;
+}
+
 int dqlite__replication_begin(sqlite3_wal_replication *r, void *arg)
 {
-	(void)r;
 	(void)arg;
 
+	assert(r != NULL);
+	assert(r->pAppData != NULL);
+
+	dqlite__replication_reset(r->pAppData);
+
 	return SQLITE_OK;
 }
 
 int dqlite__replication_abort(sqlite3_wal_replication *r, void *arg)
 {
-	(void)r;
 	(void)arg;
 
+	assert(r != NULL);
+	assert(r->pAppData != NULL);
+
+	dqlite__replication_reset(r->pAppData);
+
 	return SQLITE_OK;
 }
 
@@ -47,38 +82,89 @@ int dqlite__replication_frames(sqlite3_wal_replication *      r,
                                unsigned                       truncate,
                                int                            commit)
 {
-	struct dqlite__replication_ctx *ctx;
+	struct dqlite__replication_ctx *  ctx;
+	struct dqlite__replication_chunk *chunk;
+	int                               i;
+	int                               rc;
 
 	(void)arg;
-	(void)page_size;
-	(void)n;
-	(void)frames;
-	(void)truncate;
-	(void)commit;
 
 	assert(r != NULL);
 	assert(r->pAppData != NULL);
 
-	ctx = r->pAppData;
-
-	co_switch(ctx->main_coroutine);
+	ctx   = r->pAppData;
+	chunk = &ctx->chunk;
+
+	assert(ctx->chunk_frames > 0);
+
+	/* Ship the frames in bounded chunks, so followers can start applying
+	 * them before the whole set has been transmitted, and nothing needs
+	 * to buffer it all at once. A commit with no frames still ships an
+	 * empty chunk, carrying the commit marker. */
+	i = 0;
+	do {
+		chunk->type      = DQLITE__REPLICATION_FRAMES;
+		chunk->page_size = page_size;
+		chunk->n         = n - i;
+		chunk->frames    = frames + i;
+		chunk->truncate  = truncate;
+		chunk->begin     = ctx->begin;
+
+		if ((unsigned)chunk->n > ctx->chunk_frames) {
+			chunk->n = (int)ctx->chunk_frames;
+		}
+		i += chunk->n;
+
+		chunk->commit = commit && i == n;
+
+		rc = dqlite__replication_ship(ctx);
+		if (rc != SQLITE_OK) {
+			/* SQLite will roll back and invoke xUndo, which tells
+			 * followers to discard what they got so far. */
+			return rc;
+		}
+
+		ctx->begin = 0;
+		ctx->shipped++;
+	} while (i < n);
 
 	return SQLITE_OK;
 }
 
 int dqlite__replication_undo(sqlite3_wal_replication *r, void *arg)
 {
-	(void)r;
+	struct dqlite__replication_ctx *ctx;
+	int                             rc = SQLITE_OK;
+
 	(void)arg;
 
-	return SQLITE_OK;
+	assert(r != NULL);
+	assert(r->pAppData != NULL);
+
+	ctx = r->pAppData;
+
+	/* Followers only need to know if they got some frames already. */
+	if (ctx->shipped > 0) {
+		memset(&ctx->chunk, 0, sizeof ctx->chunk);
+		ctx->chunk.type = DQLITE__REPLICATION_UNDO;
+
+		rc = dqlite__replication_ship(ctx);
+	}
+
+	dqlite__replication_reset(ctx);
+
+	return rc;
 }
 
 int dqlite__replication_end(sqlite3_wal_replication *r, void *arg)
 {
-	(void)r;
 	(void)arg;
 
+	assert(r != NULL);
+	assert(r->pAppData != NULL);
+
+	dqlite__replication_reset(r->pAppData);
+
 	return SQLITE_OK;
 }
 
@@ -2,6 +2,11 @@
  *
  * Raft-based implementation of the SQLite replication interface.
  *
+ * This is an experimental stub: nothing in dqlite registers these hooks or
+ * ships the chunks they produce, since Raft replication is left to consumers
+ * (see the stand-in replication layer of the cluster benchmark for a working
+ * implementation).
+ *
  *****************************************************************************/
 
 #ifndef DQLITE_REPLICATION_H
@@ -12,9 +17,49 @@
 #include <libco.h>
 #include <sqlite3.h>
 
-/* Application context object for sqlite3_wal_replication. */
+/* Default maximum number of frames shipped in a single chunk. */
+#define DQLITE__REPLICATION_CHUNK_FRAMES 256
+
+/* Types of chunks */
+#define DQLITE__REPLICATION_FRAMES 0 /* Frames of a write transaction */
+#define DQLITE__REPLICATION_UNDO 1   /* Discard the frames shipped so far */
+
+/* A bounded part of a write transaction, to be shipped to followers.
+ *
+ * Followers apply the frames of each chunk as soon as they receive it, with
+ * sqlite3_wal_replication_frames(), passing the begin and commit flags through.
+ * Only the last chunk of a transaction carries the commit flag. */
+struct dqlite__replication_chunk {
+	int                            type;      /* DQLITE__REPLICATION_* */
+	int                            page_size; /* Size of each page */
+	int                            n;         /* Number of frames */
+	sqlite3_wal_replication_frame *frames;    /* Frames to ship */
+	unsigned                       truncate;  /* Database size after commit */
+	int                            begin;     /* First chunk of the txn */
+	int                            commit;    /* Last chunk of the txn */
+};
+
+/* Application context object for sqlite3_wal_replication.
+ *
+ * Frame sets passed to xFrames are split into chunks of at most chunk_frames
+ * frames. For each chunk, control is passed to the main coroutine, which is
+ * expected to start shipping it, possibly set rc to a non-zero SQLite error
+ * code to fail the transaction, and switch back.
+ *
+ * The main coroutine must be set by whoever registers the hooks, which is
+ * also in charge of consuming the chunks. */
 struct dqlite__replication_ctx {
+	/* public */
 	cothread_t main_coroutine;
+	unsigned   chunk_frames; /* Maximum frames per chunk */
+	int        rc;           /* Result of shipping the current chunk */
+
+	/* read-only */
+	struct dqlite__replication_chunk chunk; /* Chunk being shipped */
+
+	/* private */
+	int      begin;   /* No frame of the transaction shipped yet */
+	unsigned shipped; /* Chunks of the transaction shipped so far */
 };
 
 /* Initialize a replication context object. */
@@ -29,5 +29,7 @@ DQLITE__SCHEMA_IMPLEMENT(dqlite__request_query_sql,
                          DQLITE__REQUEST_SCHEMA_QUERY_SQL);
 DQLITE__SCHEMA_IMPLEMENT(dqlite__request_interrupt,
                          DQLITE__REQUEST_SCHEMA_INTERRUPT);
+DQLITE__SCHEMA_IMPLEMENT(dqlite__request_connect,
+                         DQLITE__REQUEST_SCHEMA_CONNECT);
 
 DQLITE__SCHEMA_HANDLER_IMPLEMENT(dqlite__request, DQLITE__REQUEST_SCHEMA_TYPES);
@@ -49,6 +49,12 @@
 
 #define DQLITE__REQUEST_SCHEMA_INTERRUPT(X, ...) X(uint64, db_id, __VA_ARGS__)
 
+#define DQLITE__REQUEST_SCHEMA_CONNECT(X, ...)                                 \
+	X(uint64, id, __VA_ARGS__)                                             \
+	X(text, name, __VA_ARGS__)                                             \
+	X(uint64, flags, __VA_ARGS__)                                          \
+	X(text, vfs, __VA_ARGS__)
+
 DQLITE__SCHEMA_DEFINE(dqlite__request_leader, DQLITE__REQUEST_SCHEMA_LEADER);
 DQLITE__SCHEMA_DEFINE(dqlite__request_client, DQLITE__REQUEST_SCHEMA_CLIENT);
 DQLITE__SCHEMA_DEFINE(dqlite__request_heartbeat,
@@ -65,6 +71,7 @@ DQLITE__SCHEMA_DEFINE(dqlite__request_query_sql,
                       DQLITE__REQUEST_SCHEMA_QUERY_SQL);
 DQLITE__SCHEMA_DEFINE(dqlite__request_interrupt,
                       DQLITE__REQUEST_SCHEMA_INTERRUPT);
+DQLITE__SCHEMA_DEFINE(dqlite__request_connect, DQLITE__REQUEST_SCHEMA_CONNECT);
 
 #define DQLITE__REQUEST_SCHEMA_TYPES(X, ...)                                   \
 	X(DQLITE_REQUEST_LEADER, dqlite__request_leader, leader, __VA_ARGS__)  \
@@ -95,7 +102,8 @@ DQLITE__SCHEMA_DEFINE(dqlite__request_interrupt,
 	X(DQLITE_REQUEST_INTERRUPT,                                            \
 	  dqlite__request_interrupt,                                           \
 	  interrupt,                                                           \
-	  __VA_ARGS__)
+	  __VA_ARGS__)                                                         \
+	X(DQLITE_REQUEST_CONNECT, dqlite__request_connect, connect, __VA_ARGS__)
 
 DQLITE__SCHEMA_HANDLER_DEFINE(dqlite__request, DQLITE__REQUEST_SCHEMA_TYPES);
 
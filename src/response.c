@@ -21,5 +21,7 @@ DQLITE__SCHEMA_IMPLEMENT(dqlite__response_stmt, DQLITE__RESPONSE_SCHEMA_STMT);
 DQLITE__SCHEMA_IMPLEMENT(dqlite__response_result, DQLITE__RESPONSE_SCHEMA_RESULT);
 DQLITE__SCHEMA_IMPLEMENT(dqlite__response_rows, DQLITE__RESPONSE_SCHEMA_ROWS);
 DQLITE__SCHEMA_IMPLEMENT(dqlite__response_empty, DQLITE__RESPONSE_SCHEMA_EMPTY);
+DQLITE__SCHEMA_IMPLEMENT(dqlite__response_welcome_db,
+                         DQLITE__RESPONSE_SCHEMA_WELCOME_DB);
 
 DQLITE__SCHEMA_HANDLER_IMPLEMENT(dqlite__response, DQLITE__RESPONSE_SCHEMA_TYPES);
@@ -35,6 +35,11 @@
 
 #define DQLITE__RESPONSE_SCHEMA_EMPTY(X, ...) X(uint64, __unused__, __VA_ARGS__)
 
+#define DQLITE__RESPONSE_SCHEMA_WELCOME_DB(X, ...)                                  \
+	X(uint64, heartbeat_timeout, __VA_ARGS__)                                   \
+	X(uint32, id, __VA_ARGS__)                                                  \
+	X(uint32, __pad__, __VA_ARGS__)
+
 DQLITE__SCHEMA_DEFINE(dqlite__response_failure, DQLITE__RESPONSE_SCHEMA_FAILURE);
 DQLITE__SCHEMA_DEFINE(dqlite__response_server, DQLITE__RESPONSE_SCHEMA_SERVER);
 DQLITE__SCHEMA_DEFINE(dqlite__response_welcome, DQLITE__RESPONSE_SCHEMA_WELCOME);
@@ -44,6 +49,8 @@ DQLITE__SCHEMA_DEFINE(dqlite__response_stmt, DQLITE__RESPONSE_SCHEMA_STMT);
 DQLITE__SCHEMA_DEFINE(dqlite__response_result, DQLITE__RESPONSE_SCHEMA_RESULT);
 DQLITE__SCHEMA_DEFINE(dqlite__response_rows, DQLITE__RESPONSE_SCHEMA_ROWS);
 DQLITE__SCHEMA_DEFINE(dqlite__response_empty, DQLITE__RESPONSE_SCHEMA_EMPTY);
+DQLITE__SCHEMA_DEFINE(dqlite__response_welcome_db,
+                      DQLITE__RESPONSE_SCHEMA_WELCOME_DB);
 
 #define DQLITE__RESPONSE_SCHEMA_TYPES(X, ...)                                       \
 	X(DQLITE_RESPONSE_FAILURE, dqlite__response_failure, failure, __VA_ARGS__)  \
@@ -54,7 +61,11 @@ DQLITE__SCHEMA_DEFINE(dqlite__response_empty, DQLITE__RESPONSE_SCHEMA_EMPTY);
 	X(DQLITE_RESPONSE_STMT, dqlite__response_stmt, stmt, __VA_ARGS__)           \
 	X(DQLITE_RESPONSE_RESULT, dqlite__response_result, result, __VA_ARGS__)     \
 	X(DQLITE_RESPONSE_ROWS, dqlite__response_rows, rows, __VA_ARGS__)           \
-	X(DQLITE_RESPONSE_EMPTY, dqlite__response_empty, empty, __VA_ARGS__)
+	X(DQLITE_RESPONSE_EMPTY, dqlite__response_empty, empty, __VA_ARGS__)        \
+	X(DQLITE_RESPONSE_WELCOME_DB,                                               \
+	  dqlite__response_welcome_db,                                              \
+	  welcome_db,                                                               \
+	  __VA_ARGS__)
 
 DQLITE__SCHEMA_HANDLER_DEFINE(dqlite__response, DQLITE__RESPONSE_SCHEMA_TYPES);
 
@@ -2,20 +2,49 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sqlite3.h>
 #include <uv.h>
 
 #include "../include/dqlite.h"
 
+#include "advisor.h"
+#include "capture.h"
 #include "conn.h"
+#include "coroutine.h"
+#include "db.h"
+#include "direct.h"
 #include "error.h"
 #include "log.h"
+#include "memory.h"
+#include "message.h"
 #include "metrics.h"
 #include "options.h"
 #include "queue.h"
+#include "uring.h"
+
+/* Maximum time in nanoseconds spent running maintenance steps each time the
+ * maintenance timer fires, so client requests are delayed by at most this
+ * amount. */
+#define DQLITE__SERVER_MAINTENANCE_SLICE (1000 * 1000)
+
+/* Convert the busy poll window from microseconds to nanoseconds. */
+#define DQLITE__SERVER_BUSY_POLL_NS(US) ((uint64_t)(US)*1000)
+
+/* Interval in milliseconds of the timer used to measure the loop lag. */
+#define DQLITE__SERVER_LAG_INTERVAL 100
+
+/* Whether libuv can account the time the loop spends waiting for events,
+ * which was added in version 1.39. */
+#if UV_VERSION_HEX >= 0x012700
+#define DQLITE__SERVER_IDLE_TIME 1
+#else
+#define DQLITE__SERVER_IDLE_TIME 0
+#endif
 
 int dqlite_init(const char **errmsg)
 {
@@ -46,11 +75,28 @@ struct dqlite__server {
 	dqlite__error error; /* Last error occurred, if any */
 
 	/* private */
-	dqlite_cluster *        cluster; /* Cluster implementation */
-	struct dqlite_logger *  logger;  /* Optional logger implementation */
-	struct dqlite__metrics *metrics; /* Operational metrics */
-	struct dqlite__options  options; /* Configuration values */
+	dqlite_cluster *            cluster; /* Cluster implementation */
+	struct dqlite_logger *      logger;  /* Logger to use, or NULL */
+	struct dqlite__log          log;     /* Wraps the configured logger */
+	struct dqlite__metrics *    metrics; /* Operational metrics */
+	struct dqlite__options      options; /* Configuration values */
+	struct dqlite__db_pool      pool;    /* Idle databases for reuse */
+	struct dqlite__advisor      advisor; /* Index recommendations */
+	struct dqlite__message_pool bufs;    /* Message body buffers */
+	struct dqlite__memory       memory;  /* Memory budget */
+	sqlite3_int64               heap;    /* Soft heap limit to restore */
+	struct dqlite__uring *      io;      /* io_uring backend, NULL for libuv */
+	struct dqlite__capture *    capture; /* Request capture, or NULL */
+	struct dqlite__capture      file;    /* Storage for the request capture */
+#ifdef DQLITE_URING
+	struct dqlite__uring uring; /* Storage for the io_uring backend */
+#endif /* DQLITE_URING */
+	struct dqlite__coroutine_pool *coroutines; /* Coroutine pool, or NULL */
+#ifdef DQLITE_EXPERIMENTAL
+	struct dqlite__coroutine_pool stacks; /* Storage for the coroutine pool */
+#endif /* DQLITE_EXPERIMENTAL */
 	struct dqlite__queue    queue;   /* Queue of incoming connections */
+	struct dqlite__direct_queue direct; /* Requests of in-process clients */
 	pthread_mutex_t         mutex; /* Serialize access to incoming queue */
 	uv_loop_t               loop;  /* UV loop */
 	uv_async_t              stop;  /* Event to stop the UV loop */
@@ -58,6 +104,13 @@ struct dqlite__server {
 	int        running;            /* Indicate that the loop is running */
 	sem_t      ready;              /* Notifiy that the loop is running */
 	uv_timer_t startup;            /* Used for unblocking the ready sem */
+	uv_timer_t maintenance;        /* Maintain idle databases */
+	uv_prepare_t prepare;          /* Sample loop metrics before polling */
+	uv_check_t   check;            /* Sample loop metrics after polling */
+	uv_timer_t   lag;              /* Measure the loop lag */
+	uint64_t     loop_start;       /* When the loop started running */
+	uint64_t     poll_start;       /* When the loop started polling */
+	uint64_t     lag_start;        /* When the lag timer was last due */
 	sem_t      stopped; /* Notifiy that the loop has been stopped */
 };
 
@@ -74,7 +127,9 @@ static void dqlite__server_stop_walk_cb(uv_handle_t *handle, void *arg)
 	assert(handle != NULL);
 	assert(arg != NULL);
 	assert(handle->type == UV_ASYNC || handle->type == UV_TIMER ||
-	       handle->type == UV_TCP || handle->type == UV_NAMED_PIPE);
+	       handle->type == UV_TCP || handle->type == UV_NAMED_PIPE ||
+	       handle->type == UV_POLL || handle->type == UV_PREPARE ||
+	       handle->type == UV_CHECK);
 
 	s = (struct dqlite__server *)arg;
 
@@ -82,7 +137,8 @@ static void dqlite__server_stop_walk_cb(uv_handle_t *handle, void *arg)
 
 	case UV_ASYNC:
 		assert(handle == (uv_handle_t *)&s->stop ||
-		       handle == (uv_handle_t *)&s->incoming);
+		       handle == (uv_handle_t *)&s->incoming ||
+		       handle == (uv_handle_t *)&s->direct.async);
 
 		uv_close(handle, NULL);
 
@@ -101,8 +157,11 @@ static void dqlite__server_stop_walk_cb(uv_handle_t *handle, void *arg)
 		break;
 
 	case UV_TIMER:
-		/* If this is the startup timer, let's close it explicitely. */
-		if (handle == (uv_handle_t *)&s->startup) {
+		/* If this is the startup, maintenance or lag timer, let's
+		 * close it explicitely. */
+		if (handle == (uv_handle_t *)&s->startup ||
+		    handle == (uv_handle_t *)&s->maintenance ||
+		    handle == (uv_handle_t *)&s->lag) {
 			uv_close(handle, NULL);
 		}
 
@@ -112,6 +171,17 @@ static void dqlite__server_stop_walk_cb(uv_handle_t *handle, void *arg)
 
 		break;
 
+	case UV_POLL:
+	case UV_PREPARE:
+	case UV_CHECK:
+		/* Handles sampling loop metrics, or handles of the io_uring
+		 * backend. The ring itself gets closed once the loop has
+		 * stopped, after aborted connections have received their last
+		 * completions. */
+		uv_close(handle, NULL);
+
+		break;
+
 	default:
 		/* Should not be reached because we assert all possible handle
 		 * types above */
@@ -120,6 +190,36 @@ static void dqlite__server_stop_walk_cb(uv_handle_t *handle, void *arg)
 	}
 }
 
+/* Callback for the uv_walk() call in dqlite__server_loop_abort.
+ *
+ * Close the handles that are still open when the loop failed to start, or to
+ * stop cleanly. */
+static void dqlite__server_abort_walk_cb(uv_handle_t *handle, void *arg)
+{
+	if (uv_is_closing(handle)) {
+		return;
+	}
+
+	dqlite__server_stop_walk_cb(handle, arg);
+}
+
+/* Close all handles initialized on the loop, let their close callbacks run
+ * and then close the loop itself. */
+static void dqlite__server_loop_abort(struct dqlite__server *s)
+{
+	int err;
+
+	uv_walk(&s->loop, dqlite__server_abort_walk_cb, (void *)s);
+
+	uv_run(&s->loop, UV_RUN_DEFAULT);
+
+	err = uv_loop_close(&s->loop);
+	if (err != 0) {
+		dqlite__errorf(
+		    s, "failed to close event loop: %s", uv_strerror(err));
+	}
+}
+
 /* Callback invoked when the stop async handle gets fired.
  *
  * This callback will walk through all active handles and close them. After the
@@ -145,6 +245,9 @@ static void dqlite__server_stop_cb(uv_async_t *stop)
 	 * incoming connection can be enqueued. */
 	dqlite__queue_process(&s->queue);
 
+	/* Same for in-process clients, whose gateways get closed as well. */
+	dqlite__direct_queue_stop(&s->direct);
+
 	/* Loop through all connections and abort them, then stop the event
 	 * loop. */
 	uv_walk(&s->loop, dqlite__server_stop_walk_cb, (void *)s);
@@ -191,6 +294,330 @@ static void dqlite__service_startup_cb(uv_timer_t *startup)
 	assert(err == 0); /* No reason for which posting should fail */
 }
 
+/* Function invoked by dqlite__server_each against an open database. The idle
+ * flag tells whether no request is currently using the database. */
+typedef void (*dqlite__server_each_cb)(struct dqlite__db *db,
+                                       int                idle,
+                                       void *             arg);
+
+/* Context of the uv_walk() call in dqlite__server_each. */
+struct dqlite__server_each_ctx {
+	dqlite__server_each_cb cb;
+	void *                 arg;
+};
+
+/* Invoke the given function against a gateway's database, if any. */
+static void dqlite__server_each_gateway(struct dqlite__gateway *        g,
+                                        struct dqlite__server_each_ctx *ctx)
+{
+	if (g->db == NULL || g->db->db == NULL) {
+		return;
+	}
+
+	ctx->cb(g->db, dqlite__gateway_idle(g), ctx->arg);
+}
+
+/* Callback for the uv_walk() call in dqlite__server_each, visiting the
+ * database of each client connection. */
+static void dqlite__server_each_walk_cb(uv_handle_t *handle, void *arg)
+{
+	struct dqlite__conn *conn;
+
+	if (handle->type != UV_TCP && handle->type != UV_NAMED_PIPE) {
+		return;
+	}
+
+	assert(handle->data != NULL);
+
+	conn = (struct dqlite__conn *)handle->data;
+
+	dqlite__server_each_gateway(&conn->gateway, arg);
+}
+
+/* Invoke the given function against every database opened by the server,
+ * either pooled or in use by a network or direct client. */
+static void dqlite__server_each(struct dqlite__server *s,
+                                dqlite__server_each_cb cb,
+                                void *                 arg)
+{
+	struct dqlite__server_each_ctx ctx;
+	struct dqlite__direct *        d;
+	unsigned                       i;
+
+	ctx.cb  = cb;
+	ctx.arg = arg;
+
+	for (i = 0; i < s->pool.len; i++) {
+		cb(s->pool.dbs[i], 1, arg);
+	}
+
+	uv_walk(&s->loop, dqlite__server_each_walk_cb, &ctx);
+
+	for (d = s->direct.directs; d != NULL; d = d->next) {
+		dqlite__server_each_gateway(&d->gateway, &ctx);
+	}
+}
+
+/* Run a memory shedding step against a database. */
+static void dqlite__server_shed_db(struct dqlite__db *db, int idle, void *arg)
+{
+	int *step = arg;
+
+	(void)idle;
+
+	switch (*step) {
+	case DQLITE__MEMORY_RELEASE:
+		sqlite3_db_release_memory(db->db);
+		break;
+	case DQLITE__MEMORY_EVICT:
+		dqlite__db_evict(db);
+		break;
+	}
+}
+
+/* Run a memory shedding step against the caches of the server. */
+static void dqlite__server_shed(struct dqlite__server *s, int step)
+{
+	switch (step) {
+	case DQLITE__MEMORY_TRIM:
+		dqlite__message_pool_trim(&s->bufs);
+		break;
+	case DQLITE__MEMORY_SHRINK:
+		dqlite__db_pool_trim(&s->pool);
+		break;
+	default:
+		/* Steps acting on every open database. */
+		dqlite__server_each(s, dqlite__server_shed_db, &step);
+		break;
+	}
+}
+
+/* Context of a dqlite__server_each call analyzing statements reported to the
+ * index advisor. */
+struct dqlite__server_advise_ctx {
+	struct dqlite__advisor *advisor;
+	int                     done; /* Whether a statement was analyzed */
+};
+
+/* Analyze a pending statement of the given database, unless one was already
+ * analyzed or the database is in use by a request. */
+static void dqlite__server_advise_db(struct dqlite__db *db, int idle, void *arg)
+{
+	struct dqlite__server_advise_ctx *ctx = arg;
+
+	if (ctx->done || !idle) {
+		return;
+	}
+
+	ctx->done = dqlite__advisor_analyze(ctx->advisor, db->db, db->name);
+}
+
+/* Run background maintenance steps on the given database, unless it's in use
+ * by a request or a transaction, or the slice started at the given time is
+ * over. */
+static void dqlite__server_maintain_db(struct dqlite__db *db,
+                                       int                idle,
+                                       void *             arg)
+{
+	uint64_t *start = arg;
+
+	if (!idle || !sqlite3_get_autocommit(db->db)) {
+		/* A barrier that passed before the client came back might
+		 * not hold anymore once it's gone. */
+		db->barrier = DQLITE__DB_BARRIER_NONE;
+		return;
+	}
+
+	if (uv_hrtime() - *start >= DQLITE__SERVER_MAINTENANCE_SLICE) {
+		return;
+	}
+
+	while (dqlite__db_maintain(db)) {
+		if (uv_hrtime() - *start >= DQLITE__SERVER_MAINTENANCE_SLICE) {
+			return;
+		}
+	}
+}
+
+/* Callback invoked periodically to shed caches if memory usage is close to the
+ * budget, and to run background maintenance on idle databases, in a slice
+ * bounded by DQLITE__SERVER_MAINTENANCE_SLICE. */
+static void dqlite__server_maintenance_cb(uv_timer_t *maintenance)
+{
+	struct dqlite__server *          s;
+	struct dqlite__server_advise_ctx advise;
+	uint64_t                         start;
+	int                              step;
+
+	assert(maintenance != NULL);
+	assert(maintenance->data != NULL);
+
+	s = (struct dqlite__server *)maintenance->data;
+
+	start = uv_hrtime();
+
+	while ((step = dqlite__memory_next(&s->memory)) != -1) {
+		dqlite__server_shed(s, step);
+		if (uv_hrtime() - start >= DQLITE__SERVER_MAINTENANCE_SLICE) {
+			return;
+		}
+	}
+
+	/* Running EXPLAIN QUERY PLAN takes a while, so analyze at most one of
+	 * the statements reported to the index advisor each time. */
+	if (s->options.advisor_threshold > 0 && s->advisor.pending > 0) {
+		advise.advisor = &s->advisor;
+		advise.done    = 0;
+		dqlite__server_each(s, dqlite__server_advise_db, &advise);
+		if (uv_hrtime() - start >= DQLITE__SERVER_MAINTENANCE_SLICE) {
+			return;
+		}
+	}
+
+	dqlite__server_each(s, dqlite__server_maintain_db, &start);
+}
+
+/* Invoked at every loop iteration, right before polling for I/O. */
+static void dqlite__server_prepare_cb(uv_prepare_t *prepare)
+{
+	struct dqlite__server *s;
+	uint64_t               now;
+
+	assert(prepare != NULL);
+	assert(prepare->data != NULL);
+
+	s = (struct dqlite__server *)prepare->data;
+
+	now = uv_hrtime();
+
+	DQLITE__METRICS_ADD(s->metrics, iterations, 1);
+
+#if DQLITE__SERVER_IDLE_TIME
+	DQLITE__METRICS_SET(s->metrics, idle, uv_metrics_idle_time(&s->loop));
+#endif /* DQLITE__SERVER_IDLE_TIME */
+
+	DQLITE__METRICS_SET(
+	    s->metrics, busy, now - s->loop_start - s->metrics->idle);
+
+	s->poll_start = now;
+}
+
+#if !DQLITE__SERVER_IDLE_TIME
+/* Invoked at every loop iteration, right after polling for I/O.
+ *
+ * It's used only if libuv can't account idle time by itself, in which case
+ * the whole poll phase is considered idle, including the I/O callbacks run in
+ * it. */
+static void dqlite__server_check_cb(uv_check_t *check)
+{
+	struct dqlite__server *s;
+
+	assert(check != NULL);
+	assert(check->data != NULL);
+
+	s = (struct dqlite__server *)check->data;
+
+	DQLITE__METRICS_ADD(s->metrics, idle, uv_hrtime() - s->poll_start);
+}
+#endif /* !DQLITE__SERVER_IDLE_TIME */
+
+/* Invoked every DQLITE__SERVER_LAG_INTERVAL milliseconds, to measure how late
+ * the loop is in running timers. */
+static void dqlite__server_lag_cb(uv_timer_t *lag)
+{
+	struct dqlite__server *s;
+	uint64_t               now;
+	uint64_t               delay;
+
+	assert(lag != NULL);
+	assert(lag->data != NULL);
+
+	s = (struct dqlite__server *)lag->data;
+
+	now   = uv_hrtime();
+	delay = now - s->lag_start;
+
+	/* Timers have millisecond granularity, so they can fire slightly
+	 * early. */
+	if (delay > DQLITE__SERVER_LAG_INTERVAL * 1000 * 1000) {
+		delay -= DQLITE__SERVER_LAG_INTERVAL * 1000 * 1000;
+	} else {
+		delay = 0;
+	}
+
+	DQLITE__METRICS_SET(s->metrics, lag, delay);
+	if (delay > s->metrics->lag_max) {
+		DQLITE__METRICS_SET(s->metrics, lag_max, delay);
+	}
+
+	s->lag_start = now;
+}
+
+/* Start the handles sampling loop utilization and lag. */
+static int dqlite__server_metrics_start(struct dqlite__server *s)
+{
+	int err;
+
+	assert(s->metrics != NULL);
+
+#if DQLITE__SERVER_IDLE_TIME
+	err = uv_loop_configure(&s->loop, UV_METRICS_IDLE_TIME);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to enable idle time");
+		return DQLITE_ERROR;
+	}
+#else
+	err = uv_check_init(&s->loop, &s->check);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to init check handle");
+		return DQLITE_ERROR;
+	}
+	s->check.data = (void *)s;
+
+	err = uv_check_start(&s->check, dqlite__server_check_cb);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to start check handle");
+		return DQLITE_ERROR;
+	}
+#endif /* DQLITE__SERVER_IDLE_TIME */
+
+	err = uv_prepare_init(&s->loop, &s->prepare);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to init prepare handle");
+		return DQLITE_ERROR;
+	}
+	s->prepare.data = (void *)s;
+
+	err = uv_prepare_start(&s->prepare, dqlite__server_prepare_cb);
+	if (err != 0) {
+		dqlite__error_uv(
+		    &s->error, err, "failed to start prepare handle");
+		return DQLITE_ERROR;
+	}
+
+	err = uv_timer_init(&s->loop, &s->lag);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to init timer");
+		return DQLITE_ERROR;
+	}
+	s->lag.data = (void *)s;
+
+	err = uv_timer_start(&s->lag,
+	                     dqlite__server_lag_cb,
+	                     DQLITE__SERVER_LAG_INTERVAL,
+	                     DQLITE__SERVER_LAG_INTERVAL);
+	if (err != 0) {
+		dqlite__error_uv(&s->error, err, "failed to start lag timer");
+		return DQLITE_ERROR;
+	}
+
+	s->loop_start = uv_hrtime();
+	s->poll_start = s->loop_start;
+	s->lag_start  = s->loop_start;
+
+	return 0;
+}
+
 int dqlite_server_create(dqlite_cluster *cluster, dqlite_server **out)
 {
 	dqlite_server *s;
@@ -214,7 +641,14 @@ int dqlite_server_create(dqlite_cluster *cluster, dqlite_server **out)
 
 	dqlite__options_defaults(&s->options);
 
+	dqlite__advisor_init(&s->advisor);
+	dqlite__memory_init(&s->memory, 0);
+	s->heap    = 0;
+	s->io      = NULL;
+	s->capture = NULL;
+
 	dqlite__queue_init(&s->queue);
+	dqlite__direct_queue_init(&s->direct);
 
 	err = pthread_mutex_init(&s->mutex, NULL);
 	assert(err == 0); /* Docs say that pthread_mutex_init can't fail */
@@ -256,8 +690,14 @@ void dqlite_server_destroy(dqlite_server *s)
 		sqlite3_free(s->metrics);
 	}
 
+	if (s->logger != NULL) {
+		dqlite__log_close(&s->log);
+	}
+
 	dqlite__options_close(&s->options);
 
+	dqlite__advisor_close(&s->advisor);
+
 	/* The sem_destroy call should only fail if the given semaphore is
 	 * invalid, which must not be our case. */
 	err = sem_destroy(&s->stopped);
@@ -287,7 +727,20 @@ int dqlite_server_config(dqlite_server *s, int op, void *arg)
 	switch (op) {
 
 	case DQLITE_CONFIG_LOGGER:
-		s->logger = arg;
+		if (s->logger != NULL) {
+			dqlite__log_close(&s->log);
+			s->logger = NULL;
+		}
+		if (arg == NULL) {
+			break;
+		}
+		err = dqlite__log_init(&s->log, arg);
+		if (err != 0) {
+			dqlite__error_sys(&s->error,
+			                  "failed to init log semaphore");
+			break;
+		}
+		s->logger = &s->log.logger;
 		break;
 
 	case DQLITE_CONFIG_VFS:
@@ -308,9 +761,114 @@ int dqlite_server_config(dqlite_server *s, int op, void *arg)
 		break;
 
 	case DQLITE_CONFIG_CHECKPOINT_THRESHOLD:
+		if (s->options.wal_hard_limit > 0 &&
+		    *(uint32_t *)arg >= s->options.wal_hard_limit) {
+			dqlite__error_static(
+			    &s->error,
+			    "checkpoint threshold not below WAL hard limit");
+			err = DQLITE_ERROR;
+			break;
+		}
 		s->options.checkpoint_threshold = *(uint32_t *)arg;
 		break;
 
+	case DQLITE_CONFIG_DB_POOL_SIZE:
+		s->options.db_pool_size = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_INDEX_ADVISOR:
+		s->options.advisor_threshold = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_MAINTENANCE_INTERVAL:
+		s->options.maintenance_interval = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_BUSY_POLL:
+		s->options.busy_poll = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_CAPTURE:
+		err = dqlite__options_set_capture(&s->options, (const char *)arg);
+		break;
+
+	case DQLITE_CONFIG_SNAPSHOT_READS:
+		s->options.snapshot_reads = *(uint8_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_WAL_SOFT_LIMIT:
+		s->options.wal_soft_limit = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_WAL_HARD_LIMIT:
+		/* Otherwise writes would be rejected before the WAL hook
+		 * ever starts a checkpoint. */
+		if (*(uint32_t *)arg > 0 &&
+		    *(uint32_t *)arg <= s->options.checkpoint_threshold) {
+			dqlite__error_static(
+			    &s->error,
+			    "WAL hard limit not above checkpoint threshold");
+			err = DQLITE_ERROR;
+			break;
+		}
+		s->options.wal_hard_limit = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_COROUTINE_STACK:
+		if (*(uint32_t *)arg < DQLITE__COROUTINE_MIN_STACK_SIZE) {
+			dqlite__error_printf(&s->error,
+			                     "coroutine stack smaller than %d bytes",
+			                     DQLITE__COROUTINE_MIN_STACK_SIZE);
+			err = DQLITE_ERROR;
+			break;
+		}
+		s->options.coroutine_stack = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_ZERO_COPY_THRESHOLD:
+		s->options.zero_copy_threshold = *(uint32_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_MEMORY_BUDGET:
+		s->options.memory_budget = *(uint64_t *)arg;
+		break;
+
+	case DQLITE_CONFIG_CLUSTER_ASYNC:
+		s->options.cluster_async = *(dqlite_cluster_async *)arg;
+		break;
+
+	case DQLITE_CONFIG_CPU_AFFINITY:
+		if (*(int *)arg < -1 || *(int *)arg >= CPU_SETSIZE) {
+			dqlite__error_printf(
+			    &s->error, "invalid CPU %d", *(int *)arg);
+			err = DQLITE_ERROR;
+			break;
+		}
+		s->options.cpu_affinity = *(int *)arg;
+		break;
+
+	case DQLITE_CONFIG_IO_BACKEND:
+		switch (*(uint8_t *)arg) {
+		case DQLITE_IO_LIBUV:
+			break;
+		case DQLITE_IO_URING:
+#ifndef DQLITE_URING
+			dqlite__error_static(&s->error,
+			                     "io_uring support not built in");
+			err = DQLITE_ERROR;
+#endif /* DQLITE_URING */
+			break;
+		default:
+			dqlite__error_printf(
+			    &s->error, "unknown I/O backend %d", *(uint8_t *)arg);
+			err = DQLITE_ERROR;
+			break;
+		}
+		if (err == 0) {
+			s->options.io_backend = *(uint8_t *)arg;
+		}
+		break;
+
 	case DQLITE_CONFIG_METRICS:
 		if (*(uint8_t *)arg == 1) {
 			if (s->metrics == NULL) {
@@ -334,21 +892,174 @@ int dqlite_server_config(dqlite_server *s, int op, void *arg)
 	return err;
 }
 
+/* Run the loop without ever blocking for as long as requests keep coming,
+ * blocking only after a whole busy poll window has passed without any request
+ * being served.
+ *
+ * Time spent in non-blocking iterations is accounted as spinning or working,
+ * depending on whether some request was served. */
+static int dqlite__server_spin(struct dqlite__server *s)
+{
+	uint64_t window = DQLITE__SERVER_BUSY_POLL_NS(s->options.busy_poll);
+	uint64_t requests;
+	uint64_t idle;
+	uint64_t start;
+	uint64_t now;
+	int      alive;
+
+	assert(s->metrics != NULL);
+
+	idle = uv_hrtime();
+
+	do {
+		requests = s->metrics->requests;
+		start    = uv_hrtime();
+
+		alive = uv_run(&s->loop, UV_RUN_NOWAIT);
+
+		now = uv_hrtime();
+
+		/* The metrics can be read concurrently by other threads. */
+		if (s->metrics->requests != requests) {
+			DQLITE__METRICS_ADD(s->metrics, work_duration, now - start);
+			idle = now;
+		} else {
+			DQLITE__METRICS_ADD(s->metrics, spin_duration, now - start);
+		}
+
+		if (alive && now - idle >= window) {
+			alive = uv_run(&s->loop, UV_RUN_ONCE);
+			idle  = uv_hrtime();
+		}
+	} while (alive);
+
+	dqlite__infof(s,
+	              "busy poll: spinning %lu ms, working %lu ms",
+	              DQLITE__METRICS_GET(s->metrics, spin_duration) /
+	                  (1000 * 1000),
+	              DQLITE__METRICS_GET(s->metrics, work_duration) /
+	                  (1000 * 1000));
+
+	return 0;
+}
+
 int dqlite_server_run(struct dqlite__server *s)
 {
-	int err;
+	int       err;
+	int       closed = 0;
+	cpu_set_t cpus;
 
 	assert(s != NULL);
 
+	/* Hand log messages to the configured logger from a separate thread,
+	 * so a slow logger doesn't stall the loop. */
+	if (s->logger != NULL) {
+		err = dqlite__log_start(&s->log);
+		if (err != 0) {
+			dqlite__error_static(&s->error,
+			                     "failed to start log thread");
+			return DQLITE_ERROR;
+		}
+	}
+
 	dqlite__infof(s, "starting event loop");
 
 	/* Initialize the event loop. */
 	err = uv_loop_init(&s->loop);
 	if (err != 0) {
 		dqlite__error_uv(&s->error, err, "failed to init event loop");
+		if (s->logger != NULL) {
+			dqlite__log_stop(&s->log);
+		}
 		return DQLITE_ERROR;
 	}
 
+	/* Idle databases can only be used by the loop thread, so the pool
+	 * lives as long as the loop runs. */
+	dqlite__db_pool_init(&s->pool, s->options.db_pool_size);
+	dqlite__message_pool_init(&s->bufs, DQLITE__MESSAGE_POOL_CAP);
+
+	/* Besides having caches shed by the maintenance timer, make SQLite
+	 * recycle page cache memory instead of growing past the budget. The
+	 * soft heap limit is process-wide, so the previous one is restored
+	 * when the loop stops. */
+	s->memory.budget = s->options.memory_budget;
+	if (s->memory.budget > 0) {
+		s->heap =
+		    sqlite3_soft_heap_limit64((sqlite3_int64)s->memory.budget);
+	}
+
+	s->io         = NULL;
+	s->capture    = NULL;
+	s->coroutines = NULL;
+#ifdef DQLITE_EXPERIMENTAL
+	dqlite__coroutine_pool_init(&s->stacks,
+	                            s->options.coroutine_stack,
+	                            DQLITE__COROUTINE_POOL_CAP);
+	s->coroutines = &s->stacks;
+#endif /* DQLITE_EXPERIMENTAL */
+#ifdef DQLITE_URING
+	if (s->options.io_backend == DQLITE_IO_URING) {
+		err = dqlite__uring_init(&s->uring, &s->loop);
+		if (err == 0) {
+			s->io = &s->uring;
+		} else {
+			/* Fall back to libuv, e.g. if the kernel is too old
+			 * or if io_uring is disabled by seccomp. */
+			dqlite__errorf(s,
+			               "io_uring unavailable, using libuv: %s",
+			               uv_strerror(err));
+		}
+	}
+#endif /* DQLITE_URING */
+
+	if (s->options.capture != NULL) {
+		err = dqlite__capture_init(&s->file, s->options.capture);
+		if (err != 0) {
+			dqlite__error_wrapf(
+			    &s->error, &s->file.error, "failed to start capture");
+			dqlite__capture_close(&s->file);
+			goto out;
+		}
+		s->capture = &s->file;
+	}
+
+	/* Dedicate a CPU to the loop, which is mostly useful when busy
+	 * polling. */
+	if (s->options.cpu_affinity >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(s->options.cpu_affinity, &cpus);
+
+		err = pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+		if (err != 0) {
+			dqlite__error_printf(&s->error,
+			                     "failed to pin loop to CPU %d: %s",
+			                     s->options.cpu_affinity,
+			                     strerror(err));
+			err = DQLITE_ERROR;
+			goto out;
+		}
+	}
+
+	/* Busy polling tells spinning from working apart using the counter of
+	 * served requests. */
+	if (s->options.busy_poll > 0 && s->metrics == NULL) {
+		s->metrics = sqlite3_malloc(sizeof *s->metrics);
+		if (s->metrics == NULL) {
+			dqlite__error_oom(&s->error, "failed to allocate metrics");
+			err = DQLITE_NOMEM;
+			goto out;
+		}
+		dqlite__metrics_init(s->metrics);
+	}
+
+	if (s->metrics != NULL) {
+		err = dqlite__server_metrics_start(s);
+		if (err != 0) {
+			goto out;
+		}
+	}
+
 	/* Initialize async handles. */
 	err = uv_async_init(&s->loop, &s->stop, dqlite__server_stop_cb);
 	if (err != 0) {
@@ -368,6 +1079,23 @@ int dqlite_server_run(struct dqlite__server *s)
 	}
 	s->incoming.data = (void *)s;
 
+	err = dqlite__direct_queue_start(&s->direct,
+	                                 &s->loop,
+	                                 s->cluster,
+	                                 s->logger,
+	                                 &s->options,
+	                                 s->metrics,
+	                                 &s->pool,
+	                                 &s->advisor,
+	                                 &s->bufs,
+	                                 s->coroutines);
+	if (err != 0) {
+		dqlite__error_uv(
+		    &s->error, err, "failed to init direct event handle");
+		err = DQLITE_ERROR;
+		goto out;
+	}
+
 	/* Schedule dqlite__service_startup_cb to be fired as soon as the loop
 	 * starts. It will unblock clients of dqlite_service_ready. */
 	err = uv_timer_init(&s->loop, &s->startup);
@@ -385,7 +1113,32 @@ int dqlite_server_run(struct dqlite__server *s)
 		goto out;
 	}
 
-	err = uv_run(&s->loop, UV_RUN_DEFAULT);
+	if (s->options.maintenance_interval > 0) {
+		err = uv_timer_init(&s->loop, &s->maintenance);
+		if (err != 0) {
+			dqlite__error_uv(&s->error, err, "failed to init timer");
+			err = DQLITE_ERROR;
+			goto out;
+		}
+		s->maintenance.data = (void *)s;
+
+		err = uv_timer_start(&s->maintenance,
+		                     dqlite__server_maintenance_cb,
+		                     s->options.maintenance_interval,
+		                     s->options.maintenance_interval);
+		if (err != 0) {
+			dqlite__error_uv(
+			    &s->error, err, "failed to start maintenance timer");
+			err = DQLITE_ERROR;
+			goto out;
+		}
+	}
+
+	if (s->options.busy_poll > 0) {
+		err = dqlite__server_spin(s);
+	} else {
+		err = uv_run(&s->loop, UV_RUN_DEFAULT);
+	}
 	if (err != 0) {
 		dqlite__error_uv(
 		    &s->error, err, "event loop finished unclealy");
@@ -397,14 +1150,52 @@ int dqlite_server_run(struct dqlite__server *s)
 		dqlite__error_uv(&s->error, err, "failed to close event loop");
 		goto out;
 	}
+	closed = 1;
 
 out:
+	/* In case the loop failed to start, unblock in-process clients. */
+	dqlite__direct_queue_stop(&s->direct);
+
+	/* Handles initialized before an error might still be open, and the
+	 * io_uring backend must not be closed before its own handles. */
+	if (!closed) {
+		dqlite__server_loop_abort(s);
+	}
+
+#ifdef DQLITE_URING
+	/* Connections waiting for the completion of their cancelled requests
+	 * get released here. */
+	if (s->io != NULL) {
+		dqlite__uring_close(s->io);
+	}
+#endif /* DQLITE_URING */
+
+	/* All connections are closed at this point, so no database will be
+	 * checked in anymore. */
+	dqlite__db_pool_close(&s->pool);
+	dqlite__message_pool_close(&s->bufs);
+#ifdef DQLITE_EXPERIMENTAL
+	dqlite__coroutine_pool_close(&s->stacks);
+#endif /* DQLITE_EXPERIMENTAL */
+
+	if (s->memory.budget > 0) {
+		sqlite3_soft_heap_limit64(s->heap);
+	}
+
+	if (s->capture != NULL) {
+		dqlite__capture_close(s->capture);
+	}
+
 	/* Unblock any client of dqlite_server_ready (no reason for which
 	 * posting should fail). */
 	assert(sem_post(&s->ready) == 0);
 
 	dqlite__infof(s, "event loop stopped");
 
+	if (s->logger != NULL) {
+		dqlite__log_stop(&s->log);
+	}
+
 	return err;
 }
 
@@ -484,7 +1275,7 @@ int dqlite_server_handle(dqlite_server *s, int fd, char **errmsg)
 
 	if (!s->running) {
 		err = DQLITE_STOPPED;
-		dqlite__error_printf(&e, "server is not running");
+		dqlite__error_static(&e, "server is not running");
 		goto err_not_running_or_conn_malloc;
 	}
 
@@ -494,8 +1285,19 @@ int dqlite_server_handle(dqlite_server *s, int fd, char **errmsg)
 		err = DQLITE_NOMEM;
 		goto err_not_running_or_conn_malloc;
 	}
-	dqlite__conn_init(
-	    conn, fd, s->logger, s->cluster, &s->loop, &s->options, s->metrics);
+	dqlite__conn_init(conn,
+	                  fd,
+	                  s->logger,
+	                  s->cluster,
+	                  &s->loop,
+	                  &s->options,
+	                  s->metrics,
+	                  &s->pool,
+	                  &s->advisor,
+	                  s->io,
+	                  &s->bufs,
+	                  s->coroutines,
+	                  s->capture);
 
 	err = dqlite__queue_item_init(&item, conn);
 	if (err != 0) {
@@ -563,7 +1365,20 @@ err_item_wait:
 	return err;
 }
 
-const char *dqlite_server_errmsg(dqlite_server *s) { return s->error; }
+int dqlite_direct_open(dqlite_server * s,
+                       const char *    name,
+                       dqlite_direct **out,
+                       char **         errmsg)
+{
+	assert(s != NULL);
+
+	return dqlite__direct_open(&s->direct, name, out, errmsg);
+}
+
+const char *dqlite_server_errmsg(dqlite_server *s)
+{
+	return dqlite__error_msg(&s->error);
+}
 
 dqlite_cluster *dqlite_server_cluster(dqlite_server *s)
 {
@@ -576,5 +1391,59 @@ dqlite_logger *dqlite_server_logger(dqlite_server *s)
 {
 	assert(s != NULL);
 
-	return s->logger;
+	if (s->logger == NULL) {
+		return NULL;
+	}
+
+	return s->log.sink;
+}
+
+int dqlite_server_index_advice(dqlite_server *       s,
+                               dqlite_index_advice **advice,
+                               unsigned *            n)
+{
+	assert(s != NULL);
+	assert(advice != NULL);
+	assert(n != NULL);
+
+	return dqlite__advisor_report(&s->advisor, advice, n);
+}
+
+int dqlite_server_metrics(dqlite_server *s, dqlite_metrics *metrics)
+{
+	assert(s != NULL);
+	assert(metrics != NULL);
+
+	if (s->metrics == NULL) {
+		return DQLITE_ERROR;
+	}
+
+	/* The loop thread might be updating the metrics concurrently. */
+	metrics->requests   = DQLITE__METRICS_GET(s->metrics, requests);
+	metrics->duration   = DQLITE__METRICS_GET(s->metrics, duration);
+	metrics->iterations = DQLITE__METRICS_GET(s->metrics, iterations);
+	metrics->callbacks  = DQLITE__METRICS_GET(s->metrics, callbacks);
+	metrics->busy       = DQLITE__METRICS_GET(s->metrics, busy);
+	metrics->idle       = DQLITE__METRICS_GET(s->metrics, idle);
+	metrics->lag        = DQLITE__METRICS_GET(s->metrics, lag);
+	metrics->lag_max    = DQLITE__METRICS_GET(s->metrics, lag_max);
+
+	metrics->throttled     = DQLITE__METRICS_GET(s->metrics, throttled);
+	metrics->throttle_time = DQLITE__METRICS_GET(s->metrics, throttle_time);
+	metrics->rejected      = DQLITE__METRICS_GET(s->metrics, rejected);
+
+	metrics->log_dropped   = 0;
+	metrics->log_throttled = dqlite__log_throttled();
+	if (s->logger != NULL) {
+		metrics->log_dropped =
+		    __atomic_load_n(&s->log.dropped, __ATOMIC_SEQ_CST);
+	}
+
+	metrics->memory_used  = DQLITE__METRICS_GET(&s->memory, used);
+	metrics->memory_sheds = DQLITE__METRICS_GET(&s->memory, sheds);
+
+	metrics->spin_duration = DQLITE__METRICS_GET(s->metrics, spin_duration);
+	metrics->work_duration = DQLITE__METRICS_GET(s->metrics, work_duration);
+
+	return 0;
 }
@@ -1,10 +1,12 @@
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 #include <sqlite3.h>
 
 #include "../include/dqlite.h"
 
+#include "binary.h"
 #include "error.h"
 #include "lifecycle.h"
 #include "registry.h"
@@ -20,6 +22,13 @@ void dqlite__stmt_init(struct dqlite__stmt *s)
 
 	dqlite__lifecycle_init(DQLITE__LIFECYCLE_STMT);
 
+	s->sql      = NULL;
+	s->readonly = 0;
+	s->used     = 0;
+	s->rows     = 0;
+	s->digest   = 0;
+	s->checksum = DQLITE__STMT_CHECKSUM_SEED;
+
 	dqlite__error_init(&s->error);
 }
 
@@ -33,11 +42,81 @@ void dqlite__stmt_close(struct dqlite__stmt *s)
 		sqlite3_finalize(s->stmt);
 	}
 
+	if (s->sql != NULL) {
+		sqlite3_free(s->sql);
+	}
+
 	dqlite__error_close(&s->error);
 
 	dqlite__lifecycle_close(DQLITE__LIFECYCLE_STMT);
 }
 
+int dqlite__stmt_evict(struct dqlite__stmt *s)
+{
+	assert(s != NULL);
+
+	if (s->stmt == NULL || sqlite3_stmt_busy(s->stmt)) {
+		return 0;
+	}
+
+	s->sql = sqlite3_mprintf("%s", sqlite3_sql(s->stmt));
+	if (s->sql == NULL) {
+		return 0;
+	}
+
+	/* Throttling decisions must not change while the statement is
+	 * evicted. */
+	s->readonly = sqlite3_stmt_readonly(s->stmt);
+
+	sqlite3_finalize(s->stmt);
+
+	s->stmt = NULL;
+	s->tail = NULL;
+
+	return 1;
+}
+
+int dqlite__stmt_revive(struct dqlite__stmt *s)
+{
+	int rc;
+
+	assert(s != NULL);
+
+	if (s->sql == NULL) {
+		return SQLITE_OK;
+	}
+
+	assert(s->stmt == NULL);
+
+	rc = sqlite3_prepare_v2(s->db, s->sql, -1, &s->stmt, NULL);
+	if (rc != SQLITE_OK) {
+		dqlite__error_printf(&s->error,
+		                     "prepare evicted statement: %s",
+		                     sqlite3_errmsg(s->db));
+		return rc;
+	}
+
+	sqlite3_free(s->sql);
+	s->sql = NULL;
+
+	return SQLITE_OK;
+}
+
+int dqlite__stmt_readonly(struct dqlite__stmt *s)
+{
+	assert(s != NULL);
+
+	if (s->stmt != NULL) {
+		return sqlite3_stmt_readonly(s->stmt);
+	}
+
+	if (s->sql != NULL) {
+		return s->readonly;
+	}
+
+	return 1;
+}
+
 const char *dqlite__stmt_hash(struct dqlite__stmt *stmt)
 {
 	(void)stmt;
@@ -140,6 +219,8 @@ int dqlite__stmt_bind(struct dqlite__stmt *s, struct dqlite__message *message)
 	assert(message != NULL);
 
 	sqlite3_reset(s->stmt);
+	s->rows     = 0;
+	s->checksum = DQLITE__STMT_CHECKSUM_SEED;
 
 	/* First check if we reached the end of the message. Since bindings are
 	 * always the last part of a message, no further data means that no
@@ -170,11 +251,11 @@ int dqlite__stmt_bind(struct dqlite__stmt *s, struct dqlite__message *message)
 			if (i == count + pad - 1) {
 				/* All parameter types are present, but there's
 				 * no further data holding parameter values. */
-				dqlite__error_printf(&s->error,
+				dqlite__error_static(&s->error,
 				                     "incomplete param values");
 			} else {
 				/* Not all parameter types were provided. */
-				dqlite__error_printf(&s->error,
+				dqlite__error_static(&s->error,
 				                     "incomplete param types");
 			}
 			return SQLITE_ERROR;
@@ -190,7 +271,7 @@ int dqlite__stmt_bind(struct dqlite__stmt *s, struct dqlite__message *message)
 			if (i != count - 1) {
 				/* We reached the end of the message but we did
 				 * not exhaust the parameters. */
-				dqlite__error_printf(&s->error,
+				dqlite__error_static(&s->error,
 				                     "incomplete param values");
 				return SQLITE_ERROR;
 			}
@@ -201,7 +282,7 @@ int dqlite__stmt_bind(struct dqlite__stmt *s, struct dqlite__message *message)
 		}
 
 		if (rc != SQLITE_OK) {
-			dqlite__error_printf(&s->error, sqlite3_errmsg(s->db));
+			dqlite__error_sqlite(&s->error, s->db);
 			return rc;
 		}
 	}
@@ -220,7 +301,7 @@ int dqlite__stmt_exec(struct dqlite__stmt *s,
 
 	rc = sqlite3_step(s->stmt);
 	if (rc != SQLITE_DONE) {
-		dqlite__error_printf(&s->error, sqlite3_errmsg(s->db));
+		dqlite__error_sqlite(&s->error, s->db);
 		return rc;
 	}
 
@@ -230,33 +311,194 @@ int dqlite__stmt_exec(struct dqlite__stmt *s,
 	return SQLITE_OK;
 }
 
-/* Append a single row to the message. */
+/* Return the type of the given column in the current row, mapping time and
+ * boolean columns to the dqlite-specific types. */
+static int dqlite__stmt_column_type(struct dqlite__stmt *s, int i)
+{
+	const char *column_type_name;
+	int         column_type;
+
+	column_type = sqlite3_column_type(s->stmt, i);
+
+	/* TODO: find a better way to handle time types */
+	column_type_name = sqlite3_column_decltype(s->stmt, i);
+	if (column_type_name != NULL) {
+		if (strcmp(column_type_name, "DATETIME") == 0) {
+			if (column_type == SQLITE_INTEGER) {
+				column_type = DQLITE_UNIXTIME;
+			} else {
+				assert(column_type == SQLITE_TEXT ||
+				       column_type == SQLITE_NULL);
+				column_type = DQLITE_ISO8601;
+			}
+		}
+		if (strcmp(column_type_name, "BOOLEAN") == 0) {
+			assert(column_type == SQLITE_INTEGER ||
+			       column_type == SQLITE_NULL);
+			column_type = DQLITE_BOOLEAN;
+		}
+	}
+
+	assert(column_type < 16);
+
+	return column_type;
+}
+
+/* Return true if values of the given column type are encoded in exactly one
+ * word. */
+static int dqlite__stmt_column_is_fixed(int column_type)
+{
+	switch (column_type) {
+	case SQLITE_INTEGER:
+	case SQLITE_FLOAT:
+	case SQLITE_NULL:
+	case DQLITE_UNIXTIME:
+	case DQLITE_BOOLEAN:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Store the one-word value of the given column at dst. */
+static void dqlite__stmt_column_fixed(struct dqlite__stmt *s,
+                                      int                  i,
+                                      int                  column_type,
+                                      char *               dst)
+{
+	uint64_t value;
+	double   float_;
+
+	switch (column_type) {
+	case SQLITE_INTEGER:
+	case DQLITE_UNIXTIME:
+		value = (uint64_t)sqlite3_column_int64(s->stmt, i);
+		break;
+	case SQLITE_FLOAT:
+		float_ = sqlite3_column_double(s->stmt, i);
+		memcpy(&value, &float_, sizeof value);
+		break;
+	case DQLITE_BOOLEAN:
+		value = sqlite3_column_int64(s->stmt, i) != 0;
+		break;
+	default:
+		/* TODO: allow null to be encoded with 0 bytes */
+		assert(column_type == SQLITE_NULL);
+		value = 0;
+		break;
+	}
+
+	value = dqlite__flip64(value);
+	memcpy(dst, &value, sizeof value);
+}
+
+/* Append the values of the run of one-word columns starting at column i,
+ * possibly preceded by header_len bytes of row header, using a single
+ * reservation. Return the index of the first column after the run. */
+static int dqlite__stmt_row_fixed(struct dqlite__stmt *   s,
+                                  struct dqlite__message *message,
+                                  const int *             column_types,
+                                  int                     column_count,
+                                  int                     i,
+                                  size_t                  header_len)
+{
+	char * span;
+	size_t len;
+	int    n;
+	int    j;
+	int    err;
+
+	for (n = 0; i + n < column_count; n++) {
+		if (!dqlite__stmt_column_is_fixed(column_types[i + n])) {
+			break;
+		}
+	}
+
+	len = header_len + (size_t)n * DQLITE__MESSAGE_WORD_SIZE;
+	if (len == 0) {
+		return i;
+	}
+
+	err = dqlite__message_body_reserve(message, len, &span);
+	if (err != 0) {
+		dqlite__error_wrapf(
+		    &s->error, &message->error, "failed to write row");
+		return -1;
+	}
+
+	/* Pack the column types in the row header, two per byte, leaving the
+	 * padding slots zeroed. */
+	if (header_len > 0) {
+		memset(span, 0, header_len);
+		for (j = 0; j < column_count; j++) {
+			span[j / 2] |= (char)(column_types[j] << (4 * (j % 2)));
+		}
+	}
+
+	for (j = 0; j < n; j++) {
+		dqlite__stmt_column_fixed(s,
+		                          i + j,
+		                          column_types[i + j],
+		                          span + header_len +
+		                              j * DQLITE__MESSAGE_WORD_SIZE);
+	}
+
+	dqlite__message_body_commit(message, len);
+
+	return i + n;
+}
+
+/* Append the text value of the given column, referencing it instead of
+ * copying it if it's at least zero_copy bytes long. */
+static int dqlite__stmt_column_text(struct dqlite__stmt *   s,
+                                    struct dqlite__message *message,
+                                    int                     i,
+                                    size_t                  zero_copy)
+{
+	text_t text;
+	size_t len;
+	int    err;
+
+	text = (text_t)sqlite3_column_text(s->stmt, i);
+
+	if (zero_copy > 0 &&
+	    (size_t)sqlite3_column_bytes(s->stmt, i) >= zero_copy) {
+		/* The text is sent up to its first null, as when copied. */
+		len = strlen(text);
+		if (len >= zero_copy) {
+			err = dqlite__message_body_put_text_ref(
+			    message, text, len);
+			if (err != DQLITE_OVERFLOW) {
+				return err;
+			}
+		}
+	}
+
+	return dqlite__message_body_put_text(message, text);
+}
+
+/* Append a single row to the message.
+ *
+ * The row header and runs of one-word columns are written directly into
+ * reserved spans of the message body, and only variable-length columns go
+ * through a put call each. */
 static int dqlite__stmt_row(struct dqlite__stmt *   s,
                             struct dqlite__message *message,
-                            int                     column_count)
+                            int                     column_count,
+                            int *                   column_types,
+                            size_t                  zero_copy)
 {
-	int     err;
-	int     i;
-	int     pad;
-	int     header_bits;
-	int *   column_types;
-	uint8_t slot = 0;
+	int    err = 0;
+	int    i;
+	int    pad;
+	int    header_bits;
+	size_t header_len;
+	text_t text;
 
 	assert(s != NULL);
 	assert(message != NULL);
 	assert(column_count > 0);
-
-	/* Allocate an array to store the column types
-	 *
-	 * TODO: use a statically allocated buffer when the column count is
-	 * small. */
-	column_types =
-	    (int *)sqlite3_malloc(column_count * sizeof(*column_types));
-	if (column_types == NULL) {
-		dqlite__error_oom(&s->error,
-		                  "failed to create column column_types array");
-		return SQLITE_NOMEM;
-	}
+	assert(column_types != NULL);
 
 	/* Each column needs a 4 byte slot to store the column type. The row
 	 * header must be padded to reach word boundary. */
@@ -268,93 +510,24 @@ static int dqlite__stmt_row(struct dqlite__stmt *   s,
 	} else {
 		pad = 0;
 	}
+	header_len = (size_t)(column_count + pad) / 2;
 
-	/* Write the row header */
-	for (i = 0; i < column_count + pad; i++) {
-		int column_type;
-
-		if (i < column_count) {
-			/* Actual column, figure the type */
-			const char *column_type_name;
-
-			column_type = sqlite3_column_type(s->stmt, i);
-
-			/* TODO: find a better way to handle time types */
-			column_type_name = sqlite3_column_decltype(s->stmt, i);
-			if (column_type_name != NULL) {
-				if (strcmp(column_type_name, "DATETIME") == 0) {
-					if (column_type == SQLITE_INTEGER) {
-						column_type = DQLITE_UNIXTIME;
-					} else {
-						assert(column_type ==
-						           SQLITE_TEXT ||
-						       column_type ==
-						           SQLITE_NULL);
-						column_type = DQLITE_ISO8601;
-					}
-				}
-				if (strcmp(column_type_name, "BOOLEAN") == 0) {
-					assert(column_type == SQLITE_INTEGER ||
-					       column_type == SQLITE_NULL);
-					column_type = DQLITE_BOOLEAN;
-				}
-			}
-
-			assert(column_type < 16);
-			column_types[i] = column_type;
-		} else {
-			/* Padding */
-			column_type = 0;
-		}
-
-		if (i % 2 == 0) {
-			/* Fill the lower 4 bits of the slot */
-			slot = column_type;
-		} else {
-			/* Fill the higher 4 bits of the slot and flush it */
-			slot |= column_type << 4;
-			err = dqlite__message_body_put_uint8(message, slot);
-			if (err != 0) {
-				assert(err == DQLITE_NOMEM);
-				dqlite__error_wrapf(
-				    &s->error,
-				    &message->error,
-				    "failed to write row header");
-				err = SQLITE_NOMEM;
-				goto out;
-			}
-		}
+	for (i = 0; i < column_count; i++) {
+		column_types[i] = dqlite__stmt_column_type(s, i);
 	}
 
-	/* Write the row columns */
-	for (i = 0; i < column_count; i++) {
-		int64_t integer;
-		double  float_;
-		text_t  text;
+	/* Write the row header, along with the leading one-word columns. */
+	i = dqlite__stmt_row_fixed(
+	    s, message, column_types, column_count, 0, header_len);
 
+	/* Write the remaining row columns */
+	while (i >= 0 && i < column_count) {
 		switch (column_types[i]) {
-		case SQLITE_INTEGER:
-			integer = sqlite3_column_int64(s->stmt, i);
-			err = dqlite__message_body_put_int64(message, integer);
-			break;
-		case SQLITE_FLOAT:
-			float_ = sqlite3_column_double(s->stmt, i);
-			err = dqlite__message_body_put_double(message, float_);
-			break;
 		case SQLITE_BLOB:
 			assert(0); /* TODO */
 			break;
-		case SQLITE_NULL:
-			/* TODO: allow null to be encoded with 0 bytes */
-			err = dqlite__message_body_put_int64(message, 0);
-			break;
 		case SQLITE_TEXT:
-			text = (text_t)sqlite3_column_text(s->stmt, i);
-			err  = dqlite__message_body_put_text(message, text);
-			break;
-		case DQLITE_UNIXTIME:
-			integer = sqlite3_column_int64(s->stmt, i);
-			err = dqlite__message_body_put_int64(message, integer);
+			err = dqlite__stmt_column_text(s, message, i, zero_copy);
 			break;
 		case DQLITE_ISO8601:
 			text = (text_t)sqlite3_column_text(s->stmt, i);
@@ -362,11 +535,6 @@ static int dqlite__stmt_row(struct dqlite__stmt *   s,
 				text = "";
 			err = dqlite__message_body_put_text(message, text);
 			break;
-		case DQLITE_BOOLEAN:
-			integer = sqlite3_column_int64(s->stmt, i);
-			err     = dqlite__message_body_put_uint64(message,
-                                                              integer != 0);
-			break;
 		default:
 			dqlite__error_printf(&s->error,
 			                     "unknown type %d for column %d",
@@ -377,13 +545,20 @@ static int dqlite__stmt_row(struct dqlite__stmt *   s,
 		}
 
 		if (err != 0) {
+			dqlite__error_wrapf(
+			    &s->error, &message->error, "failed to write row");
 			break;
 		}
+
+		i = dqlite__stmt_row_fixed(
+		    s, message, column_types, column_count, i + 1, 0);
 	}
 
-out:
-	sqlite3_free(column_types);
+	if (i < 0) {
+		err = SQLITE_ERROR;
+	}
 
+out:
 	if (err != 0) {
 		assert(!dqlite__error_is_null(&s->error));
 		return SQLITE_ERROR;
@@ -392,23 +567,13 @@ out:
 	return SQLITE_OK;
 }
 
-int dqlite__stmt_query(struct dqlite__stmt *s, struct dqlite__message *message)
+/* Encode the column count and names of a query statement. */
+static int dqlite__stmt_header(struct dqlite__stmt *   s,
+                               struct dqlite__message *message,
+                               int                     column_count)
 {
-	int column_count;
 	int err;
 	int i;
-	int rc;
-
-	assert(s != NULL);
-	assert(s->stmt != NULL);
-	assert(message != NULL);
-
-	column_count = sqlite3_column_count(s->stmt);
-	if (column_count <= 0) {
-		dqlite__error_printf(&s->error,
-		                     "stmt doesn't yield any column");
-		return SQLITE_ERROR;
-	}
 
 	/* Insert the column count */
 	err = dqlite__message_body_put_uint64(message, (uint64_t)column_count);
@@ -433,6 +598,46 @@ int dqlite__stmt_query(struct dqlite__stmt *s, struct dqlite__message *message)
 		}
 	}
 
+	return SQLITE_OK;
+}
+
+int dqlite__stmt_query(struct dqlite__stmt *   s,
+                       struct dqlite__message *message,
+                       int                     header,
+                       size_t                  zero_copy)
+{
+	int  column_count;
+	int *column_types;
+	int  rc;
+
+	assert(s != NULL);
+	assert(s->stmt != NULL);
+	assert(message != NULL);
+
+	column_count = sqlite3_column_count(s->stmt);
+	if (column_count <= 0) {
+		dqlite__error_static(&s->error,
+		                     "stmt doesn't yield any column");
+		return SQLITE_ERROR;
+	}
+
+	/* Scratch space for the column types of each row, released once the
+	 * message has been flushed. */
+	column_types = dqlite__message_arena_alloc(
+	    message, (size_t)column_count * sizeof *column_types);
+	if (column_types == NULL) {
+		dqlite__error_oom(&s->error,
+		                  "failed to create column types array");
+		return SQLITE_NOMEM;
+	}
+
+	if (header) {
+		rc = dqlite__stmt_header(s, message, column_count);
+		if (rc != SQLITE_OK) {
+			return rc;
+		}
+	}
+
 	/* Insert the rows. */
 	do {
 		if (dqlite__message_is_large(message)) {
@@ -443,19 +648,138 @@ int dqlite__stmt_query(struct dqlite__stmt *s, struct dqlite__message *message)
 			break;
 		}
 
+		if (dqlite__message_has_external(message)) {
+			/* Stepping would invalidate the values referenced by
+			 * the message, so the next rows must wait until it has
+			 * been sent. */
+			rc = SQLITE_ROW;
+			break;
+		}
+
 		rc = sqlite3_step(s->stmt);
 		if (rc != SQLITE_ROW) {
 			break;
 		}
 
-		rc = dqlite__stmt_row(s, message, column_count);
+		if (s->digest) {
+			dqlite__stmt_checksum(s->stmt, &s->checksum);
+		}
+
+		rc = dqlite__stmt_row(
+		    s, message, column_count, column_types, zero_copy);
 		if (rc != SQLITE_OK) {
 			break;
 		}
 
+		s->rows++;
+
 	} while (1);
 
 	return rc;
 }
 
+/* Fold the given bytes into a FNV-1a checksum. */
+static void dqlite__stmt_checksum_bytes(uint64_t *  checksum,
+                                        const void *buf,
+                                        size_t      len)
+{
+	const uint8_t *bytes = buf;
+	size_t         i;
+
+	for (i = 0; i < len; i++) {
+		*checksum ^= bytes[i];
+		*checksum *= 0x100000001b3;
+	}
+}
+
+void dqlite__stmt_checksum(sqlite3_stmt *stmt, uint64_t *checksum)
+{
+	const void *buf;
+	size_t      len;
+	int64_t     integer;
+	double      real;
+	uint8_t     type;
+	int         i;
+
+	assert(stmt != NULL);
+	assert(checksum != NULL);
+
+	for (i = 0; i < sqlite3_column_count(stmt); i++) {
+		type = (uint8_t)sqlite3_column_type(stmt, i);
+		dqlite__stmt_checksum_bytes(checksum, &type, sizeof type);
+
+		switch (type) {
+		case SQLITE_INTEGER:
+			integer = sqlite3_column_int64(stmt, i);
+			dqlite__stmt_checksum_bytes(
+			    checksum, &integer, sizeof integer);
+			break;
+		case SQLITE_FLOAT:
+			real = sqlite3_column_double(stmt, i);
+			dqlite__stmt_checksum_bytes(
+			    checksum, &real, sizeof real);
+			break;
+		case SQLITE_TEXT:
+			buf = sqlite3_column_text(stmt, i);
+			len = (size_t)sqlite3_column_bytes(stmt, i);
+			dqlite__stmt_checksum_bytes(checksum, buf, len);
+			break;
+		case SQLITE_BLOB:
+			buf = sqlite3_column_blob(stmt, i);
+			len = (size_t)sqlite3_column_bytes(stmt, i);
+			dqlite__stmt_checksum_bytes(checksum, buf, len);
+			break;
+		}
+	}
+}
+
+int dqlite__stmt_each(struct dqlite__stmt *s,
+                      int (*xRow)(void *ctx, sqlite3_stmt *stmt),
+                      void *   ctx,
+                      unsigned max)
+{
+	unsigned n;
+	int      rc;
+
+	assert(s != NULL);
+	assert(s->stmt != NULL);
+	assert(xRow != NULL);
+
+	if (sqlite3_column_count(s->stmt) <= 0) {
+		dqlite__error_static(&s->error,
+		                     "stmt doesn't yield any column");
+		return SQLITE_ERROR;
+	}
+
+	for (n = 0; n < max; n++) {
+		rc = sqlite3_step(s->stmt);
+		if (rc != SQLITE_ROW) {
+			break;
+		}
+
+		/* Before the callback gets a chance to convert values. */
+		if (s->digest) {
+			dqlite__stmt_checksum(s->stmt, &s->checksum);
+		}
+
+		if (xRow(ctx, s->stmt) != 0) {
+			dqlite__error_static(&s->error,
+			                     "query aborted by callback");
+			return SQLITE_ABORT;
+		}
+
+		s->rows++;
+	}
+
+	if (n == max) {
+		return SQLITE_ROW;
+	}
+
+	if (rc != SQLITE_DONE) {
+		dqlite__error_sqlite(&s->error, s->db);
+	}
+
+	return rc;
+}
+
 DQLITE__REGISTRY_METHODS(dqlite__stmt_registry, dqlite__stmt);
@@ -45,19 +45,30 @@
 #ifndef DQLITE_STMT_H
 #define DQLITE_STMT_H
 
+#include <stdint.h>
+
 #include <sqlite3.h>
 
 #include "error.h"
 #include "message.h"
 #include "registry.h"
 
+/* Initial value of a row checksum. */
+#define DQLITE__STMT_CHECKSUM_SEED 0xcbf29ce484222325
+
 /* Hold state for a single open SQLite database */
 struct dqlite__stmt {
-	size_t        id;    /* Statement ID */
-	sqlite3 *     db;    /* Underlying database info */
-	sqlite3_stmt *stmt;  /* Underlying SQLite statement handle */
-	const char *  tail;  /* Unparsed SQL portion */
-	dqlite__error error; /* Last dqlite-specific error */
+	size_t        id;       /* Statement ID */
+	sqlite3 *     db;       /* Underlying database info */
+	sqlite3_stmt *stmt;     /* Underlying SQLite statement handle */
+	const char *  tail;     /* Unparsed SQL portion */
+	char *        sql;      /* SQL text kept while evicted, or NULL */
+	int           readonly; /* Whether the evicted statement is read-only */
+	uint64_t      used;     /* Database clock when the statement was used */
+	uint64_t      rows;     /* Rows encoded since the last binding */
+	int           digest;   /* Whether to checksum the rows yielded */
+	uint64_t      checksum; /* Of the rows yielded since the last binding */
+	dqlite__error error;    /* Last dqlite-specific error */
 };
 
 /* Initialize a statement state object */
@@ -70,6 +81,20 @@ void dqlite__stmt_close(struct dqlite__stmt *s);
  * required by the registry interface. */
 const char *dqlite__stmt_hash(struct dqlite__stmt *stmt);
 
+/* Finalize the underlying statement to release its memory, keeping a copy of
+ * its SQL text. Statements in the middle of a run are left alone.
+ *
+ * Return true if the statement was evicted. */
+int dqlite__stmt_evict(struct dqlite__stmt *s);
+
+/* Prepare again the underlying statement, if it was evicted. */
+int dqlite__stmt_revive(struct dqlite__stmt *s);
+
+/* Return true if the statement makes no direct change to the database, like
+ * sqlite3_stmt_readonly. It works for evicted statements too, and an empty
+ * statement is considered read-only. */
+int dqlite__stmt_readonly(struct dqlite__stmt *s);
+
 /* Bind the parameters of the underlying statement by decoding the given
  * message. */
 int dqlite__stmt_bind(struct dqlite__stmt *s, struct dqlite__message *message);
@@ -79,8 +104,34 @@ int dqlite__stmt_exec(struct dqlite__stmt *s,
                       uint64_t *           rows_affected);
 
 /* Step through a query statement and fill the given message with the rows it
- * yields. */
-int dqlite__stmt_query(struct dqlite__stmt *s, struct dqlite__message *message);
+ * yields, preceded by the column count and names if header is true. If the
+ * digest flag of the statement is set, the checksum of the rows is updated as
+ * well, which dqlite__stmt_each does too.
+ *
+ * Text values of at least zero_copy bytes are referenced by the message
+ * instead of being copied, unless zero_copy is 0. In that case the batch ends
+ * with the row holding them, and the statement must not be stepped, reset or
+ * finalized until the message has been sent.
+ *
+ * Scratch memory is taken from the arena of the message. */
+int dqlite__stmt_query(struct dqlite__stmt *   s,
+                       struct dqlite__message *message,
+                       int                     header,
+                       size_t                  zero_copy);
+
+/* Update the given checksum with the values of the row the given statement is
+ * positioned on. The values are read according to their storage class, so no
+ * type conversion takes place. */
+void dqlite__stmt_checksum(sqlite3_stmt *stmt, uint64_t *checksum);
+
+/* Step through up to max rows of a query statement, handing each of them to
+ * the given callback instead of encoding it. Return SQLITE_ROW if there might
+ * be more rows, or SQLITE_DONE if the result set is over. Stepping stops with
+ * SQLITE_ABORT if the callback returns non-zero. */
+int dqlite__stmt_each(struct dqlite__stmt *s,
+                      int (*xRow)(void *ctx, sqlite3_stmt *stmt),
+                      void *   ctx,
+                      unsigned max);
 
 DQLITE__REGISTRY(dqlite__stmt_registry, dqlite__stmt);
 
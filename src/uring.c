@@ -0,0 +1,327 @@
+#include <assert.h>
+#include <errno.h>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+#include "lifecycle.h"
+#include "uring.h"
+
+/* Return a free submission queue entry, making room by submitting the queued
+ * ones if needed. */
+static struct io_uring_sqe *dqlite__uring_sqe(struct dqlite__uring *u)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(&u->ring);
+	if (sqe == NULL) {
+		io_uring_submit(&u->ring);
+		sqe = io_uring_get_sqe(&u->ring);
+	}
+
+	return sqe;
+}
+
+/* Hand the provided buffer with the given ID back to the kernel. */
+static void dqlite__uring_buf_recycle(struct dqlite__uring *u, unsigned bid)
+{
+	io_uring_buf_ring_add(u->br,
+	                      u->bufs + bid * DQLITE__URING_BUF_SIZE,
+	                      DQLITE__URING_BUF_SIZE,
+	                      bid,
+	                      io_uring_buf_ring_mask(DQLITE__URING_BUFS),
+	                      0);
+	io_uring_buf_ring_advance(u->br, 1);
+}
+
+/* Dispatch a single completion to the callback of its request. */
+static void dqlite__uring_complete(struct dqlite__uring *u,
+                                   struct io_uring_cqe * cqe)
+{
+	struct dqlite__uring_req *req;
+	const char *              buf = NULL;
+	unsigned                  bid = 0;
+	int                       more;
+
+	req = io_uring_cqe_get_data(cqe);
+
+	/* Cancellations have no request attached. */
+	if (req == NULL) {
+		return;
+	}
+
+	more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	if (!more) {
+		assert(u->inflight > 0);
+		u->inflight--;
+	}
+
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		buf = u->bufs + bid * DQLITE__URING_BUF_SIZE;
+	}
+
+	req->cb(req, cqe->res, buf, more);
+
+	/* Callbacks consume the data right away, so the buffer can be
+	 * reused. */
+	if (buf != NULL) {
+		dqlite__uring_buf_recycle(u, bid);
+	}
+}
+
+/* Process all available completions. */
+static void dqlite__uring_reap(struct dqlite__uring *u)
+{
+	struct io_uring_cqe *cqe;
+	unsigned             head;
+	unsigned             n = 0;
+
+	io_uring_for_each_cqe(&u->ring, head, cqe)
+	{
+		dqlite__uring_complete(u, cqe);
+		n++;
+	}
+
+	io_uring_cq_advance(&u->ring, n);
+}
+
+static void dqlite__uring_poll_cb(uv_poll_t *poll, int status, int events)
+{
+	struct dqlite__uring *u;
+
+	assert(poll != NULL);
+	assert(poll->data != NULL);
+
+	(void)events;
+
+	u = poll->data;
+
+	if (status != 0) {
+		return;
+	}
+
+	dqlite__uring_reap(u);
+}
+
+/* Submit all entries queued during this loop iteration with a single system
+ * call, right before the loop blocks for I/O. */
+static void dqlite__uring_prepare_cb(uv_prepare_t *prepare)
+{
+	struct dqlite__uring *u;
+
+	assert(prepare != NULL);
+	assert(prepare->data != NULL);
+
+	u = prepare->data;
+
+	if (io_uring_sq_ready(&u->ring) > 0) {
+		io_uring_submit(&u->ring);
+	}
+}
+
+int dqlite__uring_init(struct dqlite__uring *u, uv_loop_t *loop)
+{
+	unsigned i;
+	int      rv;
+
+	assert(u != NULL);
+	assert(loop != NULL);
+
+	u->inflight = 0;
+
+	rv = io_uring_queue_init(DQLITE__URING_ENTRIES, &u->ring, 0);
+	if (rv != 0) {
+		goto err;
+	}
+
+	u->bufs = sqlite3_malloc(DQLITE__URING_BUFS * DQLITE__URING_BUF_SIZE);
+	if (u->bufs == NULL) {
+		rv = -ENOMEM;
+		goto err_after_queue_init;
+	}
+
+	/* Fails on kernels older than 5.19, which lack provided buffer
+	 * rings. */
+	u->br = io_uring_setup_buf_ring(
+	    &u->ring, DQLITE__URING_BUFS, DQLITE__URING_BGID, 0, &rv);
+	if (u->br == NULL) {
+		goto err_after_bufs_alloc;
+	}
+
+	for (i = 0; i < DQLITE__URING_BUFS; i++) {
+		io_uring_buf_ring_add(u->br,
+		                      u->bufs + i * DQLITE__URING_BUF_SIZE,
+		                      DQLITE__URING_BUF_SIZE,
+		                      i,
+		                      io_uring_buf_ring_mask(DQLITE__URING_BUFS),
+		                      i);
+	}
+	io_uring_buf_ring_advance(u->br, DQLITE__URING_BUFS);
+
+	rv = uv_poll_init(loop, &u->poll, u->ring.ring_fd);
+	if (rv != 0) {
+		goto err_after_buf_ring_setup;
+	}
+	u->poll.data = (void *)u;
+
+	rv = uv_poll_start(&u->poll, UV_READABLE, dqlite__uring_poll_cb);
+	if (rv != 0) {
+		goto err_after_poll_init;
+	}
+
+	rv = uv_prepare_init(loop, &u->prepare);
+	if (rv != 0) {
+		goto err_after_poll_init;
+	}
+	u->prepare.data = (void *)u;
+
+	rv = uv_prepare_start(&u->prepare, dqlite__uring_prepare_cb);
+	if (rv != 0) {
+		goto err_after_prepare_init;
+	}
+
+	dqlite__lifecycle_init(DQLITE__LIFECYCLE_URING);
+
+	return 0;
+
+err_after_prepare_init:
+	uv_close((uv_handle_t *)&u->prepare, NULL);
+
+err_after_poll_init:
+	uv_close((uv_handle_t *)&u->poll, NULL);
+
+err_after_buf_ring_setup:
+	io_uring_free_buf_ring(
+	    &u->ring, u->br, DQLITE__URING_BUFS, DQLITE__URING_BGID);
+
+err_after_bufs_alloc:
+	sqlite3_free(u->bufs);
+
+err_after_queue_init:
+	io_uring_queue_exit(&u->ring);
+
+err:
+	assert(rv != 0);
+	return rv;
+}
+
+void dqlite__uring_close(struct dqlite__uring *u)
+{
+	struct io_uring_cqe *cqe;
+	int                  rv;
+
+	assert(u != NULL);
+
+	/* All connections have been aborted and their requests cancelled, so
+	 * the remaining completions are about to arrive. */
+	io_uring_submit(&u->ring);
+
+	while (u->inflight > 0) {
+		rv = io_uring_wait_cqe(&u->ring, &cqe);
+		if (rv != 0 && rv != -EINTR) {
+			break;
+		}
+		dqlite__uring_reap(u);
+	}
+
+	io_uring_free_buf_ring(
+	    &u->ring, u->br, DQLITE__URING_BUFS, DQLITE__URING_BGID);
+	io_uring_queue_exit(&u->ring);
+
+	sqlite3_free(u->bufs);
+
+	dqlite__lifecycle_close(DQLITE__LIFECYCLE_URING);
+}
+
+int dqlite__uring_recv(struct dqlite__uring *    u,
+                       struct dqlite__uring_req *req,
+                       int                       fd)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(u != NULL);
+	assert(req != NULL);
+	assert(req->cb != NULL);
+
+	sqe = dqlite__uring_sqe(u);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	io_uring_prep_recv_multishot(sqe, fd, NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = DQLITE__URING_BGID;
+	io_uring_sqe_set_data(sqe, req);
+
+	u->inflight++;
+
+	return 0;
+}
+
+int dqlite__uring_send(struct dqlite__uring *    u,
+                       struct dqlite__uring_req *req,
+                       int                       fd,
+                       const struct msghdr *     msg)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(u != NULL);
+	assert(req != NULL);
+	assert(req->cb != NULL);
+	assert(msg != NULL);
+
+	sqe = dqlite__uring_sqe(u);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	io_uring_prep_sendmsg(sqe, fd, msg, MSG_NOSIGNAL);
+	io_uring_sqe_set_data(sqe, req);
+
+	u->inflight++;
+
+	return 0;
+}
+
+int dqlite__uring_cancel(struct dqlite__uring *u, int fd)
+{
+	struct io_uring_sqe *sqe;
+	int                  rv;
+
+	assert(u != NULL);
+
+	sqe = dqlite__uring_sqe(u);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	io_uring_prep_cancel_fd(sqe, fd, IORING_ASYNC_CANCEL_ALL);
+	io_uring_sqe_set_data(sqe, NULL);
+
+	rv = io_uring_submit(&u->ring);
+	if (rv < 0) {
+		return rv;
+	}
+
+	return 0;
+}
+
+int dqlite__uring_cancel_req(struct dqlite__uring *    u,
+                             struct dqlite__uring_req *req)
+{
+	struct io_uring_sqe *sqe;
+
+	assert(u != NULL);
+	assert(req != NULL);
+
+	sqe = dqlite__uring_sqe(u);
+	if (sqe == NULL) {
+		return -EBUSY;
+	}
+
+	io_uring_prep_cancel(sqe, req, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+
+	return 0;
+}
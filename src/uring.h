@@ -0,0 +1,108 @@
+/******************************************************************************
+ *
+ * Optional io_uring backend for receiving and sending on client sockets.
+ *
+ * Each connection keeps a single multishot receive request armed, which picks
+ * buffers from a ring of provided buffers shared by all connections, so no
+ * memory is pinned by idle clients. Sends are queued as submission entries and
+ * submitted in a single batch once per loop iteration.
+ *
+ * The ring's file descriptor is watched by the libuv loop, which keeps running
+ * timers and async handles as usual.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_URING_H
+#define DQLITE_URING_H
+
+#include <stddef.h>
+
+#include <sys/socket.h>
+
+#include <uv.h>
+
+#ifdef DQLITE_URING
+#include <liburing.h>
+#endif /* DQLITE_URING */
+
+/* Number of submission queue entries of the ring. */
+#define DQLITE__URING_ENTRIES 256
+
+/* Number of buffers provided to the kernel for multishot receives. Must be a
+ * power of two. */
+#define DQLITE__URING_BUFS 256
+
+/* Size of each provided buffer. */
+#define DQLITE__URING_BUF_SIZE 4096
+
+/* ID of the group of provided buffers. */
+#define DQLITE__URING_BGID 0
+
+struct dqlite__uring_req;
+
+/* Invoked for every completion of a request.
+ *
+ * If the completion carries data, buf points to a provided buffer holding res
+ * bytes, which is valid only until the callback returns. The more flag is set
+ * if the request will generate further completions. */
+typedef void (*dqlite__uring_cb)(struct dqlite__uring_req *req,
+                                 int                       res,
+                                 const char *              buf,
+                                 int                       more);
+
+/* A request submitted to the ring. */
+struct dqlite__uring_req {
+	void *           data; /* User data */
+	dqlite__uring_cb cb;   /* Completion callback */
+};
+
+#ifdef DQLITE_URING
+
+struct dqlite__uring {
+	struct io_uring           ring;     /* Submission and completion queues */
+	struct io_uring_buf_ring *br;       /* Ring of provided buffers */
+	char *                    bufs;     /* Memory of provided buffers */
+	uv_poll_t                 poll;     /* Watch the ring for completions */
+	uv_prepare_t              prepare;  /* Submit queued entries in batch */
+	unsigned                  inflight; /* Requests expecting completions */
+};
+
+/* Set up the ring and start watching it from the given loop.
+ *
+ * Return 0 on success, or a negative errno value if io_uring or one of the
+ * features we need is not available. */
+int dqlite__uring_init(struct dqlite__uring *u, uv_loop_t *loop);
+
+/* Wait for the final completion of all requests, invoking their callbacks,
+ * and release the ring.
+ *
+ * Must be called after the poll and prepare handles have been closed. */
+void dqlite__uring_close(struct dqlite__uring *u);
+
+/* Queue a multishot receive from the given socket, using provided buffers. */
+int dqlite__uring_recv(struct dqlite__uring *    u,
+                       struct dqlite__uring_req *req,
+                       int                       fd);
+
+/* Queue a send of the given message to the given socket. */
+int dqlite__uring_send(struct dqlite__uring *    u,
+                       struct dqlite__uring_req *req,
+                       int                       fd,
+                       const struct msghdr *     msg);
+
+/* Cancel all requests against the given socket.
+ *
+ * The cancellation is submitted right away, along with any entry still queued
+ * for the socket, so it's safe to close the socket as soon as this function
+ * returns. */
+int dqlite__uring_cancel(struct dqlite__uring *u, int fd);
+
+/* Cancel the given request, which gets a final completion with -ECANCELED
+ * unless it completes first. The cancellation is submitted in batch with the
+ * other queued entries. */
+int dqlite__uring_cancel_req(struct dqlite__uring *    u,
+                             struct dqlite__uring_req *req);
+
+#endif /* DQLITE_URING */
+
+#endif /* DQLITE_URING_H */
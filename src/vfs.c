@@ -13,6 +13,7 @@
 
 #include "format.h"
 #include "log.h"
+#include "vfs.h"
 
 /* Maximum pathname length supported by this VFS. */
 #define DQLITE__VFS_MAX_PATHNAME 512
@@ -20,10 +21,20 @@
 /* Maximum number of files this VFS can create. */
 #define DQLITE__VFS_MAX_FILES 64
 
-/* Hold content for a single page or frame in a volatile file. */
+/* Number of file slots that snapshots never take, so that they can't starve
+ * regular databases. A snapshot takes three slots once opened, for its
+ * database, WAL and shared memory files. */
+#define DQLITE__VFS_SNAPSHOT_RESERVE (DQLITE__VFS_MAX_FILES / 2)
+#define DQLITE__VFS_SNAPSHOT_FILES 3
+
+/* Hold content for a single page or frame in a volatile file.
+ *
+ * A page can be shared between a file and its snapshots, in which case it's
+ * copied before being modified. */
 struct dqlite__vfs_page {
-	void *buf; /* Content of the page. */
-	void *hdr; /* Page header (only for WAL pages). */
+	void *buf;      /* Content of the page. */
+	void *hdr;      /* Page header (only for WAL pages). */
+	int   refcount; /* Number of files referencing this page. */
 };
 
 /* Create a new volatile page for a database or WAL file.
@@ -57,6 +68,8 @@ static struct dqlite__vfs_page *dqlite__vfs_page_create(int size, int wal)
 		p->hdr = NULL;
 	}
 
+	p->refcount = 1;
+
 	return p;
 
 oom_after_buf_malloc:
@@ -84,6 +97,19 @@ static void dqlite__vfs_page_destroy(struct dqlite__vfs_page *p)
 	sqlite3_free(p);
 }
 
+/* Drop a reference to a volatile page, destroying it if it was the last one. */
+static void dqlite__vfs_page_unref(struct dqlite__vfs_page *p)
+{
+	assert(p != NULL);
+	assert(p->refcount > 0);
+
+	p->refcount--;
+
+	if (p->refcount == 0) {
+		dqlite__vfs_page_destroy(p);
+	}
+}
+
 /* Hold content for a shared memory mapping. */
 struct dqlite__vfs_shm {
 	void **regions;     /* Pointers to shared memory regions. */
@@ -239,7 +265,7 @@ static void dqlite__vfs_content_destroy(struct dqlite__vfs_content *c)
 	for (i = 0; i < c->pages_len; i++) {
 		page = *(c->pages + i);
 		assert(page != NULL);
-		dqlite__vfs_page_destroy(page);
+		dqlite__vfs_page_unref(page);
 	}
 
 	/* Free the page array. */
@@ -332,6 +358,28 @@ static int dqlite__vfs_content_page_get(struct dqlite__vfs_content *c,
 		/* Return the existing page. */
 		assert(c->pages != NULL);
 		*page = *(c->pages + pgno - 1);
+
+		/* If the page is shared with a snapshot, the caller is about
+		 * to modify it, so replace it with a private copy. */
+		if ((*page)->refcount > 1) {
+			struct dqlite__vfs_page *shared = *page;
+
+			*page = dqlite__vfs_page_create(c->page_size, is_wal);
+			if (*page == NULL) {
+				rc = SQLITE_NOMEM;
+				goto err;
+			}
+
+			memcpy((*page)->buf, shared->buf, c->page_size);
+			if (is_wal) {
+				memcpy((*page)->hdr,
+				       shared->hdr,
+				       DQLITE__FORMAT_WAL_FRAME_HDR_SIZE);
+			}
+
+			*(c->pages + pgno - 1) = *page;
+			dqlite__vfs_page_unref(shared);
+		}
 	}
 
 	return SQLITE_OK;
@@ -389,7 +437,7 @@ static void dqlite__vfs_content_truncate(struct dqlite__vfs_content *content,
 	/* Destroy pages beyond pages_len. */
 	cursor = content->pages + pages_len;
 	for (i = 0; i < (content->pages_len - pages_len); i++) {
-		dqlite__vfs_page_destroy(*cursor);
+		dqlite__vfs_page_unref(*cursor);
 		cursor++;
 	}
 
@@ -1019,9 +1067,12 @@ static int dqlite__vfs_write(sqlite3_file *file,
 			    f->content->page_size, offset);
 
 			// The header for the this frame must already have been
-			// written, so the page is there.
-			page =
-			    dqlite__vfs_content_page_lookup(f->content, pgno);
+			// written, so the page is there. Still get it for
+			// writing, in case it's shared with a snapshot.
+			rc = dqlite__vfs_content_page_get(f->content, pgno, &page);
+			if (rc != SQLITE_OK) {
+				return rc;
+			}
 
 			assert(page != NULL);
 
@@ -1449,8 +1500,66 @@ static int dqlite__vfs_shm_unmap(sqlite3_file *file, int delete_flag)
 	return SQLITE_OK;
 }
 
+/* Memory-mapped access to database pages.
+ *
+ * Since pages already live in memory, we can hand SQLite a pointer to the page
+ * buffer instead of having it copy the page into its own page cache. SQLite
+ * only uses fetched pages for reading: when a page needs to be modified it gets
+ * copied into the page cache first, and written back with xWrite. */
+static int dqlite__vfs_fetch(sqlite3_file *file,
+                             sqlite_int64  offset,
+                             int           amount,
+                             void **       pp)
+{
+	struct dqlite__vfs_file *f = (struct dqlite__vfs_file *)file;
+
+	int                      pgno;
+	struct dqlite__vfs_page *page;
+
+	assert(f != NULL);
+	assert(pp != NULL);
+
+	/* A NULL pointer tells SQLite to fall back to xRead. */
+	*pp = NULL;
+
+	if (f->temp != NULL) {
+		return SQLITE_OK;
+	}
+
+	assert(f->content != NULL);
+
+	/* Only full pages of the main database can be mapped, since pages are
+	 * not contiguous in memory. */
+	if (f->content->type != DQLITE__FORMAT_DB ||
+	    dqlite__vfs_content_is_empty(f->content) ||
+	    amount != (int)f->content->page_size ||
+	    (offset % f->content->page_size) != 0) {
+		return SQLITE_OK;
+	}
+
+	pgno = (offset / f->content->page_size) + 1;
+
+	page = dqlite__vfs_content_page_lookup(f->content, pgno);
+	if (page != NULL) {
+		*pp = page->buf;
+	}
+
+	return SQLITE_OK;
+}
+
+static int dqlite__vfs_unfetch(sqlite3_file *file, sqlite_int64 offset, void *p)
+{
+	(void)file;
+	(void)offset;
+	(void)p;
+
+	/* Nothing to release, mapped pages are owned by the file content. */
+
+	return SQLITE_OK;
+}
+
 static const sqlite3_io_methods dqlite__io_methods = {
-    2,                                  // iVersion
+    3,                                  // iVersion
     dqlite__vfs_close,                  // xClose
     dqlite__vfs_read,                   // xRead
     dqlite__vfs_write,                  // xWrite
@@ -1467,8 +1576,8 @@ static const sqlite3_io_methods dqlite__io_methods = {
     dqlite__vfs_shm_lock,               // xShmLock
     dqlite__vfs_shm_barrier,            // xShmBarrier
     dqlite__vfs_shm_unmap,              // xShmUnmap
-    0,
-    0,
+    dqlite__vfs_fetch,                  // xFetch
+    dqlite__vfs_unfetch,                // xUnfetch
 };
 
 static int dqlite__vfs_open(sqlite3_vfs * vfs,
@@ -1865,3 +1974,155 @@ void dqlite_vfs_destroy(sqlite3_vfs *vfs)
 	sqlite3_free((char *)vfs->zName);
 	sqlite3_free(vfs);
 }
+
+int dqlite__vfs_snapshot(sqlite3_vfs *vfs,
+                         const char * filename,
+                         const char * snapshot)
+{
+	struct dqlite__vfs_root *   root;
+	struct dqlite__vfs_content *database;
+	struct dqlite__vfs_content *wal;
+	struct dqlite__vfs_content *content;
+	struct dqlite__vfs_content *existing;
+	struct dqlite__vfs_page *   page;
+	uint32_t                    mx_frame = 0;
+	uint32_t                    pgno;
+	uint32_t                    commit;
+	unsigned                    page_size;
+	int                         pages_len;
+	int                         free_slot;
+	int                         free_slots;
+	int                         rc;
+	int                         i;
+
+	assert(vfs != NULL);
+	assert(filename != NULL);
+	assert(snapshot != NULL);
+
+	/* Only volatile files can be snapshotted. */
+	if (vfs->xOpen != dqlite__vfs_open) {
+		return SQLITE_NOTFOUND;
+	}
+
+	root = (struct dqlite__vfs_root *)(vfs->pAppData);
+
+	pthread_mutex_lock(&root->mutex);
+
+	dqlite__vfs_root_content_lookup(root, filename, &database);
+	if (database == NULL || database->type != DQLITE__FORMAT_DB) {
+		root->error = ENOENT;
+		rc          = SQLITE_CANTOPEN;
+		goto err;
+	}
+
+	free_slot = dqlite__vfs_root_content_lookup(root, snapshot, &existing);
+	if (existing != NULL) {
+		root->error = EEXIST;
+		rc          = SQLITE_CANTOPEN;
+		goto err;
+	}
+	free_slots = 0;
+	for (i = 0; i < root->contents_len; i++) {
+		if (*(root->contents + i) == NULL) {
+			free_slots++;
+		}
+	}
+	if (free_slot == -1 || free_slots < DQLITE__VFS_SNAPSHOT_RESERVE +
+	                                        DQLITE__VFS_SNAPSHOT_FILES) {
+		root->error = ENFILE;
+		rc          = SQLITE_CANTOPEN;
+		goto err;
+	}
+
+	/* Only frames up to mxFrame belong to committed transactions. */
+	wal = database->wal;
+	if (wal != NULL && database->shm != NULL &&
+	    database->shm->regions_len > 0) {
+		dqlite__format_get_mx_frame(
+		    (const uint8_t *)database->shm->regions[0], &mx_frame);
+	}
+
+	/* The last committed frame holds the size of the database. */
+	if (mx_frame > 0) {
+		if ((int)mx_frame > wal->pages_len) {
+			rc = SQLITE_CORRUPT;
+			goto err;
+		}
+		page = *(wal->pages + mx_frame - 1);
+		dqlite__format_get_frame_info(page->hdr, &pgno, &commit);
+		if (commit == 0) {
+			rc = SQLITE_CORRUPT;
+			goto err;
+		}
+		page_size = wal->page_size;
+		pages_len = (int)commit;
+	} else {
+		page_size = database->page_size;
+		pages_len = database->pages_len;
+	}
+
+	content = dqlite__vfs_content_create(
+	    snapshot, DQLITE__FORMAT_DB, root->logger);
+	if (content == NULL) {
+		root->error = ENOMEM;
+		rc          = SQLITE_NOMEM;
+		goto err;
+	}
+
+	content->page_size = page_size;
+
+	if (pages_len > 0) {
+		content->pages = sqlite3_malloc((sizeof *content->pages) * pages_len);
+		if (content->pages == NULL) {
+			root->error = ENOMEM;
+			rc          = SQLITE_NOMEM;
+			goto err_after_content_create;
+		}
+		memset(content->pages, 0, (sizeof *content->pages) * pages_len);
+	}
+
+	/* Start from the pages of the database file, then overlay the committed
+	 * frames of the WAL in order, so the most recent version of each page
+	 * wins. */
+	for (i = 0; i < pages_len && i < database->pages_len; i++) {
+		*(content->pages + i) = *(database->pages + i);
+	}
+	for (i = 0; i < (int)mx_frame; i++) {
+		page = *(wal->pages + i);
+		dqlite__format_get_frame_info(page->hdr, &pgno, &commit);
+		if (pgno > 0 && (int)pgno <= pages_len) {
+			*(content->pages + pgno - 1) = page;
+		}
+	}
+
+	for (i = 0; i < pages_len; i++) {
+		if (*(content->pages + i) == NULL) {
+			rc = SQLITE_CORRUPT;
+			goto err_after_content_create;
+		}
+	}
+
+	/* Only take references once the page array is complete, so pages are
+	 * counted once no matter how many frames referenced them. */
+	for (i = 0; i < pages_len; i++) {
+		(*(content->pages + i))->refcount++;
+	}
+	content->pages_len = pages_len;
+
+	*(root->contents + free_slot) = content;
+
+	pthread_mutex_unlock(&root->mutex);
+
+	return SQLITE_OK;
+
+err_after_content_create:
+	/* No reference has been taken yet, so only the page array is freed. */
+	dqlite__vfs_content_destroy(content);
+
+err:
+	assert(rc != SQLITE_OK);
+
+	pthread_mutex_unlock(&root->mutex);
+
+	return rc;
+}
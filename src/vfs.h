@@ -0,0 +1,30 @@
+/******************************************************************************
+ *
+ * Internal API of the volatile VFS.
+ *
+ *****************************************************************************/
+
+#ifndef DQLITE_VFS_H
+#define DQLITE_VFS_H
+
+#include <sqlite3.h>
+
+/* Create a new database file with the given snapshot name, holding the content
+ * that the given database file had as of its last committed transaction,
+ * including the frames of its WAL that were not checkpointed yet.
+ *
+ * Pages are shared with the original database and WAL files until either side
+ * modifies them, so creating a snapshot is cheap and checkpoints of the
+ * original database can proceed while the snapshot is being read. The snapshot
+ * must be removed with xDelete once done.
+ *
+ * Snapshots are refused with SQLITE_CANTOPEN and ENFILE unless at least half of
+ * the file slots of the VFS would still be free once the snapshot is open, so
+ * regular databases always have room.
+ *
+ * Return SQLITE_NOTFOUND if the given VFS is not a volatile one. */
+int dqlite__vfs_snapshot(sqlite3_vfs *vfs,
+                         const char * filename,
+                         const char * snapshot);
+
+#endif /* DQLITE_VFS_H */
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <sqlite3.h>
@@ -45,7 +46,8 @@ static void test_client__write(struct test_client *c)
 	/* Encode the request. */
 	err = dqlite__request_encode(&c->request);
 	if (err != 0) {
-		munit_errorf("failed to encode request: %s", c->request.error);
+		munit_errorf("failed to encode request: %s",
+		             dqlite__error_msg(&c->request.error));
 	}
 
 	/* Write out the request data. */
@@ -67,10 +69,13 @@ static void test_client__write(struct test_client *c)
 	dqlite__message_send_reset(&c->request.message);
 }
 
-static void test_client__read(struct test_client *c)
+/* Read and decode a response. If the request failed, abort unless tolerate
+ * is set, in which case the failure code is returned. */
+static uint64_t test_client__recv(struct test_client *c, int tolerate)
 {
-	int n;
-	int err;
+	uint64_t code = 0;
+	int      n;
+	int      err;
 	dqlite__message_header_recv_start(&c->response.message, &c->bufs[0]);
 
 	err = read(c->fd, c->bufs[0].base, c->bufs[0].len);
@@ -82,14 +87,14 @@ static void test_client__read(struct test_client *c)
 	err = dqlite__message_header_recv_done(&c->response.message);
 	if (err != 0) {
 		munit_errorf("failed to handle response header: %s",
-		             c->response.message.error);
+		             dqlite__error_msg(&c->response.message.error));
 	}
 
 	err =
 	    dqlite__message_body_recv_start(&c->response.message, &c->bufs[0]);
 	if (err != 0) {
 		munit_errorf("failed to start receiving body: %s",
-		             c->response.message.error);
+		             dqlite__error_msg(&c->response.message.error));
 	}
 
 	n = read(c->fd, c->bufs[0].base, c->bufs[0].len);
@@ -103,13 +108,16 @@ static void test_client__read(struct test_client *c)
 	err = dqlite__response_decode(&c->response);
 	if (err != 0) {
 		munit_errorf("failed to decode response: %s",
-		             c->response.error);
+		             dqlite__error_msg(&c->response.error));
 	}
 
 	if (c->response.type == DQLITE_RESPONSE_FAILURE) {
-		munit_errorf("request failed: %s (%lu)",
-		             c->response.failure.message,
-		             c->response.failure.code);
+		if (!tolerate) {
+			munit_errorf("request failed: %s (%lu)",
+			             c->response.failure.message,
+			             c->response.failure.code);
+		}
+		code = c->response.failure.code;
 	}
 
 	/* Reset the message in all cases except for rows responses, which need
@@ -117,6 +125,13 @@ static void test_client__read(struct test_client *c)
 	if (c->response.type != DQLITE_RESPONSE_ROWS) {
 		dqlite__message_recv_reset(&c->response.message);
 	}
+
+	return code;
+}
+
+static void test_client__read(struct test_client *c)
+{
+	test_client__recv(c, 0);
 }
 
 void test_client_leader(struct test_client *c, char **leader)
@@ -142,10 +157,8 @@ void test_client_client(struct test_client *c, uint64_t *heartbeat)
 
 void test_client_open(struct test_client *c, const char *name, uint32_t *db_id)
 {
-	(void)name;
-
 	c->request.type       = DQLITE_REQUEST_OPEN;
-	c->request.open.name  = "test.db";
+	c->request.open.name  = name;
 	c->request.open.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
 	c->request.open.vfs   = "test";
 
@@ -155,6 +168,89 @@ void test_client_open(struct test_client *c, const char *name, uint32_t *db_id)
 	*db_id = c->response.db.id;
 }
 
+void test_client_connect(struct test_client *c,
+                         const char *        name,
+                         uint64_t *          heartbeat,
+                         uint32_t *          db_id)
+{
+	struct iovec iov[3];
+	uint64_t     protocol;
+	int          err;
+
+	c->request.type          = DQLITE_REQUEST_CONNECT;
+	c->request.connect.id    = 123;
+	c->request.connect.name  = name;
+	c->request.connect.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	c->request.connect.vfs   = "test";
+
+	err = dqlite__request_encode(&c->request);
+	if (err != 0) {
+		munit_errorf("failed to encode request: %s",
+		             dqlite__error_msg(&c->request.error));
+	}
+
+	protocol = dqlite__flip64(DQLITE_PROTOCOL_VERSION);
+
+	dqlite__message_send_start(&c->request.message, c->bufs);
+
+	iov[0].iov_base = &protocol;
+	iov[0].iov_len  = sizeof protocol;
+	iov[1].iov_base = c->bufs[0].base;
+	iov[1].iov_len  = c->bufs[0].len;
+	iov[2].iov_base = c->bufs[1].base;
+	iov[2].iov_len  = c->bufs[1].len;
+
+	err = writev(c->fd, iov, 3);
+	if (err < 0) {
+		munit_errorf("failed to write connect request: %s",
+		             strerror(errno));
+	}
+
+	dqlite__message_send_reset(&c->request.message);
+
+	test_client__read(c);
+
+	munit_assert_int(c->response.type, ==, DQLITE_RESPONSE_WELCOME_DB);
+
+	*heartbeat = c->response.welcome_db.heartbeat_timeout;
+	*db_id     = c->response.welcome_db.id;
+}
+
+int test_client_open_try(struct test_client *c,
+                         const char *        name,
+                         uint32_t *          db_id)
+{
+	uint64_t code;
+
+	c->request.type       = DQLITE_REQUEST_OPEN;
+	c->request.open.name  = name;
+	c->request.open.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	c->request.open.vfs   = "test";
+
+	test_client__write(c);
+	code = test_client__recv(c, 1);
+	if (code != 0) {
+		return (int)code;
+	}
+
+	*db_id = c->response.db.id;
+
+	return 0;
+}
+
+int test_client_exec_sql_try(struct test_client *c,
+                             uint32_t            db_id,
+                             const char *        sql)
+{
+	c->request.type           = DQLITE_REQUEST_EXEC_SQL;
+	c->request.exec_sql.db_id = db_id;
+	c->request.exec_sql.sql   = sql;
+
+	test_client__write(c);
+
+	return (int)test_client__recv(c, 1);
+}
+
 void test_client_prepare(struct test_client *c,
                          uint32_t            db_id,
                          const char *        sql,
@@ -19,7 +19,7 @@ struct test_client {
 	int                     fd;
 	struct dqlite__request  request;
 	struct dqlite__response response;
-	uv_buf_t                bufs[3];
+	uv_buf_t                bufs[DQLITE__MESSAGE_MAX_BUFS];
 };
 
 struct test_client_result {
@@ -61,6 +61,26 @@ void test_client_client(struct test_client *c, uint64_t *heartbeat);
 /* Open a database */
 void test_client_open(struct test_client *c, const char *name, uint32_t *db_id);
 
+/* Write the protocol version along with a connect request in a single burst,
+ * in place of test_client_handshake, test_client_client and
+ * test_client_open. */
+void test_client_connect(struct test_client *c,
+                         const char *        name,
+                         uint64_t *          heartbeat,
+                         uint32_t *          db_id);
+
+/* Open a database, returning the failure code instead of aborting if the
+ * request fails. */
+int test_client_open_try(struct test_client *c,
+                         const char *        name,
+                         uint32_t *          db_id);
+
+/* Execute the given SQL text, returning the failure code instead of aborting
+ * if the request fails. */
+int test_client_exec_sql_try(struct test_client *c,
+                             uint32_t            db_id,
+                             const char *        sql);
+
 /* Prepare a statement */
 void test_client_prepare(struct test_client *c,
                          uint32_t            db_id,
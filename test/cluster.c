@@ -133,10 +133,32 @@ static void test__cluster_unregister(void *arg, sqlite3 *db)
 	ctx->db_list = new_db_list;
 }
 
+static int test__cluster_barrier_rc = 0;
+
 static int test__cluster_barrier(void *ctx)
 {
 	(void)ctx;
 
+	return test__cluster_barrier_rc;
+}
+
+/* Barrier started by xBarrierAsync and not yet completed. */
+static struct test__cluster_barrier {
+	void *            arg;
+	dqlite_cluster_cb cb;
+} test__cluster_barrier_pending;
+
+static int test__cluster_barrier_async(void *            ctx,
+                                       void *            arg,
+                                       dqlite_cluster_cb cb)
+{
+	(void)ctx;
+
+	munit_assert_ptr_null(test__cluster_barrier_pending.cb);
+
+	test__cluster_barrier_pending.arg = arg;
+	test__cluster_barrier_pending.cb  = cb;
+
 	return 0;
 }
 
@@ -158,6 +180,28 @@ static int test__cluster_checkpoint(void *ctx, sqlite3 *db)
 	return 0;
 }
 
+/* Checkpoint started by xCheckpointAsync and not yet completed. */
+static struct test__cluster_checkpoint {
+	void *            arg;
+	dqlite_cluster_cb cb;
+} test__cluster_checkpoint_pending;
+
+static int test__cluster_checkpoint_async(void *            ctx,
+                                          sqlite3 *         db,
+                                          void *            arg,
+                                          dqlite_cluster_cb cb)
+{
+	(void)ctx;
+	(void)db;
+
+	munit_assert_ptr_null(test__cluster_checkpoint_pending.cb);
+
+	test__cluster_checkpoint_pending.arg = arg;
+	test__cluster_checkpoint_pending.cb  = cb;
+
+	return 0;
+}
+
 static dqlite_cluster test__cluster = {
     &test__cluster_ctx,
     test__cluster_leader,
@@ -175,7 +219,56 @@ dqlite_cluster *test_cluster()
 
 	*test__cluster_ctx.db_list = NULL;
 
+	test__cluster_barrier_rc          = 0;
+	test__cluster_barrier_pending.arg = NULL;
+	test__cluster_barrier_pending.cb  = NULL;
+
+	test__cluster_checkpoint_pending.arg = NULL;
+	test__cluster_checkpoint_pending.cb  = NULL;
+
 	return &test__cluster;
 }
 
+void test_cluster_barrier_async(dqlite_cluster_async *async)
+{
+	async->xBarrierAsync = test__cluster_barrier_async;
+}
+
+void test_cluster_barrier_complete(int status)
+{
+	struct test__cluster_barrier barrier = test__cluster_barrier_pending;
+
+	munit_assert_ptr_not_null(barrier.cb);
+
+	test__cluster_barrier_pending.arg = NULL;
+	test__cluster_barrier_pending.cb  = NULL;
+
+	barrier.cb(barrier.arg, status);
+}
+
+void test_cluster_checkpoint_async(dqlite_cluster_async *async)
+{
+	async->xCheckpointAsync = test__cluster_checkpoint_async;
+}
+
+int test_cluster_checkpoint_pending()
+{
+	return test__cluster_checkpoint_pending.cb != NULL;
+}
+
+void test_cluster_checkpoint_complete(int status)
+{
+	struct test__cluster_checkpoint checkpoint =
+	    test__cluster_checkpoint_pending;
+
+	munit_assert_ptr_not_null(checkpoint.cb);
+
+	test__cluster_checkpoint_pending.arg = NULL;
+	test__cluster_checkpoint_pending.cb  = NULL;
+
+	checkpoint.cb(checkpoint.arg, status);
+}
+
 void test_cluster_servers_rc(int rc) { test__cluster_servers_rc = rc; }
+
+void test_cluster_barrier_rc(int rc) { test__cluster_barrier_rc = rc; }
@@ -8,4 +8,24 @@ dqlite_cluster *test_cluster();
 /* Set the return code of the xServers method. */
 void test_cluster_servers_rc(int rc);
 
+/* Set the return code of the xBarrier method. */
+void test_cluster_barrier_rc(int rc);
+
+/* Make barriers run through the given asynchronous methods asynchronous,
+ * completing only when test_cluster_barrier_complete() is called. */
+void test_cluster_barrier_async(dqlite_cluster_async *async);
+
+/* Complete the pending asynchronous barrier with the given status. */
+void test_cluster_barrier_complete(int status);
+
+/* Make checkpoints run through the given asynchronous methods asynchronous,
+ * completing only when test_cluster_checkpoint_complete() is called. */
+void test_cluster_checkpoint_async(dqlite_cluster_async *async);
+
+/* Return true if an asynchronous checkpoint was started and not completed. */
+int test_cluster_checkpoint_pending();
+
+/* Complete the pending asynchronous checkpoint with the given status. */
+void test_cluster_checkpoint_complete(int status);
+
 #endif /* DQLITE_TEST_CLUSTER_H */
@@ -9,7 +9,7 @@
 void test_message_send(struct dqlite__message *outgoing,
                        struct dqlite__message *incoming) {
 	int      err;
-	uv_buf_t bufs[3];
+	uv_buf_t bufs[DQLITE__MESSAGE_MAX_BUFS];
 	uv_buf_t buf;
 
 	/* Get the send buffers of the outgoing message */
@@ -53,6 +53,10 @@ TEST_MESSAGE_SEND_IMPLEMENT(open,
                             DQLITE_REQUEST_OPEN,
                             dqlite__request,
                             DQLITE__REQUEST_SCHEMA_OPEN);
+TEST_MESSAGE_SEND_IMPLEMENT(connect,
+                            DQLITE_REQUEST_CONNECT,
+                            dqlite__request,
+                            DQLITE__REQUEST_SCHEMA_CONNECT);
 
 TEST_MESSAGE_SEND_IMPLEMENT(server,
                             DQLITE_RESPONSE_SERVER,
@@ -43,6 +43,7 @@ TEST_MESSAGE_SEND_DEFINE(leader, DQLITE__REQUEST_SCHEMA_LEADER);
 TEST_MESSAGE_SEND_DEFINE(client, DQLITE__REQUEST_SCHEMA_CLIENT);
 TEST_MESSAGE_SEND_DEFINE(heartbeat, DQLITE__REQUEST_SCHEMA_HEARTBEAT);
 TEST_MESSAGE_SEND_DEFINE(open, DQLITE__REQUEST_SCHEMA_OPEN);
+TEST_MESSAGE_SEND_DEFINE(connect, DQLITE__REQUEST_SCHEMA_CONNECT);
 
 TEST_MESSAGE_SEND_DEFINE(server, DQLITE__RESPONSE_SCHEMA_SERVER);
 TEST_MESSAGE_SEND_DEFINE(welcome, DQLITE__RESPONSE_SCHEMA_WELCOME);
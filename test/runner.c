@@ -6,13 +6,20 @@
 
 #include "munit.h"
 
+extern MunitSuite dqlite__advisor_suites[];
+extern MunitSuite dqlite__capture_suites[];
 extern MunitSuite dqlite__conn_suites[];
+#ifdef DQLITE_EXPERIMENTAL
+extern MunitSuite dqlite__coroutine_suites[];
+#endif /* DQLITE_EXPERIMENTAL */
 extern MunitSuite dqlite__db_suites[];
 extern MunitSuite dqlite__error_suites[];
 extern MunitSuite dqlite__file_suites[];
 extern MunitSuite dqlite__format_suites[];
 extern MunitSuite dqlite__gateway_suites[];
 extern MunitSuite dqlite__integration_suites[];
+extern MunitSuite dqlite__log_suites[];
+extern MunitSuite dqlite__memory_suites[];
 extern MunitSuite dqlite__message_suites[];
 extern MunitSuite dqlite__queue_suites[];
 #ifdef DQLITE_EXPERIMENTAL
@@ -28,13 +35,20 @@ extern MunitSuite dqlite__uv_suites[];
 extern MunitSuite dqlite__vfs_suites[];
 
 static MunitSuite dqlite__test_suites[] = {
+    {"dqlite__advisor", NULL, dqlite__advisor_suites, 1, 0},
+    {"dqlite__capture", NULL, dqlite__capture_suites, 1, 0},
     {"dqlite__conn", NULL, dqlite__conn_suites, 1, 0},
+#ifdef DQLITE_EXPERIMENTAL
+    {"dqlite__coroutine", NULL, dqlite__coroutine_suites, 1, 0},
+#endif /* DQLITE_EXPERIMENTAL */
     {"dqlite__db", NULL, dqlite__db_suites, 1, 0},
     {"dqlite__error", NULL, dqlite__error_suites, 1, 0},
     {"dqlite__file", NULL, dqlite__file_suites, 1, 0},
     {"dqlite__format", NULL, dqlite__format_suites, 1, 0},
     {"dqlite__gateway", NULL, dqlite__gateway_suites, 1, 0},
     {"dqlite__integration", NULL, dqlite__integration_suites, 1, 0},
+    {"dqlite__log", NULL, dqlite__log_suites, 1, 0},
+    {"dqlite__memory", NULL, dqlite__memory_suites, 1, 0},
     {"dqlite__message", NULL, dqlite__message_suites, 1, 0},
     {"dqlite__queue", NULL, dqlite__queue_suites, 1, 0},
     {"dqlite__registry", NULL, dqlite__registry_suites, 1, 0},
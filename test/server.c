@@ -18,7 +18,7 @@
 #include "replication.h"
 #include "server.h"
 
-static struct test_server *test_server__create()
+static struct test_server *test_server__create(uint8_t io_backend)
 {
 	int                 err = 0;
 	struct test_server *s;
@@ -78,6 +78,12 @@ static struct test_server *test_server__create()
 		munit_errorf("failed to enable metrics: %d", err);
 	}
 
+	err = dqlite_server_config(
+	    s->service, DQLITE_CONFIG_IO_BACKEND, (void *)(&io_backend));
+	if (err != 0) {
+		munit_errorf("failed to set I/O backend: %d", err);
+	}
+
 	s->socket = 0;
 
 	return s;
@@ -259,10 +265,15 @@ static void *test__server_run(void *arg)
 }
 
 struct test_server *test_server_start(const char *family)
+{
+	return test_server_start_io(family, DQLITE_IO_LIBUV);
+}
+
+struct test_server *test_server_start_io(const char *family, uint8_t io_backend)
 {
 	int                 err;
 	int                 ready;
-	struct test_server *s = test_server__create();
+	struct test_server *s = test_server__create(io_backend);
 
 	assert(s);
 	assert(s->service);
@@ -20,6 +20,9 @@ struct test_server {
 
 struct test_server *test_server_start(const char *family);
 
+/* Start a test server using the given DQLITE_IO_* backend. */
+struct test_server *test_server_start_io(const char *family, uint8_t io_backend);
+
 void test_server_stop(struct test_server *);
 
 void test_server_connect(struct test_server *t, struct test_client **client);
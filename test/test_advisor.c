@@ -0,0 +1,451 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "../include/dqlite.h"
+#include "../src/advisor.h"
+
+#include "leak.h"
+#include "munit.h"
+
+/******************************************************************************
+ *
+ * Helpers
+ *
+ ******************************************************************************/
+
+struct fixture {
+	struct dqlite__advisor advisor;
+	sqlite3 *              db;
+};
+
+/* Execute the given SQL text, asserting that it succeeds. */
+static void __db_exec(sqlite3 *db, const char *sql)
+{
+	int rc;
+
+	rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+}
+
+/* Run a query until completion and sample its statistics. */
+static void __query(struct fixture *f, const char *sql, uint32_t threshold)
+{
+	sqlite3_stmt *stmt;
+	int           rc;
+
+	rc = sqlite3_prepare_v2(f->db, sql, -1, &stmt, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	do {
+		rc = sqlite3_step(stmt);
+	} while (rc == SQLITE_ROW);
+	munit_assert_int(rc, ==, SQLITE_DONE);
+
+	dqlite__advisor_sample(&f->advisor, "test.db", stmt, threshold);
+
+	sqlite3_finalize(stmt);
+}
+
+/******************************************************************************
+ *
+ * Setup and tear down
+ *
+ ******************************************************************************/
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+	struct fixture *f;
+	int             rc;
+
+	(void)params;
+	(void)user_data;
+
+	f = munit_malloc(sizeof *f);
+
+	dqlite__advisor_init(&f->advisor);
+
+	rc = sqlite3_open(":memory:", &f->db);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	__db_exec(f->db,
+	          "CREATE TABLE t1 (a INT); "
+	          "CREATE TABLE t2 (b INT); "
+	          "INSERT INTO t1 VALUES(1), (2), (3); "
+	          "INSERT INTO t2 VALUES(1), (2), (3)");
+
+	return f;
+}
+
+static void tear_down(void *data)
+{
+	struct fixture *f = data;
+
+	sqlite3_close(f->db);
+
+	dqlite__advisor_close(&f->advisor);
+
+	free(f);
+
+	test_assert_no_leaks();
+}
+
+/******************************************************************************
+ *
+ * dqlite__advisor_sample
+ *
+ ******************************************************************************/
+
+/* Statements below the threshold are not tracked. */
+static MunitResult test_sample_below_threshold(const MunitParameter params[],
+                                               void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1", 1000);
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 0);
+	munit_assert_ptr_null(advice);
+
+	return MUNIT_OK;
+}
+
+/* Repeated executions of the same statement are accumulated. */
+static MunitResult test_sample_accumulate(const MunitParameter params[],
+                                          void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1", 1);
+	__query(f, "SELECT * FROM t1", 1);
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1);
+
+	munit_assert_string_equal(advice[0].db, "test.db");
+	munit_assert_string_equal(advice[0].sql, "SELECT * FROM t1");
+	munit_assert_ptr_null(advice[0].plan);
+	munit_assert_ptr_null(advice[0].index);
+	munit_assert_int(advice[0].count, ==, 2);
+	munit_assert_int(advice[0].fullscan_steps, >, 0);
+
+	sqlite3_free(advice);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__advisor_sample_tests[] = {
+    {"/below-threshold", test_sample_below_threshold, setup, tear_down, 0, NULL},
+    {"/accumulate", test_sample_accumulate, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__advisor_analyze
+ *
+ ******************************************************************************/
+
+/* A full scan filtered by a WHERE term gets an index on the compared
+ * column. */
+static MunitResult test_analyze_full_scan(const MunitParameter params[],
+                                          void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1 WHERE a > 1", 1);
+
+	rc = dqlite__advisor_analyze(&f->advisor, f->db, "test.db");
+	munit_assert_int(rc, ==, 1);
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1);
+
+	munit_assert_ptr_not_null(advice[0].plan);
+	munit_assert_string_equal(advice[0].index,
+	                          "CREATE INDEX t1_a_idx ON t1(a)");
+
+	sqlite3_free(advice);
+
+	return MUNIT_OK;
+}
+
+/* An unfiltered full scan is reported without a suggested index. */
+static MunitResult test_analyze_no_terms(const MunitParameter params[],
+                                         void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1 ORDER BY a", 1);
+
+	rc = dqlite__advisor_analyze(&f->advisor, f->db, "test.db");
+	munit_assert_int(rc, ==, 1);
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1);
+
+	munit_assert_ptr_not_null(advice[0].plan);
+	munit_assert_ptr_null(advice[0].index);
+
+	sqlite3_free(advice);
+
+	return MUNIT_OK;
+}
+
+/* A join building an automatic index gets a matching index suggestion. */
+static MunitResult test_analyze_autoindex(const MunitParameter params[],
+                                          void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1, t2 WHERE t1.a = t2.b", 1);
+
+	dqlite__advisor_analyze(&f->advisor, f->db, "test.db");
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1);
+
+	munit_assert_ptr_not_null(advice[0].index);
+	munit_assert_int(strncmp(advice[0].index, "CREATE INDEX ", 13), ==, 0);
+
+	sqlite3_free(advice);
+
+	return MUNIT_OK;
+}
+
+/* Statements against other databases are not analyzed. */
+static MunitResult test_analyze_other_db(const MunitParameter params[],
+                                         void *               data)
+{
+	struct fixture *     f = data;
+	dqlite_index_advice *advice;
+	unsigned             n;
+	int                  rc;
+
+	(void)params;
+
+	__query(f, "SELECT * FROM t1", 1);
+
+	rc = dqlite__advisor_analyze(&f->advisor, f->db, "other.db");
+	munit_assert_int(rc, ==, 0);
+
+	rc = dqlite__advisor_report(&f->advisor, &advice, &n);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1);
+
+	munit_assert_ptr_null(advice[0].plan);
+
+	sqlite3_free(advice);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__advisor_analyze_tests[] = {
+    {"/full-scan", test_analyze_full_scan, setup, tear_down, 0, NULL},
+    {"/no-terms", test_analyze_no_terms, setup, tear_down, 0, NULL},
+    {"/autoindex", test_analyze_autoindex, setup, tear_down, 0, NULL},
+    {"/other-db", test_analyze_other_db, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__advisor_parse
+ *
+ ******************************************************************************/
+
+/* Steps not using an automatic index yield no suggestion. */
+static MunitResult test_parse_no_autoindex(const MunitParameter params[],
+                                           void *               data)
+{
+	(void)params;
+	(void)data;
+
+	munit_assert_ptr_null(dqlite__advisor_parse("SCAN TABLE t"));
+	munit_assert_ptr_null(
+	    dqlite__advisor_parse("SEARCH TABLE t USING INDEX i (a=?)"));
+
+	return MUNIT_OK;
+}
+
+/* Both the legacy and the current query plan formats are understood. */
+static MunitResult test_parse(const MunitParameter params[], void *data)
+{
+	char *index;
+
+	(void)params;
+	(void)data;
+
+	index = dqlite__advisor_parse(
+	    "SEARCH TABLE t USING AUTOMATIC COVERING INDEX (a=?)");
+	munit_assert_string_equal(index, "CREATE INDEX t_a_idx ON t(a)");
+	sqlite3_free(index);
+
+	index = dqlite__advisor_parse(
+	    "SEARCH t AS x USING AUTOMATIC PARTIAL COVERING INDEX "
+	    "(a=? AND b>?)");
+	munit_assert_string_equal(index, "CREATE INDEX t_a_b_idx ON t(a, b)");
+	sqlite3_free(index);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__advisor_parse_tests[] = {
+    {"/no-autoindex", test_parse_no_autoindex, NULL, NULL, 0, NULL},
+    {"", test_parse, NULL, NULL, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__advisor_suggest
+ *
+ ******************************************************************************/
+
+/* Assert that the index suggested for the given full scan step matches the
+ * given one. */
+static void __assert_suggest(sqlite3 *   db,
+                             const char *sql,
+                             const char *detail,
+                             const char *expected)
+{
+	char *index;
+
+	index = dqlite__advisor_suggest(db, sql, detail);
+	munit_assert_string_equal(index, expected);
+	sqlite3_free(index);
+}
+
+/* Columns compared for equality come first, followed by the first column
+ * compared by range. */
+static MunitResult test_suggest_order(const MunitParameter params[],
+                                      void *               data)
+{
+	struct fixture *f = data;
+
+	(void)params;
+
+	__db_exec(f->db, "CREATE TABLE t3 (x INT, y INT, z INT)");
+
+	__assert_suggest(f->db,
+	                 "SELECT * FROM t3 WHERE z > 1 AND x = 2 AND y IN (3)",
+	                 "SCAN t3",
+	                 "CREATE INDEX t3_x_y_z_idx ON t3(x, y, z)");
+
+	__assert_suggest(f->db,
+	                 "SELECT * FROM t3 "
+	                 "WHERE 1 = \"x\" AND y BETWEEN 1 AND 2",
+	                 "SCAN TABLE t3",
+	                 "CREATE INDEX t3_x_y_idx ON t3(x, y)");
+
+	return MUNIT_OK;
+}
+
+/* Qualified columns must refer to the scanned table, possibly by its alias,
+ * and columns of other tables are ignored. */
+static MunitResult test_suggest_qualified(const MunitParameter params[],
+                                          void *               data)
+{
+	struct fixture *f = data;
+
+	(void)params;
+
+	__db_exec(f->db, "CREATE TABLE t3 (x INT, y INT, z INT)");
+
+	__assert_suggest(f->db,
+	                 "SELECT * FROM t3 AS u, t1 WHERE u.y = t1.a AND b = 1",
+	                 "SCAN t3 AS u",
+	                 "CREATE INDEX t3_y_idx ON t3(y)");
+
+	__assert_suggest(f->db,
+	                 "SELECT * FROM t3 JOIN t1 ON t1.a = t3.z",
+	                 "SCAN t3",
+	                 "CREATE INDEX t3_z_idx ON t3(z)");
+
+	return MUNIT_OK;
+}
+
+/* Assignments, string literals, function calls and comparisons outside of
+ * WHERE and ON clauses don't yield suggestions. */
+static MunitResult test_suggest_none(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	char *          index;
+
+	(void)params;
+
+	__db_exec(f->db, "CREATE TABLE t3 (x INT, y INT, z INT)");
+
+	index = dqlite__advisor_suggest(
+	    f->db, "UPDATE t3 SET x = 1 WHERE abs(y) = 2", "SCAN t3");
+	munit_assert_ptr_null(index);
+
+	index = dqlite__advisor_suggest(
+	    f->db, "SELECT * FROM t3 WHERE 'x = 1' = z || 'y'", "SCAN t3");
+	munit_assert_ptr_null(index);
+
+	index = dqlite__advisor_suggest(
+	    f->db, "SELECT x = 1, y > 2 FROM t3 ORDER BY z", "SCAN t3");
+	munit_assert_ptr_null(index);
+
+	index = dqlite__advisor_suggest(
+	    f->db, "SELECT * FROM t3 WHERE x IS NOT NULL", "SCAN t3");
+	munit_assert_ptr_null(index);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__advisor_suggest_tests[] = {
+    {"/order", test_suggest_order, setup, tear_down, 0, NULL},
+    {"/qualified", test_suggest_qualified, setup, tear_down, 0, NULL},
+    {"/none", test_suggest_none, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Suite
+ *
+ ******************************************************************************/
+
+MunitSuite dqlite__advisor_suites[] = {
+    {"_sample", dqlite__advisor_sample_tests, NULL, 1, 0},
+    {"_analyze", dqlite__advisor_analyze_tests, NULL, 1, 0},
+    {"_parse", dqlite__advisor_parse_tests, NULL, 1, 0},
+    {"_suggest", dqlite__advisor_suggest_tests, NULL, 1, 0},
+    {NULL, NULL, NULL, 0, 0},
+};
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+#include <uv.h>
+
+#include "../include/dqlite.h"
+#include "../src/binary.h"
+#include "../src/capture.h"
+#include "../src/message.h"
+
+#include "fs.h"
+#include "leak.h"
+#include "munit.h"
+
+/******************************************************************************
+ *
+ * Helpers
+ *
+ ******************************************************************************/
+
+struct fixture {
+	const char *           dir;
+	char                   path[64];
+	struct dqlite__capture capture;
+	struct dqlite__message message;
+};
+
+/* Simulate the receipt of a request with a single word body. */
+static void __message_recv(struct dqlite__message *m,
+                           uint8_t                 type,
+                           uint64_t                value)
+{
+	uv_buf_t buf;
+	uint8_t  header[DQLITE__MESSAGE_HEADER_LEN] = {1, 0, 0, 0, 0, 0, 0, 0};
+	int      err;
+
+	header[4] = type;
+
+	dqlite__message_header_recv_start(m, &buf);
+	memcpy(buf.base, header, sizeof header);
+
+	err = dqlite__message_header_recv_done(m);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__message_body_recv_start(m, &buf);
+	munit_assert_int(err, ==, 0);
+	munit_assert_int(buf.len, ==, 8);
+
+	value = dqlite__flip64(value);
+	memcpy(buf.base, &value, sizeof value);
+}
+
+/* Read the whole content of the capture file. */
+static uint8_t *__read(struct fixture *f, size_t *len)
+{
+	FILE *   file;
+	uint8_t *buf;
+	long     size;
+
+	file = fopen(f->path, "rb");
+	munit_assert_ptr_not_null(file);
+
+	munit_assert_int(fseek(file, 0, SEEK_END), ==, 0);
+	size = ftell(file);
+	munit_assert_int(size, >=, 0);
+	munit_assert_int(fseek(file, 0, SEEK_SET), ==, 0);
+
+	buf = munit_malloc(size + 1);
+	munit_assert_int(fread(buf, 1, size, file), ==, size);
+
+	fclose(file);
+
+	*len = (size_t)size;
+
+	return buf;
+}
+
+/******************************************************************************
+ *
+ * Setup and tear down
+ *
+ ******************************************************************************/
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+	struct fixture *f;
+	int             err;
+
+	(void)params;
+	(void)user_data;
+
+	f = munit_malloc(sizeof *f);
+
+	f->dir = test_dir_setup();
+	sprintf(f->path, "%s/capture", f->dir);
+
+	err = dqlite__capture_init(&f->capture, f->path);
+	munit_assert_int(err, ==, 0);
+
+	dqlite__message_init(&f->message);
+
+	return f;
+}
+
+static void tear_down(void *data)
+{
+	struct fixture *f = data;
+
+	dqlite__message_close(&f->message);
+
+	test_dir_tear_down(f->dir);
+	free((char *)f->dir);
+	free(f);
+
+	test_assert_no_leaks();
+}
+
+/******************************************************************************
+ *
+ * dqlite__capture_init
+ *
+ ******************************************************************************/
+
+/* The file can't be created. */
+static MunitResult test_init_error(const MunitParameter params[], void *data)
+{
+	struct fixture *       f = data;
+	struct dqlite__capture capture;
+	int                    err;
+
+	(void)params;
+
+	dqlite__capture_close(&f->capture);
+
+	err = dqlite__capture_init(&capture, "/non/existing/dir/capture");
+	munit_assert_int(err, ==, DQLITE_ERROR);
+	munit_assert_string_equal(
+	    dqlite__error_msg(&capture.error),
+	    "failed to open capture file: No such file or directory");
+
+	dqlite__capture_close(&capture);
+
+	return MUNIT_OK;
+}
+
+/* A new capture file contains just the magic string. */
+static MunitResult test_init_magic(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	uint8_t *       buf;
+	size_t          len;
+
+	(void)params;
+
+	dqlite__capture_close(&f->capture);
+
+	buf = __read(f, &len);
+	munit_assert_int(len, ==, DQLITE__CAPTURE_MAGIC_LEN);
+	munit_assert_memory_equal(len, buf, DQLITE__CAPTURE_MAGIC);
+
+	free(buf);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__capture_init_tests[] = {
+    {"/error", test_init_error, setup, tear_down, 0, NULL},
+    {"/magic", test_init_magic, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__capture_record
+ *
+ ******************************************************************************/
+
+/* Each request is stored with its connection ID, preceded by the magic. */
+static MunitResult test_record(const MunitParameter params[], void *data)
+{
+	struct fixture *              f = data;
+	struct dqlite__capture_record record;
+	uint32_t                      conn1;
+	uint32_t                      conn2;
+	uint8_t *                     buf;
+	uint8_t *                     cursor;
+	size_t                        len;
+	int                           err;
+
+	(void)params;
+
+	conn1 = dqlite__capture_conn(&f->capture);
+	conn2 = dqlite__capture_conn(&f->capture);
+	munit_assert_int(conn1, ==, 0);
+	munit_assert_int(conn2, ==, 1);
+
+	__message_recv(&f->message, DQLITE_REQUEST_LEADER, 123);
+	err = dqlite__capture_record(&f->capture, conn2, &f->message);
+	munit_assert_int(err, ==, 0);
+	dqlite__message_recv_reset(&f->message);
+
+	__message_recv(&f->message, DQLITE_REQUEST_HEARTBEAT, 456);
+	err = dqlite__capture_record(&f->capture, conn1, &f->message);
+	munit_assert_int(err, ==, 0);
+	dqlite__message_recv_reset(&f->message);
+
+	dqlite__capture_close(&f->capture);
+
+	buf = __read(f, &len);
+	munit_assert_int(
+	    len, ==, DQLITE__CAPTURE_MAGIC_LEN + 2 * (sizeof record + 16));
+	munit_assert_memory_equal(
+	    DQLITE__CAPTURE_MAGIC_LEN, buf, DQLITE__CAPTURE_MAGIC);
+
+	cursor = buf + DQLITE__CAPTURE_MAGIC_LEN;
+
+	memcpy(&record, cursor, sizeof record);
+	munit_assert_int(dqlite__flip32(record.conn), ==, 1);
+	munit_assert_int(dqlite__flip32(record.len), ==, 16);
+	cursor += sizeof record;
+
+	munit_assert_int(dqlite__flip32(*(uint32_t *)cursor), ==, 1);
+	munit_assert_int(cursor[4], ==, DQLITE_REQUEST_LEADER);
+	munit_assert_int(dqlite__flip64(*(uint64_t *)(cursor + 8)), ==, 123);
+	cursor += 16;
+
+	memcpy(&record, cursor, sizeof record);
+	munit_assert_int(dqlite__flip32(record.conn), ==, 0);
+	munit_assert_int(dqlite__flip32(record.len), ==, 16);
+	cursor += sizeof record;
+
+	munit_assert_int(cursor[4], ==, DQLITE_REQUEST_HEARTBEAT);
+	munit_assert_int(dqlite__flip64(*(uint64_t *)(cursor + 8)), ==, 456);
+
+	free(buf);
+
+	return MUNIT_OK;
+}
+
+/* The protocol version of a connection is stored in a record with no
+ * message. */
+static MunitResult test_record_handshake(const MunitParameter params[],
+                                         void *               data)
+{
+	struct fixture *              f = data;
+	struct dqlite__capture_record record;
+	uint64_t                      protocol;
+	uint8_t *                     buf;
+	uint8_t *                     cursor;
+	size_t                        len;
+	int                           err;
+
+	(void)params;
+
+	err = dqlite__capture_handshake(
+	    &f->capture, 3, DQLITE_PROTOCOL_VERSION_COMPACT_ROWS);
+	munit_assert_int(err, ==, 0);
+
+	dqlite__capture_close(&f->capture);
+
+	buf = __read(f, &len);
+	munit_assert_int(len,
+	                 ==,
+	                 DQLITE__CAPTURE_MAGIC_LEN + sizeof record +
+	                     sizeof protocol);
+
+	cursor = buf + DQLITE__CAPTURE_MAGIC_LEN;
+
+	memcpy(&record, cursor, sizeof record);
+	munit_assert_int(dqlite__flip32(record.conn), ==, 3);
+	munit_assert_int(dqlite__flip32(record.len), ==, 0);
+	cursor += sizeof record;
+
+	memcpy(&protocol, cursor, sizeof protocol);
+	munit_assert_int(dqlite__flip64(protocol),
+	                 ==,
+	                 DQLITE_PROTOCOL_VERSION_COMPACT_ROWS);
+
+	free(buf);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__capture_record_tests[] = {
+    {"", test_record, setup, tear_down, 0, NULL},
+    {"/handshake", test_record_handshake, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Suite
+ *
+ ******************************************************************************/
+
+MunitSuite dqlite__capture_suites[] = {
+    {"_init", dqlite__capture_init_tests, NULL, 1, 0},
+    {"_record", dqlite__capture_record_tests, NULL, 1, 0},
+    {NULL, NULL, NULL, 0, 0},
+};
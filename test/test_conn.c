@@ -132,7 +132,13 @@ static void *setup(const MunitParameter params[], void *user_data)
 	                  test_cluster(),
 	                  &f->loop,
 	                  &f->options,
-	                  &f->metrics);
+	                  &f->metrics,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL);
 
 	dqlite__response_init(&f->response);
 
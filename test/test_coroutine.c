@@ -0,0 +1,224 @@
+#ifdef DQLITE_EXPERIMENTAL
+
+#include <libco.h>
+
+#include "../src/coroutine.h"
+
+#include "case.h"
+
+/******************************************************************************
+ *
+ * Helpers
+ *
+ ******************************************************************************/
+
+struct fixture {
+	struct dqlite__coroutine_pool pool;
+};
+
+/* State of a function run by a coroutine. */
+struct run {
+	struct dqlite__coroutine *coroutine; /* Coroutine running us */
+	int                       yield;     /* Whether to yield once */
+	int                       steps;     /* Steps performed so far */
+};
+
+static void __run(void *arg)
+{
+	struct run *r = arg;
+
+	r->steps++;
+
+	if (r->yield) {
+		co_switch(r->coroutine->caller);
+		r->steps++;
+	}
+}
+
+/******************************************************************************
+ *
+ * Setup and tear down
+ *
+ ******************************************************************************/
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+	struct fixture *f;
+
+	(void)params;
+	(void)user_data;
+
+	test_case_setup(params, user_data);
+
+	f = munit_malloc(sizeof *f);
+
+	dqlite__coroutine_pool_init(&f->pool, 64 * 1024, 2);
+
+	return f;
+}
+
+static void tear_down(void *data)
+{
+	struct fixture *f = data;
+
+	dqlite__coroutine_pool_close(&f->pool);
+
+	test_case_tear_down(data);
+}
+
+/******************************************************************************
+ *
+ * dqlite__coroutine_run
+ *
+ ******************************************************************************/
+
+/* A run returns as soon as its function does. */
+static MunitResult test_run(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	struct run      r = {NULL, 0, 0};
+
+	(void)params;
+
+	r.coroutine = dqlite__coroutine_get(&f->pool);
+	munit_assert_ptr_not_null(r.coroutine);
+
+	dqlite__coroutine_run(r.coroutine, __run, &r);
+
+	munit_assert_int(r.steps, ==, 1);
+	munit_assert_false(dqlite__coroutine_running(r.coroutine));
+
+	dqlite__coroutine_put(&f->pool, r.coroutine);
+
+	return MUNIT_OK;
+}
+
+/* A run which yields can be resumed later. */
+static MunitResult test_run_yield(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	struct run      r = {NULL, 1, 0};
+
+	(void)params;
+
+	r.coroutine = dqlite__coroutine_get(&f->pool);
+	munit_assert_ptr_not_null(r.coroutine);
+
+	dqlite__coroutine_run(r.coroutine, __run, &r);
+
+	munit_assert_int(r.steps, ==, 1);
+	munit_assert_true(dqlite__coroutine_running(r.coroutine));
+
+	co_switch(r.coroutine->thread);
+
+	munit_assert_int(r.steps, ==, 2);
+	munit_assert_false(dqlite__coroutine_running(r.coroutine));
+
+	dqlite__coroutine_put(&f->pool, r.coroutine);
+
+	return MUNIT_OK;
+}
+
+static MunitTest run_tests[] = {
+    {"", test_run, setup, tear_down, 0, NULL},
+    {"/yield", test_run_yield, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__coroutine_put
+ *
+ ******************************************************************************/
+
+/* A coroutine handed back to the pool gets reused by the next run. */
+static MunitResult test_put_reuse(const MunitParameter params[], void *data)
+{
+	struct fixture *          f = data;
+	struct dqlite__coroutine *c;
+	struct run                r = {NULL, 0, 0};
+
+	(void)params;
+
+	c = dqlite__coroutine_get(&f->pool);
+	munit_assert_ptr_not_null(c);
+
+	dqlite__coroutine_run(c, __run, &r);
+	dqlite__coroutine_put(&f->pool, c);
+
+	munit_assert_int(f->pool.len, ==, 1);
+
+	r.coroutine = dqlite__coroutine_get(&f->pool);
+	munit_assert_ptr_equal(r.coroutine, c);
+	munit_assert_int(f->pool.len, ==, 0);
+
+	dqlite__coroutine_run(r.coroutine, __run, &r);
+	munit_assert_int(r.steps, ==, 2);
+
+	dqlite__coroutine_put(&f->pool, r.coroutine);
+
+	return MUNIT_OK;
+}
+
+/* A coroutine suspended in the middle of a run is not pooled. */
+static MunitResult test_put_running(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	struct run      r = {NULL, 1, 0};
+
+	(void)params;
+
+	r.coroutine = dqlite__coroutine_get(&f->pool);
+	munit_assert_ptr_not_null(r.coroutine);
+
+	dqlite__coroutine_run(r.coroutine, __run, &r);
+	dqlite__coroutine_put(&f->pool, r.coroutine);
+
+	munit_assert_int(f->pool.len, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Coroutines exceeding the capacity of the pool get destroyed. */
+static MunitResult test_put_full(const MunitParameter params[], void *data)
+{
+	struct fixture *          f = data;
+	struct dqlite__coroutine *c[3];
+	int                       i;
+
+	(void)params;
+
+	for (i = 0; i < 3; i++) {
+		c[i] = dqlite__coroutine_get(&f->pool);
+		munit_assert_ptr_not_null(c[i]);
+	}
+
+	for (i = 0; i < 3; i++) {
+		dqlite__coroutine_put(&f->pool, c[i]);
+	}
+
+	munit_assert_int(f->pool.len, ==, 2);
+
+	return MUNIT_OK;
+}
+
+static MunitTest put_tests[] = {
+    {"/reuse", test_put_reuse, setup, tear_down, 0, NULL},
+    {"/running", test_put_running, setup, tear_down, 0, NULL},
+    {"/full", test_put_full, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Test suite
+ *
+ ******************************************************************************/
+
+MunitSuite dqlite__coroutine_suites[] = {
+    {"_run", run_tests, NULL, 1, 0},
+    {"_put", put_tests, NULL, 1, 0},
+    {NULL, NULL, NULL, 0, 0},
+};
+
+#endif /* DQLITE_EXPERIMENTAL */
@@ -1,8 +1,11 @@
+#include <string.h>
+
 #include <sqlite3.h>
 
 #include "../include/dqlite.h"
 #include "../src/db.h"
 
+#include "cluster.h"
 #include "replication.h"
 
 #include "leak.h"
@@ -21,7 +24,7 @@ static void __db_open(struct dqlite__db *db)
 	int rc;
 	int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
 
-	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test");
+	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test", 1);
 	munit_assert_int(rc, ==, SQLITE_OK);
 }
 
@@ -98,10 +101,11 @@ static MunitResult test_open_cantopen(const MunitParameter params[], void *data)
 
 	(void)params;
 
-	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test");
+	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test", 1);
 	munit_assert_int(rc, ==, SQLITE_CANTOPEN);
 
-	munit_assert_string_equal(db->error, "unable to open database file");
+	munit_assert_string_equal(dqlite__error_msg(&db->error),
+	                          "unable to open database file");
 
 	return MUNIT_OK;
 }
@@ -116,10 +120,11 @@ static MunitResult test_open_bad_vfs(const MunitParameter params[], void *data)
 
 	(void)params;
 
-	rc = dqlite__db_open(db, "test.db", flags, "foo", 4096, "test");
+	rc = dqlite__db_open(db, "test.db", flags, "foo", 4096, "test", 1);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(db->error, "no such vfs: foo");
+	munit_assert_string_equal(dqlite__error_msg(&db->error),
+	                          "no such vfs: foo");
 
 	return MUNIT_OK;
 }
@@ -133,7 +138,7 @@ static MunitResult test_open(const MunitParameter params[], void *data)
 
 	(void)params;
 
-	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test");
+	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test", 1);
 	munit_assert_int(rc, ==, SQLITE_OK);
 
 	return MUNIT_OK;
@@ -167,7 +172,8 @@ static MunitResult test_prepare_bad_sql(const MunitParameter params[],
 	rc = dqlite__db_prepare(db, "FOO bar", &stmt);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(db->error, "near \"FOO\": syntax error");
+	munit_assert_string_equal(dqlite__error_msg(&db->error),
+	                          "near \"FOO\": syntax error");
 
 	return MUNIT_OK;
 }
@@ -203,7 +209,8 @@ static MunitResult test_begin_error(const MunitParameter params[], void *data)
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
 	munit_assert_string_equal(
-	    db->error, "cannot start a transaction within a transaction");
+	    dqlite__error_msg(&db->error),
+	    "cannot start a transaction within a transaction");
 
 	return MUNIT_OK;
 }
@@ -320,6 +327,467 @@ static MunitTest dqlite__commit_tests[] = {
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
+/******************************************************************************
+ *
+ * dqlite__db_maintain
+ *
+ ******************************************************************************/
+
+/* A freshly opened database has no pending maintenance. */
+static MunitResult test_maintain_done(const MunitParameter params[],
+                                      void *               data)
+{
+	struct dqlite__db *db = data;
+
+	(void)params;
+
+	__db_open(db);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Free pages are released in slices, until none is left. */
+static MunitResult test_maintain_vacuum(const MunitParameter params[],
+                                        void *               data)
+{
+	struct dqlite__db *db = data;
+	sqlite3_stmt *     stmt;
+	int                steps = 0;
+	int                rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	rc = sqlite3_exec(db->db,
+	                  "CREATE TABLE test (t TEXT); "
+	                  "WITH RECURSIVE n(i) AS "
+	                  "  (SELECT 1 UNION ALL SELECT i+1 FROM n LIMIT 500) "
+	                  "INSERT INTO test SELECT randomblob(1000) FROM n; "
+	                  "DELETE FROM test",
+	                  NULL,
+	                  NULL,
+	                  NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+
+	while (dqlite__db_maintain(db)) {
+		steps++;
+	}
+
+	/* More than one vacuum slice was needed. */
+	munit_assert_int(steps, >, 4);
+
+	rc = sqlite3_prepare_v2(
+	    db->db, "PRAGMA freelist_count", -1, &stmt, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_step(stmt);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, 0);
+
+	sqlite3_finalize(stmt);
+
+	return MUNIT_OK;
+}
+
+/* Databases created without incremental auto vacuum keep their free pages. */
+static MunitResult test_maintain_no_auto_vacuum(const MunitParameter params[],
+                                                void *               data)
+{
+	struct dqlite__db *db    = data;
+	int                flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	int                steps = 0;
+	int                rc;
+
+	(void)params;
+
+	rc = dqlite__db_open(db, "test.db", flags, "test", 4096, "test", 0);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_exec(db->db,
+	                  "CREATE TABLE test (t TEXT); "
+	                  "WITH RECURSIVE n(i) AS "
+	                  "  (SELECT 1 UNION ALL SELECT i+1 FROM n LIMIT 500) "
+	                  "INSERT INTO test SELECT randomblob(1000) FROM n; "
+	                  "DELETE FROM test",
+	                  NULL,
+	                  NULL,
+	                  NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+
+	while (dqlite__db_maintain(db)) {
+		steps++;
+	}
+
+	/* The vacuum step is skipped right away, instead of running slices
+	 * which would never release anything. */
+	munit_assert_int(steps, ==, 3);
+
+	return MUNIT_OK;
+}
+
+/* A new round starts once statements are run again. */
+static MunitResult test_maintain_used(const MunitParameter params[],
+                                      void *               data)
+{
+	struct dqlite__db *  db = data;
+	struct dqlite__stmt *stmt;
+	int                  rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+
+	rc = dqlite__db_prepare(db, "SELECT 1", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 1);
+
+	while (dqlite__db_maintain(db)) {
+		munit_assert_int(db->maintenance, !=, DQLITE__DB_MAINTAIN_DONE);
+	}
+
+	return MUNIT_OK;
+}
+
+/* If leadership is lost while free pages are being released, the remaining
+ * vacuum slices and the checkpoint are skipped. */
+static MunitResult test_maintain_not_leader(const MunitParameter params[],
+                                            void *               data)
+{
+	struct dqlite__db *db = data;
+	sqlite3_stmt *     stmt;
+	int                rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	db->cluster = test_cluster();
+
+	rc = sqlite3_exec(db->db,
+	                  "CREATE TABLE test (t TEXT); "
+	                  "WITH RECURSIVE n(i) AS "
+	                  "  (SELECT 1 UNION ALL SELECT i+1 FROM n LIMIT 500) "
+	                  "INSERT INTO test SELECT randomblob(1000) FROM n; "
+	                  "DELETE FROM test",
+	                  NULL,
+	                  NULL,
+	                  NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	db->maintenance = DQLITE__DB_MAINTAIN_VACUUM;
+
+	test_cluster_barrier_rc(SQLITE_IOERR_NOT_LEADER);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 1);
+	munit_assert_int(db->maintenance, ==, DQLITE__DB_MAINTAIN_RELEASE);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+
+	rc = sqlite3_prepare_v2(
+	    db->db, "PRAGMA freelist_count", -1, &stmt, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_step(stmt);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_int(stmt, 0), >, 0);
+
+	sqlite3_finalize(stmt);
+
+	test_cluster_barrier_rc(0);
+
+	/* The database was never registered with the cluster. */
+	db->cluster = NULL;
+
+	return MUNIT_OK;
+}
+
+/* An asynchronous barrier doesn't block: the step is resumed once it
+ * completes, and skipped if it fails. */
+static MunitResult test_maintain_barrier_async(const MunitParameter params[],
+                                               void *               data)
+{
+	struct dqlite__db *  db = data;
+	dqlite_cluster_async async;
+
+	(void)params;
+
+	__db_open(db);
+
+	memset(&async, 0, sizeof async);
+	test_cluster_barrier_async(&async);
+
+	db->cluster = test_cluster();
+	db->async   = &async;
+
+	db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+	munit_assert_ptr_not_null(db->wait);
+	munit_assert_int(db->maintenance, ==, DQLITE__DB_MAINTAIN_OPTIMIZE);
+
+	/* Nothing happens until the barrier completes. */
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+
+	test_cluster_barrier_complete(0);
+	munit_assert_ptr_null(db->wait);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 1);
+	munit_assert_int(db->maintenance, ==, DQLITE__DB_MAINTAIN_VACUUM);
+
+	db->maintenance = DQLITE__DB_MAINTAIN_OPTIMIZE;
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 0);
+
+	test_cluster_barrier_complete(SQLITE_IOERR_NOT_LEADER);
+
+	munit_assert_int(dqlite__db_maintain(db), ==, 1);
+	munit_assert_int(db->maintenance, ==, DQLITE__DB_MAINTAIN_RELEASE);
+
+	/* The database was never registered with the cluster. */
+	db->cluster = NULL;
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__maintain_tests[] = {
+    {"/done", test_maintain_done, setup, tear_down, 0, NULL},
+    {"/vacuum", test_maintain_vacuum, setup, tear_down, 0, NULL},
+    {"/no-auto-vacuum",
+     test_maintain_no_auto_vacuum,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/used", test_maintain_used, setup, tear_down, 0, NULL},
+    {"/not-leader", test_maintain_not_leader, setup, tear_down, 0, NULL},
+    {"/barrier-async",
+     test_maintain_barrier_async,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__db_pool
+ *
+ ******************************************************************************/
+
+/* If the pool has no capacity, databases are not accepted. */
+static MunitResult test_pool_put_full(const MunitParameter params[], void *data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	int                    rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	dqlite__db_pool_init(&pool, 0);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, DQLITE_OVERFLOW);
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+/* A database that failed to open is not accepted. */
+static MunitResult test_pool_put_not_open(const MunitParameter params[],
+                                          void *               data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	int                    rc;
+
+	(void)params;
+
+	dqlite__db_pool_init(&pool, 1);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, DQLITE_ERROR);
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+/* Only databases with the same name and flags are checked out. */
+static MunitResult test_pool_get_no_match(const MunitParameter params[],
+                                          void *               data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	int                    flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	int                    rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	dqlite__db_pool_init(&pool, 1);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, 0);
+
+	munit_assert_ptr_null(dqlite__db_pool_get(&pool, "other.db", flags));
+	munit_assert_ptr_null(
+	    dqlite__db_pool_get(&pool, "test.db", SQLITE_OPEN_READWRITE));
+
+	munit_assert_ptr_equal(dqlite__db_pool_get(&pool, "test.db", flags),
+	                       db);
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+/* Checking in a database finalizes its statements and rolls back any pending
+ * transaction. */
+static MunitResult test_pool_put_reset(const MunitParameter params[],
+                                       void *               data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	struct dqlite__stmt *  stmt;
+	int                    flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	int                    rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	rc = dqlite__db_prepare(db, "SELECT 1", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = dqlite__db_begin(db);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	dqlite__db_pool_init(&pool, 1);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, 0);
+
+	munit_assert_ptr_equal(dqlite__db_pool_get(&pool, "test.db", flags),
+	                       db);
+
+	munit_assert_int(sqlite3_get_autocommit(db->db), ==, 1);
+	munit_assert_ptr_null(dqlite__db_stmt(db, 0));
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+/* A database whose client changed a setting of the connection is not
+ * accepted. */
+static MunitResult test_pool_put_tainted(const MunitParameter params[],
+                                         void *               data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	struct dqlite__stmt *  stmt;
+	int                    rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	rc = dqlite__db_prepare(db, "PRAGMA table_info(foo)", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_false(db->tainted);
+
+	rc = dqlite__db_prepare(db, "PRAGMA cache_size=10", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_true(db->tainted);
+
+	dqlite__db_pool_init(&pool, 1);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, DQLITE_ENGINE);
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+/* Statements of a pooled database are handed back to the next client
+ * preparing the same SQL text. */
+static MunitResult test_pool_put_cache(const MunitParameter params[],
+                                       void *               data)
+{
+	struct dqlite__db *    db = data;
+	struct dqlite__db_pool pool;
+	struct dqlite__stmt *  stmt;
+	sqlite3_stmt *         cached;
+	int                    flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	int                    rc;
+
+	(void)params;
+
+	__db_open(db);
+
+	rc = dqlite__db_prepare(db, "SELECT ?", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	cached = stmt->stmt;
+
+	rc = sqlite3_bind_int(cached, 1, 123);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	dqlite__db_pool_init(&pool, 1);
+
+	rc = dqlite__db_pool_put(&pool, db);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(db->cached, ==, 1);
+
+	munit_assert_ptr_equal(dqlite__db_pool_get(&pool, "test.db", flags),
+	                       db);
+
+	rc = dqlite__db_prepare(db, "SELECT 1", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_ptr_not_equal(stmt->stmt, cached);
+
+	rc = dqlite__db_prepare(db, "SELECT ?", &stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_ptr_equal(stmt->stmt, cached);
+	munit_assert_string_equal(stmt->tail, "");
+	munit_assert_int(db->cached, ==, 0);
+
+	/* Bindings of the old client were cleared. */
+	rc = sqlite3_step(stmt->stmt);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+	munit_assert_int(sqlite3_column_type(stmt->stmt, 0), ==, SQLITE_NULL);
+
+	dqlite__db_pool_close(&pool);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__pool_tests[] = {
+    {"_put/full", test_pool_put_full, setup, tear_down, 0, NULL},
+    {"_put/not-open", test_pool_put_not_open, setup, tear_down, 0, NULL},
+    {"_put/reset", test_pool_put_reset, setup, tear_down, 0, NULL},
+    {"_put/tainted", test_pool_put_tainted, setup, tear_down, 0, NULL},
+    {"_put/cache", test_pool_put_cache, setup, tear_down, 0, NULL},
+    {"_get/no-match", test_pool_get_no_match, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
 /******************************************************************************
  *
  * Suite
@@ -331,5 +799,7 @@ MunitSuite dqlite__db_suites[] = {
     {"_prepare", dqlite__prepare_tests, NULL, 1, 0},
     {"_begin", dqlite__begin_tests, NULL, 1, 0},
     {"_commit", dqlite__commit_tests, NULL, 1, 0},
+    {"_maintain", dqlite__maintain_tests, NULL, 1, 0},
+    {"_pool", dqlite__pool_tests, NULL, 1, 0},
     {NULL, NULL, NULL, 0, 0},
 };
@@ -1,3 +1,6 @@
+#include <string.h>
+
+#include <sqlite3.h>
 #include <uv.h>
 
 #include "../include/dqlite.h"
@@ -50,7 +53,7 @@ static MunitResult test_printf(const MunitParameter params[], void *data)
 
 	dqlite__error_printf(error, "hello %s", "world");
 
-	munit_assert_string_equal(*error, "hello world");
+	munit_assert_string_equal(dqlite__error_msg(error), "hello world");
 
 	return MUNIT_OK;
 }
@@ -65,11 +68,12 @@ static MunitResult test_printf_override(const MunitParameter params[],
 	dqlite__error_printf(error, "hello %s", "world");
 	dqlite__error_printf(error, "I'm %s!", "here");
 
-	munit_assert_string_equal(*error, "I'm here!");
+	munit_assert_string_equal(dqlite__error_msg(error), "I'm here!");
 
 	return MUNIT_OK;
 }
 
+/* Rendering a message does not allocate memory. */
 static MunitResult test_printf_oom(const MunitParameter params[], void *data)
 {
 	dqlite__error *error = data;
@@ -81,8 +85,34 @@ static MunitResult test_printf_oom(const MunitParameter params[], void *data)
 
 	dqlite__error_printf(error, "hello %s", "world");
 
-	munit_assert_string_equal(*error,
-	                          "error message unavailable (out of memory)");
+	munit_assert_string_equal(dqlite__error_msg(error), "hello world");
+
+	return MUNIT_OK;
+}
+
+/* Messages exceeding the capacity of the inline buffer are not truncated. */
+static MunitResult test_printf_long(const MunitParameter params[], void *data)
+{
+	dqlite__error *error = data;
+	char           text[DQLITE__ERROR_LEN * 2];
+	const char *   msg;
+
+	(void)params;
+
+	memset(text, 'x', sizeof text - 1);
+	text[sizeof text - 1] = 0;
+
+	dqlite__error_printf(error, "hello %s", text);
+
+	msg = dqlite__error_msg(error);
+
+	munit_assert_int(strlen(msg), ==, strlen("hello ") + sizeof text - 1);
+	munit_assert_int(strncmp(msg, "hello xxx", 9), ==, 0);
+
+	/* Setting a short message releases the long one. */
+	dqlite__error_printf(error, "hello %s", "world");
+
+	munit_assert_string_equal(dqlite__error_msg(error), "hello world");
 
 	return MUNIT_OK;
 }
@@ -91,6 +121,206 @@ static MunitTest dqlite__error_printf_tests[] = {
     {"/", test_printf, setup, tear_down, 0, NULL},
     {"/override", test_printf_override, setup, tear_down, 0, NULL},
     {"/oom", test_printf_oom, setup, tear_down, 0, NULL},
+    {"/long", test_printf_long, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__error_set
+ *
+ ******************************************************************************/
+
+/* The message is not interpreted as a format. */
+static MunitResult test_set(const MunitParameter params[], void *data)
+{
+	dqlite__error *error = data;
+
+	(void)params;
+
+	dqlite__error_set(error, "100% done");
+
+	munit_assert_string_equal(dqlite__error_msg(error), "100% done");
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__error_set_tests[] = {
+    {"/", test_set, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__error_static
+ *
+ ******************************************************************************/
+
+/* Fixed messages are referenced without being copied. */
+static MunitResult test_static(const MunitParameter params[], void *data)
+{
+	dqlite__error *error = data;
+	static char    msg[] = "boom";
+
+	(void)params;
+
+	dqlite__error_static(error, msg);
+
+	munit_assert_ptr_equal(dqlite__error_msg(error), msg);
+	munit_assert_false(dqlite__error_is_null(error));
+
+	/* Setting a rendered message drops the fixed one. */
+	dqlite__error_printf(error, "hello %s", "world");
+
+	munit_assert_string_equal(dqlite__error_msg(error), "hello world");
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__error_static_tests[] = {
+    {"/", test_static, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__error_forward
+ *
+ ******************************************************************************/
+
+/* Fixed messages are forwarded without being copied. */
+static MunitResult test_forward_static(const MunitParameter params[],
+                                       void *               data)
+{
+	dqlite__error *error = data;
+	dqlite__error  cause;
+	static char    msg[] = "boom";
+
+	(void)params;
+
+	dqlite__error_init(&cause);
+
+	dqlite__error_static(&cause, msg);
+	dqlite__error_forward(error, &cause);
+
+	dqlite__error_close(&cause);
+
+	munit_assert_ptr_equal(dqlite__error_msg(error), msg);
+
+	return MUNIT_OK;
+}
+
+/* Rendered messages are copied. */
+static MunitResult test_forward_rendered(const MunitParameter params[],
+                                         void *               data)
+{
+	dqlite__error *error = data;
+	dqlite__error  cause;
+
+	(void)params;
+
+	dqlite__error_init(&cause);
+
+	dqlite__error_printf(&cause, "hello %s", "world");
+	dqlite__error_forward(error, &cause);
+
+	dqlite__error_close(&cause);
+
+	munit_assert_string_equal(dqlite__error_msg(error), "hello world");
+
+	return MUNIT_OK;
+}
+
+/* Long messages are copied too. */
+static MunitResult test_forward_long(const MunitParameter params[], void *data)
+{
+	dqlite__error *error = data;
+	dqlite__error  cause;
+	char           text[DQLITE__ERROR_LEN * 2];
+
+	(void)params;
+
+	memset(text, 'x', sizeof text - 1);
+	text[sizeof text - 1] = 0;
+
+	dqlite__error_init(&cause);
+
+	dqlite__error_set(&cause, text);
+	dqlite__error_forward(error, &cause);
+
+	dqlite__error_close(&cause);
+
+	munit_assert_string_equal(dqlite__error_msg(error), text);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__error_forward_tests[] = {
+    {"/static", test_forward_static, setup, tear_down, 0, NULL},
+    {"/rendered", test_forward_rendered, setup, tear_down, 0, NULL},
+    {"/long", test_forward_long, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__error_sqlite
+ *
+ ******************************************************************************/
+
+/* Messages that SQLite doesn't customize are static. */
+static MunitResult test_sqlite_static(const MunitParameter params[],
+                                      void *               data)
+{
+	dqlite__error *error = data;
+	sqlite3 *      db;
+	int            rc;
+
+	(void)params;
+
+	rc = sqlite3_open_v2(
+	    "/non/existing/dir/test.db", &db, SQLITE_OPEN_READWRITE, NULL);
+	munit_assert_int(rc, ==, SQLITE_CANTOPEN);
+
+	dqlite__error_sqlite(error, db);
+
+	munit_assert_ptr_equal(dqlite__error_msg(error),
+	                       sqlite3_errstr(SQLITE_CANTOPEN));
+
+	sqlite3_close(db);
+
+	return MUNIT_OK;
+}
+
+/* Custom messages are copied, since they don't outlive the next call. */
+static MunitResult test_sqlite_custom(const MunitParameter params[],
+                                      void *               data)
+{
+	dqlite__error *error = data;
+	sqlite3 *      db;
+	int            rc;
+
+	(void)params;
+
+	rc = sqlite3_open(":memory:", &db);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_exec(db, "FOO", NULL, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_ERROR);
+
+	dqlite__error_sqlite(error, db);
+
+	sqlite3_close(db);
+
+	munit_assert_string_equal(dqlite__error_msg(error),
+	                          "near \"FOO\": syntax error");
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__error_sqlite_tests[] = {
+    {"/static", test_sqlite_static, setup, tear_down, 0, NULL},
+    {"/custom", test_sqlite_custom, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
@@ -115,7 +345,8 @@ static MunitResult test_wrapf(const MunitParameter params[], void *data)
 
 	dqlite__error_close(&cause);
 
-	munit_assert_string_equal(*error, "boom: hello world");
+	munit_assert_string_equal(dqlite__error_msg(error),
+	                          "boom: hello world");
 
 	return MUNIT_OK;
 }
@@ -134,7 +365,7 @@ static MunitResult test_wrapf_null_cause(const MunitParameter params[],
 
 	dqlite__error_close(&cause);
 
-	munit_assert_string_equal(*error, "boom: (null)");
+	munit_assert_string_equal(dqlite__error_msg(error), "boom: (null)");
 
 	return MUNIT_OK;
 }
@@ -149,7 +380,32 @@ static MunitResult test_wrapf_itself(const MunitParameter params[], void *data)
 
 	dqlite__error_wrapf(error, error, "boom");
 
-	munit_assert_string_equal(*error, "boom: I'm here!");
+	munit_assert_string_equal(dqlite__error_msg(error), "boom: I'm here!");
+
+	return MUNIT_OK;
+}
+
+/* A long message can wrap itself. */
+static MunitResult test_wrapf_itself_long(const MunitParameter params[],
+                                          void *               data)
+{
+	dqlite__error *error = data;
+	char           text[DQLITE__ERROR_LEN * 2];
+	const char *   msg;
+
+	(void)params;
+
+	memset(text, 'x', sizeof text - 1);
+	text[sizeof text - 1] = 0;
+
+	dqlite__error_set(error, text);
+
+	dqlite__error_wrapf(error, error, "boom");
+
+	msg = dqlite__error_msg(error);
+
+	munit_assert_int(strlen(msg), ==, strlen("boom: ") + sizeof text - 1);
+	munit_assert_int(strncmp(msg, "boom: xxx", 9), ==, 0);
 
 	return MUNIT_OK;
 }
@@ -158,6 +414,7 @@ static MunitTest dqlite__error_wrapf_tests[] = {
     {"/", test_wrapf, setup, tear_down, 0, NULL},
     {"/null_cause", test_wrapf_null_cause, setup, tear_down, 0, NULL},
     {"/itself", test_wrapf_itself, setup, tear_down, 0, NULL},
+    {"/itself-long", test_wrapf_itself_long, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
@@ -175,7 +432,8 @@ static MunitResult test_oom(const MunitParameter params[], void *data)
 
 	dqlite__error_oom(error, "boom");
 
-	munit_assert_string_equal(*error, "boom: out of memory");
+	munit_assert_string_equal(dqlite__error_msg(error),
+	                          "boom: out of memory");
 
 	return MUNIT_OK;
 }
@@ -188,7 +446,8 @@ static MunitResult test_oom_vargs(const MunitParameter params[], void *data)
 
 	dqlite__error_oom(error, "boom %d", 123);
 
-	munit_assert_string_equal(*error, "boom 123: out of memory");
+	munit_assert_string_equal(dqlite__error_msg(error),
+	                          "boom 123: out of memory");
 
 	return MUNIT_OK;
 }
@@ -214,7 +473,8 @@ static MunitResult test_sys(const MunitParameter params[], void *data)
 	open("/foo/bar/egg/baz", 0);
 	dqlite__error_sys(error, "boom");
 
-	munit_assert_string_equal(*error, "boom: No such file or directory");
+	munit_assert_string_equal(dqlite__error_msg(error),
+	                          "boom: No such file or directory");
 
 	return MUNIT_OK;
 }
@@ -238,7 +498,7 @@ static MunitResult test_uv(const MunitParameter params[], void *data)
 
 	dqlite__error_uv(error, UV_EBUSY, "boom");
 
-	munit_assert_string_equal(*error,
+	munit_assert_string_equal(dqlite__error_msg(error),
 	                          "boom: resource busy or locked (EBUSY)");
 
 	return MUNIT_OK;
@@ -298,7 +558,7 @@ static MunitResult test_copy_oom(const MunitParameter params[], void *data)
 
 	(void)params;
 
-	test_mem_fault_config(2, 1);
+	test_mem_fault_config(0, 1);
 	test_mem_fault_enable();
 
 	dqlite__error_printf(error, "hello");
@@ -394,6 +654,10 @@ static MunitTest dqlite__error_is_disconnect_tests[] = {
 
 MunitSuite dqlite__error_suites[] = {
     {"_printf", dqlite__error_printf_tests, NULL, 1, 0},
+    {"_set", dqlite__error_set_tests, NULL, 1, 0},
+    {"_static", dqlite__error_static_tests, NULL, 1, 0},
+    {"_forward", dqlite__error_forward_tests, NULL, 1, 0},
+    {"_sqlite", dqlite__error_sqlite_tests, NULL, 1, 0},
     {"_wrapf", dqlite__error_wrapf_tests, NULL, 1, 0},
     {"_oom", dqlite__error_oom_tests, NULL, 1, 0},
     {"_sys", dqlite__error_sys_tests, NULL, 1, 0},
@@ -104,6 +104,34 @@ static void __exec(struct fixture *f, uint32_t db_id, uint32_t stmt_id)
 	dqlite__gateway_flushed(f->gateway, f->response);
 }
 
+/* Initialize the gateway of the fixture. */
+static void __gateway_init(struct fixture *f, dqlite_cluster *cluster)
+{
+	struct dqlite__gateway_cbs callbacks;
+#ifdef DQLITE_EXPERIMENTAL
+	int rc;
+#endif /* DQLITE_EXPERIMENTAL */
+
+	callbacks.ctx    = f;
+	callbacks.xFlush = fixture_flush_cb;
+	callbacks.xRow   = NULL;
+
+	dqlite__gateway_init(f->gateway,
+	                     &callbacks,
+	                     cluster,
+	                     test_logger(),
+	                     f->options,
+	                     NULL,
+	                     NULL,
+	                     NULL,
+	                     NULL);
+
+#ifdef DQLITE_EXPERIMENTAL
+	rc = dqlite__gateway_start(f->gateway, 0, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+#endif /* DQLITE_EXPERIMENTAL */
+}
+
 /******************************************************************************
  *
  * Setup and tear down
@@ -112,18 +140,14 @@ static void __exec(struct fixture *f, uint32_t db_id, uint32_t stmt_id)
 
 static void *setup(const MunitParameter params[], void *user_data)
 {
-	struct fixture *           f;
-	struct dqlite__gateway_cbs callbacks;
-	dqlite_logger *            logger = test_logger();
-	int                        rc;
+	struct fixture *f;
+	dqlite_logger * logger = test_logger();
+	int             rc;
 
 	test_case_setup(params, user_data);
 
 	f = munit_malloc(sizeof *f);
 
-	callbacks.ctx    = f;
-	callbacks.xFlush = fixture_flush_cb;
-
 	f->replication = test_replication();
 
 	rc = sqlite3_wal_replication_register(f->replication, 0);
@@ -142,13 +166,7 @@ static void *setup(const MunitParameter params[], void *user_data)
 	f->options->wal_replication = "test";
 
 	f->gateway = munit_malloc(sizeof *f->gateway);
-	dqlite__gateway_init(
-	    f->gateway, &callbacks, test_cluster(), test_logger(), f->options);
-
-#ifdef DQLITE_EXPERIMENTAL
-	rc = dqlite__gateway_start(f->gateway, 0);
-	munit_assert_int(rc, ==, SQLITE_OK);
-#endif /* DQLITE_EXPERIMENTAL */
+	__gateway_init(f, test_cluster());
 
 	f->request = munit_malloc(sizeof *f->request);
 
@@ -403,6 +421,60 @@ static MunitResult test_open_twice(const MunitParameter params[], void *data)
 	return MUNIT_OK;
 }
 
+/* Handle a connect request, which both welcomes the client and opens its
+ * database. */
+static MunitResult test_connect(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	int             err;
+
+	(void)params;
+
+	f->request->type          = DQLITE_REQUEST_CONNECT;
+	f->request->connect.id    = 123;
+	f->request->connect.name  = "test.db";
+	f->request->connect.flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+	f->request->connect.vfs   = f->replication->zName;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_not_null(f->response);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_WELCOME_DB);
+	munit_assert_int(f->response->welcome_db.heartbeat_timeout, ==, 15000);
+	munit_assert_int(f->response->welcome_db.id, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* A connect request fails like an open one if the database can't be
+ * opened. */
+static MunitResult test_connect_error(const MunitParameter params[],
+                                      void *               data)
+{
+	struct fixture *f = data;
+	int             err;
+
+	(void)params;
+
+	f->request->type          = DQLITE_REQUEST_CONNECT;
+	f->request->connect.id    = 123;
+	f->request->connect.name  = "test.db";
+	f->request->connect.flags = SQLITE_OPEN_CREATE;
+	f->request->connect.vfs   = f->replication->zName;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_not_null(f->response);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
+	munit_assert_int(f->response->failure.code, ==, SQLITE_MISUSE);
+
+	return MUNIT_OK;
+}
+
 /* If no registered db matches the provided ID, the request fails. */
 static MunitResult test_prepare_bad_db(const MunitParameter params[],
                                        void *               data)
@@ -979,6 +1051,221 @@ static MunitResult test_exec_sql_error(const MunitParameter params[],
 	return MUNIT_OK;
 }
 
+/* If the WAL has reached the hard limit, new writes are rejected with a
+ * retryable error. */
+static MunitResult test_exec_sql_wal_limit(const MunitParameter params[],
+                                           void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	uint32_t        stmt_id;
+	int             err;
+
+	(void)params;
+
+	f->options->wal_hard_limit = 1;
+
+	__open(f, &db_id);
+
+	__prepare(f, db_id, "CREATE TABLE foo (n INT)", &stmt_id);
+	__exec(f, db_id, stmt_id);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "INSERT INTO foo(n) VALUES(1)";
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_not_null(f->response);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
+	munit_assert_int(f->response->failure.code, ==, SQLITE_BUSY);
+
+	munit_assert_string_equal(f->response->failure.message,
+	                          "WAL size limit reached");
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	/* The rejected write started a checkpoint, so a retry succeeds. */
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_not_null(f->response);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_RESULT);
+
+	return MUNIT_OK;
+}
+
+/* A write rejected because of the hard limit starts an asynchronous
+ * checkpoint, even if the WAL hook wouldn't. */
+static MunitResult test_exec_sql_wal_limit_checkpoint(
+    const MunitParameter params[],
+    void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	uint32_t        stmt_id;
+	int             err;
+
+	(void)params;
+
+	test_cluster_checkpoint_async(&f->options->cluster_async);
+
+	f->options->checkpoint_threshold = 1000;
+	f->options->wal_hard_limit       = 1;
+
+	__open(f, &db_id);
+
+	__prepare(f, db_id, "CREATE TABLE foo (n INT)", &stmt_id);
+	__exec(f, db_id, stmt_id);
+
+	munit_assert_false(test_cluster_checkpoint_pending());
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "INSERT INTO foo(n) VALUES(1)";
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
+	munit_assert_int(f->response->failure.code, ==, SQLITE_BUSY);
+
+	munit_assert_true(test_cluster_checkpoint_pending());
+	test_cluster_checkpoint_complete(0);
+
+	return MUNIT_OK;
+}
+
+/* If the WAL is past the soft limit, writes get delayed, while other requests
+ * don't. */
+static MunitResult test_exec_sql_throttle(const MunitParameter params[],
+                                          void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__metrics metrics;
+	uint32_t               db_id;
+	uint32_t               stmt_id;
+	uint64_t               delay;
+
+	(void)params;
+
+	f->options->wal_soft_limit = 1;
+	f->options->wal_hard_limit = 1000;
+
+	dqlite__metrics_init(&metrics);
+	f->gateway->metrics = &metrics;
+
+	__open(f, &db_id);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "INSERT INTO foo(n) VALUES(1)";
+
+	delay = dqlite__gateway_throttle(f->gateway, f->request);
+	munit_assert_int(delay, ==, 0);
+
+	__prepare(f, db_id, "CREATE TABLE foo (n INT)", &stmt_id);
+	__exec(f, db_id, stmt_id);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "INSERT INTO foo(n) VALUES(1)";
+
+	delay = dqlite__gateway_throttle(f->gateway, f->request);
+	munit_assert_int(delay, >, 0);
+	munit_assert_int(delay, <=, 100);
+
+	/* The delay is accounted in nanoseconds. */
+	munit_assert_int(metrics.throttled, ==, 1);
+	munit_assert_int(metrics.throttle_time, ==, delay * 1000000);
+
+	f->request->type            = DQLITE_REQUEST_QUERY_SQL;
+	f->request->query_sql.db_id = db_id;
+	f->request->query_sql.sql   = "SELECT n FROM foo";
+
+	delay = dqlite__gateway_throttle(f->gateway, f->request);
+	munit_assert_int(delay, ==, 0);
+
+	f->gateway->metrics = NULL;
+
+	return MUNIT_OK;
+}
+
+/* If the cluster supports asynchronous barriers, the request is parked until
+ * the barrier completes. */
+static MunitResult test_exec_sql_barrier_async(const MunitParameter params[],
+                                               void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	int             err;
+
+	(void)params;
+
+	__open(f, &db_id);
+
+	test_cluster_barrier_async(&f->options->cluster_async);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "CREATE TABLE foo (n INT)";
+
+	f->response = NULL;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_null(f->response);
+	munit_assert_true(dqlite__gateway_parked(f->gateway));
+
+	test_cluster_barrier_complete(0);
+
+	munit_assert_false(dqlite__gateway_parked(f->gateway));
+
+	munit_assert_ptr_not_null(f->response);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_RESULT);
+
+	return MUNIT_OK;
+}
+
+/* If an asynchronous barrier fails, the parked request fails too. */
+static MunitResult test_exec_sql_barrier_error(const MunitParameter params[],
+                                               void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	int             err;
+
+	(void)params;
+
+	__open(f, &db_id);
+
+	test_cluster_barrier_async(&f->options->cluster_async);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "CREATE TABLE foo (n INT)";
+
+	f->response = NULL;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_null(f->response);
+
+	test_cluster_barrier_complete(SQLITE_IOERR);
+
+	munit_assert_ptr_not_null(f->response);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
+	munit_assert_int(f->response->failure.code, ==, SQLITE_IOERR);
+
+	munit_assert_string_equal(f->response->failure.message,
+	                          "raft barrier failed");
+
+	return MUNIT_OK;
+}
+
 /* Handle a query sql request. */
 static MunitResult test_query_sql(const MunitParameter params[], void *data)
 {
@@ -1116,53 +1403,374 @@ static MunitResult test_query_sql_bad_params(const MunitParameter params[],
 	return MUNIT_OK;
 }
 
-/* If the given request type is invalid, an error is returned. */
-static MunitResult test_invalid_request_type(const MunitParameter params[],
-                                             void *               data)
+/* Create a table with enough rows for a query selecting all of them to need
+ * more than one batch. */
+static void __query_sql_fill(struct fixture *f, uint32_t db_id)
 {
-	struct fixture *f = data;
-	int             err;
+	uint32_t stmt_id;
 
-	(void)params;
+	__prepare(f, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	__exec(f, db_id, stmt_id);
 
-	f->request->type = 128;
+	__prepare(f,
+	          db_id,
+	          "INSERT INTO test(n) WITH RECURSIVE seq(i) AS "
+	          "(SELECT 1 UNION ALL SELECT i + 1 FROM seq WHERE i < 1024) "
+	          "SELECT i FROM seq",
+	          &stmt_id);
+	__exec(f, db_id, stmt_id);
+}
 
-	err = dqlite__gateway_handle(f->gateway, f->request);
-	munit_assert_int(err, ==, 0);
+/* Send a query request selecting all rows of the test table and check that
+ * the first batch does not hold all of them. */
+static void __query_sql_start(struct fixture *f, uint32_t db_id)
+{
+	int err;
 
-	munit_assert_ptr_not_null(f->response);
-	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
-	munit_assert_int(f->response->failure.code, ==, SQLITE_ERROR);
+	f->request->type            = DQLITE_REQUEST_QUERY_SQL;
+	f->request->query_sql.db_id = db_id;
+	f->request->query_sql.sql   = "SELECT n FROM test";
 
-	munit_assert_string_equal(f->response->failure.message,
-	                          "invalid request type 128");
+	f->request->message.words   = 1;
+	f->request->message.offset1 = 8;
 
-	return MUNIT_OK;
+	f->response->message.offset1 = 0;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	munit_assert_int(f->response->rows.eof, ==, DQLITE_RESPONSE_ROWS_PART);
 }
 
-/* If a second request is pushed before the first has completed , an error is
- * returned. */
-static MunitResult test_max_requests(const MunitParameter params[], void *data)
+/* A query fitting in a single batch is not moved to a snapshot. */
+static MunitResult test_query_sql_snapshot_single(const MunitParameter params[],
+                                                  void *               data)
 {
 	struct fixture *f = data;
 	uint32_t        db_id;
+	uint32_t        stmt_id;
 	int             err;
 
 	(void)params;
 
-	__open(f, &db_id);
+	f->options->snapshot_reads = 1;
 
-	f->request->type          = DQLITE_REQUEST_PREPARE;
-	f->request->prepare.db_id = db_id;
-	f->request->prepare.sql   = "SELECT 1";
+	__open(f, &db_id);
 
-	err = dqlite__gateway_handle(f->gateway, f->request);
-	munit_assert_int(err, ==, 0);
+	__prepare(f, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	__exec(f, db_id, stmt_id);
 
-	err = dqlite__gateway_handle(f->gateway, f->request);
+	f->request->type            = DQLITE_REQUEST_QUERY_SQL;
+	f->request->query_sql.db_id = db_id;
+	f->request->query_sql.sql   = "SELECT n FROM test";
+
+	f->request->message.words   = 1;
+	f->request->message.offset1 = 8;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	munit_assert_int(f->response->rows.eof, ==, DQLITE_RESPONSE_ROWS_DONE);
+
+	munit_assert_int(
+	    f->gateway->ctxs[0].cleanup, ==, DQLITE__GATEWAY_CLEANUP_NONE);
+
+	return MUNIT_OK;
+}
+
+/* A query needing more than one batch moves to a snapshot, which gets released
+ * along with both statements if the query is interrupted. */
+static MunitResult test_query_sql_snapshot_interrupt(
+    const MunitParameter params[],
+    void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	int             ctx;
+	int             rc;
+
+	(void)params;
+
+	f->options->snapshot_reads = 1;
+
+	__open(f, &db_id);
+	__query_sql_fill(f, db_id);
+	__query_sql_start(f, db_id);
+
+	munit_assert_int(
+	    f->gateway->ctxs[0].cleanup, ==, DQLITE__GATEWAY_CLEANUP_SNAPSHOT);
+	munit_assert_ptr_not_null(f->gateway->ctxs[0].origin);
+
+	/* The original statement is finalized once its batch is sent. */
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_ptr_null(f->gateway->ctxs[0].origin);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	f->request->type            = DQLITE_REQUEST_INTERRUPT;
+	f->request->interrupt.db_id = db_id;
+
+	f->request->message.words   = 1;
+	f->request->message.offset1 = 8;
+
+	rc = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(rc, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_EMPTY);
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_ptr_null(f->gateway->ctxs[0].db);
+	munit_assert_ptr_null(f->gateway->ctxs[0].stmt);
+
+	ctx = dqlite__gateway_ctx_for(f->gateway, DQLITE_REQUEST_EXEC_SQL);
+	munit_assert_int(ctx, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Closing the gateway in the middle of a snapshot query releases the snapshot
+ * and both statements. */
+static MunitResult test_query_sql_snapshot_close(const MunitParameter params[],
+                                                 void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+
+	(void)params;
+
+	f->options->snapshot_reads = 1;
+
+	__open(f, &db_id);
+	__query_sql_fill(f, db_id);
+	__query_sql_start(f, db_id);
+
+	munit_assert_int(
+	    f->gateway->ctxs[0].cleanup, ==, DQLITE__GATEWAY_CLEANUP_SNAPSHOT);
+	munit_assert_ptr_not_null(f->gateway->ctxs[0].origin);
+
+	/* The tear down closes the gateway, which must not leak anything. */
+
+	return MUNIT_OK;
+}
+
+/* If the VFS has no room left for a snapshot, the query keeps running against
+ * the database. */
+static MunitResult test_query_sql_snapshot_no_slots(
+    const MunitParameter params[],
+    void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	sqlite3 *       db;
+	char            name[32];
+	int             i;
+	int             rc;
+
+	(void)params;
+
+	f->options->snapshot_reads = 1;
+
+	__open(f, &db_id);
+	__query_sql_fill(f, db_id);
+
+	/* Files of the volatile VFS outlive their connections. */
+	for (i = 0; i < 64; i++) {
+		sqlite3_snprintf(sizeof name, name, "fill-%d.db", i);
+		rc = sqlite3_open_v2(name,
+		                     &db,
+		                     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+		                     f->vfs->zName);
+		sqlite3_close(db);
+		if (rc != SQLITE_OK) {
+			break;
+		}
+	}
+	munit_assert_int(rc, ==, SQLITE_CANTOPEN);
+
+	__query_sql_start(f, db_id);
+
+	munit_assert_int(
+	    f->gateway->ctxs[0].cleanup, ==, DQLITE__GATEWAY_CLEANUP_FINALIZE);
+	munit_assert_ptr_null(f->gateway->ctxs[0].origin);
+
+	/* All remaining rows are still streamed. */
+	for (i = 0; f->response->rows.eof == DQLITE_RESPONSE_ROWS_PART; i++) {
+		munit_assert_int(i, <, 1024);
+		dqlite__gateway_flushed(f->gateway, f->response);
+		munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	}
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_ptr_null(f->gateway->ctxs[0].stmt);
+
+	return MUNIT_OK;
+}
+
+/* A prepared statement needing more than one batch moves to a snapshot as
+ * well, and is reset rather than finalized once its batch is sent, since it
+ * still belongs to the client. */
+static MunitResult test_query_snapshot(const MunitParameter params[],
+                                       void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	uint32_t        stmt_id;
+	int             i;
+	int             err;
+
+	(void)params;
+
+	f->options->snapshot_reads = 1;
+
+	__open(f, &db_id);
+	__query_sql_fill(f, db_id);
+
+	__prepare(f, db_id, "SELECT n FROM test", &stmt_id);
+
+	f->request->type          = DQLITE_REQUEST_QUERY;
+	f->request->query.db_id   = db_id;
+	f->request->query.stmt_id = stmt_id;
+
+	f->request->message.words   = 2;
+	f->request->message.offset1 = 16;
+
+	f->response->message.offset1 = 0;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	munit_assert_int(f->response->rows.eof, ==, DQLITE_RESPONSE_ROWS_PART);
+
+	munit_assert_int(f->gateway->ctxs[0].cleanup,
+	                 ==,
+	                 DQLITE__GATEWAY_CLEANUP_SNAPSHOT_RESET);
+	munit_assert_ptr_not_null(f->gateway->ctxs[0].origin);
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_ptr_null(f->gateway->ctxs[0].origin);
+
+	for (i = 0; f->response->rows.eof == DQLITE_RESPONSE_ROWS_PART; i++) {
+		munit_assert_int(i, <, 1024);
+		dqlite__gateway_flushed(f->gateway, f->response);
+		munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	}
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_ptr_null(f->gateway->ctxs[0].stmt);
+
+	/* The prepared statement can be run again. */
+	f->request->type          = DQLITE_REQUEST_QUERY;
+	f->request->query.db_id   = db_id;
+	f->request->query.stmt_id = stmt_id;
+
+	f->request->message.words   = 2;
+	f->request->message.offset1 = 16;
+
+	f->response->message.offset1 = 0;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+
+	return MUNIT_OK;
+}
+
+/* A query whose rows differ when run again against the snapshot keeps
+ * running against the database. */
+static MunitResult test_query_sql_snapshot_nondeterministic(
+    const MunitParameter params[],
+    void *               data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	int             err;
+
+	(void)params;
+
+	f->options->snapshot_reads = 1;
+
+	__open(f, &db_id);
+	__query_sql_fill(f, db_id);
+
+	f->request->type            = DQLITE_REQUEST_QUERY_SQL;
+	f->request->query_sql.db_id = db_id;
+	f->request->query_sql.sql   = "SELECT n, random() FROM test";
+
+	f->request->message.words   = 1;
+	f->request->message.offset1 = 8;
+
+	f->response->message.offset1 = 0;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_ROWS);
+	munit_assert_int(f->response->rows.eof, ==, DQLITE_RESPONSE_ROWS_PART);
+
+	munit_assert_int(
+	    f->gateway->ctxs[0].cleanup, ==, DQLITE__GATEWAY_CLEANUP_FINALIZE);
+	munit_assert_ptr_null(f->gateway->ctxs[0].origin);
+
+	return MUNIT_OK;
+}
+
+/* If the given request type is invalid, an error is returned. */
+static MunitResult test_invalid_request_type(const MunitParameter params[],
+                                             void *               data)
+{
+	struct fixture *f = data;
+	int             err;
+
+	(void)params;
+
+	f->request->type = 128;
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_not_null(f->response);
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_FAILURE);
+	munit_assert_int(f->response->failure.code, ==, SQLITE_ERROR);
+
+	munit_assert_string_equal(f->response->failure.message,
+	                          "invalid request type 128");
+
+	return MUNIT_OK;
+}
+
+/* If a second request is pushed before the first has completed , an error is
+ * returned. */
+static MunitResult test_max_requests(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	uint32_t        db_id;
+	int             err;
+
+	(void)params;
+
+	__open(f, &db_id);
+
+	f->request->type          = DQLITE_REQUEST_PREPARE;
+	f->request->prepare.db_id = db_id;
+	f->request->prepare.sql   = "SELECT 1";
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
 	munit_assert_int(err, ==, DQLITE_PROTO);
 
-	munit_assert_string_equal(f->gateway->error,
+	munit_assert_string_equal(dqlite__error_msg(&f->gateway->error),
 	                          "concurrent request limit exceeded");
 
 	return MUNIT_OK;
@@ -1214,6 +1822,127 @@ static MunitResult test_checkpoint(const MunitParameter params[], void *data)
 	return MUNIT_OK;
 }
 
+/* A database whose asynchronous checkpoint is still in progress when its
+ * gateway gets closed is not handed over to the pool. */
+static MunitResult test_checkpoint_close(const MunitParameter params[],
+                                         void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__db_pool pool;
+	dqlite_cluster *       cluster;
+	uint32_t               db_id;
+	int                    err;
+
+	(void)params;
+
+	dqlite__db_pool_init(&pool, 1);
+
+	test_cluster_checkpoint_async(&f->options->cluster_async);
+
+	f->gateway->pool                          = &pool;
+	f->gateway->options->checkpoint_threshold = 1;
+
+	__open(f, &db_id);
+
+	f->request->type           = DQLITE_REQUEST_EXEC_SQL;
+	f->request->exec_sql.db_id = db_id;
+	f->request->exec_sql.sql   = "CREATE TABLE test (n INT)";
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(f->response->type, ==, DQLITE_RESPONSE_RESULT);
+
+	dqlite__gateway_flushed(f->gateway, f->response);
+
+	munit_assert_true(test_cluster_checkpoint_pending());
+
+	cluster = f->gateway->cluster;
+	dqlite__gateway_close(f->gateway);
+
+	munit_assert_int(pool.len, ==, 0);
+
+	/* The checkpoint completes after the database was closed. */
+	test_cluster_checkpoint_complete(0);
+
+	dqlite__db_pool_close(&pool);
+
+	/* Leave a fresh gateway for the tear down to close. */
+	__gateway_init(f, cluster);
+
+	return MUNIT_OK;
+}
+
+#ifdef DQLITE_EXPERIMENTAL
+
+/* SQL function suspending the request coroutine of the gateway passed as user
+ * data, like raft I/O does. */
+static void __yield(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+	struct dqlite__gateway *g = sqlite3_user_data(context);
+
+	(void)argc;
+	(void)argv;
+
+	co_switch(g->coroutine->caller);
+}
+
+/* A database whose request got suspended in the middle of a statement is
+ * closed along with the gateway, not pooled. */
+static MunitResult test_close_suspended(const MunitParameter params[],
+                                        void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__db_pool pool;
+	dqlite_cluster *       cluster;
+	uint32_t               db_id;
+	int                    err;
+	int                    rc;
+
+	(void)params;
+
+	dqlite__db_pool_init(&pool, 1);
+
+	f->gateway->pool = &pool;
+
+	__open(f, &db_id);
+
+	rc = sqlite3_create_function(f->gateway->db->db,
+	                             "yield",
+	                             0,
+	                             SQLITE_UTF8,
+	                             f->gateway,
+	                             __yield,
+	                             NULL,
+	                             NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	f->response                 = NULL;
+	f->request->type            = DQLITE_REQUEST_QUERY_SQL;
+	f->request->query_sql.db_id = db_id;
+	f->request->query_sql.sql   = "SELECT yield()";
+
+	err = dqlite__gateway_handle(f->gateway, f->request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_null(f->response);
+	munit_assert_ptr_not_null(f->gateway->coroutine);
+
+	cluster = f->gateway->cluster;
+	dqlite__gateway_close(f->gateway);
+
+	munit_assert_int(pool.len, ==, 0);
+
+	dqlite__db_pool_close(&pool);
+
+	/* Leave a fresh gateway for the tear down to close. */
+	__gateway_init(f, cluster);
+
+	return MUNIT_OK;
+}
+
+#endif /* DQLITE_EXPERIMENTAL */
+
 /* If the number of frames in the WAL reaches the configured threshold, but a
  * read transaction holding a shared lock on the WAL is in progress, no
  * checkpoint is triggered. */
@@ -1261,7 +1990,8 @@ static MunitResult test_checkpoint_busy(const MunitParameter params[],
                              flags,
                              f->gateway->options->vfs,
                              f->gateway->options->page_size,
-                             f->gateway->options->wal_replication);
+                             f->gateway->options->wal_replication,
+                             1);
 	munit_assert_int(rc, ==, 0);
 
 	rc = dqlite__db_prepare(&db2, "BEGIN", &stmt2);
@@ -1533,6 +2263,8 @@ static MunitTest dqlite__gateway_handle_tests[] = {
     {"/open/oom", test_open_oom, setup, tear_down, 0, test_open_oom_params},
     {"/open", test_open, setup, tear_down, 0, NULL},
     {"/open/twice", test_open_twice, setup, tear_down, 0, NULL},
+    {"/connect", test_connect, setup, tear_down, 0, NULL},
+    {"/connect/error", test_connect_error, setup, tear_down, 0, NULL},
     {"/prepare/bad-db", test_prepare_bad_db, setup, tear_down, 0, NULL},
     {"/prepare/bad-sql", test_prepare_bad_sql, setup, tear_down, 0, NULL},
     {"/prepare", test_prepare, setup, tear_down, 0, NULL},
@@ -1554,6 +2286,26 @@ static MunitTest dqlite__gateway_handle_tests[] = {
      0,
      NULL},
     {"/exec-sql/error", test_exec_sql_error, setup, tear_down, 0, NULL},
+    {"/exec-sql/wal-limit", test_exec_sql_wal_limit, setup, tear_down, 0, NULL},
+    {"/exec-sql/wal-limit-checkpoint",
+     test_exec_sql_wal_limit_checkpoint,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/exec-sql/throttle", test_exec_sql_throttle, setup, tear_down, 0, NULL},
+    {"/exec-sql/barrier-async",
+     test_exec_sql_barrier_async,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/exec-sql/barrier-error",
+     test_exec_sql_barrier_error,
+     setup,
+     tear_down,
+     0,
+     NULL},
     {"/query-sql", test_query_sql, setup, tear_down, 0, NULL},
     {"/query-sql/bad-sql", test_query_sql_bad_sql, setup, tear_down, 0, NULL},
     {"/query-sql/bad-params",
@@ -1562,6 +2314,42 @@ static MunitTest dqlite__gateway_handle_tests[] = {
      tear_down,
      0,
      NULL},
+    {"/query-sql/snapshot/single",
+     test_query_sql_snapshot_single,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/query-sql/snapshot/interrupt",
+     test_query_sql_snapshot_interrupt,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/query-sql/snapshot/close",
+     test_query_sql_snapshot_close,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/query-sql/snapshot/no-slots",
+     test_query_sql_snapshot_no_slots,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/query-sql/snapshot/nondeterministic",
+     test_query_sql_snapshot_nondeterministic,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/query/snapshot",
+     test_query_snapshot,
+     setup,
+     tear_down,
+     0,
+     NULL},
     {"/invalid-request-type",
      test_invalid_request_type,
      setup,
@@ -1571,6 +2359,10 @@ static MunitTest dqlite__gateway_handle_tests[] = {
     {"/max-requests", test_max_requests, setup, tear_down, 0, NULL},
     {"/checkpoint", test_checkpoint, setup, tear_down, 0, NULL},
     {"/checkpoint-busy", test_checkpoint_busy, setup, tear_down, 0, NULL},
+    {"/checkpoint/close", test_checkpoint_close, setup, tear_down, 0, NULL},
+#ifdef DQLITE_EXPERIMENTAL
+    {"/close/suspended", test_close_suspended, setup, tear_down, 0, NULL},
+#endif /* DQLITE_EXPERIMENTAL */
     {"/interrupt", test_interrupt, setup, tear_down, 0, NULL},
     {"/interrupt/finalize", test_interrupt_finalize, setup, tear_down, 0, NULL},
     {"/interrupt/no-request",
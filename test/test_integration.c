@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <pthread.h>
+#include <string.h>
 #include <time.h>
 
 #include "../include/dqlite.h"
@@ -134,19 +135,38 @@ static void __worker_wait(struct worker *w)
  *
  ******************************************************************************/
 
+static char *test_io_backends[] = {
+    "libuv",
+#ifdef DQLITE_URING
+    "uring",
+#endif /* DQLITE_URING */
+    NULL,
+};
+
+static MunitParameterEnum test_params[] = {
+    {"io", test_io_backends},
+    {NULL, NULL},
+};
+
 static void *setup(const MunitParameter params[], void *user_data)
 {
 	struct test_server *server;
 	const char *        errmsg;
+	const char *        io;
+	uint8_t             io_backend = DQLITE_IO_LIBUV;
 	int                 err;
 
-	(void)params;
 	(void)user_data;
 
 	err = dqlite_init(&errmsg);
 	munit_assert_int(err, ==, 0);
 
-	server = test_server_start("unix");
+	io = munit_parameters_get(params, "io");
+	if (io != NULL && strcmp(io, "uring") == 0) {
+		io_backend = DQLITE_IO_URING;
+	}
+
+	server = test_server_start_io("unix", io_backend);
 
 	return server;
 }
@@ -352,10 +372,229 @@ static MunitResult test_multi_thread(const MunitParameter params[], void *data)
 	return MUNIT_OK;
 }
 
+/* Loop metrics are collected while serving requests. */
+static MunitResult test_metrics(const MunitParameter params[], void *data)
+{
+	struct test_server *      server = data;
+	struct test_client *      client;
+	uint64_t                  heartbeat;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+	struct test_client_result result;
+	dqlite_metrics            metrics;
+	int                       rc;
+
+	(void)params;
+
+	test_server_connect(server, &client);
+
+	test_client_handshake(client);
+	test_client_client(client, &heartbeat);
+	test_client_open(client, "test.db", &db_id);
+
+	test_client_prepare(
+	    client, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_close(client);
+
+	rc = dqlite_server_metrics(server->service, &metrics);
+	munit_assert_int(rc, ==, 0);
+
+	munit_assert_int(metrics.requests, >=, 5);
+	munit_assert_int(metrics.iterations, >, 0);
+	munit_assert_int(metrics.callbacks, >=, metrics.requests);
+	munit_assert_int(metrics.busy, >, 0);
+
+	return MUNIT_OK;
+}
+
+/* A connection can be set up with a single round trip. */
+static MunitResult test_connect(const MunitParameter params[], void *data)
+{
+	struct test_server *      server = data;
+	struct test_client *      client;
+	uint64_t                  heartbeat;
+	uint32_t                  db_id;
+	uint32_t                  stmt_id;
+	struct test_client_result result;
+
+	(void)params;
+
+	test_server_connect(server, &client);
+
+	test_client_connect(client, "test.db", &heartbeat, &db_id);
+
+	munit_assert_int(heartbeat, ==, 15000);
+
+	test_client_prepare(
+	    client, db_id, "CREATE TABLE test (n INT)", &stmt_id);
+	test_client_exec(client, db_id, stmt_id, &result);
+	test_client_finalize(client, db_id, stmt_id);
+
+	test_client_close(client);
+
+	return MUNIT_OK;
+}
+
+/* Collect the integers yielded by a direct query. */
+struct direct_rows {
+	int64_t values[8];
+	int     n;
+};
+
+static int __direct_row(void *arg, sqlite3_stmt *stmt)
+{
+	struct direct_rows *rows = arg;
+
+	munit_assert_int(rows->n, <, 8);
+	rows->values[rows->n++] = sqlite3_column_int64(stmt, 0);
+
+	return 0;
+}
+
+/* Requests of in-process clients are served without going through a
+ * socket. */
+static MunitResult test_direct(const MunitParameter params[], void *data)
+{
+	struct test_server *server = data;
+	dqlite_direct *     direct;
+	struct direct_rows  rows;
+	uint64_t            last_insert_id;
+	uint64_t            rows_affected;
+	char *              errmsg;
+	int                 rc;
+
+	(void)params;
+
+	rc = dqlite_direct_open(server->service, "test.db", &direct, &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	rc = dqlite_direct_exec(direct,
+	                        "CREATE TABLE test (n INT)",
+	                        &last_insert_id,
+	                        &rows_affected,
+	                        &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	rc = dqlite_direct_exec(direct,
+	                        "INSERT INTO test VALUES(1); "
+	                        "INSERT INTO test VALUES(2)",
+	                        &last_insert_id,
+	                        &rows_affected,
+	                        &errmsg);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(last_insert_id, ==, 2);
+	munit_assert_int(rows_affected, ==, 1);
+
+	rows.n = 0;
+	rc     = dqlite_direct_query(direct,
+	                         "SELECT n FROM test ORDER BY n",
+	                         __direct_row,
+	                         &rows,
+	                         &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	munit_assert_int(rows.n, ==, 2);
+	munit_assert_int(rows.values[0], ==, 1);
+	munit_assert_int(rows.values[1], ==, 2);
+
+	dqlite_direct_close(direct);
+
+	return MUNIT_OK;
+}
+
+/* Check that a direct query yields consecutive integers starting from 1. */
+static int __direct_row_seq(void *arg, sqlite3_stmt *stmt)
+{
+	int *n = arg;
+
+	(*n)++;
+	munit_assert_int(sqlite3_column_int(stmt, 0), ==, *n);
+
+	return 0;
+}
+
+/* Result sets spanning several batches are handed over in full. */
+static MunitResult test_direct_large(const MunitParameter params[],
+                                     void *               data)
+{
+	struct test_server *server = data;
+	dqlite_direct *     direct;
+	char *              errmsg;
+	int                 n;
+	int                 rc;
+
+	(void)params;
+
+	rc = dqlite_direct_open(server->service, "test.db", &direct, &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	rc = dqlite_direct_exec(direct,
+	                        "CREATE TABLE test (n INT); "
+	                        "WITH RECURSIVE seq(i) AS "
+	                        "  (SELECT 1 UNION ALL SELECT i+1 FROM seq "
+	                        "   LIMIT 1000) "
+	                        "INSERT INTO test SELECT i FROM seq",
+	                        NULL,
+	                        NULL,
+	                        &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	n  = 0;
+	rc = dqlite_direct_query(direct,
+	                         "SELECT n FROM test ORDER BY n",
+	                         __direct_row_seq,
+	                         &n,
+	                         &errmsg);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_int(n, ==, 1000);
+
+	dqlite_direct_close(direct);
+
+	return MUNIT_OK;
+}
+
+/* SQLite errors are reported with DQLITE_ENGINE. */
+static MunitResult test_direct_error(const MunitParameter params[],
+                                     void *               data)
+{
+	struct test_server *server = data;
+	dqlite_direct *     direct;
+	char *              errmsg;
+	int                 rc;
+
+	(void)params;
+
+	rc = dqlite_direct_open(server->service, "test.db", &direct, &errmsg);
+	munit_assert_int(rc, ==, 0);
+
+	rc = dqlite_direct_exec(direct, "FOO", NULL, NULL, &errmsg);
+	munit_assert_int(rc, ==, DQLITE_ENGINE);
+	munit_assert_string_equal(errmsg, "near \"FOO\": syntax error (code 1)");
+
+	sqlite3_free(errmsg);
+
+	dqlite_direct_close(direct);
+
+	return MUNIT_OK;
+}
+
 static MunitTest dqlite__integration_tests[] = {
-    {"/exec-and-query", test_exec_and_query, setup, tear_down, 0, NULL},
-    {"/query-large", test_query_large, setup, tear_down, 0, NULL},
-    {"/multi-thread", test_multi_thread, setup, tear_down, 0, NULL},
+    {"/exec-and-query",
+     test_exec_and_query,
+     setup,
+     tear_down,
+     0,
+     test_params},
+    {"/query-large", test_query_large, setup, tear_down, 0, test_params},
+    {"/multi-thread", test_multi_thread, setup, tear_down, 0, test_params},
+    {"/metrics", test_metrics, setup, tear_down, 0, test_params},
+    {"/connect", test_connect, setup, tear_down, 0, test_params},
+    {"/direct", test_direct, setup, tear_down, 0, test_params},
+    {"/direct-large", test_direct_large, setup, tear_down, 0, test_params},
+    {"/direct-error", test_direct_error, setup, tear_down, 0, test_params},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
@@ -0,0 +1,243 @@
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../include/dqlite.h"
+#include "../src/log.h"
+
+#include "case.h"
+
+/******************************************************************************
+ *
+ * Helpers
+ *
+ ******************************************************************************/
+
+/* Logger recording the messages it receives. */
+struct sink {
+	dqlite_logger logger;
+	int           n;         /* Number of messages received */
+	int           level;     /* Level of the last message */
+	char          text[256]; /* Text of the last message */
+	int           block;     /* Whether to block on the first message */
+	sem_t         unblock;   /* Posted to resume a blocked sink */
+};
+
+static void __sink_logf(void *ctx, int level, const char *format, ...)
+{
+	struct sink *s = ctx;
+	va_list      args;
+
+	if (s->block && s->n == 0) {
+		sem_wait(&s->unblock);
+	}
+
+	va_start(args, format);
+	vsnprintf(s->text, sizeof s->text, format, args);
+	va_end(args);
+
+	s->level = level;
+	s->n++;
+}
+
+struct fixture {
+	struct sink        sink;
+	struct dqlite__log log;
+};
+
+/******************************************************************************
+ *
+ * Setup and tear down
+ *
+ ******************************************************************************/
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+	struct fixture *f;
+	int             err;
+
+	test_case_setup(params, user_data);
+
+	f = munit_malloc(sizeof *f);
+
+	f->sink.logger.ctx   = &f->sink;
+	f->sink.logger.xLogf = __sink_logf;
+	f->sink.n            = 0;
+	f->sink.level        = -1;
+	f->sink.text[0]      = 0;
+	f->sink.block        = 0;
+
+	err = sem_init(&f->sink.unblock, 0, 0);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__log_init(&f->log, &f->sink.logger);
+	munit_assert_int(err, ==, 0);
+
+	return f;
+}
+
+static void tear_down(void *data)
+{
+	struct fixture *f = data;
+
+	dqlite__log_close(&f->log);
+	sem_destroy(&f->sink.unblock);
+
+	test_case_tear_down(data);
+}
+
+/******************************************************************************
+ *
+ * dqlite__log_logf
+ *
+ ******************************************************************************/
+
+/* Before the drain thread is started, messages reach the sink right away. */
+static MunitResult test_logf_sync(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+
+	(void)params;
+
+	f->log.logger.xLogf(f->log.logger.ctx, DQLITE_LOG_INFO, "hello %d", 1);
+
+	munit_assert_int(f->sink.n, ==, 1);
+	munit_assert_int(f->sink.level, ==, DQLITE_LOG_INFO);
+	munit_assert_string_equal(f->sink.text, "hello 1");
+
+	return MUNIT_OK;
+}
+
+/* Messages queued while the drain thread runs are all handed to the sink, in
+ * order, by the time the thread is stopped. */
+static MunitResult test_logf_async(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	int             err;
+	int             i;
+
+	(void)params;
+
+	err = dqlite__log_start(&f->log);
+	munit_assert_int(err, ==, 0);
+
+	for (i = 0; i < 100; i++) {
+		f->log.logger.xLogf(
+		    f->log.logger.ctx, DQLITE_LOG_ERROR, "message %d", i);
+	}
+
+	dqlite__log_stop(&f->log);
+
+	munit_assert_int(f->sink.n, ==, 100);
+	munit_assert_int(f->sink.level, ==, DQLITE_LOG_ERROR);
+	munit_assert_string_equal(f->sink.text, "message 99");
+	munit_assert_int(f->log.dropped, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Messages finding the ring full are dropped and counted, instead of waiting
+ * for a slow sink. */
+static MunitResult test_logf_full(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	int             err;
+	int             i;
+
+	(void)params;
+
+	f->sink.block = 1;
+
+	err = dqlite__log_start(&f->log);
+	munit_assert_int(err, ==, 0);
+
+	/* The first slot is held until the sink returns. */
+	for (i = 0; i < DQLITE__LOG_RING_LEN + 1; i++) {
+		f->log.logger.xLogf(
+		    f->log.logger.ctx, DQLITE_LOG_INFO, "message %d", i);
+	}
+
+	munit_assert_int(f->log.dropped, ==, 1);
+
+	sem_post(&f->sink.unblock);
+
+	dqlite__log_stop(&f->log);
+
+	munit_assert_int(f->sink.n, ==, DQLITE__LOG_RING_LEN);
+
+	return MUNIT_OK;
+}
+
+static MunitTest logf_tests[] = {
+    {"/sync", test_logf_sync, setup, tear_down, 0, NULL},
+    {"/async", test_logf_async, setup, tear_down, 0, NULL},
+    {"/full", test_logf_full, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__log_site_enter
+ *
+ ******************************************************************************/
+
+static uint64_t __now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+	return (uint64_t)now.tv_sec;
+}
+
+/* A site logs at most a burst of messages per second. */
+static MunitResult test_site_burst(const MunitParameter params[], void *data)
+{
+	struct dqlite__log_site site = {0, 0};
+	uint64_t                throttled;
+	uint64_t                second;
+	int                     allowed[DQLITE__LOG_SITE_BURST + 1];
+	int                     i;
+
+	(void)params;
+	(void)data;
+
+	throttled = dqlite__log_throttled();
+	second    = __now();
+
+	for (i = 0; i < DQLITE__LOG_SITE_BURST + 1; i++) {
+		allowed[i] = dqlite__log_site_enter(&site);
+	}
+
+	/* The window might have moved forward in the meantime. */
+	if (__now() != second) {
+		return MUNIT_SKIP;
+	}
+
+	for (i = 0; i < DQLITE__LOG_SITE_BURST; i++) {
+		munit_assert_true(allowed[i]);
+	}
+	munit_assert_false(allowed[DQLITE__LOG_SITE_BURST]);
+
+	munit_assert_int(dqlite__log_throttled(), ==, throttled + 1);
+
+	return MUNIT_OK;
+}
+
+static MunitTest site_enter_tests[] = {
+    {"/burst", test_site_burst, NULL, NULL, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Test suite
+ *
+ ******************************************************************************/
+
+MunitSuite dqlite__log_suites[] = {
+    {"_logf", logf_tests, NULL, 1, 0},
+    {"_site_enter", site_enter_tests, NULL, 1, 0},
+    {NULL, NULL, NULL, 0, 0},
+};
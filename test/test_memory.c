@@ -0,0 +1,182 @@
+#include <sqlite3.h>
+
+#include "../src/memory.h"
+
+#include "case.h"
+
+/******************************************************************************
+ *
+ * Helpers
+ *
+ ******************************************************************************/
+
+struct fixture {
+	struct dqlite__memory memory;
+	void *                chunk; /* Accounted for by SQLite */
+};
+
+/******************************************************************************
+ *
+ * Setup and tear down
+ *
+ ******************************************************************************/
+
+static void *setup(const MunitParameter params[], void *user_data)
+{
+	struct fixture *f;
+
+	test_case_setup(params, user_data);
+
+	f = munit_malloc(sizeof *f);
+
+	dqlite__memory_init(&f->memory, 0);
+
+	f->chunk = sqlite3_malloc(4096);
+	munit_assert_ptr_not_null(f->chunk);
+
+	return f;
+}
+
+static void tear_down(void *data)
+{
+	struct fixture *f = data;
+
+	sqlite3_free(f->chunk);
+
+	test_case_tear_down(data);
+}
+
+/******************************************************************************
+ *
+ * dqlite__memory_next
+ *
+ ******************************************************************************/
+
+/* Without a budget nothing is ever shed, but usage is still sampled. */
+static MunitResult test_next_no_budget(const MunitParameter params[],
+                                       void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__memory *m = &f->memory;
+
+	(void)params;
+
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+	munit_assert_int(m->used, >=, 4096);
+	munit_assert_int(m->sheds, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Under the high water mark of the budget nothing is shed. */
+static MunitResult test_next_under(const MunitParameter params[], void *data)
+{
+	struct fixture *       f = data;
+	struct dqlite__memory *m = &f->memory;
+
+	(void)params;
+
+	m->budget = (uint64_t)sqlite3_memory_used() * 2;
+
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+	munit_assert_int(m->sheds, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Past the high water mark all steps are returned in order, once per round. */
+static MunitResult test_next_over(const MunitParameter params[], void *data)
+{
+	struct fixture *       f = data;
+	struct dqlite__memory *m = &f->memory;
+
+	(void)params;
+
+	m->budget = 1;
+
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_TRIM);
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_RELEASE);
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_SHRINK);
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_EVICT);
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+
+	munit_assert_int(m->sheds, ==, DQLITE__MEMORY_STEPS);
+
+	return MUNIT_OK;
+}
+
+/* After a full round, a new one starts only once usage has grown. */
+static MunitResult test_next_settled(const MunitParameter params[],
+                                     void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__memory *m = &f->memory;
+	void *                 chunk;
+	int                    i;
+
+	(void)params;
+
+	m->budget = 1;
+
+	for (i = 0; i < DQLITE__MEMORY_STEPS; i++) {
+		munit_assert_int(dqlite__memory_next(m), ==, i);
+	}
+
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+
+	munit_assert_int(m->sheds, ==, DQLITE__MEMORY_STEPS);
+
+	chunk = sqlite3_malloc(4096);
+	munit_assert_ptr_not_null(chunk);
+
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_TRIM);
+
+	sqlite3_free(chunk);
+
+	return MUNIT_OK;
+}
+
+/* Getting back under the high water mark ends the round. */
+static MunitResult test_next_recover(const MunitParameter params[],
+                                     void *               data)
+{
+	struct fixture *       f = data;
+	struct dqlite__memory *m = &f->memory;
+
+	(void)params;
+
+	m->budget = 1;
+
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_TRIM);
+
+	m->budget = (uint64_t)sqlite3_memory_used() * 2;
+
+	munit_assert_int(dqlite__memory_next(m), ==, -1);
+
+	m->budget = 1;
+
+	munit_assert_int(dqlite__memory_next(m), ==, DQLITE__MEMORY_TRIM);
+
+	return MUNIT_OK;
+}
+
+static MunitTest next_tests[] = {
+    {"/no-budget", test_next_no_budget, setup, tear_down, 0, NULL},
+    {"/under", test_next_under, setup, tear_down, 0, NULL},
+    {"/over", test_next_over, setup, tear_down, 0, NULL},
+    {"/settled", test_next_settled, setup, tear_down, 0, NULL},
+    {"/recover", test_next_recover, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Test suite
+ *
+ ******************************************************************************/
+
+MunitSuite dqlite__memory_suites[] = {
+    {"_next", next_tests, NULL, 1, 0},
+    {NULL, NULL, NULL, 0, 0},
+};
@@ -26,6 +26,9 @@ static void *setup(const MunitParameter params[], void *user_data) {
 	message = munit_malloc(sizeof *message);
 	dqlite__message_init(message);
 
+	/* Tests fill the static body buffer directly. */
+	munit_assert_int(dqlite__message_body_borrow(message), ==, 0);
+
 	return message;
 }
 
@@ -98,7 +101,8 @@ static MunitResult test_header_recv_done_empty_body(
 	(void)params;
 
 	munit_assert_int(err, ==, DQLITE_PROTO);
-	munit_assert_string_equal(message->error, "empty message body");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "empty message body");
 
 	return MUNIT_OK;
 }
@@ -125,7 +129,8 @@ static MunitResult test_header_recv_done_body_too_big(
 	err = dqlite__message_header_recv_done(message);
 
 	munit_assert_int(err, ==, DQLITE_PROTO);
-	munit_assert_string_equal(message->error, "message body too large");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "message body too large");
 
 	return MUNIT_OK;
 }
@@ -226,7 +231,8 @@ static MunitResult test_body_get_text_misaligned(const MunitParameter params[],
 	err = dqlite__message_body_get_text(message, &text);
 	munit_assert_int(err, ==, DQLITE_PARSE);
 
-	munit_assert_string_equal(message->error, "misaligned read");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "misaligned read");
 
 	return MUNIT_OK;
 }
@@ -249,7 +255,8 @@ static MunitResult test_body_get_text_not_found(const MunitParameter params[],
 
 	munit_assert_int(err, ==, DQLITE_PARSE);
 
-	munit_assert_string_equal(message->error, "no string found");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "no string found");
 
 	return MUNIT_OK;
 }
@@ -455,7 +462,8 @@ static MunitResult test_body_get_uint32_misaligned(
 	err = dqlite__message_body_get_uint32(message, &value2);
 	munit_assert_int(err, ==, DQLITE_PARSE);
 
-	munit_assert_string_equal(message->error, "misaligned read");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "misaligned read");
 
 	return MUNIT_OK;
 }
@@ -561,7 +569,8 @@ static MunitResult test_body_get_uint64_misaligned(
 	err = dqlite__message_body_get_uint64(message, &value2);
 	munit_assert_int(err, ==, DQLITE_PARSE);
 
-	munit_assert_string_equal(message->error, "misaligned read");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "misaligned read");
 
 	return MUNIT_OK;
 }
@@ -880,7 +889,8 @@ static MunitResult test_body_put_text_misaligned(const MunitParameter params[],
 	err = dqlite__message_body_put_text(message, "hello");
 	munit_assert_int(err, ==, DQLITE_PROTO);
 
-	munit_assert_string_equal(message->error, "misaligned write");
+	munit_assert_string_equal(dqlite__error_msg(&message->error),
+	                          "misaligned write");
 
 	return MUNIT_OK;
 }
@@ -1143,6 +1153,67 @@ static MunitResult test_body_put_servers_one(const MunitParameter params[],
 	return MUNIT_OK;
 }
 
+static MunitResult test_body_reserve_one(const MunitParameter params[],
+                                         void *               data) {
+	struct dqlite__message *message = data;
+	int                     err;
+	char *                  span;
+	uint64_t                value;
+
+	(void)params;
+
+	err = dqlite__message_body_reserve(message, 16, &span);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_equal(span, message->body1);
+	munit_assert_int(message->offset1, ==, 0);
+
+	value = dqlite__flip64(1);
+	memcpy(span, &value, sizeof value);
+	value = dqlite__flip64(2);
+	memcpy(span + 8, &value, sizeof value);
+
+	dqlite__message_body_commit(message, 16);
+
+	munit_assert_int(message->offset1, ==, 16);
+
+	munit_assert_int(dqlite__flip64(*(uint64_t *)(message->body1)), ==, 1);
+	munit_assert_int(
+	    dqlite__flip64(*(uint64_t *)(message->body1 + 8)), ==, 2);
+
+	return MUNIT_OK;
+}
+
+/* A span that doesn't fit in the static buffer is reserved in the dynamic
+ * one. */
+static MunitResult test_body_reserve_dyn_buf(const MunitParameter params[],
+                                             void *               data) {
+	struct dqlite__message *message = data;
+	int                     err;
+	char *                  span;
+	uint64_t                i;
+
+	(void)params;
+
+	for (i = 0; i < 4096 / 8 - 1; i++) {
+		err = dqlite__message_body_put_uint64(message, i);
+		munit_assert_int(err, ==, 0);
+	}
+
+	err = dqlite__message_body_reserve(message, 16, &span);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_ptr_equal(span, message->body2.base);
+
+	memset(span, 0, 16);
+	dqlite__message_body_commit(message, 16);
+
+	munit_assert_int(message->offset1, ==, 4088);
+	munit_assert_int(message->offset2, ==, 16);
+
+	return MUNIT_OK;
+}
+
 static MunitTest body_put_tests[] = {
     {"_text/misaligned",
      test_body_put_text_misaligned,
@@ -1166,6 +1237,8 @@ static MunitTest body_put_tests[] = {
     {"_double/one", test_body_put_double_one, setup, tear_down, 0, NULL},
     {"_uint64/dyn-buf", test_body_put_dyn_buf, setup, tear_down, 0, NULL},
     {"_servers/one", test_body_put_servers_one, setup, tear_down, 0, NULL},
+    {"_reserve/one", test_body_reserve_one, setup, tear_down, 0, NULL},
+    {"_reserve/dyn-buf", test_body_reserve_dyn_buf, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL}};
 
 /******************************************************************************
@@ -1178,7 +1251,7 @@ static MunitResult test_send_start_no_dyn_buf(const MunitParameter params[],
                                               void *               data) {
 	struct dqlite__message *message = data;
 	int                     err;
-	uv_buf_t                bufs[3];
+	uv_buf_t                bufs[DQLITE__MESSAGE_MAX_BUFS];
 	struct dqlite__message  message2;
 	uv_buf_t                buf;
 	uint64_t                value;
@@ -1244,7 +1317,7 @@ static MunitResult test_send_start_dyn_buf(const MunitParameter params[],
 	struct dqlite__message *message = data;
 	int                     err;
 	uint64_t                i;
-	uv_buf_t                bufs[3];
+	uv_buf_t                bufs[DQLITE__MESSAGE_MAX_BUFS];
 	struct dqlite__message  message2;
 	uv_buf_t                buf;
 	uint64_t                value;
@@ -1313,9 +1386,306 @@ static MunitResult test_send_start_dyn_buf(const MunitParameter params[],
 	return MUNIT_OK;
 }
 
+/* Text values referenced by the message are sent from their own memory,
+ * padded with zeros, in between the surrounding body bytes. */
+static MunitResult test_send_start_external(const MunitParameter params[],
+                                            void *               data) {
+	struct dqlite__message *message = data;
+	int                     err;
+	uv_buf_t                bufs[DQLITE__MESSAGE_MAX_BUFS];
+	unsigned                n;
+	unsigned                i;
+	struct dqlite__message  message2;
+	uv_buf_t                buf;
+	size_t                  offset;
+	uint64_t                value;
+	text_t                  text;
+
+	(void)params;
+
+	dqlite__message_header_put(message, 9, 123);
+
+	err = dqlite__message_body_put_uint64(message, 78);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__message_body_put_text_ref(message, "hello", 5);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__message_body_put_uint64(message, 79);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_true(dqlite__message_has_external(message));
+
+	n = dqlite__message_send_start(message, bufs);
+	munit_assert_int(n, ==, 5);
+
+	munit_assert_ptr_equal(bufs[1].base, message->body1);
+	munit_assert_int(bufs[1].len, ==, 8);
+
+	munit_assert_string_equal(bufs[2].base, "hello");
+	munit_assert_int(bufs[2].len, ==, 5);
+
+	munit_assert_int(bufs[3].len, ==, 3);
+
+	munit_assert_ptr_equal(bufs[4].base, message->body1 + 8);
+	munit_assert_int(bufs[4].len, ==, 8);
+
+	dqlite__message_init(&message2);
+
+	dqlite__message_header_recv_start(&message2, &buf);
+	memcpy(buf.base, bufs[0].base, bufs[0].len);
+
+	err = dqlite__message_header_recv_done(&message2);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite__message_body_recv_start(&message2, &buf);
+	munit_assert_int(err, ==, 0);
+	munit_assert_int(buf.len, ==, 24);
+
+	for (i = 1, offset = 0; i < n; i++) {
+		memcpy(buf.base + offset, bufs[i].base, bufs[i].len);
+		offset += bufs[i].len;
+	}
+
+	err = dqlite__message_body_get_uint64(&message2, &value);
+	munit_assert_int(err, ==, 0);
+	munit_assert_int(value, ==, 78);
+
+	err = dqlite__message_body_get_text(&message2, &text);
+	munit_assert_int(err, ==, 0);
+	munit_assert_string_equal(text, "hello");
+
+	err = dqlite__message_body_get_uint64(&message2, &value);
+	munit_assert_int(err, ==, DQLITE_EOM);
+	munit_assert_int(value, ==, 79);
+
+	dqlite__message_recv_reset(&message2);
+	dqlite__message_send_reset(message);
+
+	munit_assert_false(dqlite__message_has_external(message));
+
+	dqlite__message_close(&message2);
+
+	return MUNIT_OK;
+}
+
 static MunitTest send_start_tests[] = {
     {"/no-dyn-buf", test_send_start_no_dyn_buf, setup, tear_down, 0, NULL},
     {"/dyn-buf", test_send_start_dyn_buf, setup, tear_down, 0, NULL},
+    {"/external", test_send_start_external, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__message_pool
+ *
+ ******************************************************************************/
+
+/* Receive a one word body, then reset the message. */
+static void __recv_one_word(struct dqlite__message *message) {
+	int      err;
+	uv_buf_t buf;
+
+	message->words = 1;
+
+	err = dqlite__message_body_recv_start(message, &buf);
+	munit_assert_int(err, ==, 0);
+	munit_assert_ptr_equal(buf.base, message->body1);
+
+	dqlite__message_recv_reset(message);
+}
+
+/* Idle messages hold no body buffer. */
+static MunitResult test_pool_idle(const MunitParameter params[], void *data) {
+	struct dqlite__message message;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_init(&message);
+
+	munit_assert_ptr_null(message.body1);
+
+	dqlite__message_close(&message);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+/* Buffers are handed back to the pool on reset and reused by the next
+ * message. */
+static MunitResult test_pool_recycle(const MunitParameter params[],
+                                     void *               data) {
+	struct dqlite__message_pool pool;
+	struct dqlite__message      message1;
+	struct dqlite__message      message2;
+	char *                      buf;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_pool_init(&pool, 1);
+	dqlite__message_init(&message1);
+	dqlite__message_init(&message2);
+
+	message1.pool = &pool;
+	message2.pool = &pool;
+
+	__recv_one_word(&message1);
+
+	munit_assert_ptr_null(message1.body1);
+	munit_assert_int(pool.len, ==, 1);
+
+	buf = pool.bufs[0];
+
+	munit_assert_int(dqlite__message_body_put_uint64(&message2, 1), ==, 0);
+	munit_assert_ptr_equal(message2.body1, buf);
+	munit_assert_int(pool.len, ==, 0);
+
+	dqlite__message_close(&message1);
+	dqlite__message_close(&message2);
+
+	munit_assert_int(pool.len, ==, 1);
+
+	dqlite__message_pool_close(&pool);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+/* Buffers exceeding the pool capacity are freed. */
+static MunitResult test_pool_full(const MunitParameter params[], void *data) {
+	struct dqlite__message_pool pool;
+	struct dqlite__message      message;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_pool_init(&pool, 0);
+	dqlite__message_init(&message);
+
+	message.pool = &pool;
+
+	__recv_one_word(&message);
+
+	munit_assert_int(pool.len, ==, 0);
+
+	dqlite__message_close(&message);
+	dqlite__message_pool_close(&pool);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+static MunitTest pool_tests[] = {
+    {"/idle", test_pool_idle, NULL, NULL, 0, NULL},
+    {"/recycle", test_pool_recycle, NULL, NULL, 0, NULL},
+    {"/full", test_pool_full, NULL, NULL, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__message_arena_alloc
+ *
+ ******************************************************************************/
+
+/* Small allocations are carved out of the inline arena of the message, keeping
+ * word alignment. */
+static MunitResult test_arena_alloc_block(const MunitParameter params[],
+                                          void *               data) {
+	struct dqlite__message message;
+	char *                 p1;
+	char *                 p2;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_init(&message);
+
+	p1 = dqlite__message_arena_alloc(&message, 3);
+	p2 = dqlite__message_arena_alloc(&message, 16);
+
+	munit_assert_ptr_not_null(p1);
+	munit_assert_ptr_equal(p1, message.arena);
+	munit_assert_ptr_equal(p2, p1 + 8);
+	munit_assert_int(message.arena_offset, ==, 24);
+	munit_assert_ptr_null(message.arena_extra);
+
+	/* Resetting the arena rewinds it. */
+	dqlite__message_arena_reset(&message);
+
+	munit_assert_int(message.arena_offset, ==, 0);
+	munit_assert_ptr_equal(dqlite__message_arena_alloc(&message, 8), p1);
+
+	dqlite__message_close(&message);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+/* Allocations not fitting in the arena fall back to the heap, and are freed
+ * when the arena is reset. */
+static MunitResult test_arena_alloc_extra(const MunitParameter params[],
+                                          void *               data) {
+	struct dqlite__message message;
+	char *                 p;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_init(&message);
+
+	p = dqlite__message_arena_alloc(&message,
+	                                DQLITE__MESSAGE_ARENA_LEN + 1);
+
+	munit_assert_ptr_not_null(p);
+	munit_assert_int(message.arena_offset, ==, 0);
+	munit_assert_ptr_not_null(message.arena_extra);
+
+	memset(p, 0, DQLITE__MESSAGE_ARENA_LEN + 1);
+
+	dqlite__message_arena_reset(&message);
+
+	munit_assert_ptr_null(message.arena_extra);
+
+	dqlite__message_close(&message);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+/* Closing a message releases the memory of its arena. */
+static MunitResult test_arena_alloc_close(const MunitParameter params[],
+                                          void *               data) {
+	struct dqlite__message message;
+
+	(void)params;
+	(void)data;
+
+	dqlite__message_init(&message);
+
+	munit_assert_ptr_not_null(dqlite__message_arena_alloc(&message, 8));
+	munit_assert_ptr_not_null(
+	    dqlite__message_arena_alloc(&message, DQLITE__MESSAGE_ARENA_LEN));
+
+	dqlite__message_close(&message);
+
+	test_assert_no_leaks();
+
+	return MUNIT_OK;
+}
+
+static MunitTest arena_alloc_tests[] = {
+    {"/block", test_arena_alloc_block, NULL, NULL, 0, NULL},
+    {"/extra", test_arena_alloc_extra, NULL, NULL, 0, NULL},
+    {"/close", test_arena_alloc_close, NULL, NULL, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
@@ -1333,5 +1703,7 @@ MunitSuite dqlite__message_suites[] = {
     {"_header_put", header_put_tests, NULL, 1, 0},
     {"_body_put", body_put_tests, NULL, 1, 0},
     {"_send_start", send_start_tests, NULL, 1, 0},
+    {"_pool", pool_tests, NULL, 1, 0},
+    {"_arena_alloc", arena_alloc_tests, NULL, 1, 0},
     {NULL, NULL, NULL, 0, 0},
 };
@@ -92,7 +92,13 @@ static MunitResult test_push(const MunitParameter params[], void *data)
 	                  test_cluster(),
 	                  &f->loop,
 	                  &f->options,
-	                  &f->metrics);
+	                  &f->metrics,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL);
 
 	err = dqlite__queue_item_init(&item, &conn);
 	munit_assert_int(err, ==, 0);
@@ -136,7 +142,13 @@ static MunitResult test_process(const MunitParameter params[], void *data)
 	                  test_cluster(),
 	                  &f->loop,
 	                  &f->options,
-	                  &f->metrics);
+	                  &f->metrics,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL,
+	                  NULL);
 
 	err = dqlite__queue_item_init(&item, conn);
 	munit_assert_int(err, ==, 0);
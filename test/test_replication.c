@@ -182,6 +182,76 @@ static MunitTest concurrency_tests[] = {
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
+/******************************************************************************
+ *
+ * Chunks
+ *
+ ******************************************************************************/
+
+static int test_chunks_done;
+
+static void test_chunks_coroutine()
+{
+	struct fixture *f = test_coroutine_arg;
+
+	__db_exec(f->db1,
+	          "BEGIN; CREATE TABLE test (b BLOB); "
+	          "INSERT INTO test VALUES(randomblob(4096)); COMMIT");
+
+	test_chunks_done = 1;
+	co_switch(f->ctx.main_coroutine);
+}
+
+/* A large transaction is shipped in bounded chunks, with the begin flag set
+ * only on the first one and the commit flag only on the last one. */
+static MunitResult test_chunks_split(const MunitParameter params[],
+                                     void *               data)
+{
+	struct fixture *                  f     = data;
+	struct dqlite__replication_chunk *chunk = &f->ctx.chunk;
+	cothread_t *                      coroutine;
+	int                               n = 0;
+
+	(void)params;
+
+	coroutine = co_create(1024 * 1024, test_chunks_coroutine);
+
+	f->ctx.chunk_frames = 2;
+
+	test_coroutine_arg = f;
+	test_chunks_done   = 0;
+
+	while (1) {
+		co_switch(coroutine);
+		if (test_chunks_done) {
+			break;
+		}
+
+		munit_assert_int(chunk->type, ==, DQLITE__REPLICATION_FRAMES);
+		munit_assert_int(chunk->n, <=, 2);
+		munit_assert_int(chunk->begin, ==, n == 0);
+
+		if (chunk->commit) {
+			munit_assert_int(chunk->truncate, >, 0);
+		}
+
+		n++;
+	}
+
+	/* The blob alone spans more than 8 pages of 512 bytes. */
+	munit_assert_int(n, >, 4);
+	munit_assert_true(chunk->commit);
+
+	co_delete(coroutine);
+
+	return MUNIT_OK;
+}
+
+static MunitTest chunks_tests[] = {
+    {"/split", test_chunks_split, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
 /******************************************************************************
  *
  * Test suite
@@ -190,6 +260,7 @@ static MunitTest concurrency_tests[] = {
 
 MunitSuite dqlite__replication_suites[] = {
     {"/concurrency", concurrency_tests, NULL, 1, 0},
+    {"/chunks", chunks_tests, NULL, 1, 0},
     {NULL, NULL, NULL, 0, 0},
 };
 
@@ -104,11 +104,32 @@ static MunitResult test_open(const MunitParameter params[], void *data) {
 	return MUNIT_OK;
 }
 
+static MunitResult test_connect(const MunitParameter params[], void *data) {
+	struct dqlite__request *request = data;
+	int                     err;
+
+	(void)params;
+
+	test_message_send_connect(
+	    123, "test.db", 6, "volatile", &request->message);
+
+	err = dqlite__request_decode(request);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(request->connect.id, ==, 123);
+	munit_assert_string_equal(request->connect.name, "test.db");
+	munit_assert_int(request->connect.flags, ==, 6);
+	munit_assert_string_equal(request->connect.vfs, "volatile");
+
+	return MUNIT_OK;
+}
+
 static MunitTest dqlite__request_decode_tests[] = {
     {"/leader", test_leader, setup, tear_down, 0, NULL},
     {"/client", test_client, setup, tear_down, 0, NULL},
     {"/heartbeat", test_heartbeat, setup, tear_down, 0, NULL},
     {"/open", test_open, setup, tear_down, 0, NULL},
+    {"/connect", test_connect, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
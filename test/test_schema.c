@@ -54,6 +54,9 @@ static void *setup(const MunitParameter params[], void *user_data) {
 
 	test_handler_init(handler);
 
+	/* Tests fill the static body buffer directly. */
+	munit_assert_int(dqlite__message_body_borrow(&handler->message), ==, 0);
+
 	return handler;
 }
 
@@ -129,7 +132,8 @@ static MunitResult test_encode_unknown_type(const MunitParameter params[],
 	err = test_handler_encode(handler);
 	munit_assert_int(err, ==, DQLITE_PROTO);
 
-	munit_assert_string_equal(handler->error, "unknown message type 255");
+	munit_assert_string_equal(dqlite__error_msg(&handler->error),
+	                          "unknown message type 255");
 
 	return MUNIT_OK;
 }
@@ -167,7 +171,7 @@ static MunitResult test_decode_invalid_text(const MunitParameter params[],
 	err = test_handler_decode(handler);
 	munit_assert_int(err, ==, DQLITE_PARSE);
 
-	munit_assert_string_equal(handler->error,
+	munit_assert_string_equal(dqlite__error_msg(&handler->error),
 	                          "failed to decode 'foo': failed to get "
 	                          "'name' field: no string found");
 
@@ -187,7 +191,8 @@ static MunitResult test_decode_unknown_type(const MunitParameter params[],
 	err = test_handler_decode(handler);
 	munit_assert_int(err, ==, DQLITE_PROTO);
 
-	munit_assert_string_equal(handler->error, "unknown message type 255");
+	munit_assert_string_equal(dqlite__error_msg(&handler->error),
+	                          "unknown message type 255");
 
 	return MUNIT_OK;
 }
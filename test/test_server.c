@@ -1,5 +1,10 @@
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
 
 #include <sqlite3.h>
 
@@ -103,6 +108,133 @@ static MunitResult test_config_checkpoint_threshold(const MunitParameter params[
 	return MUNIT_OK;
 }
 
+/* The WAL hard limit must be above the checkpoint threshold. */
+static MunitResult test_config_wal_hard_limit(const MunitParameter params[],
+                                              void *               data) {
+	dqlite_server *server    = data;
+	uint32_t       threshold = 100;
+	uint32_t       limit     = 100;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(
+	    server, DQLITE_CONFIG_CHECKPOINT_THRESHOLD, &threshold);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_WAL_HARD_LIMIT, &limit);
+	munit_assert_int(err, ==, DQLITE_ERROR);
+	munit_assert_string_equal(dqlite_server_errmsg(server),
+	                          "WAL hard limit not above checkpoint threshold");
+
+	limit = 101;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_WAL_HARD_LIMIT, &limit);
+	munit_assert_int(err, ==, 0);
+
+	threshold = 101;
+
+	err = dqlite_server_config(
+	    server, DQLITE_CONFIG_CHECKPOINT_THRESHOLD, &threshold);
+	munit_assert_int(err, ==, DQLITE_ERROR);
+	munit_assert_string_equal(dqlite_server_errmsg(server),
+	                          "checkpoint threshold not below WAL hard limit");
+
+	return MUNIT_OK;
+}
+
+static MunitResult test_config_db_pool_size(const MunitParameter params[],
+                                            void *               data) {
+	dqlite_server *server = data;
+	uint32_t       size   = 8;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_DB_POOL_SIZE, &size);
+	munit_assert_int(err, ==, 0);
+
+	return MUNIT_OK;
+}
+
+static MunitResult test_config_maintenance_interval(
+    const MunitParameter params[],
+    void *               data) {
+	dqlite_server *server   = data;
+	uint32_t       interval = 100;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(
+	    server, DQLITE_CONFIG_MAINTENANCE_INTERVAL, &interval);
+	munit_assert_int(err, ==, 0);
+
+	return MUNIT_OK;
+}
+
+static MunitResult test_config_io_backend(const MunitParameter params[],
+                                          void *               data) {
+	dqlite_server *server  = data;
+	uint8_t        backend = DQLITE_IO_LIBUV;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_IO_BACKEND, &backend);
+	munit_assert_int(err, ==, 0);
+
+	backend = DQLITE_IO_URING;
+	err = dqlite_server_config(server, DQLITE_CONFIG_IO_BACKEND, &backend);
+#ifdef DQLITE_URING
+	munit_assert_int(err, ==, 0);
+#else
+	munit_assert_int(err, ==, DQLITE_ERROR);
+#endif /* DQLITE_URING */
+
+	backend = 123;
+	err = dqlite_server_config(server, DQLITE_CONFIG_IO_BACKEND, &backend);
+	munit_assert_int(err, ==, DQLITE_ERROR);
+
+	return MUNIT_OK;
+}
+
+static MunitResult test_config_busy_poll(const MunitParameter params[],
+                                        void *               data) {
+	dqlite_server *server = data;
+	uint32_t       usecs  = 50;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_BUSY_POLL, &usecs);
+	munit_assert_int(err, ==, 0);
+
+	return MUNIT_OK;
+}
+
+static MunitResult test_config_cpu_affinity(const MunitParameter params[],
+                                           void *               data) {
+	dqlite_server *server = data;
+	int            cpu    = 0;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_CPU_AFFINITY, &cpu);
+	munit_assert_int(err, ==, 0);
+
+	cpu = -1;
+	err = dqlite_server_config(server, DQLITE_CONFIG_CPU_AFFINITY, &cpu);
+	munit_assert_int(err, ==, 0);
+
+	cpu = -2;
+	err = dqlite_server_config(server, DQLITE_CONFIG_CPU_AFFINITY, &cpu);
+	munit_assert_int(err, ==, DQLITE_ERROR);
+
+	return MUNIT_OK;
+}
+
 static MunitTest dqlite_server_config_tests[] = {
     {"/logger", test_config_logger, setup, tear_down, 0, NULL},
     {"/heartbeat-timeout", test_config_heartbeat_timeout, setup, tear_down, 0, NULL},
@@ -113,6 +245,114 @@ static MunitTest dqlite_server_config_tests[] = {
      tear_down,
      0,
      NULL},
+    {"/wal-hard-limit", test_config_wal_hard_limit, setup, tear_down, 0, NULL},
+    {"/db-pool-size", test_config_db_pool_size, setup, tear_down, 0, NULL},
+    {"/maintenance-interval",
+     test_config_maintenance_interval,
+     setup,
+     tear_down,
+     0,
+     NULL},
+    {"/io-backend", test_config_io_backend, setup, tear_down, 0, NULL},
+    {"/busy-poll", test_config_busy_poll, setup, tear_down, 0, NULL},
+    {"/cpu-affinity", test_config_cpu_affinity, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * Tests dqlite_server_run
+ *
+ ******************************************************************************/
+
+/* If the server fails to start after some loop handles were initialized, they
+ * get closed before returning. */
+static MunitResult test_run_error(const MunitParameter params[], void *data) {
+	dqlite_server *server  = data;
+	uint8_t        backend = DQLITE_IO_URING;
+	int            cpu     = CPU_SETSIZE - 1;
+	int            err;
+
+	(void)params;
+
+	if (cpu < sysconf(_SC_NPROCESSORS_CONF)) {
+		return MUNIT_SKIP;
+	}
+
+#ifdef DQLITE_URING
+	err = dqlite_server_config(server, DQLITE_CONFIG_IO_BACKEND, &backend);
+	munit_assert_int(err, ==, 0);
+#else
+	(void)backend;
+#endif /* DQLITE_URING */
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_CPU_AFFINITY, &cpu);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite_server_run(server);
+	munit_assert_int(err, ==, DQLITE_ERROR);
+
+	munit_assert_string_equal(dqlite_server_errmsg(server),
+	                          "failed to pin loop to CPU 1023: "
+	                          "Invalid argument");
+
+	return MUNIT_OK;
+}
+
+/* Run the given server in the calling thread. */
+static void *__run(void *arg) {
+	dqlite_server *server = arg;
+
+	return (void *)(intptr_t)dqlite_server_run(server);
+}
+
+/* Time spent busy polling without serving requests is accounted as
+ * spinning. */
+static MunitResult test_run_busy_poll(const MunitParameter params[],
+                                      void *               data) {
+	dqlite_server *server  = data;
+	uint8_t        enabled = 1;
+	uint32_t       usecs   = 1000;
+	dqlite_metrics metrics;
+	pthread_t      thread;
+	void *         retval;
+	char *         errmsg;
+	int            err;
+
+	(void)params;
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_METRICS, &enabled);
+	munit_assert_int(err, ==, 0);
+
+	err = dqlite_server_config(server, DQLITE_CONFIG_BUSY_POLL, &usecs);
+	munit_assert_int(err, ==, 0);
+
+	err = pthread_create(&thread, NULL, __run, server);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_true(dqlite_server_ready(server));
+
+	usleep(10 * 1000);
+
+	err = dqlite_server_metrics(server, &metrics);
+	munit_assert_int(err, ==, 0);
+
+	munit_assert_int(metrics.spin_duration, >, 0);
+	munit_assert_int(metrics.work_duration, ==, 0);
+
+	err = dqlite_server_stop(server, &errmsg);
+	munit_assert_int(err, ==, 0);
+
+	err = pthread_join(thread, &retval);
+	munit_assert_int(err, ==, 0);
+	munit_assert_ptr_null(retval);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite_server_run_tests[] = {
+    {"/error", test_run_error, setup, tear_down, 0, NULL},
+    {"/busy-poll", test_run_busy_poll, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
@@ -124,5 +364,6 @@ static MunitTest dqlite_server_config_tests[] = {
 
 MunitSuite dqlite__server_suites[] = {
     {"_config", dqlite_server_config_tests, NULL, 1, MUNIT_SUITE_OPTION_NONE},
+    {"_run", dqlite_server_run_tests, NULL, 1, MUNIT_SUITE_OPTION_NONE},
     {NULL, NULL, NULL, 0, 0},
 };
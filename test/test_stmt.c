@@ -79,6 +79,9 @@ static void *setup(const MunitParameter params[], void *user_data)
 	f->message = munit_malloc(sizeof *f->message);
 	dqlite__message_init(f->message);
 
+	rc = dqlite__message_body_borrow(f->message);
+	munit_assert_int(rc, ==, 0);
+
 	return f;
 }
 
@@ -139,7 +142,8 @@ static MunitResult test_bind_missing_types(const MunitParameter params[],
 	rc = dqlite__stmt_bind(f->stmt, f->message);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(f->stmt->error, "incomplete param types");
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
+	                          "incomplete param types");
 
 	return MUNIT_OK;
 }
@@ -165,7 +169,8 @@ static MunitResult test_bind_no_params(const MunitParameter params[],
 	rc = dqlite__stmt_bind(f->stmt, f->message);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(f->stmt->error, "incomplete param values");
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
+	                          "incomplete param values");
 
 	return MUNIT_OK;
 }
@@ -193,7 +198,8 @@ static MunitResult test_bind_missing_params(const MunitParameter params[],
 	rc = dqlite__stmt_bind(f->stmt, f->message);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(f->stmt->error, "incomplete param values");
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
+	                          "incomplete param values");
 
 	return MUNIT_OK;
 }
@@ -216,7 +222,7 @@ static MunitResult test_bind_bad_type(const MunitParameter params[], void *data)
 	rc = dqlite__stmt_bind(f->stmt, f->message);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(f->stmt->error,
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
 	                          "invalid param 1: unknown type 127");
 
 	return MUNIT_OK;
@@ -242,7 +248,8 @@ static MunitResult test_bind_bad_param(const MunitParameter params[],
 	rc = dqlite__stmt_bind(f->stmt, f->message);
 	munit_assert_int(rc, ==, SQLITE_RANGE);
 
-	munit_assert_string_equal(f->stmt->error, "column index out of range");
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
+	                          "column index out of range");
 
 	return MUNIT_OK;
 }
@@ -414,10 +421,10 @@ static MunitResult test_query_no_columns(const MunitParameter params[],
 	/* This statement yields no columns. */
 	__prepare(f, "DELETE FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_ERROR);
 
-	munit_assert_string_equal(f->stmt->error,
+	munit_assert_string_equal(dqlite__error_msg(&f->stmt->error),
 	                          "stmt doesn't yield any column");
 
 	return MUNIT_OK;
@@ -435,7 +442,7 @@ static MunitResult test_query_none(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT name FROM sqlite_master");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -468,7 +475,7 @@ static MunitResult test_query_integer(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT n FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -503,7 +510,7 @@ static MunitResult test_query_float(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT f FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -539,7 +546,7 @@ static MunitResult test_query_null(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -574,7 +581,7 @@ static MunitResult test_query_text(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -611,7 +618,7 @@ static MunitResult test_query_unixtime(const MunitParameter params[],
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -650,7 +657,7 @@ static MunitResult test_query_iso8601(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -686,7 +693,7 @@ static MunitResult test_query_iso8601_null(const MunitParameter params[],
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -722,7 +729,7 @@ static MunitResult test_query_iso8601_empty(const MunitParameter params[],
 
 	__prepare(f, "SELECT t FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -757,7 +764,7 @@ static MunitResult test_query_boolean(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT b FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -794,7 +801,7 @@ static MunitResult test_query_two_simple(const MunitParameter params[],
 
 	__prepare(f, "SELECT n FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -831,7 +838,7 @@ static MunitResult test_query_two_complex(const MunitParameter params[],
 
 	__prepare(f, "SELECT n, t, f FROM test");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -891,7 +898,7 @@ static MunitResult test_query_count(const MunitParameter params[], void *data)
 
 	__prepare(f, "SELECT COUNT(name) FROM sqlite_master");
 
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_DONE);
 
 	/* The first word written is the column count. */
@@ -932,7 +939,7 @@ static MunitResult test_query_large(const MunitParameter params[], void *data)
 
 	/* The return code is SQLITE_ROW, to indicate that not all rows were
 	 * fetched. */
-	rc = dqlite__stmt_query(f->stmt, f->message);
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
 	munit_assert_int(rc, ==, SQLITE_ROW);
 
 	/* The first word written is the column count. */
@@ -952,6 +959,68 @@ static MunitResult test_query_large(const MunitParameter params[], void *data)
 	return MUNIT_OK;
 }
 
+/* Encode a follow-up batch of rows, without the column count and names. */
+static MunitResult test_query_no_header(const MunitParameter params[],
+                                        void *               data)
+{
+	struct fixture *f = data;
+	int             rc;
+	uint64_t *      buf;
+
+	(void)params;
+
+	__exec(f, "CREATE TABLE test (n INT)");
+	__exec(f, "INSERT INTO test VALUES(-123)");
+
+	__prepare(f, "SELECT n FROM test");
+
+	rc = dqlite__stmt_query(f->stmt, f->message, 0, 0);
+	munit_assert_int(rc, ==, SQLITE_DONE);
+
+	/* The first word written is the row header, followed by the value. */
+	munit_assert_int(f->message->body1[0], ==, SQLITE_INTEGER);
+	buf = (uint64_t *)(f->message->body1 + 8);
+	munit_assert_int((int64_t)(dqlite__flip64(*buf)), ==, -123);
+
+	munit_assert_int(f->message->offset1, ==, 16);
+
+	return MUNIT_OK;
+}
+
+/* Text values above the zero-copy threshold are referenced instead of being
+ * copied, and end the batch. */
+static MunitResult test_query_zero_copy(const MunitParameter params[],
+                                        void *               data)
+{
+	struct fixture *f = data;
+	int             rc;
+
+	(void)params;
+
+	__exec(f, "CREATE TABLE test (t TEXT)");
+	__exec(f, "INSERT INTO test VALUES('hi')");
+	__exec(f, "INSERT INTO test VALUES('hello world')");
+	__exec(f, "INSERT INTO test VALUES('hello world')");
+
+	__prepare(f, "SELECT t FROM test");
+
+	rc = dqlite__stmt_query(f->stmt, f->message, 0, 8);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+
+	/* The short value got copied, the long one referenced. */
+	munit_assert_string_equal(f->message->body1 + 8, "hi");
+
+	munit_assert_int(f->message->n_external, ==, 1);
+	munit_assert_string_equal(f->message->external[0].base,
+	                          "hello world");
+	munit_assert_int(f->message->external[0].len, ==, 11);
+	munit_assert_int(f->message->external[0].offset, ==, 24);
+
+	munit_assert_int(f->message->offset1, ==, 24);
+
+	return MUNIT_OK;
+}
+
 static MunitTest dqlite__stmt_query_tests[] = {
     {"/no-columns", test_query_no_columns, setup, tear_down, 0, NULL},
     {"/none", test_query_none, setup, tear_down, 0, NULL},
@@ -968,6 +1037,109 @@ static MunitTest dqlite__stmt_query_tests[] = {
     {"/two/complex", test_query_two_complex, setup, tear_down, 0, NULL},
     {"/count", test_query_count, setup, tear_down, 0, NULL},
     {"/large", test_query_large, setup, tear_down, 0, NULL},
+    {"/no-header", test_query_no_header, setup, tear_down, 0, NULL},
+    {"/zero-copy", test_query_zero_copy, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL}};
+
+/******************************************************************************
+ *
+ * dqlite__stmt_evict
+ *
+ ******************************************************************************/
+
+/* An idle statement gets finalized, and prepared again when revived. */
+static MunitResult test_evict_idle(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	int             rc;
+
+	(void)params;
+
+	__prepare(f, "SELECT 1");
+
+	munit_assert_true(dqlite__stmt_evict(f->stmt));
+	munit_assert_ptr_null(f->stmt->stmt);
+	munit_assert_string_equal(f->stmt->sql, "SELECT 1");
+
+	rc = dqlite__stmt_revive(f->stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_ptr_not_null(f->stmt->stmt);
+	munit_assert_ptr_null(f->stmt->sql);
+
+	rc = dqlite__stmt_query(f->stmt, f->message, 1, 0);
+	munit_assert_int(rc, ==, SQLITE_DONE);
+
+	return MUNIT_OK;
+}
+
+/* A statement in the middle of a run is not evicted. */
+static MunitResult test_evict_busy(const MunitParameter params[], void *data)
+{
+	struct fixture *f = data;
+	int             rc;
+
+	(void)params;
+
+	__prepare(f, "SELECT 1 UNION SELECT 2");
+
+	rc = sqlite3_step(f->stmt->stmt);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+
+	munit_assert_false(dqlite__stmt_evict(f->stmt));
+	munit_assert_ptr_not_null(f->stmt->stmt);
+
+	return MUNIT_OK;
+}
+
+/* If the statement can't be prepared again, an error is returned. */
+static MunitResult test_evict_revive_error(const MunitParameter params[],
+                                           void *               data)
+{
+	struct fixture *f = data;
+	int             rc;
+
+	(void)params;
+
+	__exec(f, "CREATE TABLE test (n INT)");
+	__prepare(f, "SELECT n FROM test");
+
+	munit_assert_true(dqlite__stmt_evict(f->stmt));
+
+	__exec(f, "DROP TABLE test");
+
+	rc = dqlite__stmt_revive(f->stmt);
+	munit_assert_int(rc, ==, SQLITE_ERROR);
+
+	munit_assert_string_equal(
+	    dqlite__error_msg(&f->stmt->error),
+	    "prepare evicted statement: no such table: test");
+
+	return MUNIT_OK;
+}
+
+/* Whether an evicted statement is read-only is still known. */
+static MunitResult test_evict_readonly(const MunitParameter params[],
+                                       void *               data)
+{
+	struct fixture *f = data;
+
+	(void)params;
+
+	__exec(f, "CREATE TABLE test (n INT)");
+	__prepare(f, "INSERT INTO test VALUES(1)");
+
+	munit_assert_false(dqlite__stmt_readonly(f->stmt));
+	munit_assert_true(dqlite__stmt_evict(f->stmt));
+	munit_assert_false(dqlite__stmt_readonly(f->stmt));
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__stmt_evict_tests[] = {
+    {"/idle", test_evict_idle, setup, tear_down, 0, NULL},
+    {"/busy", test_evict_busy, setup, tear_down, 0, NULL},
+    {"/readonly", test_evict_readonly, setup, tear_down, 0, NULL},
+    {"/revive-error", test_evict_revive_error, setup, tear_down, 0, NULL},
     {NULL, NULL, NULL, NULL, 0, NULL}};
 
 /******************************************************************************
@@ -979,5 +1151,6 @@ static MunitTest dqlite__stmt_query_tests[] = {
 MunitSuite dqlite__stmt_suites[] = {
     {"_bind", dqlite__stmt_bind_tests, NULL, 1, MUNIT_SUITE_OPTION_NONE},
     {"_query", dqlite__stmt_query_tests, NULL, 1, MUNIT_SUITE_OPTION_NONE},
+    {"_evict", dqlite__stmt_evict_tests, NULL, 1, MUNIT_SUITE_OPTION_NONE},
     {NULL, NULL, NULL, 0, MUNIT_SUITE_OPTION_NONE},
 };
@@ -4,6 +4,7 @@
 
 #include "../include/dqlite.h"
 #include "../src/format.h"
+#include "../src/vfs.h"
 
 #include "case.h"
 #include "fs.h"
@@ -137,6 +138,27 @@ static sqlite3 *__db_open()
 	return db;
 }
 
+/* Helper to evaluate a query returning a single integer. */
+static sqlite3_int64 __db_query_int(sqlite3 *db, const char *sql)
+{
+	sqlite3_stmt *stmt;
+	sqlite3_int64 n;
+	int           rc;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	rc = sqlite3_step(stmt);
+	munit_assert_int(rc, ==, SQLITE_ROW);
+
+	n = sqlite3_column_int64(stmt, 0);
+
+	rc = sqlite3_finalize(stmt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	return n;
+}
+
 /* Helper to close a database. */
 static void __db_close(sqlite3 *db)
 {
@@ -1603,6 +1625,289 @@ static MunitTest dqlite__vfs_file_control_tests[] = {
     {NULL, NULL, NULL, NULL, 0, NULL},
 };
 
+/******************************************************************************
+ *
+ * dqlite__vfs_fetch
+ *
+ ******************************************************************************/
+
+/* Fetching a database page returns a pointer to the page content. */
+static MunitResult test_fetch(const MunitParameter params[], void *data)
+{
+	sqlite3_vfs * vfs  = data;
+	sqlite3_file *file = __file_create_main_db(vfs);
+	char *        p;
+	int           rc;
+
+	(void)params;
+
+	rc = file->pMethods->xWrite(file, __buf_page_1(), 512, 0);
+	munit_assert_int(rc, ==, 0);
+
+	rc = file->pMethods->xWrite(file, __buf_page_2(), 512, 512);
+	munit_assert_int(rc, ==, 0);
+
+	rc = file->pMethods->xFetch(file, 512, 512, (void **)&p);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_ptr_not_null(p);
+
+	munit_assert_int(p[0], ==, 4);
+	munit_assert_int(p[256], ==, 5);
+	munit_assert_int(p[511], ==, 6);
+
+	rc = file->pMethods->xUnfetch(file, 512, p);
+	munit_assert_int(rc, ==, 0);
+
+	return MUNIT_OK;
+}
+
+/* Partial pages, pages beyond the end of the file and WAL frames can't be
+ * fetched. */
+static MunitResult test_fetch_fallback(const MunitParameter params[],
+                                       void *               data)
+{
+	sqlite3_vfs * vfs  = data;
+	sqlite3_file *file = __file_create_main_db(vfs);
+	sqlite3_file *wal;
+	void *        p;
+	int           rc;
+
+	(void)params;
+
+	/* Empty file. */
+	rc = file->pMethods->xFetch(file, 0, 512, &p);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_ptr_null(p);
+
+	rc = file->pMethods->xWrite(file, __buf_page_1(), 512, 0);
+	munit_assert_int(rc, ==, 0);
+
+	/* Partial page. */
+	rc = file->pMethods->xFetch(file, 0, 100, &p);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_ptr_null(p);
+
+	/* Beyond the end of the file. */
+	rc = file->pMethods->xFetch(file, 512, 512, &p);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_ptr_null(p);
+
+	wal = __file_create_wal(vfs);
+
+	rc = wal->pMethods->xWrite(wal, __buf_header_wal(), 32, 0);
+	munit_assert_int(rc, ==, 0);
+
+	/* WAL file. */
+	rc = wal->pMethods->xFetch(wal, 0, 512, &p);
+	munit_assert_int(rc, ==, 0);
+	munit_assert_ptr_null(p);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__vfs_fetch_tests[] = {
+    {"", test_fetch, setup, tear_down, 0, NULL},
+    {"/fallback", test_fetch_fallback, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+/******************************************************************************
+ *
+ * dqlite__vfs_snapshot
+ *
+ ******************************************************************************/
+
+/* Helper to create a table with 100 rows whose values sum up to 5050. */
+static void __snapshot_fill(sqlite3 *db)
+{
+	char stmt[64];
+	int  i;
+
+	__db_exec(db, "CREATE TABLE test (n INT)");
+	__db_exec(db, "BEGIN");
+	for (i = 1; i <= 100; i++) {
+		sprintf(stmt, "INSERT INTO test(n) VALUES(%d)", i);
+		__db_exec(db, stmt);
+	}
+	__db_exec(db, "COMMIT");
+}
+
+/* Helper to modify all rows and then checkpoint and truncate the WAL. */
+static void __snapshot_overwrite(sqlite3 *db)
+{
+	int log;
+	int ckpt;
+	int rc;
+
+	__db_exec(db, "UPDATE test SET n = 0");
+
+	rc = sqlite3_wal_checkpoint_v2(
+	    db, "main", SQLITE_CHECKPOINT_TRUNCATE, &log, &ckpt);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_int(log, ==, 0);
+}
+
+/* Helper to open a snapshot and return the sum of its rows. */
+static sqlite3_int64 __snapshot_sum(sqlite3_vfs *vfs, const char *name)
+{
+	sqlite3 *     db;
+	sqlite3_int64 sum;
+	int           rc;
+
+	rc = sqlite3_open_v2(name, &db, SQLITE_OPEN_READWRITE, "volatile");
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	sum = __db_query_int(db, "SELECT sum(n) FROM test");
+
+	__db_close(db);
+
+	rc = vfs->xDelete(vfs, name, 0);
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	return sum;
+}
+
+/* A snapshot includes the committed frames of the WAL, and is not affected by
+ * subsequent writes and checkpoints of the original database. */
+static MunitResult test_snapshot_wal(const MunitParameter params[], void *data)
+{
+	sqlite3_vfs *vfs = data;
+	sqlite3 *    db;
+	int          rc;
+
+	(void)params;
+
+	sqlite3_vfs_register(vfs, 0);
+
+	db = __db_open();
+	__snapshot_fill(db);
+	munit_assert_int(__wal_idx_mx_frame(db), >, 0);
+
+	rc = dqlite__vfs_snapshot(vfs, "test.db", "snapshot.db");
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	__snapshot_overwrite(db);
+
+	munit_assert_int(__db_query_int(db, "SELECT sum(n) FROM test"), ==, 0);
+	munit_assert_int(__snapshot_sum(vfs, "snapshot.db"), ==, 5050);
+
+	__db_close(db);
+
+	sqlite3_vfs_unregister(vfs);
+
+	return MUNIT_OK;
+}
+
+/* A snapshot of a fully checkpointed database only shares its pages. */
+static MunitResult test_snapshot_db(const MunitParameter params[], void *data)
+{
+	sqlite3_vfs *vfs = data;
+	sqlite3 *    db;
+	int          rc;
+
+	(void)params;
+
+	sqlite3_vfs_register(vfs, 0);
+
+	db = __db_open();
+	__snapshot_fill(db);
+
+	rc = sqlite3_wal_checkpoint_v2(
+	    db, "main", SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+	munit_assert_int(rc, ==, SQLITE_OK);
+	munit_assert_int(__wal_idx_mx_frame(db), ==, 0);
+
+	rc = dqlite__vfs_snapshot(vfs, "test.db", "snapshot.db");
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	__snapshot_overwrite(db);
+
+	munit_assert_int(__db_query_int(db, "SELECT sum(n) FROM test"), ==, 0);
+	munit_assert_int(__snapshot_sum(vfs, "snapshot.db"), ==, 5050);
+
+	__db_close(db);
+
+	sqlite3_vfs_unregister(vfs);
+
+	return MUNIT_OK;
+}
+
+/* Trying to snapshot a file that doesn't exist results in an error. */
+static MunitResult test_snapshot_noent(const MunitParameter params[],
+                                       void *               data)
+{
+	sqlite3_vfs *vfs = data;
+	int          rc;
+
+	(void)params;
+
+	rc = dqlite__vfs_snapshot(vfs, "test.db", "snapshot.db");
+	munit_assert_int(rc, ==, SQLITE_CANTOPEN);
+
+	munit_assert_int(ENOENT, ==, vfs->xGetLastError(vfs, 0, 0));
+
+	return MUNIT_OK;
+}
+
+/* Snapshots are refused once they would take more than half of the slots. */
+static MunitResult test_snapshot_reserve(const MunitParameter params[],
+                                         void *               data)
+{
+	sqlite3_vfs *vfs = data;
+	sqlite3 *    db;
+	char         name[32];
+	int          n;
+	int          i;
+	int          rc;
+
+	(void)params;
+
+	sqlite3_vfs_register(vfs, 0);
+
+	db = __db_open();
+	__snapshot_fill(db);
+
+	for (n = 0; n < 64; n++) {
+		sprintf(name, "snapshot-%d.db", n);
+		rc = dqlite__vfs_snapshot(vfs, "test.db", name);
+		if (rc != SQLITE_OK) {
+			break;
+		}
+	}
+
+	munit_assert_int(rc, ==, SQLITE_CANTOPEN);
+	munit_assert_int(ENFILE, ==, vfs->xGetLastError(vfs, 0, 0));
+
+	munit_assert_int(n, >, 0);
+	munit_assert_int(n, <, 64 / 2);
+
+	for (i = 0; i < n; i++) {
+		sprintf(name, "snapshot-%d.db", i);
+		rc = vfs->xDelete(vfs, name, 0);
+		munit_assert_int(rc, ==, SQLITE_OK);
+	}
+
+	/* Slots are available again. */
+	rc = dqlite__vfs_snapshot(vfs, "test.db", "snapshot.db");
+	munit_assert_int(rc, ==, SQLITE_OK);
+
+	munit_assert_int(__snapshot_sum(vfs, "snapshot.db"), ==, 5050);
+
+	__db_close(db);
+
+	sqlite3_vfs_unregister(vfs);
+
+	return MUNIT_OK;
+}
+
+static MunitTest dqlite__vfs_snapshot_tests[] = {
+    {"/wal", test_snapshot_wal, setup, tear_down, 0, NULL},
+    {"/db", test_snapshot_db, setup, tear_down, 0, NULL},
+    {"/noent", test_snapshot_noent, setup, tear_down, 0, NULL},
+    {"/reserve", test_snapshot_reserve, setup, tear_down, 0, NULL},
+    {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
 /******************************************************************************
  *
  * dqlite__vfs_current_time
@@ -1983,6 +2288,8 @@ MunitSuite dqlite__vfs_suites[] = {
     {"_shm_map", dqlite__vfs_shm_map_tests, NULL, 1, 0},
     {"_shm_lock", dqlite__vfs_shm_lock_tests, NULL, 1, 0},
     {"_file_control", dqlite__vfs_file_control_tests, NULL, 1, 0},
+    {"_fetch", dqlite__vfs_fetch_tests, NULL, 1, 0},
+    {"_snapshot", dqlite__vfs_snapshot_tests, NULL, 1, 0},
     {"_current_time", dqlite_vfs_current_time_tests, NULL, 1, 0},
     {"_sleep", dqlite_vfs_sleep_tests, NULL, 1, 0},
     {"_create", dqlite_vfs_create_tests, NULL, 1, 0},